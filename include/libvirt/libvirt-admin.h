@@ -405,6 +405,11 @@ int virAdmServerSetClientLimits(virAdmServerPtr srv,
 int virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
                                unsigned int flags);
 
+int virAdmServerGetProcedureStats(virAdmServerPtr srv,
+                                  virTypedParameterPtr *params,
+                                  int *nparams,
+                                  unsigned int flags);
+
 int virAdmConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                    char **outputs,
                                    unsigned int flags);
@@ -2181,6 +2181,9 @@ typedef enum {
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_SHUTOFF = VIR_CONNECT_LIST_DOMAINS_SHUTOFF,
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_OTHER = VIR_CONNECT_LIST_DOMAINS_OTHER,
 
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_PARALLEL = 1 << 28, /* gather statistics of
+                                                             multiple domains
+                                                             concurrently */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT = 1 << 29, /* report statistics that can be obtained
                                                            immediately without any blocking */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING = 1 << 30, /* include backing chain for block stats */
@@ -2199,6 +2202,11 @@ int virDomainListGetStats(virDomainPtr *doms,
 
 void virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats);
 
+int virConnectSetAllDomainStatsEvents(virConnectPtr conn,
+                                      unsigned int stats,
+                                      unsigned int interval,
+                                      unsigned int flags);
+
 /*
  * Perf Event API
  */
@@ -3635,6 +3643,32 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_DISK_TEMP_TOTAL "disk_temp_total"
 
+/**
+ * VIR_DOMAIN_JOB_QUEUE_DEPTH:
+ * virDomainGetJobStats field: number of APIs waiting for their turn to
+ * access the domain, as VIR_TYPED_PARAM_ULLONG. Reported even if no
+ * job is active, but not in statistics for a completed job.
+ */
+# define VIR_DOMAIN_JOB_QUEUE_DEPTH "queue_depth"
+
+/**
+ * VIR_DOMAIN_JOB_QUEUE_WAIT:
+ * virDomainGetJobStats field: time (ms) the longest waiting API has
+ * been waiting for its turn to access the domain so far, as
+ * VIR_TYPED_PARAM_ULLONG. Reported even if no job is active, but not in
+ * statistics for a completed job.
+ */
+# define VIR_DOMAIN_JOB_QUEUE_WAIT "queue_wait"
+
+/**
+ * VIR_DOMAIN_JOB_QUEUE_WAIT_LAST:
+ * virDomainGetJobStats field: time (ms) the most recent API accessing
+ * the domain had to wait for its turn, as VIR_TYPED_PARAM_ULLONG.
+ * Reported even if no job is active, but not in statistics for a
+ * completed job.
+ */
+# define VIR_DOMAIN_JOB_QUEUE_WAIT_LAST "queue_wait_last"
+
 /**
  * virConnectDomainEventGenericCallback:
  * @conn: the connection pointer
@@ -4551,6 +4585,44 @@ typedef void (*virConnectDomainEventBlockThresholdCallback)(virConnectPtr conn,
                                                             unsigned long long excess,
                                                             void *opaque);
 
+/**
+ * virConnectDomainEventStatsChangeCallback:
+ * @conn: connection object
+ * @dom: domain on which the event occurred
+ * @params: changed statistics stored as an array of virTypedParameter
+ * @nparams: size of the params array
+ * @opaque: application specific data
+ *
+ * This callback occurs when the periodic statistics collection configured
+ * by virConnectSetAllDomainStatsEvents finds that some statistics of the
+ * domain changed since the previous collection.
+ *
+ * The params array contains only the statistics which are new or changed,
+ * using the same names as virConnectGetAllDomainStats. If some statistics
+ * disappeared or the collection starts over, @params holds all statistics
+ * of the domain instead and includes VIR_DOMAIN_STATS_CHANGE_FULL set to
+ * true, so values reported by earlier events have to be discarded. The
+ * callback must not free @params (the array will be freed once the
+ * callback finishes).
+ *
+ * The callback signature to use when registering for an event of type
+ * VIR_DOMAIN_EVENT_ID_STATS_CHANGE with virConnectDomainEventRegisterAny().
+ */
+typedef void (*virConnectDomainEventStatsChangeCallback)(virConnectPtr conn,
+                                                         virDomainPtr dom,
+                                                         virTypedParameterPtr params,
+                                                         int nparams,
+                                                         void *opaque);
+
+/**
+ * VIR_DOMAIN_STATS_CHANGE_FULL:
+ *
+ * Macro for the VIR_DOMAIN_EVENT_ID_STATS_CHANGE event parameter, as
+ * VIR_TYPED_PARAM_BOOLEAN, which is true if the event carries the full
+ * set of statistics of the domain, replacing anything reported before.
+ */
+# define VIR_DOMAIN_STATS_CHANGE_FULL "full"
+
 /**
  * VIR_DOMAIN_EVENT_CALLBACK:
  *
@@ -4593,6 +4665,7 @@ typedef enum {
     VIR_DOMAIN_EVENT_ID_DEVICE_REMOVAL_FAILED = 22, /* virConnectDomainEventDeviceRemovalFailedCallback */
     VIR_DOMAIN_EVENT_ID_METADATA_CHANGE = 23, /* virConnectDomainEventMetadataChangeCallback */
     VIR_DOMAIN_EVENT_ID_BLOCK_THRESHOLD = 24, /* virConnectDomainEventBlockThresholdCallback */
+    VIR_DOMAIN_EVENT_ID_STATS_CHANGE = 25,   /* virConnectDomainEventStatsChangeCallback */
 
 # ifdef VIR_ENUM_SENTINELS
     VIR_DOMAIN_EVENT_ID_LAST
@@ -376,3 +376,71 @@ adminServerUpdateTlsFiles(virNetServerPtr srv,
 
     return virNetServerUpdateTlsFiles(srv);
 }
+
+static int
+adminServerAddLatencyParams(virTypedParamListPtr paramlist,
+                            virNetServerProgramLatencyPtr latency,
+                            size_t idx,
+                            const char *kind)
+{
+    size_t i;
+
+    if (virTypedParamListAddULLong(paramlist, latency->count,
+                                   "procedure.%zu.%s.count", idx, kind) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, latency->sum,
+                                   "procedure.%zu.%s.sum", idx, kind) < 0)
+        return -1;
+
+    /* Most of the buckets are empty, so skip them to keep the reply small */
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; i++) {
+        if (latency->buckets[i] == 0)
+            continue;
+
+        if (virTypedParamListAddULLong(paramlist, latency->buckets[i],
+                                       "procedure.%zu.%s.bucket.%zu",
+                                       idx, kind, i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+int
+adminServerGetProcedureStats(virNetServerPtr srv,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    g_autofree virNetServerProgramProcStats *stats = NULL;
+    size_t nstats = 0;
+    size_t i;
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+
+    virCheckFlags(0, -1);
+
+    if (virNetServerGetProcedureStats(srv, &stats, &nstats) < 0)
+        return -1;
+
+    if (virTypedParamListAddUInt(paramlist, nstats, "procedure.count") < 0)
+        return -1;
+
+    for (i = 0; i < nstats; i++) {
+        if (virTypedParamListAddUInt(paramlist, stats[i].program,
+                                     "procedure.%zu.program", i) < 0 ||
+            virTypedParamListAddUInt(paramlist, stats[i].version,
+                                     "procedure.%zu.version", i) < 0 ||
+            virTypedParamListAddUInt(paramlist, stats[i].procedure,
+                                     "procedure.%zu.procedure", i) < 0)
+            return -1;
+
+        if (adminServerAddLatencyParams(paramlist, &stats[i].wait, i, "wait") < 0 ||
+            adminServerAddLatencyParams(paramlist, &stats[i].exec, i, "exec") < 0)
+            return -1;
+    }
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+
+    return 0;
+}
@@ -70,3 +70,8 @@ int adminServerSetClientLimits(virNetServerPtr srv,
 
 int adminServerUpdateTlsFiles(virNetServerPtr srv,
                               unsigned int flags);
+
+int adminServerGetProcedureStats(virNetServerPtr srv,
+                                 virTypedParameterPtr *params,
+                                 int *nparams,
+                                 unsigned int flags);
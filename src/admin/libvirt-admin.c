@@ -1108,6 +1108,80 @@ virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
     return ret;
 }
 
+/**
+ * virAdmServerGetProcedureStats:
+ * @srv: a valid server object reference
+ * @params: pointer to a list of typed parameters which will be allocated
+ *          to store all returned parameters
+ * @nparams: pointer which will hold the number of params returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves latency statistics of the RPC procedures handled by @srv. Each
+ * call is accounted twice: the time it spent in the job queue waiting for a
+ * worker thread and the time a worker spent executing it. Only procedures
+ * which have been called at least once since the daemon started are
+ * reported. Upon successful completion, @params will be allocated
+ * automatically to hold all returned data, setting @nparams accordingly.
+ *
+ * The following typed parameters are returned:
+ *
+ *  "procedure.count" - number of procedures reported, as unsigned int.
+ *  "procedure.<num>.program" - RPC program number of the procedure,
+ *                              as unsigned int.
+ *  "procedure.<num>.version" - RPC program version, as unsigned int.
+ *  "procedure.<num>.procedure" - procedure number within the program,
+ *                                as unsigned int.
+ *  "procedure.<num>.wait.count" - number of calls which waited in the job
+ *                                 queue, as unsigned long long. Calls
+ *                                 handled without a worker pool are not
+ *                                 counted.
+ *  "procedure.<num>.wait.sum" - total time spent in the job queue in
+ *                               microseconds, as unsigned long long.
+ *  "procedure.<num>.wait.bucket.<b>" - number of calls whose queue wait
+ *                                      fell into histogram bucket <b>, as
+ *                                      unsigned long long.
+ *  "procedure.<num>.exec.count" - number of calls executed,
+ *                                 as unsigned long long.
+ *  "procedure.<num>.exec.sum" - total execution time in microseconds,
+ *                               as unsigned long long.
+ *  "procedure.<num>.exec.bucket.<b>" - number of calls whose execution time
+ *                                      fell into histogram bucket <b>, as
+ *                                      unsigned long long.
+ *
+ * Histogram buckets are powers of two: bucket 0 counts calls which took no
+ * measurable time, bucket <b> counts calls which took at least 2^(<b>-1)
+ * and less than 2^<b> microseconds. The last bucket reported by the daemon
+ * also counts all slower calls. Empty buckets are omitted.
+ *
+ * Returns 0 on success, -1 in case of an error.
+ */
+int
+virAdmServerGetProcedureStats(virAdmServerPtr srv,
+                              virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=0x%x",
+              srv, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetProcedureStats(srv, params, nparams,
+                                                  flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
 /**
  * virAdmConnectGetLoggingOutputs:
  * @conn: pointer to an active admin connection
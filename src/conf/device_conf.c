@@ -99,6 +99,16 @@ virDomainDeviceInfoClear(virDomainDeviceInfoPtr info)
     info->isolationGroupLocked = false;
 }
 
+void
+virDomainDeviceInfoCopy(virDomainDeviceInfoPtr dst,
+                        const virDomainDeviceInfo *src)
+{
+    *dst = *src;
+    dst->alias = g_strdup(src->alias);
+    dst->romfile = g_strdup(src->romfile);
+    dst->loadparm = g_strdup(src->loadparm);
+}
+
 void
 virDomainDeviceInfoFree(virDomainDeviceInfoPtr info)
 {
@@ -182,6 +182,8 @@ struct _virDomainDeviceInfo {
 };
 
 void virDomainDeviceInfoClear(virDomainDeviceInfoPtr info);
+void virDomainDeviceInfoCopy(virDomainDeviceInfoPtr dst,
+                             const virDomainDeviceInfo *src);
 void virDomainDeviceInfoFree(virDomainDeviceInfoPtr info);
 
 bool virDomainDeviceInfoAddressIsEqual(const virDomainDeviceInfo *a,
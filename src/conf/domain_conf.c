@@ -2629,11 +2629,18 @@ int
 virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
                           virDomainChrSourceDefPtr src)
 {
+    size_t i;
+
     if (!dest || !src)
         return -1;
 
     virDomainChrSourceDefClear(dest);
 
+    for (i = 0; i < dest->nseclabels; i++)
+        virSecurityDeviceLabelDefFree(dest->seclabels[i]);
+    VIR_FREE(dest->seclabels);
+    dest->nseclabels = 0;
+
     switch (src->type) {
     case VIR_DOMAIN_CHR_TYPE_FILE:
     case VIR_DOMAIN_CHR_TYPE_PTY:
@@ -2655,6 +2662,9 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
         dest->data.tcp.host = g_strdup(src->data.tcp.host);
         dest->data.tcp.service = g_strdup(src->data.tcp.service);
 
+        dest->data.tcp.listen = src->data.tcp.listen;
+        dest->data.tcp.protocol = src->data.tcp.protocol;
+        dest->data.tcp.tlscreds = src->data.tcp.tlscreds;
         dest->data.tcp.haveTLS = src->data.tcp.haveTLS;
         dest->data.tcp.tlsFromConfig = src->data.tcp.tlsFromConfig;
 
@@ -2665,6 +2675,7 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
     case VIR_DOMAIN_CHR_TYPE_UNIX:
         dest->data.nix.path = g_strdup(src->data.nix.path);
 
+        dest->data.nix.listen = src->data.nix.listen;
         dest->data.nix.reconnect.enabled = src->data.nix.reconnect.enabled;
         dest->data.nix.reconnect.timeout = src->data.nix.reconnect.timeout;
         break;
@@ -2674,9 +2685,26 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
         dest->data.nmdm.slave = g_strdup(src->data.nmdm.slave);
 
         break;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEVMC:
+        dest->data.spicevmc = src->data.spicevmc;
+        break;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEPORT:
+        dest->data.spiceport.channel = g_strdup(src->data.spiceport.channel);
+        break;
     }
 
     dest->type = src->type;
+    dest->logfile = g_strdup(src->logfile);
+    dest->logappend = src->logappend;
+
+    if (src->nseclabels) {
+        dest->seclabels = g_new0(virSecurityDeviceLabelDefPtr, src->nseclabels);
+        dest->nseclabels = src->nseclabels;
+        for (i = 0; i < src->nseclabels; i++)
+            dest->seclabels[i] = virSecurityDeviceLabelDefCopy(src->seclabels[i]);
+    }
 
     return 0;
 }
@@ -30413,25 +30441,1333 @@ virDomainUSBDeviceDefForeach(virDomainDefPtr def,
 }
 
 
-/* Copy src into a new definition; with the quality of the copy
- * depending on the migratable flag (false for transitions between
- * persistent and active, true for transitions across save files or
- * snapshots).  */
-virDomainDefPtr
-virDomainDefCopy(virDomainDefPtr src,
-                 virDomainXMLOptionPtr xmlopt,
-                 void *parseOpaque,
-                 bool migratable)
+static virDomainVirtioOptionsPtr
+virDomainVirtioOptionsCopy(virDomainVirtioOptionsPtr src)
 {
-    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
-    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
-    g_autofree char *xml = NULL;
+    virDomainVirtioOptionsPtr dst;
+
+    if (!src)
+        return NULL;
+
+    dst = g_new0(virDomainVirtioOptions, 1);
+    *dst = *src;
+    return dst;
+}
+
+
+static virDomainDiskDefPtr
+virDomainDiskDefCopy(virDomainDiskDefPtr src,
+                     virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDiskDefPtr def;
+    virObjectPtr privateData;
+
+    if (!(def = virDomainDiskDefNew(xmlopt)))
+        return NULL;
+
+    privateData = g_steal_pointer(&def->privateData);
+    virObjectUnref(def->src);
+
+    *def = *src;
+    def->privateData = privateData;
+    def->src = NULL;
+    def->mirror = NULL;
+
+    def->dst = g_strdup(src->dst);
+    def->driverName = g_strdup(src->driverName);
+    def->serial = g_strdup(src->serial);
+    def->wwn = g_strdup(src->wwn);
+    def->vendor = g_strdup(src->vendor);
+    def->product = g_strdup(src->product);
+    def->domain_name = g_strdup(src->domain_name);
+    def->blkdeviotune.group_name = g_strdup(src->blkdeviotune.group_name);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    if (!(def->src = virStorageSourceCopy(src->src, true)))
+        goto error;
+
+    if (src->mirror &&
+        !(def->mirror = virStorageSourceCopy(src->mirror, true)))
+        goto error;
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(def);
+    return NULL;
+}
+
+
+static virDomainControllerDefPtr
+virDomainControllerDefCopy(virDomainControllerDefPtr src)
+{
+    virDomainControllerDefPtr def = g_new0(virDomainControllerDef, 1);
+
+    *def = *src;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+
+    return def;
+}
+
+
+static virDomainFSDefPtr
+virDomainFSDefCopy(virDomainFSDefPtr src,
+                   virDomainXMLOptionPtr xmlopt)
+{
+    virDomainFSDefPtr def;
+    virObjectPtr privateData;
+
+    if (!(def = virDomainFSDefNew(xmlopt)))
+        return NULL;
+
+    privateData = g_steal_pointer(&def->privateData);
+    virObjectUnref(def->src);
+
+    *def = *src;
+    def->privateData = privateData;
+    def->src = NULL;
+
+    def->dst = g_strdup(src->dst);
+    def->binary = g_strdup(src->binary);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    if (!(def->src = virStorageSourceCopy(src->src, false))) {
+        virDomainFSDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+/* Fills @dst, which is either a standalone hostdev or one embedded in
+ * a network interface, with a deep copy of @src.  Ownership of @info
+ * follows the usual rule: it belongs to @dst only if @parentnet is NULL.
+ * @dst is safe to clear even on failure.  */
+static int
+virDomainHostdevDefCopyInto(virDomainHostdevDefPtr dst,
+                            virDomainHostdevDefPtr src,
+                            virDomainNetDefPtr parentnet,
+                            virDomainDeviceInfoPtr info)
+{
+    virDomainHostdevCapsPtr caps = &dst->source.caps;
+    virDomainHostdevSubsysPtr subsys = &dst->source.subsys;
+
+    *dst = *src;
+    dst->parentnet = parentnet;
+    dst->info = info;
+
+    switch ((virDomainHostdevMode) src->mode) {
+    case VIR_DOMAIN_HOSTDEV_MODE_CAPABILITIES:
+        switch ((virDomainHostdevCapsType) caps->type) {
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_STORAGE:
+            caps->u.storage.block = g_strdup(caps->u.storage.block);
+            break;
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_MISC:
+            caps->u.misc.chardev = g_strdup(caps->u.misc.chardev);
+            break;
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_NET:
+            caps->u.net.ifname = g_strdup(caps->u.net.ifname);
+            virNetDevIPInfoCopy(&caps->u.net.ip, &src->source.caps.u.net.ip);
+            break;
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_LAST:
+            break;
+        }
+        break;
+
+    case VIR_DOMAIN_HOSTDEV_MODE_SUBSYS:
+        switch ((virDomainHostdevSubsysType) subsys->type) {
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_SCSI:
+            if (subsys->u.scsi.protocol == VIR_DOMAIN_HOSTDEV_SCSI_PROTOCOL_TYPE_ISCSI) {
+                virStorageSourcePtr iscsisrc = src->source.subsys.u.scsi.u.iscsi.src;
+
+                subsys->u.scsi.u.iscsi.src = NULL;
+                if (iscsisrc &&
+                    !(subsys->u.scsi.u.iscsi.src = virStorageSourceCopy(iscsisrc, false)))
+                    return -1;
+            } else {
+                subsys->u.scsi.u.host.adapter = g_strdup(subsys->u.scsi.u.host.adapter);
+            }
+            break;
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_SCSI_HOST:
+            subsys->u.scsi_host.wwpn = g_strdup(subsys->u.scsi_host.wwpn);
+            break;
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_USB:
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_PCI:
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_MDEV:
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_LAST:
+            break;
+        }
+        break;
+
+    case VIR_DOMAIN_HOSTDEV_MODE_LAST:
+        break;
+    }
+
+    return 0;
+}
+
+
+static virDomainHostdevDefPtr
+virDomainHostdevDefCopy(virDomainHostdevDefPtr src)
+{
+    virDomainHostdevDefPtr def = g_new0(virDomainHostdevDef, 1);
+    virDomainDeviceInfoPtr info = g_new0(virDomainDeviceInfo, 1);
+
+    virDomainDeviceInfoCopy(info, src->info);
+
+    if (virDomainHostdevDefCopyInto(def, src, NULL, info) < 0) {
+        virDomainHostdevDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainActualNetDefPtr
+virDomainActualNetDefCopy(virDomainActualNetDefPtr src,
+                          virDomainNetDefPtr parent)
+{
+    virDomainActualNetDefPtr def = g_new0(virDomainActualNetDef, 1);
+
+    *def = *src;
+    memset(&def->data, 0, sizeof(def->data));
+    def->bandwidth = NULL;
+    def->vlan.tag = NULL;
+
+    switch ((virDomainNetType) src->type) {
+    case VIR_DOMAIN_NET_TYPE_BRIDGE:
+    case VIR_DOMAIN_NET_TYPE_NETWORK:
+        def->data.bridge.brname = g_strdup(src->data.bridge.brname);
+        def->data.bridge.macTableManager = src->data.bridge.macTableManager;
+        break;
+    case VIR_DOMAIN_NET_TYPE_DIRECT:
+        def->data.direct.linkdev = g_strdup(src->data.direct.linkdev);
+        def->data.direct.mode = src->data.direct.mode;
+        break;
+    case VIR_DOMAIN_NET_TYPE_HOSTDEV:
+        if (virDomainHostdevDefCopyInto(&def->data.hostdev.def,
+                                        &src->data.hostdev.def,
+                                        parent, &parent->info) < 0)
+            goto error;
+        break;
+    default:
+        break;
+    }
+
+    if (src->virtPortProfile) {
+        def->virtPortProfile = g_new0(virNetDevVPortProfile, 1);
+        *def->virtPortProfile = *src->virtPortProfile;
+    }
+
+    if (virNetDevBandwidthCopy(&def->bandwidth, src->bandwidth) < 0 ||
+        virNetDevVlanCopy(&def->vlan, &src->vlan) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainActualNetDefFree(def);
+    return NULL;
+}
+
+
+static virDomainNetDefPtr
+virDomainNetDefCopy(virDomainNetDefPtr src,
+                    virDomainXMLOptionPtr xmlopt)
+{
+    virDomainNetDefPtr def;
+    virObjectPtr privateData;
+
+    if (!(def = virDomainNetDefNew(xmlopt)))
+        return NULL;
+
+    privateData = g_steal_pointer(&def->privateData);
+
+    *def = *src;
+    def->privateData = privateData;
+    memset(&def->data, 0, sizeof(def->data));
+    memset(&def->hostIP, 0, sizeof(def->hostIP));
+    memset(&def->guestIP, 0, sizeof(def->guestIP));
+    def->filterparams = NULL;
+    def->bandwidth = NULL;
+    def->vlan.tag = NULL;
+
+    def->modelstr = g_strdup(src->modelstr);
+    def->backend.tap = g_strdup(src->backend.tap);
+    def->backend.vhost = g_strdup(src->backend.vhost);
+    def->teaming.persistent = g_strdup(src->teaming.persistent);
+    def->script = g_strdup(src->script);
+    def->domain_name = g_strdup(src->domain_name);
+    def->ifname = g_strdup(src->ifname);
+    def->ifname_guest_actual = g_strdup(src->ifname_guest_actual);
+    def->ifname_guest = g_strdup(src->ifname_guest);
+    def->filter = g_strdup(src->filter);
+    virNetDevIPInfoCopy(&def->hostIP, &src->hostIP);
+    virNetDevIPInfoCopy(&def->guestIP, &src->guestIP);
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+
+    if (src->virtPortProfile) {
+        def->virtPortProfile = g_new0(virNetDevVPortProfile, 1);
+        *def->virtPortProfile = *src->virtPortProfile;
+    }
+
+    if (src->coalesce) {
+        def->coalesce = g_new0(virNetDevCoalesce, 1);
+        *def->coalesce = *src->coalesce;
+    }
+
+    switch (src->type) {
+    case VIR_DOMAIN_NET_TYPE_VHOSTUSER:
+        if (!(def->data.vhostuser = virDomainChrSourceDefNew(xmlopt)) ||
+            virDomainChrSourceDefCopy(def->data.vhostuser,
+                                      src->data.vhostuser) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_SERVER:
+    case VIR_DOMAIN_NET_TYPE_CLIENT:
+    case VIR_DOMAIN_NET_TYPE_MCAST:
+    case VIR_DOMAIN_NET_TYPE_UDP:
+        def->data.socket = src->data.socket;
+        def->data.socket.address = g_strdup(src->data.socket.address);
+        def->data.socket.localaddr = g_strdup(src->data.socket.localaddr);
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_NETWORK:
+        def->data.network.name = g_strdup(src->data.network.name);
+        def->data.network.portgroup = g_strdup(src->data.network.portgroup);
+        memcpy(def->data.network.portid, src->data.network.portid,
+               VIR_UUID_BUFLEN);
+        if (src->data.network.actual &&
+            !(def->data.network.actual =
+              virDomainActualNetDefCopy(src->data.network.actual, def)))
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_BRIDGE:
+        def->data.bridge.brname = g_strdup(src->data.bridge.brname);
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_INTERNAL:
+        def->data.internal.name = g_strdup(src->data.internal.name);
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_DIRECT:
+        def->data.direct.linkdev = g_strdup(src->data.direct.linkdev);
+        def->data.direct.mode = src->data.direct.mode;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_HOSTDEV:
+        if (virDomainHostdevDefCopyInto(&def->data.hostdev.def,
+                                        &src->data.hostdev.def,
+                                        def, &def->info) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_ETHERNET:
+    case VIR_DOMAIN_NET_TYPE_USER:
+    case VIR_DOMAIN_NET_TYPE_LAST:
+        break;
+    }
+
+    if (src->filterparams) {
+        if (!(def->filterparams = virNWFilterHashTableCreate(0)) ||
+            virNWFilterHashTablePutAll(src->filterparams, def->filterparams) < 0)
+            goto error;
+    }
+
+    if (virNetDevBandwidthCopy(&def->bandwidth, src->bandwidth) < 0 ||
+        virNetDevVlanCopy(&def->vlan, &src->vlan) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainNetDefFree(def);
+    return NULL;
+}
+
+
+static virDomainInputDefPtr
+virDomainInputDefCopy(virDomainInputDefPtr src)
+{
+    virDomainInputDefPtr def = g_new0(virDomainInputDef, 1);
+
+    *def = *src;
+    def->source.evdev = g_strdup(src->source.evdev);
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+
+    return def;
+}
+
+
+static virDomainSoundDefPtr
+virDomainSoundDefCopy(virDomainSoundDefPtr src)
+{
+    virDomainSoundDefPtr def = g_new0(virDomainSoundDef, 1);
+    size_t i;
+
+    *def = *src;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    if (src->ncodecs) {
+        def->codecs = g_new0(virDomainSoundCodecDefPtr, src->ncodecs);
+        for (i = 0; i < src->ncodecs; i++) {
+            def->codecs[i] = g_new0(virDomainSoundCodecDef, 1);
+            *def->codecs[i] = *src->codecs[i];
+        }
+    }
+
+    return def;
+}
+
+
+static virDomainVideoDefPtr
+virDomainVideoDefCopy(virDomainVideoDefPtr src,
+                      virDomainXMLOptionPtr xmlopt)
+{
+    virDomainVideoDefPtr def;
+    virObjectPtr privateData;
+
+    if (!(def = virDomainVideoDefNew(xmlopt)))
+        return NULL;
+
+    privateData = g_steal_pointer(&def->privateData);
+
+    *def = *src;
+    def->privateData = privateData;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+
+    if (src->accel) {
+        def->accel = g_new0(virDomainVideoAccelDef, 1);
+        *def->accel = *src->accel;
+        def->accel->rendernode = g_strdup(src->accel->rendernode);
+    }
+
+    if (src->res) {
+        def->res = g_new0(virDomainVideoResolutionDef, 1);
+        *def->res = *src->res;
+    }
+
+    if (src->driver) {
+        def->driver = g_new0(virDomainVideoDriverDef, 1);
+        *def->driver = *src->driver;
+        def->driver->vhost_user_binary = g_strdup(src->driver->vhost_user_binary);
+    }
+
+    return def;
+}
+
+
+static virDomainGraphicsDefPtr
+virDomainGraphicsDefCopy(virDomainGraphicsDefPtr src,
+                         virDomainXMLOptionPtr xmlopt)
+{
+    virDomainGraphicsDefPtr def;
+    virObjectPtr privateData;
+    size_t i;
+
+    if (!(def = virDomainGraphicsDefNew(xmlopt)))
+        return NULL;
+
+    privateData = g_steal_pointer(&def->privateData);
+
+    *def = *src;
+    def->privateData = privateData;
+
+    switch (src->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        def->data.vnc.keymap = g_strdup(src->data.vnc.keymap);
+        def->data.vnc.auth.passwd = g_strdup(src->data.vnc.auth.passwd);
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+        def->data.sdl.display = g_strdup(src->data.sdl.display);
+        def->data.sdl.xauth = g_strdup(src->data.sdl.xauth);
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+        def->data.desktop.display = g_strdup(src->data.desktop.display);
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        def->data.spice.rendernode = g_strdup(src->data.spice.rendernode);
+        def->data.spice.keymap = g_strdup(src->data.spice.keymap);
+        def->data.spice.auth.passwd = g_strdup(src->data.spice.auth.passwd);
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
+        def->data.egl_headless.rendernode = g_strdup(src->data.egl_headless.rendernode);
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+        break;
+    }
+
+    def->listens = NULL;
+    if (src->nListens) {
+        def->listens = g_new0(virDomainGraphicsListenDef, src->nListens);
+        for (i = 0; i < src->nListens; i++) {
+            def->listens[i] = src->listens[i];
+            def->listens[i].address = g_strdup(src->listens[i].address);
+            def->listens[i].network = g_strdup(src->listens[i].network);
+            def->listens[i].socket = g_strdup(src->listens[i].socket);
+        }
+    }
+
+    return def;
+}
+
+
+static virDomainChrDefPtr
+virDomainChrDefCopy(virDomainChrDefPtr src,
+                    virDomainXMLOptionPtr xmlopt)
+{
+    virDomainChrDefPtr def;
+    virDomainChrSourceDefPtr source;
+
+    if (!(def = virDomainChrDefNew(xmlopt)))
+        return NULL;
+
+    source = g_steal_pointer(&def->source);
+
+    *def = *src;
+    def->source = source;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    if (src->deviceType == VIR_DOMAIN_CHR_DEVICE_TYPE_CHANNEL) {
+        switch (src->targetType) {
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_GUESTFWD:
+            def->target.addr = NULL;
+            if (src->target.addr) {
+                def->target.addr = g_new0(virSocketAddr, 1);
+                *def->target.addr = *src->target.addr;
+            }
+            break;
+
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_XEN:
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO:
+            def->target.name = g_strdup(src->target.name);
+            break;
+        }
+    }
+
+    if (virDomainChrSourceDefCopy(def->source, src->source) < 0) {
+        virDomainChrDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainSmartcardDefPtr
+virDomainSmartcardDefCopy(virDomainSmartcardDefPtr src,
+                          virDomainXMLOptionPtr xmlopt)
+{
+    virDomainSmartcardDefPtr def = g_new0(virDomainSmartcardDef, 1);
+    size_t i;
+
+    def->type = src->type;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    switch (src->type) {
+    case VIR_DOMAIN_SMARTCARD_TYPE_HOST_CERTIFICATES:
+        for (i = 0; i < VIR_DOMAIN_SMARTCARD_NUM_CERTIFICATES; i++)
+            def->data.cert.file[i] = g_strdup(src->data.cert.file[i]);
+        def->data.cert.database = g_strdup(src->data.cert.database);
+        break;
+
+    case VIR_DOMAIN_SMARTCARD_TYPE_PASSTHROUGH:
+        if (!(def->data.passthru = virDomainChrSourceDefNew(xmlopt)) ||
+            virDomainChrSourceDefCopy(def->data.passthru,
+                                      src->data.passthru) < 0) {
+            virDomainSmartcardDefFree(def);
+            return NULL;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return def;
+}
+
+
+static virDomainRedirdevDefPtr
+virDomainRedirdevDefCopy(virDomainRedirdevDefPtr src,
+                         virDomainXMLOptionPtr xmlopt)
+{
+    virDomainRedirdevDefPtr def = g_new0(virDomainRedirdevDef, 1);
+
+    def->bus = src->bus;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    if (!(def->source = virDomainChrSourceDefNew(xmlopt)) ||
+        virDomainChrSourceDefCopy(def->source, src->source) < 0) {
+        virDomainRedirdevDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainRNGDefPtr
+virDomainRNGDefCopy(virDomainRNGDefPtr src,
+                    virDomainXMLOptionPtr xmlopt)
+{
+    virDomainRNGDefPtr def = g_new0(virDomainRNGDef, 1);
+
+    *def = *src;
+    memset(&def->source, 0, sizeof(def->source));
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+
+    switch ((virDomainRNGBackend) src->backend) {
+    case VIR_DOMAIN_RNG_BACKEND_RANDOM:
+        def->source.file = g_strdup(src->source.file);
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_EGD:
+        if (!(def->source.chardev = virDomainChrSourceDefNew(xmlopt)) ||
+            virDomainChrSourceDefCopy(def->source.chardev,
+                                      src->source.chardev) < 0) {
+            virDomainRNGDefFree(def);
+            return NULL;
+        }
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_BUILTIN:
+    case VIR_DOMAIN_RNG_BACKEND_LAST:
+        break;
+    }
+
+    return def;
+}
+
+
+static virDomainShmemDefPtr
+virDomainShmemDefCopy(virDomainShmemDefPtr src)
+{
+    virDomainShmemDefPtr def = g_new0(virDomainShmemDef, 1);
+
+    *def = *src;
+    memset(&def->server.chr, 0, sizeof(def->server.chr));
+    def->name = g_strdup(src->name);
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    if (virDomainChrSourceDefCopy(&def->server.chr, &src->server.chr) < 0) {
+        virDomainShmemDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainTPMDefPtr
+virDomainTPMDefCopy(virDomainTPMDefPtr src)
+{
+    virDomainTPMDefPtr def = g_new0(virDomainTPMDef, 1);
+    int rc = 0;
+
+    *def = *src;
+    memset(&def->data, 0, sizeof(def->data));
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    switch ((virDomainTPMBackendType) src->type) {
+    case VIR_DOMAIN_TPM_TYPE_PASSTHROUGH:
+        rc = virDomainChrSourceDefCopy(&def->data.passthrough.source,
+                                       &src->data.passthrough.source);
+        break;
+
+    case VIR_DOMAIN_TPM_TYPE_EMULATOR:
+        def->data.emulator.storagepath = g_strdup(src->data.emulator.storagepath);
+        def->data.emulator.logfile = g_strdup(src->data.emulator.logfile);
+        memcpy(def->data.emulator.secretuuid, src->data.emulator.secretuuid,
+               VIR_UUID_BUFLEN);
+        def->data.emulator.hassecretuuid = src->data.emulator.hassecretuuid;
+        rc = virDomainChrSourceDefCopy(&def->data.emulator.source,
+                                       &src->data.emulator.source);
+        break;
+
+    case VIR_DOMAIN_TPM_TYPE_LAST:
+        break;
+    }
+
+    if (rc < 0) {
+        virDomainTPMDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainMemoryDefPtr
+virDomainMemoryDefCopy(virDomainMemoryDefPtr src)
+{
+    virDomainMemoryDefPtr def = g_new0(virDomainMemoryDef, 1);
+
+    *def = *src;
+    def->sourceNodes = NULL;
+    def->nvdimmPath = g_strdup(src->nvdimmPath);
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    if (src->sourceNodes &&
+        !(def->sourceNodes = virBitmapNewCopy(src->sourceNodes))) {
+        virDomainMemoryDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainVsockDefPtr
+virDomainVsockDefCopy(virDomainVsockDefPtr src,
+                      virDomainXMLOptionPtr xmlopt)
+{
+    virDomainVsockDefPtr def;
+    virObjectPtr privateData;
+
+    if (!(def = virDomainVsockDefNew(xmlopt)))
+        return NULL;
+
+    privateData = g_steal_pointer(&def->privateData);
+
+    *def = *src;
+    def->privateData = privateData;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+
+    return def;
+}
+
+
+static virDomainLeaseDefPtr
+virDomainLeaseDefCopy(virDomainLeaseDefPtr src)
+{
+    virDomainLeaseDefPtr def = g_new0(virDomainLeaseDef, 1);
+
+    def->lockspace = g_strdup(src->lockspace);
+    def->key = g_strdup(src->key);
+    def->path = g_strdup(src->path);
+    def->offset = src->offset;
+
+    return def;
+}
+
+
+static virDomainHubDefPtr
+virDomainHubDefCopy(virDomainHubDefPtr src)
+{
+    virDomainHubDefPtr def = g_new0(virDomainHubDef, 1);
+
+    *def = *src;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    return def;
+}
+
+
+static virDomainPanicDefPtr
+virDomainPanicDefCopy(virDomainPanicDefPtr src)
+{
+    virDomainPanicDefPtr def = g_new0(virDomainPanicDef, 1);
+
+    *def = *src;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    return def;
+}
+
+
+static virDomainWatchdogDefPtr
+virDomainWatchdogDefCopy(virDomainWatchdogDefPtr src)
+{
+    virDomainWatchdogDefPtr def = g_new0(virDomainWatchdogDef, 1);
+
+    *def = *src;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    return def;
+}
+
+
+static virDomainNVRAMDefPtr
+virDomainNVRAMDefCopy(virDomainNVRAMDefPtr src)
+{
+    virDomainNVRAMDefPtr def = g_new0(virDomainNVRAMDef, 1);
+
+    *def = *src;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    return def;
+}
+
+
+static virDomainMemballoonDefPtr
+virDomainMemballoonDefCopy(virDomainMemballoonDefPtr src)
+{
+    virDomainMemballoonDefPtr def = g_new0(virDomainMemballoonDef, 1);
+
+    *def = *src;
+    virDomainDeviceInfoCopy(&def->info, &src->info);
+    def->virtio = virDomainVirtioOptionsCopy(src->virtio);
+    return def;
+}
+
+
+static virDomainVcpuDefPtr
+virDomainVcpuDefCopy(virDomainVcpuDefPtr src,
+                     virDomainXMLOptionPtr xmlopt)
+{
+    virDomainVcpuDefPtr def;
+
+    if (!(def = virDomainVcpuDefNew(xmlopt)))
+        return NULL;
+
+    def->online = src->online;
+    def->hotpluggable = src->hotpluggable;
+    def->order = src->order;
+    def->sched = src->sched;
+
+    if (src->cpumask &&
+        !(def->cpumask = virBitmapNewCopy(src->cpumask))) {
+        virDomainVcpuDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainIOThreadIDDefPtr
+virDomainIOThreadIDDefCopy(virDomainIOThreadIDDefPtr src)
+{
+    virDomainIOThreadIDDefPtr def = g_new0(virDomainIOThreadIDDef, 1);
+
+    *def = *src;
+    def->cpumask = NULL;
+
+    if (src->cpumask &&
+        !(def->cpumask = virBitmapNewCopy(src->cpumask))) {
+        virDomainIOThreadIDDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static void
+virDomainOSDefCopy(virDomainOSDefPtr dst,
+                   virDomainOSDefPtr src)
+{
+    size_t i;
+
+    *dst = *src;
+
+    dst->machine = g_strdup(src->machine);
+    dst->init = g_strdup(src->init);
+    dst->initargv = g_strdupv(src->initargv);
+    dst->initdir = g_strdup(src->initdir);
+    dst->inituser = g_strdup(src->inituser);
+    dst->initgroup = g_strdup(src->initgroup);
+    dst->kernel = g_strdup(src->kernel);
+    dst->initrd = g_strdup(src->initrd);
+    dst->cmdline = g_strdup(src->cmdline);
+    dst->dtb = g_strdup(src->dtb);
+    dst->root = g_strdup(src->root);
+    dst->slic_table = g_strdup(src->slic_table);
+    dst->bootloader = g_strdup(src->bootloader);
+    dst->bootloaderArgs = g_strdup(src->bootloaderArgs);
+
+    dst->initenv = NULL;
+    if (src->initenv) {
+        for (i = 0; src->initenv[i]; i++)
+            ;
+        dst->initenv = g_new0(virDomainOSEnvPtr, i + 1);
+        for (i = 0; src->initenv[i]; i++) {
+            dst->initenv[i] = g_new0(virDomainOSEnv, 1);
+            dst->initenv[i]->name = g_strdup(src->initenv[i]->name);
+            dst->initenv[i]->value = g_strdup(src->initenv[i]->value);
+        }
+    }
+
+    dst->loader = NULL;
+    if (src->loader) {
+        dst->loader = g_new0(virDomainLoaderDef, 1);
+        *dst->loader = *src->loader;
+        dst->loader->path = g_strdup(src->loader->path);
+        dst->loader->nvram = g_strdup(src->loader->nvram);
+        dst->loader->templt = g_strdup(src->loader->templt);
+    }
+}
+
+
+static void
+virDomainClockDefCopy(virDomainClockDefPtr dst,
+                      virDomainClockDefPtr src)
+{
+    size_t i;
+
+    *dst = *src;
+
+    if (src->offset == VIR_DOMAIN_CLOCK_OFFSET_TIMEZONE)
+        dst->data.timezone = g_strdup(src->data.timezone);
+
+    dst->timers = NULL;
+    if (src->ntimers) {
+        dst->timers = g_new0(virDomainTimerDefPtr, src->ntimers);
+        for (i = 0; i < src->ntimers; i++) {
+            dst->timers[i] = g_new0(virDomainTimerDef, 1);
+            *dst->timers[i] = *src->timers[i];
+        }
+    }
+}
+
+
+/* Deep copies @src field by field.  Unlike the XML round-trip this
+ * keeps live-only state (aliases, the domain id, allocated ports, ...)
+ * and does not re-run the post parse callbacks.  */
+static virDomainDefPtr
+virDomainDefCopyInternal(virDomainDefPtr src,
+                         virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDefPtr def = g_new0(virDomainDef, 1);
+    size_t i;
+    size_t j;
+
+    def->virtType = src->virtType;
+    def->id = src->id;
+    memcpy(def->uuid, src->uuid, VIR_UUID_BUFLEN);
+    memcpy(def->genid, src->genid, VIR_UUID_BUFLEN);
+    def->genidRequested = src->genidRequested;
+    def->genidGenerated = src->genidGenerated;
+
+    def->name = g_strdup(src->name);
+    def->title = g_strdup(src->title);
+    def->description = g_strdup(src->description);
+    def->emulator = g_strdup(src->emulator);
+    def->hyperv_vendor_id = g_strdup(src->hyperv_vendor_id);
+
+    def->blkio.weight = src->blkio.weight;
+    if (src->blkio.ndevices) {
+        def->blkio.devices = g_new0(virBlkioDevice, src->blkio.ndevices);
+        def->blkio.ndevices = src->blkio.ndevices;
+        for (i = 0; i < src->blkio.ndevices; i++) {
+            def->blkio.devices[i] = src->blkio.devices[i];
+            def->blkio.devices[i].path = g_strdup(src->blkio.devices[i].path);
+        }
+    }
+
+    def->mem = src->mem;
+    def->mem.hugepages = NULL;
+    def->mem.nhugepages = 0;
+    if (src->mem.nhugepages) {
+        def->mem.hugepages = g_new0(virDomainHugePage, src->mem.nhugepages);
+        def->mem.nhugepages = src->mem.nhugepages;
+        for (i = 0; i < src->mem.nhugepages; i++) {
+            virBitmapPtr nodemask = src->mem.hugepages[i].nodemask;
+
+            def->mem.hugepages[i].size = src->mem.hugepages[i].size;
+            if (nodemask &&
+                !(def->mem.hugepages[i].nodemask = virBitmapNewCopy(nodemask)))
+                goto error;
+        }
+    }
+
+    if (src->maxvcpus) {
+        def->vcpus = g_new0(virDomainVcpuDefPtr, src->maxvcpus);
+        def->maxvcpus = src->maxvcpus;
+        for (i = 0; i < src->maxvcpus; i++) {
+            if (!(def->vcpus[i] = virDomainVcpuDefCopy(src->vcpus[i], xmlopt)))
+                goto error;
+        }
+    }
+    def->individualvcpus = src->individualvcpus;
+    def->placement_mode = src->placement_mode;
+    if (src->cpumask &&
+        !(def->cpumask = virBitmapNewCopy(src->cpumask)))
+        goto error;
+
+    if (src->niothreadids) {
+        def->iothreadids = g_new0(virDomainIOThreadIDDefPtr, src->niothreadids);
+        def->niothreadids = src->niothreadids;
+        for (i = 0; i < src->niothreadids; i++) {
+            if (!(def->iothreadids[i] = virDomainIOThreadIDDefCopy(src->iothreadids[i])))
+                goto error;
+        }
+    }
+
+    def->cputune = src->cputune;
+    def->cputune.emulatorpin = NULL;
+    def->cputune.emulatorsched = NULL;
+    if (src->cputune.emulatorsched) {
+        def->cputune.emulatorsched = g_new0(virDomainThreadSchedParam, 1);
+        *def->cputune.emulatorsched = *src->cputune.emulatorsched;
+    }
+    if (src->cputune.emulatorpin &&
+        !(def->cputune.emulatorpin = virBitmapNewCopy(src->cputune.emulatorpin)))
+        goto error;
+
+    if (src->numa &&
+        !(def->numa = virDomainNumaCopy(src->numa)))
+        goto error;
+
+    if (src->resource) {
+        def->resource = g_new0(virDomainResourceDef, 1);
+        def->resource->partition = g_strdup(src->resource->partition);
+    }
+
+    if (src->idmap.nuidmap) {
+        def->idmap.uidmap = g_new0(virDomainIdMapEntry, src->idmap.nuidmap);
+        def->idmap.nuidmap = src->idmap.nuidmap;
+        memcpy(def->idmap.uidmap, src->idmap.uidmap,
+               sizeof(*src->idmap.uidmap) * src->idmap.nuidmap);
+    }
+    if (src->idmap.ngidmap) {
+        def->idmap.gidmap = g_new0(virDomainIdMapEntry, src->idmap.ngidmap);
+        def->idmap.ngidmap = src->idmap.ngidmap;
+        memcpy(def->idmap.gidmap, src->idmap.gidmap,
+               sizeof(*src->idmap.gidmap) * src->idmap.ngidmap);
+    }
+
+    def->onReboot = src->onReboot;
+    def->onPoweroff = src->onPoweroff;
+    def->onCrash = src->onCrash;
+    def->onLockFailure = src->onLockFailure;
+    def->pm = src->pm;
+    def->perf = src->perf;
+
+    virDomainOSDefCopy(&def->os, &src->os);
+
+    memcpy(def->features, src->features, sizeof(src->features));
+    memcpy(def->caps_features, src->caps_features, sizeof(src->caps_features));
+    memcpy(def->hyperv_features, src->hyperv_features, sizeof(src->hyperv_features));
+    memcpy(def->kvm_features, src->kvm_features, sizeof(src->kvm_features));
+    memcpy(def->msrs_features, src->msrs_features, sizeof(src->msrs_features));
+    memcpy(def->xen_features, src->xen_features, sizeof(src->xen_features));
+    def->xen_passthrough_mode = src->xen_passthrough_mode;
+    def->hyperv_spinlocks = src->hyperv_spinlocks;
+    def->hyperv_stimer_direct = src->hyperv_stimer_direct;
+    def->gic_version = src->gic_version;
+    def->hpt_resizing = src->hpt_resizing;
+    def->hpt_maxpagesize = src->hpt_maxpagesize;
+    def->apic_eoi = src->apic_eoi;
+    def->tseg_specified = src->tseg_specified;
+    def->tseg_size = src->tseg_size;
+
+    virDomainClockDefCopy(&def->clock, &src->clock);
+
+    if (src->ngraphics) {
+        def->graphics = g_new0(virDomainGraphicsDefPtr, src->ngraphics);
+        def->ngraphics = src->ngraphics;
+        for (i = 0; i < src->ngraphics; i++) {
+            if (!(def->graphics[i] = virDomainGraphicsDefCopy(src->graphics[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->ndisks) {
+        def->disks = g_new0(virDomainDiskDefPtr, src->ndisks);
+        def->ndisks = src->ndisks;
+        for (i = 0; i < src->ndisks; i++) {
+            if (!(def->disks[i] = virDomainDiskDefCopy(src->disks[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->ncontrollers) {
+        def->controllers = g_new0(virDomainControllerDefPtr, src->ncontrollers);
+        def->ncontrollers = src->ncontrollers;
+        for (i = 0; i < src->ncontrollers; i++)
+            def->controllers[i] = virDomainControllerDefCopy(src->controllers[i]);
+    }
+
+    if (src->nfss) {
+        def->fss = g_new0(virDomainFSDefPtr, src->nfss);
+        def->nfss = src->nfss;
+        for (i = 0; i < src->nfss; i++) {
+            if (!(def->fss[i] = virDomainFSDefCopy(src->fss[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nnets) {
+        def->nets = g_new0(virDomainNetDefPtr, src->nnets);
+        def->nnets = src->nnets;
+        for (i = 0; i < src->nnets; i++) {
+            if (!(def->nets[i] = virDomainNetDefCopy(src->nets[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->ninputs) {
+        def->inputs = g_new0(virDomainInputDefPtr, src->ninputs);
+        def->ninputs = src->ninputs;
+        for (i = 0; i < src->ninputs; i++)
+            def->inputs[i] = virDomainInputDefCopy(src->inputs[i]);
+    }
+
+    if (src->nsounds) {
+        def->sounds = g_new0(virDomainSoundDefPtr, src->nsounds);
+        def->nsounds = src->nsounds;
+        for (i = 0; i < src->nsounds; i++)
+            def->sounds[i] = virDomainSoundDefCopy(src->sounds[i]);
+    }
+
+    if (src->nvideos) {
+        def->videos = g_new0(virDomainVideoDefPtr, src->nvideos);
+        def->nvideos = src->nvideos;
+        for (i = 0; i < src->nvideos; i++) {
+            if (!(def->videos[i] = virDomainVideoDefCopy(src->videos[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    /* Hostdevs backing an <interface type='hostdev'> live inside the
+     * interface definition, so they have to point into the copied nets
+     * rather than being copied on their own.  */
+    if (src->nhostdevs) {
+        def->hostdevs = g_new0(virDomainHostdevDefPtr, src->nhostdevs);
+        def->nhostdevs = src->nhostdevs;
+        for (i = 0; i < src->nhostdevs; i++) {
+            virDomainHostdevDefPtr hostdev = src->hostdevs[i];
+
+            if (!hostdev->parentnet) {
+                if (!(def->hostdevs[i] = virDomainHostdevDefCopy(hostdev)))
+                    goto error;
+                continue;
+            }
+
+            for (j = 0; j < src->nnets; j++) {
+                if (src->nets[j] == hostdev->parentnet) {
+                    def->hostdevs[i] = virDomainNetGetActualHostdev(def->nets[j]);
+                    break;
+                }
+            }
+
+            if (!def->hostdevs[i]) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("hostdev refers to an unknown interface"));
+                goto error;
+            }
+        }
+    }
+
+    if (src->nredirdevs) {
+        def->redirdevs = g_new0(virDomainRedirdevDefPtr, src->nredirdevs);
+        def->nredirdevs = src->nredirdevs;
+        for (i = 0; i < src->nredirdevs; i++) {
+            if (!(def->redirdevs[i] = virDomainRedirdevDefCopy(src->redirdevs[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nsmartcards) {
+        def->smartcards = g_new0(virDomainSmartcardDefPtr, src->nsmartcards);
+        def->nsmartcards = src->nsmartcards;
+        for (i = 0; i < src->nsmartcards; i++) {
+            if (!(def->smartcards[i] = virDomainSmartcardDefCopy(src->smartcards[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nserials) {
+        def->serials = g_new0(virDomainChrDefPtr, src->nserials);
+        def->nserials = src->nserials;
+        for (i = 0; i < src->nserials; i++) {
+            if (!(def->serials[i] = virDomainChrDefCopy(src->serials[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nparallels) {
+        def->parallels = g_new0(virDomainChrDefPtr, src->nparallels);
+        def->nparallels = src->nparallels;
+        for (i = 0; i < src->nparallels; i++) {
+            if (!(def->parallels[i] = virDomainChrDefCopy(src->parallels[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nchannels) {
+        def->channels = g_new0(virDomainChrDefPtr, src->nchannels);
+        def->nchannels = src->nchannels;
+        for (i = 0; i < src->nchannels; i++) {
+            if (!(def->channels[i] = virDomainChrDefCopy(src->channels[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nconsoles) {
+        def->consoles = g_new0(virDomainChrDefPtr, src->nconsoles);
+        def->nconsoles = src->nconsoles;
+        for (i = 0; i < src->nconsoles; i++) {
+            if (!(def->consoles[i] = virDomainChrDefCopy(src->consoles[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nleases) {
+        def->leases = g_new0(virDomainLeaseDefPtr, src->nleases);
+        def->nleases = src->nleases;
+        for (i = 0; i < src->nleases; i++)
+            def->leases[i] = virDomainLeaseDefCopy(src->leases[i]);
+    }
+
+    if (src->nhubs) {
+        def->hubs = g_new0(virDomainHubDefPtr, src->nhubs);
+        def->nhubs = src->nhubs;
+        for (i = 0; i < src->nhubs; i++)
+            def->hubs[i] = virDomainHubDefCopy(src->hubs[i]);
+    }
+
+    if (src->nseclabels) {
+        def->seclabels = g_new0(virSecurityLabelDefPtr, src->nseclabels);
+        def->nseclabels = src->nseclabels;
+        for (i = 0; i < src->nseclabels; i++)
+            def->seclabels[i] = virSecurityLabelDefCopy(src->seclabels[i]);
+    }
+
+    if (src->nrngs) {
+        def->rngs = g_new0(virDomainRNGDefPtr, src->nrngs);
+        def->nrngs = src->nrngs;
+        for (i = 0; i < src->nrngs; i++) {
+            if (!(def->rngs[i] = virDomainRNGDefCopy(src->rngs[i], xmlopt)))
+                goto error;
+        }
+    }
+
+    if (src->nshmems) {
+        def->shmems = g_new0(virDomainShmemDefPtr, src->nshmems);
+        def->nshmems = src->nshmems;
+        for (i = 0; i < src->nshmems; i++) {
+            if (!(def->shmems[i] = virDomainShmemDefCopy(src->shmems[i])))
+                goto error;
+        }
+    }
+
+    if (src->nmems) {
+        def->mems = g_new0(virDomainMemoryDefPtr, src->nmems);
+        def->nmems = src->nmems;
+        for (i = 0; i < src->nmems; i++) {
+            if (!(def->mems[i] = virDomainMemoryDefCopy(src->mems[i])))
+                goto error;
+        }
+    }
+
+    if (src->npanics) {
+        def->panics = g_new0(virDomainPanicDefPtr, src->npanics);
+        def->npanics = src->npanics;
+        for (i = 0; i < src->npanics; i++)
+            def->panics[i] = virDomainPanicDefCopy(src->panics[i]);
+    }
+
+    if (src->watchdog)
+        def->watchdog = virDomainWatchdogDefCopy(src->watchdog);
+    if (src->memballoon)
+        def->memballoon = virDomainMemballoonDefCopy(src->memballoon);
+    if (src->nvram)
+        def->nvram = virDomainNVRAMDefCopy(src->nvram);
+    if (src->tpm &&
+        !(def->tpm = virDomainTPMDefCopy(src->tpm)))
+        goto error;
+    if (src->cpu &&
+        !(def->cpu = virCPUDefCopy(src->cpu)))
+        goto error;
+    if (src->sysinfo)
+        def->sysinfo = virSysinfoDefCopy(src->sysinfo);
+    if (src->vsock &&
+        !(def->vsock = virDomainVsockDefCopy(src->vsock, xmlopt)))
+        goto error;
+
+    if (src->redirfilter) {
+        virDomainRedirFilterDefPtr redirfilter = src->redirfilter;
+
+        def->redirfilter = g_new0(virDomainRedirFilterDef, 1);
+        if (redirfilter->nusbdevs) {
+            def->redirfilter->usbdevs = g_new0(virDomainRedirFilterUSBDevDefPtr,
+                                               redirfilter->nusbdevs);
+            def->redirfilter->nusbdevs = redirfilter->nusbdevs;
+            for (i = 0; i < redirfilter->nusbdevs; i++) {
+                def->redirfilter->usbdevs[i] = g_new0(virDomainRedirFilterUSBDevDef, 1);
+                *def->redirfilter->usbdevs[i] = *redirfilter->usbdevs[i];
+            }
+        }
+    }
+
+    if (src->iommu) {
+        def->iommu = g_new0(virDomainIOMMUDef, 1);
+        *def->iommu = *src->iommu;
+    }
+
+    if (src->keywrap) {
+        def->keywrap = g_new0(virDomainKeyWrapDef, 1);
+        *def->keywrap = *src->keywrap;
+    }
+
+    if (src->sev) {
+        def->sev = g_new0(virDomainSEVDef, 1);
+        *def->sev = *src->sev;
+        def->sev->dh_cert = g_strdup(src->sev->dh_cert);
+        def->sev->session = g_strdup(src->sev->session);
+    }
+
+    def->ns = src->ns;
+
+    if (src->metadata &&
+        !(def->metadata = xmlCopyNode(src->metadata, 1))) {
+        virReportOOMError();
+        goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainDefFree(def);
+    return NULL;
+}
+
+
+/* Copy src into a new definition; with the quality of the copy
+ * depending on the migratable flag (false for transitions between
+ * persistent and active, true for transitions across save files or
+ * snapshots).  Non-migratable copies are done field by field, the rest
+ * are cloned via a round-trip through XML.  */
+virDomainDefPtr
+virDomainDefCopy(virDomainDefPtr src,
+                 virDomainXMLOptionPtr xmlopt,
+                 void *parseOpaque,
+                 bool migratable)
+{
+    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
+    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    g_autofree char *xml = NULL;
+
+    /* A migratable copy has to drop everything the formatter strips for
+     * migration, namespace data has no copy callback, resctrl monitors
+     * are shared with the host side state and a definition whose post
+     * parse failed wants the callbacks re-run.  Those go through XML.  */
+    if (!migratable &&
+        !src->namespaceData &&
+        src->nresctrls == 0 &&
+        !src->postParseFailed)
+        return virDomainDefCopyInternal(src, xmlopt);
 
     if (migratable)
         format_flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_MIGRATABLE;
 
-    /* Easiest to clone via a round-trip through XML.  */
     if (!(xml = virDomainDefFormat(src, xmlopt, format_flags)))
         return NULL;
 
@@ -2697,6 +2697,8 @@ struct _virDomainObj {
     unsigned int persistent : 1;
     unsigned int updated : 1;
     unsigned int removing : 1;
+    unsigned int statusPending : 1; /* status XML write queued with
+                                     * virDomainStatusWriterSchedule */
 
     virDomainDefPtr def; /* The current definition */
     virDomainDefPtr newDef; /* New definition to activate at shutdown */
@@ -2796,7 +2798,9 @@ typedef int (*virDomainDeviceDefValidateCallback)(const virDomainDeviceDef *dev,
                                                   void *opaque);
 
 struct _virDomainDefParserConfig {
-    /* driver domain definition callbacks */
+    /* driver domain definition callbacks; virDomainObjListLoadAllConfigs
+     * may run them in several threads at once unless the driver limits
+     * it to one thread by virDomainObjListSetLoadWorkers */
     virDomainDefPostParseBasicCallback domainPostParseBasicCallback;
     virDomainDefPostParseDataAlloc domainPostParseDataAlloc;
     virDomainDefPostParseCallback domainPostParseCallback;
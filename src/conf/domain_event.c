@@ -57,6 +57,7 @@ static virClassPtr virDomainEventJobCompletedClass;
 static virClassPtr virDomainEventDeviceRemovalFailedClass;
 static virClassPtr virDomainEventMetadataChangeClass;
 static virClassPtr virDomainEventBlockThresholdClass;
+static virClassPtr virDomainEventStatsChangeClass;
 
 static void virDomainEventDispose(void *obj);
 static void virDomainEventLifecycleDispose(void *obj);
@@ -79,6 +80,7 @@ static void virDomainEventJobCompletedDispose(void *obj);
 static void virDomainEventDeviceRemovalFailedDispose(void *obj);
 static void virDomainEventMetadataChangeDispose(void *obj);
 static void virDomainEventBlockThresholdDispose(void *obj);
+static void virDomainEventStatsChangeDispose(void *obj);
 
 static void
 virDomainEventDispatchDefaultFunc(virConnectPtr conn,
@@ -287,6 +289,18 @@ struct _virDomainEventBlockThreshold {
 typedef struct _virDomainEventBlockThreshold virDomainEventBlockThreshold;
 typedef virDomainEventBlockThreshold *virDomainEventBlockThresholdPtr;
 
+struct _virDomainEventStatsChange {
+    virDomainEvent parent;
+
+    virTypedParameterPtr params;
+    int nparams;
+    /* connection the event is meant for, NULL for all; only compared,
+     * not referenced */
+    virConnectPtr target;
+};
+typedef struct _virDomainEventStatsChange virDomainEventStatsChange;
+typedef virDomainEventStatsChange *virDomainEventStatsChangePtr;
+
 
 static int
 virDomainEventsOnceInit(void)
@@ -333,6 +347,8 @@ virDomainEventsOnceInit(void)
         return -1;
     if (!VIR_CLASS_NEW(virDomainEventBlockThreshold, virDomainEventClass))
         return -1;
+    if (!VIR_CLASS_NEW(virDomainEventStatsChange, virDomainEventClass))
+        return -1;
     return 0;
 }
 
@@ -542,6 +558,16 @@ virDomainEventBlockThresholdDispose(void *obj)
 }
 
 
+static void
+virDomainEventStatsChangeDispose(void *obj)
+{
+    virDomainEventStatsChangePtr event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    virTypedParamsFree(event->params, event->nparams);
+}
+
+
 static void *
 virDomainEventNew(virClassPtr klass,
                   int eventID,
@@ -1619,6 +1645,68 @@ virDomainEventBlockThresholdNewFromDom(virDomainPtr dom,
 }
 
 
+/* This function consumes @params, the caller must not free it.
+ */
+static virObjectEventPtr
+virDomainEventStatsChangeNew(int id,
+                             const char *name,
+                             const unsigned char *uuid,
+                             virConnectPtr target,
+                             virTypedParameterPtr params,
+                             int nparams)
+{
+    virDomainEventStatsChangePtr ev;
+
+    if (virDomainEventsInitialize() < 0)
+        goto error;
+
+    if (!(ev = virDomainEventNew(virDomainEventStatsChangeClass,
+                                 VIR_DOMAIN_EVENT_ID_STATS_CHANGE,
+                                 id, name, uuid)))
+        goto error;
+
+    ev->params = params;
+    ev->nparams = nparams;
+    ev->target = target;
+
+    return (virObjectEventPtr) ev;
+
+ error:
+    virTypedParamsFree(params, nparams);
+    return NULL;
+}
+
+/**
+ * virDomainEventStatsChangeNewFromObj:
+ * @obj: domain object
+ * @target: connection to deliver the event to, NULL for all
+ * @params: statistics carried by the event, stolen
+ * @nparams: number of @params
+ *
+ * The statistics reported to different connections may differ, in which
+ * case each of them gets its own event by setting @target.
+ */
+virObjectEventPtr
+virDomainEventStatsChangeNewFromObj(virDomainObjPtr obj,
+                                    virConnectPtr target,
+                                    virTypedParameterPtr params,
+                                    int nparams)
+{
+    return virDomainEventStatsChangeNew(obj->def->id, obj->def->name,
+                                        obj->def->uuid, target,
+                                        params, nparams);
+}
+
+virObjectEventPtr
+virDomainEventStatsChangeNewFromDom(virDomainPtr dom,
+                                    virTypedParameterPtr params,
+                                    int nparams)
+{
+    return virDomainEventStatsChangeNew(dom->id, dom->name, dom->uuid,
+                                        NULL, params, nparams);
+}
+
+
 static void
 virDomainEventDispatchDefaultFunc(virConnectPtr conn,
                                   virObjectEventPtr event,
@@ -1902,6 +1990,20 @@ virDomainEventDispatchDefaultFunc(virConnectPtr conn,
                                                               cbopaque);
             goto cleanup;
         }
+
+    case VIR_DOMAIN_EVENT_ID_STATS_CHANGE:
+        {
+            virDomainEventStatsChangePtr ev;
+
+            ev = (virDomainEventStatsChangePtr) event;
+            if (ev->target && ev->target != conn)
+                goto cleanup;
+            ((virConnectDomainEventStatsChangeCallback) cb)(conn, dom,
+                                                            ev->params,
+                                                            ev->nparams,
+                                                            cbopaque);
+            goto cleanup;
+        }
     case VIR_DOMAIN_EVENT_ID_LAST:
         break;
     }
@@ -255,6 +255,17 @@ virDomainEventBlockThresholdNewFromDom(virDomainPtr dom,
                                        unsigned long long threshold,
                                        unsigned long long excess);
 
+virObjectEventPtr
+virDomainEventStatsChangeNewFromObj(virDomainObjPtr obj,
+                                    virConnectPtr target,
+                                    virTypedParameterPtr params,
+                                    int nparams);
+
+virObjectEventPtr
+virDomainEventStatsChangeNewFromDom(virDomainPtr dom,
+                                    virTypedParameterPtr params,
+                                    int nparams);
+
 int
 virDomainEventStateRegister(virConnectPtr conn,
                             virObjectEventStatePtr state,
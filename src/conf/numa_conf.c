@@ -1082,6 +1082,56 @@ virDomainNumaNew(void)
     return ret;
 }
 
+virDomainNumaPtr
+virDomainNumaCopy(virDomainNumaPtr numa)
+{
+    virDomainNumaPtr ret = virDomainNumaNew();
+    size_t i;
+
+    ret->memory = numa->memory;
+    ret->memory.nodeset = NULL;
+    if (numa->memory.nodeset &&
+        !(ret->memory.nodeset = virBitmapNewCopy(numa->memory.nodeset)))
+        goto error;
+
+    if (numa->nmem_nodes) {
+        ret->mem_nodes = g_new0(struct _virDomainNumaNode, numa->nmem_nodes);
+        ret->nmem_nodes = numa->nmem_nodes;
+    }
+
+    for (i = 0; i < numa->nmem_nodes; i++) {
+        struct _virDomainNumaNode *src = &numa->mem_nodes[i];
+        struct _virDomainNumaNode *dst = &ret->mem_nodes[i];
+
+        dst->mem = src->mem;
+        dst->mode = src->mode;
+        dst->memAccess = src->memAccess;
+        dst->discard = src->discard;
+
+        if (src->cpumask &&
+            !(dst->cpumask = virBitmapNewCopy(src->cpumask)))
+            goto error;
+
+        if (src->nodeset &&
+            !(dst->nodeset = virBitmapNewCopy(src->nodeset)))
+            goto error;
+
+        if (src->ndistances) {
+            dst->distances = g_new0(struct _virDomainNumaDistance,
+                                    src->ndistances);
+            memcpy(dst->distances, src->distances,
+                   src->ndistances * sizeof(*src->distances));
+            dst->ndistances = src->ndistances;
+        }
+    }
+
+    return ret;
+
+ error:
+    virDomainNumaFree(ret);
+    return NULL;
+}
+
 
 bool
 virDomainNumaCheckABIStability(virDomainNumaPtr src,
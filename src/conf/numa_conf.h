@@ -53,6 +53,8 @@ VIR_ENUM_DECL(virDomainMemoryAccess);
 
 
 virDomainNumaPtr virDomainNumaNew(void);
+virDomainNumaPtr virDomainNumaCopy(virDomainNumaPtr numa)
+    ATTRIBUTE_NONNULL(1);
 void virDomainNumaFree(virDomainNumaPtr numa);
 
 /*
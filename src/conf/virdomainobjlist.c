@@ -31,6 +31,7 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 #include "virdomainsnapshotobjlist.h"
 #include "virdomaincheckpointobjlist.h"
 
@@ -41,6 +42,44 @@ VIR_LOG_INIT("conf.virdomainobjlist");
 static virClassPtr virDomainObjListClass;
 static void virDomainObjListDispose(void *obj);
 
+/* Number of reader counters per list. Threads are spread over them so
+ * that concurrent lookups don't all modify the same cache line. */
+#define VIR_DOMAIN_OBJ_LIST_READER_SLOTS 32
+
+typedef struct _virDomainObjListReaders virDomainObjListReaders;
+struct _virDomainObjListReaders {
+    /* lookups in progress, indexed by the parity of the epoch they
+     * started in */
+    int active[2];
+    char padding[64 - 2 * sizeof(int)];
+};
+
+/* Copy of the lookup tables, each entry holding a reference to its
+ * domain object. */
+typedef struct _virDomainObjListSnapshot virDomainObjListSnapshot;
+typedef virDomainObjListSnapshot *virDomainObjListSnapshotPtr;
+struct _virDomainObjListSnapshot {
+    virHashTablePtr objs;
+    virHashTablePtr objsName;
+};
+
+/* Modification of the lookup tables to be repeated on the snapshots */
+typedef struct _virDomainObjListChange virDomainObjListChange;
+typedef virDomainObjListChange *virDomainObjListChangePtr;
+struct _virDomainObjListChange {
+    virDomainObjPtr vm; /* domain being added or renamed, NULL on removal */
+    const char *uuidstr; /* NULL if the uuid doesn't change */
+    const char *oldName; /* name to remove or NULL */
+    const char *newName; /* name to add or NULL */
+};
+
+/* Snapshot replaced while lookups might still use it */
+typedef struct _virDomainObjListRetired virDomainObjListRetired;
+typedef virDomainObjListRetired *virDomainObjListRetiredPtr;
+struct _virDomainObjListRetired {
+    virDomainObjListSnapshotPtr snap;
+    unsigned long long switches; /* value of doms->switches once replaced */
+};
 
 struct _virDomainObjList {
     virObjectRWLockable parent;
@@ -52,14 +91,94 @@ struct _virDomainObjList {
     /* name -> virDomainObj mapping for O(1),
      * lockless lookup-by-name */
     virHashTable *objsName;
+
+    /* Copy of @objs and @objsName used by lookups which don't take
+     * the list lock. Writers never modify it but publish a new one, see
+     * virDomainObjListUpdate. */
+    virDomainObjListSnapshotPtr snapshot;
+
+    /* The previous snapshot, to be reused by the next writer once no
+     * lookup uses it, and the snapshots which couldn't be reused, to be
+     * freed once no lookup uses them. Guarded by @snapshotLock rather
+     * than the list lock, so that virDomainObjListReclaim can wait for
+     * lookups without blocking the list. */
+    virMutex snapshotLock;
+    virDomainObjListSnapshotPtr spare;
+    virDomainObjListChange spareChange; /* not applied to @spare yet */
+    bool spareBehind; /* @spareChange is set */
+    bool spareIdle; /* no lookup uses @spare anymore */
+    unsigned long long switches; /* number of snapshots published */
+    virDomainObjListRetiredPtr retired;
+    size_t nretired;
+
+    /* Serializes virDomainObjListSynchronize */
+    virMutex syncLock;
+
+    /* Lookups in progress, see virDomainObjListSynchronize. */
+    int epoch;
+    virDomainObjListReaders readers[VIR_DOMAIN_OBJ_LIST_READER_SLOTS];
+
+    /* Signalled once lookups finish while a writer waits for them */
+    virMutex readersLock;
+    virCond readersCond;
+    int writerWaiting;
+
+    /* Threads parsing files in virDomainObjListLoadAllConfigs,
+     * 0 picks the number automatically */
+    size_t loadWorkers;
 };
 
+static virDomainObjListSnapshotPtr
+virDomainObjListSnapshotNew(void)
+{
+    virDomainObjListSnapshotPtr snap = g_new0(virDomainObjListSnapshot, 1);
+
+    snap->objs = virHashNewFlat(virObjectFreeHashData);
+    snap->objsName = virHashNewFlat(virObjectFreeHashData);
+
+    return snap;
+}
+
+
+static void
+virDomainObjListSnapshotFree(virDomainObjListSnapshotPtr snap)
+{
+    if (!snap)
+        return;
+
+    virHashFree(snap->objs);
+    virHashFree(snap->objsName);
+    g_free(snap);
+}
+
+
+/* Frees the copies held by a change stored for later */
+static void
+virDomainObjListChangeClear(virDomainObjListChangePtr change)
+{
+    virObjectUnref(change->vm);
+    g_free((char *) change->uuidstr);
+    g_free((char *) change->oldName);
+    g_free((char *) change->newName);
+    memset(change, 0, sizeof(*change));
+}
+
+
+static virThreadLocal virDomainObjListReaderSlot;
+static int virDomainObjListReaderSlotNext;
+
 
 static int virDomainObjListOnceInit(void)
 {
     if (!VIR_CLASS_NEW(virDomainObjList, virClassForObjectRWLockable()))
         return -1;
 
+    if (virThreadLocalInit(&virDomainObjListReaderSlot, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize thread local variable"));
+        return -1;
+    }
+
     return 0;
 }
 
@@ -75,12 +194,26 @@ virDomainObjListPtr virDomainObjListNew(void)
     if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
-    if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+    if (virMutexInit(&doms->readersLock) < 0 ||
+        virCondInit(&doms->readersCond) < 0 ||
+        virMutexInit(&doms->snapshotLock) < 0 ||
+        virMutexInit(&doms->syncLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize domain list lookups"));
         virObjectUnref(doms);
         return NULL;
     }
 
+    if (!(doms->objs = virHashNewFlat(virObjectFreeHashData)) ||
+        !(doms->objsName = virHashNewFlat(virObjectFreeHashData))) {
+        virObjectUnref(doms);
+        return NULL;
+    }
+
+    doms->snapshot = virDomainObjListSnapshotNew();
+    doms->spare = virDomainObjListSnapshotNew();
+    doms->spareIdle = true;
+
     return doms;
 }
 
@@ -88,9 +221,325 @@ virDomainObjListPtr virDomainObjListNew(void)
 static void virDomainObjListDispose(void *obj)
 {
     virDomainObjListPtr doms = obj;
+    size_t i;
 
+    virDomainObjListSnapshotFree(doms->snapshot);
+    virDomainObjListSnapshotFree(doms->spare);
+    virDomainObjListChangeClear(&doms->spareChange);
+    for (i = 0; i < doms->nretired; i++)
+        virDomainObjListSnapshotFree(doms->retired[i].snap);
+    g_free(doms->retired);
     virHashFree(doms->objs);
     virHashFree(doms->objsName);
+    virCondDestroy(&doms->readersCond);
+    virMutexDestroy(&doms->readersLock);
+    virMutexDestroy(&doms->snapshotLock);
+    virMutexDestroy(&doms->syncLock);
+}
+
+
+/*
+ * virDomainObjListReadBegin:
+ *
+ * Mark the start of a lookup in the snapshot of @doms. Returns the
+ * counter to be passed to virDomainObjListReadEnd once the caller
+ * stops using the snapshot.
+ */
+static int *
+virDomainObjListReadBegin(virDomainObjListPtr doms)
+{
+    size_t slot;
+    int *active;
+
+    slot = GPOINTER_TO_SIZE(virThreadLocalGet(&virDomainObjListReaderSlot));
+    if (slot == 0) {
+        slot = (unsigned int)g_atomic_int_add(&virDomainObjListReaderSlotNext, 1);
+        slot = slot % VIR_DOMAIN_OBJ_LIST_READER_SLOTS + 1;
+        ignore_value(virThreadLocalSet(&virDomainObjListReaderSlot,
+                                       GSIZE_TO_POINTER(slot)));
+    }
+
+    active = &doms->readers[slot - 1].active[g_atomic_int_get(&doms->epoch) & 1];
+    g_atomic_int_inc(active);
+
+    return active;
+}
+
+
+static void
+virDomainObjListReadEnd(virDomainObjListPtr doms,
+                        int *active)
+{
+    /* Both the counter and the flag are accessed with full barriers so
+     * either the writer sees the counter drop or we see it waiting. */
+    if (g_atomic_int_dec_and_test(active) &&
+        g_atomic_int_get(&doms->writerWaiting)) {
+        virMutexLock(&doms->readersLock);
+        virCondBroadcast(&doms->readersCond);
+        virMutexUnlock(&doms->readersLock);
+    }
+}
+
+
+/*
+ * virDomainObjListSynchronize:
+ *
+ * Wait until all lookups which might have seen the snapshot switched
+ * away from before this call have finished. Lookups which start
+ * meanwhile are counted separately and thus can't delay the caller
+ * indefinitely. Flipping the epoch twice ensures that both counters
+ * are observed idle after the switch. The caller must hold
+ * @doms->syncLock, but not the list lock: waiting for lookups must not
+ * block other users of the list.
+ */
+static void
+virDomainObjListSynchronize(virDomainObjListPtr doms)
+{
+    size_t phase;
+    size_t i;
+
+    virMutexLock(&doms->readersLock);
+    g_atomic_int_set(&doms->writerWaiting, 1);
+
+    for (phase = 0; phase < 2; phase++) {
+        int old = g_atomic_int_add(&doms->epoch, 1) & 1;
+
+        for (i = 0; i < VIR_DOMAIN_OBJ_LIST_READER_SLOTS; i++) {
+            while (g_atomic_int_get(&doms->readers[i].active[old]) > 0)
+                ignore_value(virCondWait(&doms->readersCond,
+                                         &doms->readersLock));
+        }
+    }
+
+    g_atomic_int_set(&doms->writerWaiting, 0);
+    virMutexUnlock(&doms->readersLock);
+}
+
+
+static void
+virDomainObjListSnapshotApply(virDomainObjListSnapshotPtr snap,
+                              virDomainObjListChangePtr change)
+{
+    /* The keys were already checked to be unique in the list tables
+     * which the snapshots mirror, so adding can't fail. */
+    if (change->oldName)
+        virHashRemoveEntry(snap->objsName, change->oldName);
+
+    if (change->uuidstr) {
+        if (!change->vm)
+            virHashRemoveEntry(snap->objs, change->uuidstr);
+        else if (virHashAddEntry(snap->objs, change->uuidstr, change->vm) == 0)
+            virObjectRef(change->vm);
+    }
+
+    if (change->newName &&
+        virHashAddEntry(snap->objsName, change->newName, change->vm) == 0)
+        virObjectRef(change->vm);
+}
+
+
+static int
+virDomainObjListSnapshotCopyEntry(void *payload,
+                                  const void *name,
+                                  void *opaque)
+{
+    virHashTablePtr table = opaque;
+
+    /* the keys are unique in the source table, so adding can't fail */
+    if (virHashAddEntry(table, name, payload) == 0)
+        virObjectRef(payload);
+    return 0;
+}
+
+
+static virDomainObjListSnapshotPtr
+virDomainObjListSnapshotCopy(virDomainObjListSnapshotPtr src)
+{
+    virDomainObjListSnapshotPtr snap = virDomainObjListSnapshotNew();
+
+    virHashForEach(src->objs, virDomainObjListSnapshotCopyEntry, snap->objs);
+    virHashForEach(src->objsName, virDomainObjListSnapshotCopyEntry,
+                   snap->objsName);
+
+    return snap;
+}
+
+
+/* Whether no lookup is in progress right now. Lookups count themselves
+ * before reading @doms->snapshot, so none of them can be using a
+ * snapshot replaced before the check. */
+static bool
+virDomainObjListReadersIdle(virDomainObjListPtr doms)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_READER_SLOTS; i++) {
+        if (g_atomic_int_get(&doms->readers[i].active[0]) > 0 ||
+            g_atomic_int_get(&doms->readers[i].active[1]) > 0)
+            return false;
+    }
+
+    return true;
+}
+
+
+/* Frees the retired snapshots replaced at or before @switches. Must be
+ * called with @doms->snapshotLock held. */
+static void
+virDomainObjListFreeRetired(virDomainObjListPtr doms,
+                            unsigned long long switches)
+{
+    size_t i = 0;
+
+    while (i < doms->nretired) {
+        if (doms->retired[i].switches > switches) {
+            i++;
+            continue;
+        }
+
+        virDomainObjListSnapshotFree(doms->retired[i].snap);
+        VIR_DELETE_ELEMENT(doms->retired, i, doms->nretired);
+    }
+}
+
+
+/* Makes @doms->spare up to date once no lookup uses it. Must be called
+ * with @doms->snapshotLock held. */
+static void
+virDomainObjListSpareCatchUp(virDomainObjListPtr doms)
+{
+    doms->spareIdle = true;
+
+    if (doms->spareBehind) {
+        virDomainObjListSnapshotApply(doms->spare, &doms->spareChange);
+        virDomainObjListChangeClear(&doms->spareChange);
+        doms->spareBehind = false;
+    }
+}
+
+
+/*
+ * virDomainObjListUpdate:
+ *
+ * Publish a snapshot of the lookup tables of @doms with @change
+ * applied. Lookups keep using the current snapshot until they are
+ * done, so it is never modified. The new snapshot is the previous one
+ * brought up to date if no lookup uses it anymore, which is the common
+ * case, or a copy of the current one otherwise. Replaced snapshots are
+ * reused or freed once the lookups finish, see virDomainObjListReclaim,
+ * so writers never wait for lookups. The caller must hold the write
+ * lock on @doms.
+ */
+static void
+virDomainObjListUpdate(virDomainObjListPtr doms,
+                       virDomainObjListChangePtr change)
+{
+    virDomainObjListSnapshotPtr old = doms->snapshot;
+    virDomainObjListSnapshotPtr next;
+
+    virMutexLock(&doms->snapshotLock);
+
+    if (virDomainObjListReadersIdle(doms)) {
+        virDomainObjListSpareCatchUp(doms);
+        virDomainObjListFreeRetired(doms, doms->switches);
+    }
+
+    if (doms->spareIdle) {
+        next = doms->spare;
+    } else {
+        virDomainObjListRetired retired = { doms->spare, doms->switches };
+
+        next = virDomainObjListSnapshotCopy(old);
+        ignore_value(VIR_APPEND_ELEMENT(doms->retired, doms->nretired, retired));
+        virDomainObjListChangeClear(&doms->spareChange);
+        doms->spareBehind = false;
+    }
+
+    virDomainObjListSnapshotApply(next, change);
+    g_atomic_pointer_set(&doms->snapshot, next);
+    doms->switches++;
+
+    /* @old misses @change, which is repeated once it can be reused */
+    doms->spare = old;
+    doms->spareIdle = false;
+    doms->spareBehind = true;
+    doms->spareChange.vm = virObjectRef(change->vm);
+    doms->spareChange.uuidstr = g_strdup(change->uuidstr);
+    doms->spareChange.oldName = g_strdup(change->oldName);
+    doms->spareChange.newName = g_strdup(change->newName);
+
+    virMutexUnlock(&doms->snapshotLock);
+}
+
+
+/*
+ * virDomainObjListReclaim:
+ *
+ * Wait for the lookups which might use the snapshots replaced so far
+ * and make them available for reuse or free them. Called by writers
+ * once they release the list lock.
+ */
+static void
+virDomainObjListReclaim(virDomainObjListPtr doms)
+{
+    unsigned long long switches;
+
+    virMutexLock(&doms->syncLock);
+
+    virMutexLock(&doms->snapshotLock);
+    switches = doms->switches;
+    if (doms->spareIdle && doms->nretired == 0) {
+        virMutexUnlock(&doms->snapshotLock);
+        virMutexUnlock(&doms->syncLock);
+        return;
+    }
+    virMutexUnlock(&doms->snapshotLock);
+
+    virDomainObjListSynchronize(doms);
+
+    virMutexLock(&doms->snapshotLock);
+    /* a newer spare may still be used by lookups */
+    if (doms->switches == switches)
+        virDomainObjListSpareCatchUp(doms);
+    virDomainObjListFreeRetired(doms, switches);
+    virMutexUnlock(&doms->snapshotLock);
+
+    virMutexUnlock(&doms->syncLock);
+}
+
+
+/* Release the write lock on @doms taken for modifying the list */
+static void
+virDomainObjListWriteUnlock(virDomainObjListPtr doms)
+{
+    virObjectRWUnlock(doms);
+    virDomainObjListReclaim(doms);
+}
+
+
+/*
+ * virDomainObjListLookup:
+ *
+ * Look up @key in either the uuid or the name table of @doms without
+ * taking the list lock. Returns a referenced, but unlocked, domain
+ * object or NULL.
+ */
+static virDomainObjPtr
+virDomainObjListLookup(virDomainObjListPtr doms,
+                       const char *key,
+                       bool byName)
+{
+    virDomainObjListSnapshotPtr snap;
+    virDomainObjPtr obj;
+    int *active;
+
+    active = virDomainObjListReadBegin(doms);
+    snap = g_atomic_pointer_get(&doms->snapshot);
+    obj = virObjectRef(virHashLookup(byName ? snap->objsName : snap->objs,
+                                     key));
+    virDomainObjListReadEnd(doms, active);
+
+    return obj;
 }
 
 
@@ -158,16 +607,19 @@ virDomainObjListFindByUUIDLocked(virDomainObjListPtr doms,
  * Lookup the @uuid in the doms->objs hash table and return a
  * locked and ref counted domain object if found. Caller is
  * expected to use the virDomainObjEndAPI when done with the object.
+ *
+ * The lookup itself doesn't take the lock on @doms.
  */
 virDomainObjPtr
 virDomainObjListFindByUUID(virDomainObjListPtr doms,
                            const unsigned char *uuid)
 {
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
     virDomainObjPtr obj;
 
-    virObjectRWLockRead(doms);
-    obj = virDomainObjListFindByUUIDLocked(doms, uuid);
-    virObjectRWUnlock(doms);
+    virUUIDFormat(uuid, uuidstr);
+    if ((obj = virDomainObjListLookup(doms, uuidstr, false)))
+        virObjectLock(obj);
 
     if (obj && obj->removing) {
         virObjectUnlock(obj);
@@ -201,6 +653,8 @@ virDomainObjListFindByNameLocked(virDomainObjListPtr doms,
  * Lookup the @name in the doms->objsName hash table and return a
  * locked and ref counted domain object if found. Caller is expected
  * to use the virDomainObjEndAPI when done with the object.
+ *
+ * The lookup itself doesn't take the lock on @doms.
  */
 virDomainObjPtr
 virDomainObjListFindByName(virDomainObjListPtr doms,
@@ -208,9 +662,8 @@ virDomainObjListFindByName(virDomainObjListPtr doms,
 {
     virDomainObjPtr obj;
 
-    virObjectRWLockRead(doms);
-    obj = virDomainObjListFindByNameLocked(doms, name);
-    virObjectRWUnlock(doms);
+    if ((obj = virDomainObjListLookup(doms, name, true)))
+        virObjectLock(obj);
 
     if (obj && obj->removing) {
         virObjectUnlock(obj);
@@ -243,6 +696,7 @@ virDomainObjListAddObjLocked(virDomainObjListPtr doms,
                              virDomainObjPtr vm)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListChange change = { .vm = vm, .uuidstr = uuidstr };
 
     virUUIDFormat(vm->def->uuid, uuidstr);
     if (virHashAddEntry(doms->objs, uuidstr, vm) < 0)
@@ -255,6 +709,9 @@ virDomainObjListAddObjLocked(virDomainObjListPtr doms,
     }
     virObjectRef(vm);
 
+    change.newName = vm->def->name;
+    virDomainObjListUpdate(doms, &change);
+
     return 0;
 }
 
@@ -361,7 +818,7 @@ virDomainObjPtr virDomainObjListAdd(virDomainObjListPtr doms,
 
     virObjectRWLockWrite(doms);
     ret = virDomainObjListAddLocked(doms, def, xmlopt, flags, oldDef);
-    virObjectRWUnlock(doms);
+    virDomainObjListWriteUnlock(doms);
     return ret;
 }
 
@@ -377,9 +834,13 @@ virDomainObjListRemoveLocked(virDomainObjListPtr doms,
                              virDomainObjPtr dom)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListChange change = { .uuidstr = uuidstr,
+                                      .oldName = dom->def->name };
 
     virUUIDFormat(dom->def->uuid, uuidstr);
 
+    virDomainObjListUpdate(doms, &change);
+
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
 }
@@ -409,7 +870,7 @@ virDomainObjListRemove(virDomainObjListPtr doms,
     virObjectLock(dom);
     virDomainObjListRemoveLocked(doms, dom);
     virObjectUnref(dom);
-    virObjectRWUnlock(doms);
+    virDomainObjListWriteUnlock(doms);
 }
 
 
@@ -432,6 +893,7 @@ virDomainObjListRename(virDomainObjListPtr doms,
 {
     int ret = -1;
     char *old_name = NULL;
+    virDomainObjListChange change = { 0 };
     int rc;
 
     if (STREQ(dom->def->name, new_name)) {
@@ -473,30 +935,80 @@ virDomainObjListRename(virDomainObjListPtr doms,
     if (rc < 0)
         goto cleanup;
 
+    change.vm = dom;
+    change.oldName = old_name;
+    change.newName = new_name;
+    virDomainObjListUpdate(doms, &change);
+
     ret = 0;
  cleanup:
-    virObjectRWUnlock(doms);
+    virDomainObjListWriteUnlock(doms);
     VIR_FREE(old_name);
     return ret;
 }
 
 
-static virDomainObjPtr
-virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+/* Upper bound on the number of threads parsing XML files in
+ * virDomainObjListLoadAllConfigs unless set by the driver */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS_MAX 16
+
+
+/**
+ * virDomainObjListSetLoadWorkers:
+ * @doms: domain list
+ * @nworkers: maximum number of threads, 0 for the default
+ *
+ * Sets how many threads virDomainObjListLoadAllConfigs uses to parse
+ * the files, the calling one included. By default there is one thread
+ * per CPU, at most VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS_MAX. Drivers whose
+ * parser callbacks can't run in several threads at once have to set 1.
+ * Must be called before loading the configs.
+ */
+void
+virDomainObjListSetLoadWorkers(virDomainObjListPtr doms,
+                               size_t nworkers)
 {
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
-    virDomainObjPtr dom;
+    doms->loadWorkers = nworkers;
+}
+
+typedef struct _virDomainObjListLoadEntry virDomainObjListLoadEntry;
+typedef virDomainObjListLoadEntry *virDomainObjListLoadEntryPtr;
+struct _virDomainObjListLoadEntry {
+    char *name;
+
+    /* result of parsing the persistent config */
+    virDomainDefPtr def;
     int autostart;
-    virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
+    /* result of parsing the status XML, unlocked */
+    virDomainObjPtr obj;
+};
+
+typedef struct _virDomainObjListLoadData virDomainObjListLoadData;
+typedef virDomainObjListLoadData *virDomainObjListLoadDataPtr;
+struct _virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    bool liveStatus;
+    virDomainXMLOptionPtr xmlopt;
+
+    virDomainObjListLoadEntryPtr entries;
+    size_t nentries;
+    int next; /* index of the next entry to parse, updated atomically */
+};
+
+
+static int
+virDomainObjListParseConfig(virDomainXMLOptionPtr xmlopt,
+                            const char *configDir,
+                            const char *autostartDir,
+                            virDomainObjListLoadEntryPtr entry)
+{
+    g_autofree char *configFile = NULL;
+    g_autofree char *autostartLink = NULL;
+    virDomainDefPtr def = NULL;
+
+    if ((configFile = virDomainConfigFile(configDir, entry->name)) == NULL)
         goto error;
     if (!(def = virDomainDefParseFile(configFile, xmlopt, NULL,
                                       VIR_DOMAIN_DEF_PARSE_INACTIVE |
@@ -504,56 +1016,110 @@ virDomainObjListLoadConfig(virDomainObjListPtr doms,
                                       VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
         goto error;
 
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
+    if ((autostartLink = virDomainConfigFile(autostartDir, entry->name)) == NULL)
         goto error;
 
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+    if ((entry->autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
         goto error;
 
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+    entry->def = def;
+    return 0;
 
-    dom->autostart = autostart;
+ error:
+    virDomainDefFree(def);
+    return -1;
+}
+
+
+static int
+virDomainObjListParseStatus(virDomainXMLOptionPtr xmlopt,
+                            const char *statusDir,
+                            virDomainObjListLoadEntryPtr entry)
+{
+    g_autofree char *statusFile = NULL;
+    virDomainObjPtr obj;
+
+    if ((statusFile = virDomainConfigFile(statusDir, entry->name)) == NULL)
+        return -1;
+
+    if (!(obj = virDomainObjParseFile(statusFile, xmlopt,
+                                      VIR_DOMAIN_DEF_PARSE_STATUS |
+                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+        return -1;
+
+    /* The object is handed over to the thread inserting it into the
+     * list, which will lock it again */
+    virObjectUnlock(obj);
+    entry->obj = obj;
+    return 0;
+}
+
+
+static void
+virDomainObjListLoadWorker(void *opaque)
+{
+    virDomainObjListLoadDataPtr data = opaque;
+    int i;
+
+    while ((i = g_atomic_int_add(&data->next, 1)) < (int) data->nentries) {
+        virDomainObjListLoadEntryPtr entry = &data->entries[i];
+        int rc;
+
+        /* NB: ignoring errors, so one malformed config doesn't
+           kill the whole process */
+        VIR_INFO("Loading config file '%s.xml'", entry->name);
+        if (data->liveStatus)
+            rc = virDomainObjListParseStatus(data->xmlopt,
+                                             data->configDir,
+                                             entry);
+        else
+            rc = virDomainObjListParseConfig(data->xmlopt,
+                                             data->configDir,
+                                             data->autostartDir,
+                                             entry);
+        if (rc < 0)
+            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->name);
+    }
+}
+
+
+static virDomainObjPtr
+virDomainObjListLoadConfig(virDomainObjListPtr doms,
+                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadEntryPtr entry,
+                           virDomainLoadConfigNotify notify,
+                           void *opaque)
+{
+    virDomainObjPtr dom;
+    virDomainDefPtr oldDef = NULL;
+
+    if (!(dom = virDomainObjListAddLocked(doms, entry->def, xmlopt, 0, &oldDef)))
+        return NULL;
+
+    entry->def = NULL;
+    dom->autostart = entry->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
-
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
 }
 
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadEntryPtr entry,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = g_steal_pointer(&entry->obj);
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
-
+    virObjectLock(obj);
     virUUIDFormat(obj->def->uuid, uuidstr);
 
     if (virHashLookup(doms->objs, uuidstr) != NULL) {
@@ -569,16 +1135,29 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
 
  error:
     virDomainObjEndAPI(&obj);
-    VIR_FREE(statusFile);
     return NULL;
 }
 
 
+/**
+ * virDomainObjListLoadAllConfigs:
+ *
+ * Loads all domain configs (or status XMLs if @liveStatus is true) from
+ * @configDir into @doms.  The files are parsed by a pool of threads
+ * (see virDomainObjListSetLoadWorkers) without holding the list lock;
+ * the results are then added to the list in one batch, in the order the
+ * files were found in the directory.  Files which fail to load are
+ * logged and skipped.
+ *
+ * Parsing runs the post parse callbacks of @xmlopt, which thus may be
+ * called from several threads at once.
+ *
+ * Returns 0 on success, -1 if the directory could not be read.
+ */
 int
 virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                const char *configDir,
@@ -588,53 +1167,80 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                virDomainLoadConfigNotify notify,
                                void *opaque)
 {
+    virDomainObjListLoadData data = {
+        .configDir = configDir, .autostartDir = autostartDir,
+        .liveStatus = liveStatus, .xmlopt = xmlopt,
+    };
+    size_t nworkers;
     DIR *dir;
     struct dirent *entry;
     int ret = -1;
     int rc;
+    size_t i;
 
     VIR_INFO("Scanning for configs in %s", configDir);
 
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
+    while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
+        virDomainObjListLoadEntry item = { 0 };
+
+        if (!virStringStripSuffix(entry->d_name, ".xml"))
+            continue;
+
+        item.name = g_strdup(entry->d_name);
+        if (VIR_APPEND_ELEMENT(data.entries, data.nentries, item) < 0) {
+            VIR_FREE(item.name);
+            ret = -1;
+            break;
+        }
+    }
+
+    VIR_DIR_CLOSE(dir);
+
+    nworkers = doms->loadWorkers;
+    if (nworkers == 0)
+        nworkers = MIN(g_get_num_processors(),
+                       VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS_MAX);
+
+    virThreadPoolRunParallel(MIN(nworkers, data.nentries),
+                             virDomainObjListLoadWorker,
+                             "domain-load", &data);
+
     virObjectRWLockWrite(doms);
 
-    while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
+    for (i = 0; i < data.nentries; i++) {
+        virDomainObjListLoadEntryPtr item = &data.entries[i];
         virDomainObjPtr dom;
 
-        if (!virStringStripSuffix(entry->d_name, ".xml"))
+        /* Parse errors were already reported by the workers */
+        if (!item->def && !item->obj)
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
         if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadStatus(doms, item, notify, opaque);
         else
-            dom = virDomainObjListLoadConfig(doms,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadConfig(doms, xmlopt, item, notify, opaque);
+
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
             virDomainObjEndAPI(&dom);
         } else {
-            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->d_name);
+            VIR_ERROR(_("Failed to load config for domain '%s'"), item->name);
         }
     }
 
-    VIR_DIR_CLOSE(dir);
-    virObjectRWUnlock(doms);
+    virDomainObjListWriteUnlock(doms);
+
+    for (i = 0; i < data.nentries; i++) {
+        VIR_FREE(data.entries[i].name);
+        virDomainDefFree(data.entries[i].def);
+        virObjectUnref(data.entries[i].obj);
+    }
+    VIR_FREE(data.entries);
+
     return ret;
 }
 
@@ -839,7 +1445,10 @@ virDomainObjListForEach(virDomainObjListPtr doms,
     else
         virObjectRWLockRead(doms);
     virHashForEach(doms->objs, virDomainObjListHelper, &data);
-    virObjectRWUnlock(doms);
+    if (modify)
+        virDomainObjListWriteUnlock(doms);
+    else
+        virObjectRWUnlock(doms);
     return data.ret;
 }
 
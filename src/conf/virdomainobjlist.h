@@ -29,6 +29,8 @@ typedef virDomainObjList *virDomainObjListPtr;
 
 virDomainObjListPtr virDomainObjListNew(void);
 
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virDomainObjList, virObjectUnref);
+
 virDomainObjPtr virDomainObjListFindByID(virDomainObjListPtr doms,
                                          int id);
 virDomainObjPtr virDomainObjListFindByUUID(virDomainObjListPtr doms,
@@ -62,6 +64,9 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
                                   virDomainObjPtr dom);
 
+void virDomainObjListSetLoadWorkers(virDomainObjListPtr doms,
+                                    size_t nworkers);
+
 int virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                    const char *configDir,
                                    const char *autostartDir,
@@ -0,0 +1,357 @@
+/*
+ * virdomainstatuswriter.c: coalescing writer for domain status XML
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virdomainstatuswriter.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_DOMAIN
+
+VIR_LOG_INIT("conf.virdomainstatuswriter");
+
+/*
+ * Status XML of a running domain is rewritten on every job start and
+ * end and on most monitor events, although only the last of a quick
+ * succession of writes matters. The writer lets callers schedule the
+ * write instead: the domain is queued once no matter how many times it
+ * is scheduled and a worker thread writes the then current status
+ * after waiting @delay milliseconds for further updates to pile up.
+ *
+ * The pending state is kept in virDomainObj::statusPending which is
+ * protected by the domain object lock, so that a synchronous save done
+ * by virDomainStatusWriterSave or dropping the status file supersedes
+ * a queued write without touching the queue. The writer lock is never
+ * held while acquiring a domain object lock.
+ *
+ * virDomainStatusWriterFlush is the barrier for callers which need all
+ * queued writes on disk, e.g. before the daemon shuts down or reloads.
+ */
+struct _virDomainStatusWriter {
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+    bool quit;
+
+    /* the worker is writing a batch, signalled on @idle when done */
+    bool busy;
+    virCond idle;
+
+    virDomainXMLOptionPtr xmlopt;
+    char *statusDir;
+    unsigned int delay;
+
+    /* domain objects with a reference held for the queue */
+    virDomainObjPtr *pending;
+    size_t npending;
+};
+
+
+static void
+virDomainStatusWriterProcess(virDomainStatusWriterPtr writer,
+                             virDomainObjPtr *vms,
+                             size_t nvms)
+{
+    size_t i;
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+
+        virObjectLock(vm);
+        if (vm->statusPending) {
+            vm->statusPending = false;
+
+            /* The status file is removed once the domain stops, do not
+             * bring it back */
+            if (virDomainObjIsActive(vm) && !vm->removing &&
+                virDomainObjSave(vm, writer->xmlopt, writer->statusDir) < 0)
+                VIR_WARN("Unable to save status of domain %s",
+                         vm->def->name);
+        }
+        virDomainObjEndAPI(&vm);
+    }
+}
+
+
+static void
+virDomainStatusWriterWorker(void *opaque)
+{
+    virDomainStatusWriterPtr writer = opaque;
+
+    virMutexLock(&writer->lock);
+
+    while (true) {
+        virDomainObjPtr *vms = NULL;
+        size_t nvms = 0;
+        unsigned long long until;
+
+        while (writer->npending == 0 && !writer->quit) {
+            if (virCondWait(&writer->cond, &writer->lock) < 0) {
+                VIR_ERROR(_("unable to wait on status writer condition"));
+                goto cleanup;
+            }
+        }
+
+        if (writer->npending == 0)
+            break;
+
+        /* Give other updates of the same domains a chance to get
+         * folded into this batch */
+        if (writer->delay > 0 && !writer->quit &&
+            virTimeMillisNow(&until) == 0) {
+            until += writer->delay;
+            while (!writer->quit &&
+                   virCondWaitUntil(&writer->cond, &writer->lock, until) == 0)
+                ;
+        }
+
+        vms = g_steal_pointer(&writer->pending);
+        nvms = writer->npending;
+        writer->npending = 0;
+        writer->busy = true;
+
+        virMutexUnlock(&writer->lock);
+        virDomainStatusWriterProcess(writer, vms, nvms);
+        VIR_FREE(vms);
+        virMutexLock(&writer->lock);
+
+        writer->busy = false;
+        virCondBroadcast(&writer->idle);
+    }
+
+ cleanup:
+    virMutexUnlock(&writer->lock);
+}
+
+
+/**
+ * virDomainStatusWriterNew:
+ * @xmlopt: XML parser configuration object
+ * @statusDir: directory holding the status XML files
+ * @delay: time in milliseconds to collect writes before flushing them
+ *
+ * Creates a writer which persists status XML of domains scheduled by
+ * virDomainStatusWriterSchedule from a dedicated thread.
+ *
+ * Returns a new writer or NULL on error.
+ */
+virDomainStatusWriterPtr
+virDomainStatusWriterNew(virDomainXMLOptionPtr xmlopt,
+                         const char *statusDir,
+                         unsigned int delay)
+{
+    virDomainStatusWriterPtr writer = g_new0(virDomainStatusWriter, 1);
+
+    if (virMutexInit(&writer->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to init status writer mutex"));
+        VIR_FREE(writer);
+        return NULL;
+    }
+
+    if (virCondInit(&writer->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to init status writer condition"));
+        virMutexDestroy(&writer->lock);
+        VIR_FREE(writer);
+        return NULL;
+    }
+
+    if (virCondInit(&writer->idle) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to init status writer condition"));
+        virCondDestroy(&writer->cond);
+        virMutexDestroy(&writer->lock);
+        VIR_FREE(writer);
+        return NULL;
+    }
+
+    writer->xmlopt = virObjectRef(xmlopt);
+    writer->statusDir = g_strdup(statusDir);
+    writer->delay = delay;
+
+    if (virThreadCreateFull(&writer->thread, true,
+                            virDomainStatusWriterWorker,
+                            "dom-status", false, writer) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create status writer thread"));
+        virObjectUnref(writer->xmlopt);
+        VIR_FREE(writer->statusDir);
+        virCondDestroy(&writer->idle);
+        virCondDestroy(&writer->cond);
+        virMutexDestroy(&writer->lock);
+        VIR_FREE(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+
+/**
+ * virDomainStatusWriterFree:
+ * @writer: status writer
+ *
+ * Writes everything still queued and frees @writer.
+ */
+void
+virDomainStatusWriterFree(virDomainStatusWriterPtr writer)
+{
+    if (!writer)
+        return;
+
+    virMutexLock(&writer->lock);
+    writer->quit = true;
+    virCondSignal(&writer->cond);
+    virMutexUnlock(&writer->lock);
+
+    virThreadJoin(&writer->thread);
+
+    /* Only left over if the worker failed */
+    virDomainStatusWriterProcess(writer, writer->pending, writer->npending);
+
+    VIR_FREE(writer->pending);
+    VIR_FREE(writer->statusDir);
+    virObjectUnref(writer->xmlopt);
+    virCondDestroy(&writer->idle);
+    virCondDestroy(&writer->cond);
+    virMutexDestroy(&writer->lock);
+    VIR_FREE(writer);
+}
+
+
+/**
+ * virDomainStatusWriterSchedule:
+ * @writer: status writer
+ * @vm: locked domain object
+ *
+ * Queues writing of the status XML of @vm. Nothing is queued if a write
+ * is already pending, the eventual write formats the state @vm is in at
+ * that point.
+ */
+void
+virDomainStatusWriterSchedule(virDomainStatusWriterPtr writer,
+                              virDomainObjPtr vm)
+{
+    if (vm->statusPending)
+        return;
+
+    virMutexLock(&writer->lock);
+    if (VIR_APPEND_ELEMENT_COPY(writer->pending, writer->npending, vm) < 0) {
+        virMutexUnlock(&writer->lock);
+        /* fall back to writing the status right away */
+        if (virDomainObjSave(vm, writer->xmlopt, writer->statusDir) < 0)
+            VIR_WARN("Unable to save status of domain %s", vm->def->name);
+        return;
+    }
+    vm->statusPending = true;
+    virObjectRef(vm);
+    if (writer->npending == 1)
+        virCondSignal(&writer->cond);
+    virMutexUnlock(&writer->lock);
+}
+
+
+/**
+ * virDomainStatusWriterSave:
+ * @writer: status writer
+ * @vm: locked domain object
+ *
+ * Writes the status XML of @vm right away, superseding any write queued
+ * by virDomainStatusWriterSchedule. To be used where the state must hit
+ * the disk before the caller proceeds.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainStatusWriterSave(virDomainStatusWriterPtr writer,
+                          virDomainObjPtr vm)
+{
+    vm->statusPending = false;
+
+    return virDomainObjSave(vm, writer->xmlopt, writer->statusDir);
+}
+
+
+/**
+ * virDomainStatusWriterFlush:
+ * @writer: status writer
+ *
+ * Writes the status of all domains queued by virDomainStatusWriterSchedule
+ * and waits for a batch the worker thread is writing at the moment, so
+ * that every status update scheduled before the call is on disk once it
+ * returns. The caller must not hold any domain object lock.
+ */
+void
+virDomainStatusWriterFlush(virDomainStatusWriterPtr writer)
+{
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+
+    virMutexLock(&writer->lock);
+    vms = g_steal_pointer(&writer->pending);
+    nvms = writer->npending;
+    writer->npending = 0;
+
+    while (writer->busy) {
+        if (virCondWait(&writer->idle, &writer->lock) < 0) {
+            VIR_ERROR(_("unable to wait on status writer condition"));
+            break;
+        }
+    }
+    virMutexUnlock(&writer->lock);
+
+    virDomainStatusWriterProcess(writer, vms, nvms);
+    VIR_FREE(vms);
+}
+
+
+/**
+ * virDomainStatusWriterCancel:
+ * @writer: status writer
+ * @vm: locked domain object
+ *
+ * Drops a pending write of @vm's status, e.g. because the status file is
+ * about to be removed. @vm is removed from the queue of @writer unless
+ * the worker thread took it already, in which case it skips the write.
+ */
+void
+virDomainStatusWriterCancel(virDomainStatusWriterPtr writer,
+                            virDomainObjPtr vm)
+{
+    size_t i;
+
+    if (!vm->statusPending)
+        return;
+
+    vm->statusPending = false;
+
+    virMutexLock(&writer->lock);
+    for (i = 0; i < writer->npending; i++) {
+        if (writer->pending[i] == vm) {
+            VIR_DELETE_ELEMENT(writer->pending, i, writer->npending);
+            /* the caller holds a reference as well */
+            virObjectUnref(vm);
+            break;
+        }
+    }
+    virMutexUnlock(&writer->lock);
+}
@@ -285,6 +285,83 @@ virNWFilterObjTestUnassignDef(virNWFilterObjPtr obj)
 }
 
 
+static bool
+virNWFilterDefIncludesAny(virNWFilterDefPtr def,
+                          virHashTablePtr names)
+{
+    size_t i;
+
+    for (i = 0; i < def->nentries; i++) {
+        virNWFilterIncludeDefPtr inc = def->filterEntries[i]->include;
+
+        if (inc && virHashLookup(names, inc->filterref))
+            return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * virNWFilterObjListGetUpdateDeps:
+ * @nwfilters: the nwfilters to search
+ *
+ * Collect the names of the filters that are currently being updated
+ * or removed, along with the names of all filters referencing any of
+ * them either directly or through other filters. Only bindings whose
+ * filter is in the returned table need to be rebuilt.
+ *
+ * Returns a hash table keyed by filter name, or NULL on error.
+ */
+virHashTablePtr
+virNWFilterObjListGetUpdateDeps(virNWFilterObjListPtr nwfilters)
+{
+    virHashTablePtr deps;
+    virNWFilterObjPtr obj;
+    bool added;
+    size_t i;
+
+    if (!(deps = virHashCreate(0, NULL)))
+        return NULL;
+
+    for (i = 0; i < nwfilters->count; i++) {
+        obj = nwfilters->objs[i];
+        virNWFilterObjLock(obj);
+        if ((obj->newDef || obj->wantRemoved) &&
+            virHashAddEntry(deps, obj->def->name, (void *)~0) < 0) {
+            virNWFilterObjUnlock(obj);
+            goto error;
+        }
+        virNWFilterObjUnlock(obj);
+    }
+
+    /* loops are refused when defining filters, so this terminates
+     * after at most as many passes as the filter tree is deep */
+    do {
+        added = false;
+        for (i = 0; i < nwfilters->count; i++) {
+            obj = nwfilters->objs[i];
+            virNWFilterObjLock(obj);
+            if (!virHashLookup(deps, obj->def->name) &&
+                virNWFilterDefIncludesAny(obj->def, deps)) {
+                if (virHashAddEntry(deps, obj->def->name, (void *)~0) < 0) {
+                    virNWFilterObjUnlock(obj);
+                    goto error;
+                }
+                added = true;
+            }
+            virNWFilterObjUnlock(obj);
+        }
+    } while (added);
+
+    return deps;
+
+ error:
+    virHashFree(deps);
+    return NULL;
+}
+
+
 static bool
 virNWFilterDefEqual(const virNWFilterDef *def1,
                     virNWFilterDefPtr def2)
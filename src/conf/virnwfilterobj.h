@@ -46,6 +46,10 @@ struct _virNWFilterDriverState {
     char *stateDir;
     char *configDir;
     char *bindingDir;
+
+    /* threads applying the rules in virNWFilterBuildAll,
+     * 0 for the default */
+    size_t buildWorkers;
 };
 
 virNWFilterDefPtr
@@ -86,6 +90,9 @@ virNWFilterObjListAssignDef(virNWFilterObjListPtr nwfilters,
 int
 virNWFilterObjTestUnassignDef(virNWFilterObjPtr obj);
 
+virHashTablePtr
+virNWFilterObjListGetUpdateDeps(virNWFilterObjListPtr nwfilters);
+
 typedef bool
 (*virNWFilterObjListFilter)(virConnectPtr conn,
                             virNWFilterDefPtr def);
@@ -94,6 +94,11 @@ struct _virStoragePoolObj {
     virStoragePoolDefPtr newDef;
 
     virStorageVolObjListPtr volumes;
+
+    /* backend private data describing the volumes, kept across
+     * refreshes of the pool */
+    void *volCache;
+    virFreeCallback volCacheFree;
 };
 
 struct _virStoragePoolObjList {
@@ -367,6 +372,35 @@ virStoragePoolObjDecrAsyncjobs(virStoragePoolObjPtr obj)
 }
 
 
+void *
+virStoragePoolObjGetVolCache(virStoragePoolObjPtr obj)
+{
+    return obj->volCache;
+}
+
+
+/**
+ * virStoragePoolObjSetVolCache:
+ * @obj: pool object
+ * @cache: backend data to keep, or NULL
+ * @cacheFree: function to free @cache with
+ *
+ * Store data a backend wants to keep across refreshes of the pool,
+ * freeing the data stored before, if any.
+ */
+void
+virStoragePoolObjSetVolCache(virStoragePoolObjPtr obj,
+                             void *cache,
+                             virFreeCallback cacheFree)
+{
+    if (obj->volCache && obj->volCacheFree)
+        obj->volCacheFree(obj->volCache);
+
+    obj->volCache = cache;
+    obj->volCacheFree = cacheFree;
+}
+
+
 void
 virStoragePoolObjDispose(void *opaque)
 {
@@ -374,6 +408,7 @@ virStoragePoolObjDispose(void *opaque)
 
     virStoragePoolObjClearVols(obj);
     virObjectUnref(obj->volumes);
+    virStoragePoolObjSetVolCache(obj, NULL, NULL);
 
     virStoragePoolDefFree(obj->def);
     virStoragePoolDefFree(obj->newDef);
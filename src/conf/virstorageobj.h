@@ -116,6 +116,14 @@ virStoragePoolObjIncrAsyncjobs(virStoragePoolObjPtr obj);
 void
 virStoragePoolObjDecrAsyncjobs(virStoragePoolObjPtr obj);
 
+void *
+virStoragePoolObjGetVolCache(virStoragePoolObjPtr obj);
+
+void
+virStoragePoolObjSetVolCache(virStoragePoolObjPtr obj,
+                             void *cache,
+                             virFreeCallback cacheFree);
+
 int
 virStoragePoolObjLoadAllConfigs(virStoragePoolObjListPtr pools,
                                 const char *configDir,
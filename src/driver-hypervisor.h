@@ -1260,6 +1260,12 @@ typedef int
                                   virDomainStatsRecordPtr **retStats,
                                   unsigned int flags);
 
+typedef int
+(*virDrvConnectSetAllDomainStatsEvents)(virConnectPtr conn,
+                                        unsigned int stats,
+                                        unsigned int interval,
+                                        unsigned int flags);
+
 typedef int
 (*virDrvNodeAllocPages)(virConnectPtr conn,
                         unsigned int npages,
@@ -1650,4 +1656,5 @@ struct _virHypervisorDriver {
     virDrvDomainAgentSetResponseTimeout domainAgentSetResponseTimeout;
     virDrvDomainBackupBegin domainBackupBegin;
     virDrvDomainBackupGetXMLDesc domainBackupGetXMLDesc;
+    virDrvConnectSetAllDomainStatsEvents connectSetAllDomainStatsEvents;
 };
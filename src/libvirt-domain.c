@@ -11705,6 +11705,12 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_PARALLEL in @flags allows
+ * the hypervisor driver to gather statistics of several domains
+ * concurrently. Drivers may bound the time spent waiting for a busy
+ * domain in that case and return only the subset of statistics
+ * described above for it.
+ *
  * Similarly to virConnectListAllDomains, @flags can contain various flags to
  * filter the list of domains to provide stats for.
  *
@@ -11795,6 +11801,12 @@ virConnectGetAllDomainStats(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_PARALLEL in @flags allows
+ * the hypervisor driver to gather statistics of several domains
+ * concurrently. Drivers may bound the time spent waiting for a busy
+ * domain in that case and return only the subset of statistics
+ * described above for it.
+ *
  * Note that any of the domain list filtering flags in @flags may be rejected
  * by this function.
  *
@@ -11864,6 +11876,73 @@ virDomainListGetStats(virDomainPtr *doms,
 }
 
 
+/**
+ * virConnectSetAllDomainStatsEvents:
+ * @conn: pointer to the hypervisor connection
+ * @stats: stats to report, binary-OR of virDomainStatsTypes
+ * @interval: period between two collections in seconds, 0 to disable
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Makes the hypervisor driver periodically collect the statistics groups
+ * selected by @stats (as documented in virConnectGetAllDomainStats) for
+ * all running domains every @interval seconds. Instead of returning the
+ * statistics to the caller, the driver emits a
+ * VIR_DOMAIN_EVENT_ID_STATS_CHANGE event for each domain whose statistics
+ * changed since the previous collection. The event carries only the
+ * typed parameters which are new or whose value differs from the value
+ * reported in the previous event for that domain, so applications have
+ * to merge consecutive events to obtain the full set of statistics. The
+ * first event emitted for a domain after calling this API, and any event
+ * following the disappearance of some statistics, contains all of the
+ * collected statistics and has the VIR_DOMAIN_STATS_CHANGE_FULL
+ * parameter set.
+ *
+ * Using 0 for @stats collects all stats groups supported by the given
+ * hypervisor.
+ *
+ * The setting belongs to @conn, calling this API again replaces it and
+ * it is dropped when @conn is closed. Passing 0 as @interval stops the
+ * periodic collection for @conn. The events are delivered only to
+ * callbacks registered on @conn and carry only the stats groups @conn
+ * asked for. As with virConnectGetAllDomainStats, read-only connections
+ * may use this API and the events are emitted only for the domains the
+ * connection is allowed to read. If several connections request the
+ * events, the driver collects the statistics at the shortest requested
+ * interval, so a connection may receive events more often than it
+ * asked for.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virConnectSetAllDomainStatsEvents(virConnectPtr conn,
+                                  unsigned int stats,
+                                  unsigned int interval,
+                                  unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, stats=0x%x, interval=%u, flags=0x%x",
+              conn, stats, interval, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+
+    if (conn->driver->connectSetAllDomainStatsEvents) {
+        int ret;
+        ret = conn->driver->connectSetAllDomainStatsEvents(conn, stats,
+                                                           interval, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainStatsRecordListFree:
  * @stats: NULL terminated array of virDomainStatsRecords to free
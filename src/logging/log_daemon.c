@@ -160,6 +160,8 @@ virLogDaemonNew(virLogDaemonConfigPtr config, bool privileged)
     if (!(logd->handler = virLogHandlerNew(privileged,
                                            config->max_size,
                                            config->max_backups,
+                                           config->buffer_size,
+                                           config->compress_backups,
                                            virLogDaemonInhibitor,
                                            logd)))
         goto error;
@@ -252,6 +254,8 @@ virLogDaemonNewPostExecRestart(virJSONValuePtr object, bool privileged,
                                                           privileged,
                                                           config->max_size,
                                                           config->max_backups,
+                                                          config->buffer_size,
+                                                          config->compress_backups,
                                                           virLogDaemonInhibitor,
                                                           logd)))
         goto error;
@@ -65,6 +65,7 @@ virLogDaemonConfigNew(bool privileged G_GNUC_UNUSED)
     data->admin_max_clients = 5000;
     data->max_size = 1024 * 1024 * 2;
     data->max_backups = 3;
+    data->buffer_size = 0;
 
     return data;
 }
@@ -99,6 +100,10 @@ virLogDaemonConfigLoadOptions(virLogDaemonConfigPtr data,
         return -1;
     if (virConfGetValueSizeT(conf, "max_backups", &data->max_backups) < 0)
         return -1;
+    if (virConfGetValueSizeT(conf, "buffer_size", &data->buffer_size) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "compress_backups", &data->compress_backups) < 0)
+        return -1;
 
     return 0;
 }
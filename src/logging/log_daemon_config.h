@@ -35,6 +35,8 @@ struct _virLogDaemonConfig {
 
     size_t max_backups;
     size_t max_size;
+    size_t buffer_size;
+    bool compress_backups;
 };
 
 
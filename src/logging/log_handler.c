@@ -30,10 +30,10 @@
 #include "virrotatingfile.h"
 #include "viruuid.h"
 #include "virutil.h"
+#include "virhash.h"
 
 #include <unistd.h>
 #include <fcntl.h>
-#include <poll.h>
 
 #include "configmake.h"
 
@@ -43,18 +43,37 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Size of a single read from the guest log pipe; matches the default
+ * pipe capacity so that a full pipe is emptied by one read */
+#define VIR_LOG_HANDLER_READ_SIZE (64 * 1024)
+
+/* Maximum amount of data copied from one pipe per event loop wakeup so
+ * that a chatty guest can not starve the others */
+#define VIR_LOG_HANDLER_READ_BUDGET (4 * VIR_LOG_HANDLER_READ_SIZE)
+
+/* Longest time in milliseconds buffered log data waits to be written */
+#define VIR_LOG_HANDLER_FLUSH_INTERVAL 1000
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 typedef virLogHandlerLogFile *virLogHandlerLogFilePtr;
 
 struct _virLogHandlerLogFile {
-    virRotatingFileWriterPtr file;
-    int watch;
-    int pipefd; /* Read from QEMU via this */
-    bool drained;
+    virObjectLockable parent;
 
+    /* Immutable, the handler outlives its files */
+    virLogHandlerPtr handler;
+    char *path;
     char *driver;
     unsigned char domuuid[VIR_UUID_BUFLEN];
     char *domname;
+
+    /* Protected by the file lock */
+    virRotatingFileWriterPtr file;
+    int watch;
+    int timer; /* flushes the write buffer of 'file' */
+    bool flushScheduled;
+    int pipefd; /* Read from QEMU via this */
+    bool closed;
 };
 
 struct _virLogHandler {
@@ -63,16 +82,21 @@ struct _virLogHandler {
     bool privileged;
     size_t max_size;
     size_t max_backups;
+    size_t buffer_size;
+    bool compress;
 
-    virLogHandlerLogFilePtr *files;
-    size_t nfiles;
+    /* path -> virLogHandlerLogFilePtr, protected by the handler lock.
+     * Lock ordering is handler before file. */
+    virHashTablePtr files;
 
     virLogHandlerShutdownInhibitor inhibitor;
     void *opaque;
 };
 
 static virClassPtr virLogHandlerClass;
+static virClassPtr virLogHandlerLogFileClass;
 static void virLogHandlerDispose(void *obj);
+static void virLogHandlerLogFileDispose(void *obj);
 
 static int
 virLogHandlerOnceInit(void)
@@ -80,110 +104,301 @@ virLogHandlerOnceInit(void)
     if (!VIR_CLASS_NEW(virLogHandler, virClassForObjectLockable()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virLogHandlerLogFile, virClassForObjectLockable()))
+        return -1;
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virLogHandler);
 
 
+static virLogHandlerLogFilePtr
+virLogHandlerLogFileNew(virLogHandlerPtr handler,
+                        const char *path)
+{
+    virLogHandlerLogFilePtr file;
+
+    if (!(file = virObjectLockableNew(virLogHandlerLogFileClass)))
+        return NULL;
+
+    file->handler = handler;
+    file->path = g_strdup(path);
+    file->watch = -1;
+    file->timer = -1;
+    file->pipefd = -1;
+
+    return file;
+}
+
+
 static void
-virLogHandlerLogFileFree(virLogHandlerLogFilePtr file)
+virLogHandlerLogFileDispose(void *obj)
 {
-    if (!file)
-        return;
+    virLogHandlerLogFilePtr file = obj;
 
     VIR_FORCE_CLOSE(file->pipefd);
     virRotatingFileWriterFree(file->file);
 
-    if (file->watch != -1)
-        virEventRemoveHandle(file->watch);
-
+    VIR_FREE(file->path);
     VIR_FREE(file->driver);
     VIR_FREE(file->domname);
-    VIR_FREE(file);
 }
 
 
+/* Stops capturing the log pipe of a locked @file. Returns true if the
+ * file was still open. */
+static bool
+virLogHandlerLogFileShutdown(virLogHandlerLogFilePtr file)
+{
+    if (file->closed)
+        return false;
+
+    file->closed = true;
+
+    if (file->watch != -1) {
+        virEventRemoveHandle(file->watch);
+        file->watch = -1;
+    }
+
+    if (file->timer != -1) {
+        virEventRemoveTimeout(file->timer);
+        file->timer = -1;
+    }
+
+    VIR_FORCE_CLOSE(file->pipefd);
+    virRotatingFileWriterFree(file->file);
+    file->file = NULL;
+
+    return true;
+}
+
+
+/* The file is shut down before it's removed from the table so that
+ * a log file not in the table is never written by anyone holding the
+ * handler lock, see virLogHandlerDomainAppendLogFile. */
 static void
 virLogHandlerLogFileClose(virLogHandlerPtr handler,
                           virLogHandlerLogFilePtr file)
 {
-    size_t i;
+    bool wasOpen;
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (handler->files[i] == file) {
-            VIR_DELETE_ELEMENT(handler->files, i, handler->nfiles);
-            virLogHandlerLogFileFree(file);
-            break;
-        }
+    virObjectLock(handler);
+    virObjectLock(file);
+    wasOpen = virLogHandlerLogFileShutdown(file);
+    virObjectUnlock(file);
+
+    if (virHashLookup(handler->files, file->path) == file)
+        virHashRemoveEntry(handler->files, file->path);
+    virObjectUnlock(handler);
+
+    if (wasOpen)
+        handler->inhibitor(false, handler->opaque);
+}
+
+
+static virRotatingFileWriterPtr
+virLogHandlerWriterNew(virLogHandlerPtr handler,
+                       const char *path,
+                       bool trunc,
+                       bool buffered)
+{
+    virRotatingFileWriterPtr writer;
+
+    if (!(writer = virRotatingFileWriterNew(path,
+                                            handler->max_size,
+                                            handler->max_backups,
+                                            trunc,
+                                            DEFAULT_MODE)))
+        return NULL;
+
+    virRotatingFileWriterSetCompress(writer, handler->compress);
+
+    if (buffered &&
+        virRotatingFileWriterSetBufferSize(writer, handler->buffer_size) < 0) {
+        virRotatingFileWriterFree(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+
+/* Makes sure buffered data of a locked @file hits the disk soon */
+static void
+virLogHandlerLogFileScheduleFlush(virLogHandlerLogFilePtr file)
+{
+    if (file->timer == -1 || file->flushScheduled ||
+        virRotatingFileWriterGetPending(file->file) == 0)
+        return;
+
+    virEventUpdateTimeout(file->timer, VIR_LOG_HANDLER_FLUSH_INTERVAL);
+    file->flushScheduled = true;
+}
+
+
+/* Writes out buffered data of a locked @file */
+static int
+virLogHandlerLogFileFlush(virLogHandlerLogFilePtr file)
+{
+    if (file->flushScheduled) {
+        virEventUpdateTimeout(file->timer, -1);
+        file->flushScheduled = false;
     }
+
+    return virRotatingFileWriterFlush(file->file);
 }
 
 
+static void
+virLogHandlerLogFileFlushTimer(int timer G_GNUC_UNUSED,
+                               void *opaque)
+{
+    virLogHandlerLogFilePtr file = opaque;
+
+    virObjectLock(file);
+    if (!file->closed &&
+        virLogHandlerLogFileFlush(file) < 0)
+        VIR_WARN("Unable to flush log file %s: %s",
+                 file->path, virGetLastErrorMessage());
+    virObjectUnlock(file);
+}
+
+
+/* Returns a reference to the open log file for @path, or NULL */
 static virLogHandlerLogFilePtr
-virLogHandlerGetLogFileFromWatch(virLogHandlerPtr handler,
-                                 int watch)
+virLogHandlerLookupLogFile(virLogHandlerPtr handler,
+                           const char *path)
 {
-    size_t i;
+    virLogHandlerLogFilePtr file;
+
+    virObjectLock(handler);
+    file = virObjectRef(virHashLookup(handler->files, path));
+    virObjectUnlock(handler);
+
+    return file;
+}
+
+
+/*
+ * Copies data from the pipe of a locked @file into the log until the
+ * pipe is empty or @budget bytes were moved.
+ *
+ * Returns 1 once the writing end was closed and everything was read,
+ * 0 when the pipe is empty or the budget is used up, and -1 on error.
+ */
+static int
+virLogHandlerLogFileDrain(virLogHandlerLogFilePtr file,
+                          size_t budget)
+{
+    char buf[VIR_LOG_HANDLER_READ_SIZE];
+    size_t total = 0;
+
+    while (total < budget) {
+        ssize_t len = read(file->pipefd, buf, sizeof(buf));
+
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (handler->files[i]->watch == watch)
-            return handler->files[i];
+            virReportSystemError(errno, "%s",
+                                 _("Unable to read from log pipe"));
+            return -1;
+        }
+
+        if (len == 0)
+            return 1;
+
+        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
+            return -1;
+
+        total += len;
+
+        /* A short read means the pipe was emptied, save the
+         * read which would just return EAGAIN */
+        if ((size_t) len < sizeof(buf))
+            return 0;
     }
 
-    return NULL;
+    return 0;
 }
 
 
 static void
 virLogHandlerDomainLogFileEvent(int watch,
                                 int fd,
-                                int events,
+                                int events G_GNUC_UNUSED,
                                 void *opaque)
 {
-    virLogHandlerPtr handler = opaque;
-    virLogHandlerLogFilePtr logfile;
-    char buf[1024];
-    ssize_t len;
+    virLogHandlerLogFilePtr file = opaque;
+    int rc;
 
-    virObjectLock(handler);
-    logfile = virLogHandlerGetLogFileFromWatch(handler, watch);
-    if (!logfile || logfile->pipefd != fd) {
-        virEventRemoveHandle(watch);
-        virObjectUnlock(handler);
+    virObjectLock(file);
+    if (file->closed || file->watch != watch || file->pipefd != fd) {
+        virObjectUnlock(file);
         return;
     }
 
-    if (logfile->drained) {
-        logfile->drained = false;
-        goto cleanup;
-    }
+    /* Hangup is not acted upon directly, it is followed by EOF once
+     * the remaining data was read */
+    rc = virLogHandlerLogFileDrain(file, VIR_LOG_HANDLER_READ_BUDGET);
+    if (rc == 0)
+        virLogHandlerLogFileScheduleFlush(file);
+    virObjectUnlock(file);
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
+    if (rc != 0)
+        virLogHandlerLogFileClose(file->handler, file);
+}
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
-    }
 
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
-        goto error;
+/* Registers @file, which is not yet visible to anyone else, with
+ * @handler and starts capturing its pipe. Called with the handler
+ * locked. */
+static int
+virLogHandlerLogFileAdd(virLogHandlerPtr handler,
+                        virLogHandlerLogFilePtr file)
+{
+    int watch;
 
-    if (events & VIR_EVENT_HANDLE_HANGUP)
-        goto error;
+    if (virSetNonBlock(file->pipefd) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set log pipe non-blocking"));
+        return -1;
+    }
 
- cleanup:
-    virObjectUnlock(handler);
-    return;
+    if (virHashAddEntry(handler->files, file->path, file) < 0)
+        return -1;
+    virObjectRef(file);
+
+    /* The event callback may run as soon as the handle is added */
+    virObjectLock(file);
+    if ((watch = virEventAddHandle(file->pipefd,
+                                   VIR_EVENT_HANDLE_READABLE,
+                                   virLogHandlerDomainLogFileEvent,
+                                   virObjectRef(file),
+                                   virObjectFreeCallback)) < 0) {
+        virObjectUnlock(file);
+        virObjectUnref(file);
+        virHashRemoveEntry(handler->files, file->path);
+        return -1;
+    }
+    file->watch = watch;
+
+    if (handler->buffer_size > 0 &&
+        (file->timer = virEventAddTimeout(-1,
+                                          virLogHandlerLogFileFlushTimer,
+                                          virObjectRef(file),
+                                          virObjectFreeCallback)) < 0) {
+        virObjectUnref(file);
+        VIR_WARN("Unable to add flush timer for %s, not buffering",
+                 file->path);
+        ignore_value(virRotatingFileWriterSetBufferSize(file->file, 0));
+    }
+    virObjectUnlock(file);
 
- error:
-    handler->inhibitor(false, handler->opaque);
-    virLogHandlerLogFileClose(handler, logfile);
-    virObjectUnlock(handler);
+    return 0;
 }
 
 
@@ -191,6 +406,8 @@ virLogHandlerPtr
 virLogHandlerNew(bool privileged,
                  size_t max_size,
                  size_t max_backups,
+                 size_t buffer_size,
+                 bool compress,
                  virLogHandlerShutdownInhibitor inhibitor,
                  void *opaque)
 {
@@ -205,9 +422,16 @@ virLogHandlerNew(bool privileged,
     handler->privileged = privileged;
     handler->max_size = max_size;
     handler->max_backups = max_backups;
+    handler->buffer_size = buffer_size;
+    handler->compress = compress;
     handler->inhibitor = inhibitor;
     handler->opaque = opaque;
 
+    if (!(handler->files = virHashNew(virObjectFreeHashData))) {
+        virObjectUnref(handler);
+        return NULL;
+    }
+
     return handler;
 }
 
@@ -216,14 +440,11 @@ static virLogHandlerLogFilePtr
 virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
                                     virJSONValuePtr object)
 {
-    virLogHandlerLogFilePtr file;
+    virLogHandlerLogFilePtr file = NULL;
     const char *path;
     const char *domuuid;
     const char *tmp;
 
-    if (VIR_ALLOC(file) < 0)
-        return NULL;
-
     handler->inhibitor(true, handler->opaque);
 
     if ((path = virJSONValueObjectGetString(object, "path")) == NULL) {
@@ -232,6 +453,9 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
         goto error;
     }
 
+    if (!(file = virLogHandlerLogFileNew(handler, path)))
+        goto error;
+
     if ((tmp = virJSONValueObjectGetString(object, "driver")) == NULL) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Missing 'driver' in JSON document"));
@@ -257,11 +481,7 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
         goto error;
     }
 
-    if ((file->file = virRotatingFileWriterNew(path,
-                                               handler->max_size,
-                                               handler->max_backups,
-                                               false,
-                                               DEFAULT_MODE)) == NULL)
+    if (!(file->file = virLogHandlerWriterNew(handler, path, false, true)))
         goto error;
 
     if (virJSONValueObjectGetNumberInt(object, "pipefd", &file->pipefd) < 0) {
@@ -279,7 +499,7 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
 
  error:
     handler->inhibitor(false, handler->opaque);
-    virLogHandlerLogFileFree(file);
+    virObjectUnref(file);
     return NULL;
 }
 
@@ -289,6 +509,8 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
                                 bool privileged,
                                 size_t max_size,
                                 size_t max_backups,
+                                size_t buffer_size,
+                                bool compress,
                                 virLogHandlerShutdownInhibitor inhibitor,
                                 void *opaque)
 {
@@ -299,6 +521,8 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
     if (!(handler = virLogHandlerNew(privileged,
                                      max_size,
                                      max_backups,
+                                     buffer_size,
+                                     compress,
                                      inhibitor,
                                      opaque)))
         return NULL;
@@ -315,26 +539,26 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
         goto error;
     }
 
+    virObjectLock(handler);
     for (i = 0; i < virJSONValueArraySize(files); i++) {
         virLogHandlerLogFilePtr file;
         virJSONValuePtr child = virJSONValueArrayGet(files, i);
+        int rc;
 
-        if (!(file = virLogHandlerLogFilePostExecRestart(handler, child)))
-            goto error;
-
-        if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0)
+        if (!(file = virLogHandlerLogFilePostExecRestart(handler, child))) {
+            virObjectUnlock(handler);
             goto error;
+        }
 
-        if ((file->watch = virEventAddHandle(file->pipefd,
-                                             VIR_EVENT_HANDLE_READABLE,
-                                             virLogHandlerDomainLogFileEvent,
-                                             handler,
-                                             NULL)) < 0) {
-            VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
+        rc = virLogHandlerLogFileAdd(handler, file);
+        virObjectUnref(file);
+        if (rc < 0) {
+            handler->inhibitor(false, handler->opaque);
+            virObjectUnlock(handler);
             goto error;
         }
     }
-
+    virObjectUnlock(handler);
 
     return handler;
 
@@ -344,17 +568,33 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
 }
 
 
+static int
+virLogHandlerDisposeFile(void *payload,
+                         const void *name G_GNUC_UNUSED,
+                         void *opaque)
+{
+    virLogHandlerLogFilePtr file = payload;
+    virLogHandlerPtr handler = opaque;
+    bool wasOpen;
+
+    virObjectLock(file);
+    wasOpen = virLogHandlerLogFileShutdown(file);
+    virObjectUnlock(file);
+
+    if (wasOpen)
+        handler->inhibitor(false, handler->opaque);
+
+    return 0;
+}
+
+
 static void
 virLogHandlerDispose(void *obj)
 {
     virLogHandlerPtr handler = obj;
-    size_t i;
 
-    for (i = 0; i < handler->nfiles; i++) {
-        handler->inhibitor(false, handler->opaque);
-        virLogHandlerLogFileFree(handler->files[i]);
-    }
-    VIR_FREE(handler->files);
+    virHashForEach(handler->files, virLogHandlerDisposeFile, handler);
+    virHashFree(handler->files);
 }
 
 
@@ -368,7 +608,6 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
                                ino_t *inode,
                                off_t *offset)
 {
-    size_t i;
     virLogHandlerLogFilePtr file = NULL;
     int pipefd[2] = { -1, -1 };
 
@@ -376,51 +615,37 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
 
     handler->inhibitor(true, handler->opaque);
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
-                  path)) {
-            virReportSystemError(EBUSY,
-                                 _("Cannot open log file: '%s'"),
-                                 path);
-            goto error;
-        }
+    if (virHashLookup(handler->files, path)) {
+        virReportSystemError(EBUSY,
+                             _("Cannot open log file: '%s'"),
+                             path);
+        goto error;
     }
 
     if (virPipe(pipefd) < 0)
         goto error;
 
-    if (VIR_ALLOC(file) < 0)
+    if (!(file = virLogHandlerLogFileNew(handler, path)))
         goto error;
 
-    file->watch = -1;
     file->pipefd = pipefd[0];
     pipefd[0] = -1;
     memcpy(file->domuuid, domuuid, VIR_UUID_BUFLEN);
     file->driver = g_strdup(driver);
     file->domname = g_strdup(domname);
 
-    if ((file->file = virRotatingFileWriterNew(path,
-                                               handler->max_size,
-                                               handler->max_backups,
-                                               trunc,
-                                               DEFAULT_MODE)) == NULL)
-        goto error;
-
-    if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0)
+    if (!(file->file = virLogHandlerWriterNew(handler, path, trunc, true)))
         goto error;
 
-    if ((file->watch = virEventAddHandle(file->pipefd,
-                                         VIR_EVENT_HANDLE_READABLE,
-                                         virLogHandlerDomainLogFileEvent,
-                                         handler,
-                                         NULL)) < 0) {
-        VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
-        goto error;
-    }
-
+    /* Nothing was written to the pipe yet so the file can not be
+     * touched by the event callback here */
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
 
+    if (virLogHandlerLogFileAdd(handler, file) < 0)
+        goto error;
+
+    virObjectUnref(file);
     virObjectUnlock(handler);
     return pipefd[1];
 
@@ -428,50 +653,12 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
     VIR_FORCE_CLOSE(pipefd[0]);
     VIR_FORCE_CLOSE(pipefd[1]);
     handler->inhibitor(false, handler->opaque);
-    virLogHandlerLogFileFree(file);
+    virObjectUnref(file);
     virObjectUnlock(handler);
     return -1;
 }
 
 
-static void
-virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
-{
-    char buf[1024];
-    ssize_t len;
-    struct pollfd pfd;
-    int ret;
-
-    for (;;) {
-        pfd.fd = file->pipefd;
-        pfd.events = POLLIN;
-        pfd.revents = 0;
-
-        ret = poll(&pfd, 1, 0);
-        if (ret < 0) {
-            if (errno == EINTR)
-                continue;
-
-            return;
-        }
-
-        if (ret == 0)
-            return;
-
-        len = read(file->pipefd, buf, sizeof(buf));
-        file->drained = true;
-        if (len < 0) {
-            if (errno == EINTR)
-                continue;
-            return;
-        }
-
-        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
-            return;
-    }
-}
-
-
 int
 virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
                                       const char *path,
@@ -481,28 +668,31 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
 {
     virLogHandlerLogFilePtr file = NULL;
     int ret = -1;
-    size_t i;
 
     virCheckFlags(0, -1);
 
-    virObjectLock(handler);
-
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
-                  path)) {
-            file = handler->files[i];
-            break;
-        }
+    if (!(file = virLogHandlerLookupLogFile(handler, path))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("No open log file %s"),
+                       path);
+        return -1;
     }
 
-    if (!file) {
+    virObjectLock(file);
+
+    if (file->closed) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("No open log file %s"),
                        path);
         goto cleanup;
     }
 
-    virLogHandlerDomainLogFileDrain(file);
+    /* Whatever the guest wrote so far must be accounted for and be
+     * readable from the file. Errors and EOF of the pipe are dealt with
+     * by the event callback. */
+    ignore_value(virLogHandlerLogFileDrain(file, SIZE_MAX));
+    if (virLogHandlerLogFileFlush(file) < 0)
+        goto cleanup;
 
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
@@ -510,7 +700,8 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
     ret = 0;
 
  cleanup:
-    virObjectUnlock(handler);
+    virObjectUnlock(file);
+    virObjectUnref(file);
     return ret;
 }
 
@@ -524,13 +715,28 @@ virLogHandlerDomainReadLogFile(virLogHandlerPtr handler,
                                unsigned int flags)
 {
     virRotatingFileReaderPtr file = NULL;
+    virLogHandlerLogFilePtr logfile;
     char *data = NULL;
     ssize_t got;
 
     virCheckFlags(0, NULL);
 
-    virObjectLock(handler);
+    /* Buffered data must hit the disk for the reader to see it */
+    if ((logfile = virLogHandlerLookupLogFile(handler, path))) {
+        int rc = 0;
 
+        virObjectLock(logfile);
+        if (!logfile->closed)
+            rc = virLogHandlerLogFileFlush(logfile);
+        virObjectUnlock(logfile);
+        virObjectUnref(logfile);
+
+        if (rc < 0)
+            return NULL;
+    }
+
+    /* The reader only touches the files on disk, no need to serialize
+     * it with capturing of the logs */
     if (!(file = virRotatingFileReaderNew(path, handler->max_backups)))
         goto error;
 
@@ -546,17 +752,43 @@ virLogHandlerDomainReadLogFile(virLogHandlerPtr handler,
     data[got] = '\0';
 
     virRotatingFileReaderFree(file);
-    virObjectUnlock(handler);
     return data;
 
  error:
     VIR_FREE(data);
     virRotatingFileReaderFree(file);
-    virObjectUnlock(handler);
     return NULL;
 }
 
 
+/*
+ * Appends @message to the log of @file unless the file was closed.
+ *
+ * Returns 1 if @message was appended, 0 if @file is closed and -1 on
+ * error.
+ */
+static int
+virLogHandlerLogFileAppend(virLogHandlerLogFilePtr file,
+                           const char *message)
+{
+    int ret = 0;
+
+    virObjectLock(file);
+    if (!file->closed) {
+        if (virRotatingFileWriterAppend(file->file, message,
+                                        strlen(message)) < 0) {
+            ret = -1;
+        } else {
+            virLogHandlerLogFileScheduleFlush(file);
+            ret = 1;
+        }
+    }
+    virObjectUnlock(file);
+
+    return ret;
+}
+
+
 int
 virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
                                  const char *driver G_GNUC_UNUSED,
@@ -566,97 +798,126 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
                                  const char *message,
                                  unsigned int flags)
 {
-    size_t i;
-    virRotatingFileWriterPtr writer = NULL;
+    virLogHandlerLogFilePtr file = NULL;
     virRotatingFileWriterPtr newwriter = NULL;
+    int appended;
     int ret = -1;
 
     virCheckFlags(0, -1);
 
     VIR_DEBUG("Appending to log '%s' message: '%s'", path, message);
 
-    virObjectLock(handler);
-
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file), path)) {
-            writer = handler->files[i]->file;
-            break;
-        }
+    /* Appending to a log file with an open pipe doesn't need the
+     * handler lock */
+    if ((file = virLogHandlerLookupLogFile(handler, path))) {
+        appended = virLogHandlerLogFileAppend(file, message);
+        virObjectUnref(file);
+        if (appended != 0)
+            return appended < 0 ? -1 : 0;
     }
 
-    if (!writer) {
-        if (!(newwriter = virRotatingFileWriterNew(path,
-                                                   handler->max_size,
-                                                   handler->max_backups,
-                                                   false,
-                                                   DEFAULT_MODE)))
-            goto cleanup;
+    /* Otherwise the file is written directly, holding the handler lock
+     * so that nobody opens it meanwhile. It might have been opened
+     * since the lookup though. */
+    virObjectLock(handler);
 
-        writer = newwriter;
+    if ((file = virHashLookup(handler->files, path)) &&
+        (appended = virLogHandlerLogFileAppend(file, message)) != 0) {
+        ret = appended < 0 ? -1 : 0;
+        goto cleanup;
     }
 
-    if (virRotatingFileWriterAppend(writer, message, strlen(message)) < 0)
+    if (!(newwriter = virLogHandlerWriterNew(handler, path, false, false)))
+        goto cleanup;
+
+    if (virRotatingFileWriterAppend(newwriter, message,
+                                    strlen(message)) < 0)
         goto cleanup;
 
     ret = 0;
 
  cleanup:
-    virRotatingFileWriterFree(newwriter);
     virObjectUnlock(handler);
+    virRotatingFileWriterFree(newwriter);
     return ret;
 }
 
 
-virJSONValuePtr
-virLogHandlerPreExecRestart(virLogHandlerPtr handler)
+static int
+virLogHandlerPreExecRestartFile(void *payload,
+                                const void *name G_GNUC_UNUSED,
+                                void *opaque)
 {
-    virJSONValuePtr ret = virJSONValueNewObject();
-    virJSONValuePtr files;
-    size_t i;
+    virLogHandlerLogFilePtr logfile = payload;
+    virJSONValuePtr files = opaque;
+    virJSONValuePtr file = virJSONValueNewObject();
     char domuuid[VIR_UUID_STRING_BUFLEN];
+    int rc = 0;
 
-    files = virJSONValueNewArray();
+    /* The new daemon starts with an empty write buffer */
+    virObjectLock(logfile);
+    if (!logfile->closed)
+        rc = virLogHandlerLogFileFlush(logfile);
+    virObjectUnlock(logfile);
 
-    if (virJSONValueObjectAppend(ret, "files", files) < 0) {
-        virJSONValueFree(files);
-        goto error;
+    if (rc < 0) {
+        virJSONValueFree(file);
+        return -1;
     }
 
-    for (i = 0; i < handler->nfiles; i++) {
-        virJSONValuePtr file = virJSONValueNewObject();
+    if (virJSONValueArrayAppend(files, file) < 0) {
+        virJSONValueFree(file);
+        return -1;
+    }
 
-        if (virJSONValueArrayAppend(files, file) < 0) {
-            virJSONValueFree(file);
-            goto error;
-        }
+    if (virJSONValueObjectAppendNumberInt(file, "pipefd",
+                                          logfile->pipefd) < 0)
+        return -1;
 
-        if (virJSONValueObjectAppendNumberInt(file, "pipefd",
-                                              handler->files[i]->pipefd) < 0)
-            goto error;
+    if (virJSONValueObjectAppendString(file, "path", logfile->path) < 0)
+        return -1;
 
-        if (virJSONValueObjectAppendString(file, "path",
-                                           virRotatingFileWriterGetPath(handler->files[i]->file)) < 0)
-            goto error;
+    if (virJSONValueObjectAppendString(file, "driver", logfile->driver) < 0)
+        return -1;
 
-        if (virJSONValueObjectAppendString(file, "driver",
-                                           handler->files[i]->driver) < 0)
-            goto error;
+    if (virJSONValueObjectAppendString(file, "domname", logfile->domname) < 0)
+        return -1;
 
-        if (virJSONValueObjectAppendString(file, "domname",
-                                           handler->files[i]->domname) < 0)
-            goto error;
+    virUUIDFormat(logfile->domuuid, domuuid);
+    if (virJSONValueObjectAppendString(file, "domuuid", domuuid) < 0)
+        return -1;
 
-        virUUIDFormat(handler->files[i]->domuuid, domuuid);
-        if (virJSONValueObjectAppendString(file, "domuuid", domuuid) < 0)
-            goto error;
+    if (virSetInherit(logfile->pipefd, true) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot disable close-on-exec flag"));
+        return -1;
+    }
 
-        if (virSetInherit(handler->files[i]->pipefd, true) < 0) {
-            virReportSystemError(errno, "%s",
-                                 _("Cannot disable close-on-exec flag"));
-            goto error;
-        }
+    return 0;
+}
+
+
+virJSONValuePtr
+virLogHandlerPreExecRestart(virLogHandlerPtr handler)
+{
+    virJSONValuePtr ret = virJSONValueNewObject();
+    virJSONValuePtr files;
+    int rc;
+
+    files = virJSONValueNewArray();
+
+    if (virJSONValueObjectAppend(ret, "files", files) < 0) {
+        virJSONValueFree(files);
+        goto error;
     }
 
+    virObjectLock(handler);
+    rc = virHashForEach(handler->files, virLogHandlerPreExecRestartFile, files);
+    virObjectUnlock(handler);
+
+    if (rc < 0)
+        goto error;
+
     return ret;
 
  error:
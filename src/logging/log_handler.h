@@ -33,12 +33,16 @@ typedef void (*virLogHandlerShutdownInhibitor)(bool inhibit,
 virLogHandlerPtr virLogHandlerNew(bool privileged,
                                   size_t max_size,
                                   size_t max_backups,
+                                  size_t buffer_size,
+                                  bool compress,
                                   virLogHandlerShutdownInhibitor inhibitor,
                                   void *opaque);
 virLogHandlerPtr virLogHandlerNewPostExecRestart(virJSONValuePtr child,
                                                  bool privileged,
                                                  size_t max_size,
                                                  size_t max_backups,
+                                                 size_t buffer_size,
+                                                 bool compress,
                                                  virLogHandlerShutdownInhibitor inhibitor,
                                                  void *opaque);
 
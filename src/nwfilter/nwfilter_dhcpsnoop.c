@@ -57,9 +57,11 @@
 #include "virfile.h"
 #include "virsocketaddr.h"
 #include "virthreadpool.h"
+#include "virhostcpu.h"
 #include "configmake.h"
 #include "virtime.h"
 #include "virstring.h"
+#include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -71,18 +73,25 @@ VIR_LOG_INIT("nwfilter.nwfilter_dhcpsnoop");
 # define LEASEFILE LEASEFILE_DIR "nwfilter.leases"
 # define TMPLEASEFILE LEASEFILE_DIR "nwfilter.ltmp"
 
+typedef struct _virNWFilterSnoopCapture virNWFilterSnoopCapture;
+typedef virNWFilterSnoopCapture *virNWFilterSnoopCapturePtr;
+
 struct virNWFilterSnoopState {
     /* lease file */
     int                  leaseFD;
     int                  nLeases; /* number of active leases */
     int                  wLeases; /* number of written leases */
-    int                  nThreads; /* number of running threads */
+    int                  nIfaces; /* number of snooped interfaces */
     /* thread management */
     virHashTablePtr      snoopReqs;
     virHashTablePtr      ifnameToKey;
     virMutex             snoopLock;  /* protects SnoopReqs and IfNameToKey */
     virHashTablePtr      active;
-    virMutex             activeLock; /* protects Active */
+    virMutex             activeLock; /* protects Active and Captures */
+    /* capture threads shared by all interfaces, started on demand */
+    virNWFilterSnoopCapturePtr captures;
+    size_t               nCaptures;
+    virThreadPoolPtr     decodePool;
 };
 
 # define virNWFilterSnoopLock() \
@@ -110,11 +119,8 @@ typedef virNWFilterSnoopReq *virNWFilterSnoopReqPtr;
 typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
 typedef virNWFilterSnoopIPLease *virNWFilterSnoopIPLeasePtr;
 
-typedef enum {
-    THREAD_STATUS_NONE,
-    THREAD_STATUS_OK,
-    THREAD_STATUS_FAIL,
-} virNWFilterSnoopThreadStatus;
+typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
+typedef virNWFilterDHCPDecodeJob *virNWFilterDHCPDecodeJobPtr;
 
 struct _virNWFilterSnoopReq {
     /*
@@ -133,13 +139,21 @@ struct _virNWFilterSnoopReq {
     virNWFilterSnoopIPLeasePtr           start;
     virNWFilterSnoopIPLeasePtr           end;
     char                                *threadkey;
-    virErrorPtr                          threadError;
-
-    virNWFilterSnoopThreadStatus         threadStatus;
-    virCond                              threadStatusCond;
 
     int                                  jobCompletionStatus;
-    /* the number of submitted jobs in the worker's queue */
+    /* the number of submitted jobs in the queue, per direction */
+    int                                  qCtr[2];
+
+    /*
+     * jobs waiting for a decode worker; they are processed
+     * one after another in the order they were queued in
+     */
+    virMutex                             jobLock;
+    virNWFilterDHCPDecodeJobPtr         *jobs;
+    size_t                               njobs;
+    bool                                 jobScheduled;
+    bool                                 timerQueued;
+
     /*
      * protect those members that can change while the
      * req is on the public SnoopReq hash and
@@ -149,7 +163,6 @@ struct _virNWFilterSnoopReq {
      * - start
      * - end
      * - a lease while it is on the list
-     * - threadStatus
      * (for refctr, see above)
      */
     virMutex                             lock;
@@ -226,9 +239,7 @@ G_STATIC_ASSERT(sizeof(struct _virNWFilterSnoopDHCPHdr) == 236);
 # define PCAP_PBUFSIZE              576 /* >= IP/TCP/DHCP headers */
 # define PCAP_READ_MAXERRS          25 /* retries on failing device */
 # define PCAP_FLOOD_TIMEOUT_MS      10 /* ms */
-
-typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
-typedef virNWFilterDHCPDecodeJob *virNWFilterDHCPDecodeJobPtr;
+# define PCAP_BUFSIZE               (256 * 1024) /* kernel capture buffer */
 
 struct _virNWFilterDHCPDecodeJob {
     unsigned char packet[PCAP_PBUFSIZE];
@@ -250,25 +261,81 @@ struct _virNWFilterSnoopRateLimitConf {
     time_t prev;
     unsigned int pkt_ctr;
     time_t burst;
-    const unsigned int rate;
-    const unsigned int burstRate;
-    const unsigned int burstInterval;
+    unsigned int rate;
+    unsigned int burstRate;
+    unsigned int burstInterval;
 };
 # define SNOOP_POLL_MAX_TIMEOUT_MS  (10 * 1000) /* milliseconds */
 
+/* upper limit of threads capturing packets and decoding them */
+# define SNOOP_MAX_CAPTURE_THREADS  4
+
 typedef struct _virNWFilterSnoopPcapConf virNWFilterSnoopPcapConf;
 typedef virNWFilterSnoopPcapConf *virNWFilterSnoopPcapConfPtr;
 
 struct _virNWFilterSnoopPcapConf {
     pcap_t *handle;
-    const pcap_direction_t dir;
+    pcap_direction_t dir;
     const char *filter;
     virNWFilterSnoopRateLimitConf rateLimit; /* indep. rate limiters */
-    int qCtr; /* number of jobs in the worker's queue */
-    const unsigned int maxQSize;
+    unsigned int maxQSize;
     unsigned long long penaltyTimeoutAbs;
 };
 
+static const virNWFilterSnoopPcapConf virNWFilterSnoopPcapConfs[] = {
+    {
+        .dir = PCAP_D_IN, /* from VM */
+        .filter = "dst port 67 and src port 68",
+        .rateLimit = {
+            .rate = DHCP_PKT_RATE,
+            .burstRate = DHCP_PKT_BURST,
+            .burstInterval = DHCP_BURST_INTERVAL_S,
+        },
+        .maxQSize = MAX_QUEUED_JOBS,
+    }, {
+        .dir = PCAP_D_OUT, /* to VM */
+        .filter = "src port 67 and dst port 68",
+        .rateLimit = {
+            .rate = DHCP_PKT_RATE,
+            .burstRate = DHCP_PKT_BURST,
+            .burstInterval = DHCP_BURST_INTERVAL_S,
+        },
+        .maxQSize = MAX_QUEUED_JOBS,
+    },
+};
+
+typedef struct _virNWFilterSnoopIface virNWFilterSnoopIface;
+typedef virNWFilterSnoopIface *virNWFilterSnoopIfacePtr;
+
+/* An interface whose traffic is snooped by one of the capture threads */
+struct _virNWFilterSnoopIface {
+    virNWFilterSnoopReqPtr req; /* holds a reference */
+    char *threadkey;
+    int ifindex;
+    int errcount;
+    bool failed;
+    time_t lastTimerRun;
+    time_t last_displayed;
+    time_t last_displayed_queue;
+    virNWFilterSnoopPcapConf pcapConf[G_N_ELEMENTS(virNWFilterSnoopPcapConfs)];
+};
+
+/*
+ * A capture thread polling the pcap handles of all interfaces assigned
+ * to it. Packets passing the rate limits are queued on their snoop
+ * request and decoded by the shared pool of decode workers.
+ */
+struct _virNWFilterSnoopCapture {
+    virThread thread;
+    int wakeupFD[2];
+
+    virMutex lock; /* protects the members below */
+    virNWFilterSnoopIfacePtr *added; /* not picked up by the thread yet */
+    size_t nadded;
+    size_t nifaces; /* number of interfaces assigned to the thread */
+    bool quit;
+};
+
 /* local function prototypes */
 static int virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReqPtr req,
                                        virSocketAddrPtr ipaddr,
@@ -289,6 +356,19 @@ static struct virNWFilterSnoopState virNWFilterSnoopState = {
 static const unsigned char dhcp_magic[4] = { 99, 130, 83, 99 };
 
 
+/*
+ * Interrupt the poll() of a capture thread so it picks up changes
+ * to the interfaces it is snooping on
+ */
+static void
+virNWFilterSnoopCaptureWakeup(virNWFilterSnoopCapturePtr capture)
+{
+    char c = 0;
+
+    ignore_value(write(capture->wakeupFD[1], &c, 1));
+}
+
+
 static char *
 virNWFilterSnoopActivate(virNWFilterSnoopReqPtr req)
 {
@@ -309,6 +389,8 @@ virNWFilterSnoopActivate(virNWFilterSnoopReqPtr req)
 static void
 virNWFilterSnoopCancel(char **threadKey)
 {
+    size_t i;
+
     if (*threadKey == NULL)
         return;
 
@@ -317,6 +399,10 @@ virNWFilterSnoopCancel(char **threadKey)
     ignore_value(virHashRemoveEntry(virNWFilterSnoopState.active, *threadKey));
     VIR_FREE(*threadKey);
 
+    /* let the capture threads drop the interface right away */
+    for (i = 0; i < virNWFilterSnoopState.nCaptures; i++)
+        virNWFilterSnoopCaptureWakeup(&virNWFilterSnoopState.captures[i]);
+
     virNWFilterSnoopActiveUnlock();
 }
 
@@ -565,13 +651,11 @@ virNWFilterSnoopReqNew(const char *ifkey)
     if (VIR_ALLOC(req) < 0)
         return NULL;
 
-    req->threadStatus = THREAD_STATUS_NONE;
-
     if (virStrcpyStatic(req->ifkey, ifkey) < 0||
         virMutexInitRecursive(&req->lock) < 0)
         goto err_free_req;
 
-    if (virCondInit(&req->threadStatusCond) < 0)
+    if (virMutexInit(&req->jobLock) < 0)
         goto err_destroy_mutex;
 
     virNWFilterSnoopReqGet(req);
@@ -610,9 +694,12 @@ virNWFilterSnoopReqFree(virNWFilterSnoopReqPtr req)
     /* free all req data */
     virNWFilterBindingDefFree(req->binding);
 
+    while (req->njobs > 0)
+        VIR_FREE(req->jobs[--req->njobs]);
+    VIR_FREE(req->jobs);
+
     virMutexDestroy(&req->lock);
-    virCondDestroy(&req->threadStatusCond);
-    virFreeError(req->threadError);
+    virMutexDestroy(&req->jobLock);
 
     VIR_FREE(req);
 }
@@ -1081,6 +1168,7 @@ virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
     }
 
     if (pcap_set_snaplen(handle, PCAP_PBUFSIZE) < 0 ||
+        pcap_set_buffer_size(handle, PCAP_BUFSIZE) < 0 ||
         pcap_set_immediate_mode(handle, 1) < 0 ||
         pcap_activate(handle) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1089,6 +1177,14 @@ virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
         goto cleanup;
     }
 
+    /* poll() may report the handle readable without a packet passing
+     * the filter, don't let pcap_next_ex() block the capture thread */
+    if (pcap_setnonblock(handle, 1, pcap_errbuf) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("pcap_setnonblock failed: %s"), pcap_errbuf);
+        goto cleanup;
+    }
+
     if (pcap_compile(handle, &fp, ext_filter, 1, PCAP_NETMASK_UNKNOWN) != 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("pcap_compile: %s"), pcap_geterr(handle));
@@ -1124,38 +1220,121 @@ virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
 }
 
 /*
- * Worker function to decode the DHCP message and with that
- * also do the time-consuming work of instantiating the filters
+ * Worker function to decode the DHCP messages queued on a request and
+ * with that also do the time-consuming work of instantiating the
+ * filters. A request is handed to at most one worker at any time, so
+ * its messages are processed in the order they were received in.
  */
-static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
+static void virNWFilterDHCPDecodeWorker(void *jobdata,
+                                        void *opaque G_GNUC_UNUSED)
 {
-    virNWFilterSnoopReqPtr req = opaque;
-    virNWFilterDHCPDecodeJobPtr job = jobdata;
-    virNWFilterSnoopEthHdrPtr packet = (virNWFilterSnoopEthHdrPtr)job->packet;
+    virNWFilterSnoopReqPtr req = jobdata;
+    virNWFilterDHCPDecodeJobPtr job;
+    virNWFilterSnoopEthHdrPtr packet;
+    bool timer;
+    bool active;
+
+    while (true) {
+        job = NULL;
+        timer = false;
+
+        virMutexLock(&req->jobLock);
+        if (req->timerQueued) {
+            req->timerQueued = false;
+            timer = true;
+        } else if (req->njobs > 0) {
+            job = req->jobs[0];
+            VIR_DELETE_ELEMENT(req->jobs, 0, req->njobs);
+        } else {
+            req->jobScheduled = false;
+        }
+        virMutexUnlock(&req->jobLock);
 
-    if (virNWFilterSnoopDHCPDecode(req, packet,
-                                   job->caplen, job->fromVM) == -1) {
-        req->jobCompletionStatus = -1;
+        if (!timer && !job)
+            break;
 
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Instantiation of rules failed on "
-                         "interface '%s'"), req->binding->portdevname);
+        /* protect req->threadkey */
+        virNWFilterSnoopReqLock(req);
+        active = virNWFilterSnoopIsActive(req->threadkey);
+        virNWFilterSnoopReqUnlock(req);
+
+        if (timer) {
+            if (active)
+                virNWFilterSnoopReqLeaseTimerRun(req);
+            continue;
+        }
+
+        packet = (virNWFilterSnoopEthHdrPtr)job->packet;
+
+        if (active &&
+            virNWFilterSnoopDHCPDecode(req, packet,
+                                       job->caplen, job->fromVM) == -1) {
+            req->jobCompletionStatus = -1;
+
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Instantiation of rules failed on "
+                             "interface '%s'"), req->binding->portdevname);
+        }
+        ignore_value(!!g_atomic_int_dec_and_test(job->qCtr));
+        VIR_FREE(job);
+    }
+
+    /* release the reference taken when the request got scheduled */
+    virNWFilterSnoopReqPut(req);
+}
+
+/*
+ * Queue a job on the request and hand the request to a decode worker
+ * unless one is working on it already. A NULL @job asks for the lease
+ * timers of the request to be run.
+ */
+static int
+virNWFilterSnoopReqQueueJob(virNWFilterSnoopReqPtr req,
+                            virNWFilterDHCPDecodeJobPtr job)
+{
+    int ret = 0;
+
+    virMutexLock(&req->jobLock);
+
+    if (job) {
+        if (VIR_APPEND_ELEMENT_COPY(req->jobs, req->njobs, job) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+    } else {
+        req->timerQueued = true;
     }
-    ignore_value(!!g_atomic_int_dec_and_test(job->qCtr));
-    VIR_FREE(job);
+
+    if (!req->jobScheduled) {
+        virNWFilterSnoopReqGet(req);
+
+        if (virThreadPoolSendJob(virNWFilterSnoopState.decodePool,
+                                 0, req) < 0) {
+            /* the interface being snooped still holds a reference */
+            ignore_value(!!g_atomic_int_dec_and_test(&req->refctr));
+            if (job)
+                VIR_DELETE_ELEMENT(req->jobs, req->njobs - 1, req->njobs);
+            ret = -1;
+            goto cleanup;
+        }
+        req->jobScheduled = true;
+    }
+
+ cleanup:
+    virMutexUnlock(&req->jobLock);
+    return ret;
 }
 
 /*
- * Submit a job to the worker thread doing the time-consuming work...
+ * Submit a job to the worker threads doing the time-consuming work...
  */
 static int
-virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
+virNWFilterSnoopDHCPDecodeJobSubmit(virNWFilterSnoopReqPtr req,
                                     virNWFilterSnoopEthHdrPtr pep,
                                     int len, pcap_direction_t dir,
                                     int *qCtr)
 {
     virNWFilterDHCPDecodeJobPtr job;
-    int ret;
 
     if (len <= MIN_VALID_DHCP_PKT_SIZE || len > sizeof(job->packet))
         return 0;
@@ -1168,14 +1347,15 @@ virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
     job->fromVM = (dir == PCAP_D_IN);
     job->qCtr = qCtr;
 
-    ret = virThreadPoolSendJob(pool, 0, job);
+    g_atomic_int_add(qCtr, 1);
 
-    if (ret == 0)
-        g_atomic_int_add(qCtr, 1);
-    else
+    if (virNWFilterSnoopReqQueueJob(req, job) < 0) {
+        ignore_value(!!g_atomic_int_dec_and_test(qCtr));
         VIR_FREE(job);
+        return -1;
+    }
 
-    return ret;
+    return 0;
 }
 
 /*
@@ -1295,257 +1475,526 @@ virNWFilterSnoopAdjustPoll(virNWFilterSnoopPcapConfPtr pc,
     return ret;
 }
 
+static void
+virNWFilterSnoopIfaceFree(virNWFilterSnoopIfacePtr iface)
+{
+    size_t i;
+
+    if (!iface)
+        return;
+
+    for (i = 0; i < G_N_ELEMENTS(iface->pcapConf); i++) {
+        if (iface->pcapConf[i].handle)
+            pcap_close(iface->pcapConf[i].handle);
+    }
+
+    virNWFilterSnoopReqPut(iface->req);
+
+    VIR_FREE(iface->threadkey);
+    VIR_FREE(iface);
+}
+
 /*
- * The DHCP snooping thread. It spends most of its time in the pcap
- * library and if it gets suitable packets, it submits them to the worker
- * thread for processing.
+ * Stop snooping on an interface whose capture or packet decoding failed
+ * and drop its association with the request.
  */
 static void
-virNWFilterDHCPSnoopThread(void *req0)
+virNWFilterSnoopIfaceDetach(virNWFilterSnoopIfacePtr iface)
 {
-    virNWFilterSnoopReqPtr req = req0;
-    struct pcap_pkthdr *hdr;
-    virNWFilterSnoopEthHdrPtr packet;
-    int ifindex = 0;
-    int errcount = 0;
-    int tmp = -1, rv, n, pollTo;
-    size_t i;
-    char *threadkey = NULL;
-    virThreadPoolPtr worker = NULL;
-    time_t last_displayed = 0, last_displayed_queue = 0;
-    virNWFilterSnoopPcapConf pcapConf[] = {
-        {
-            .dir = PCAP_D_IN, /* from VM */
-            .filter = "dst port 67 and src port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        }, {
-            .dir = PCAP_D_OUT, /* to VM */
-            .filter = "src port 67 and dst port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        },
-    };
-    struct pollfd fds[] = {
-        {
-            /* get a POLLERR if interface goes down or disappears */
-            .events = POLLIN | POLLERR,
-        }, {
-            .events = POLLIN | POLLERR,
-        },
-    };
-    bool error = false;
+    virNWFilterSnoopReqPtr req = iface->req;
 
-    /* whoever started us increased the reference counter for the req for us */
+    /* protect IfNameToKey */
+    virNWFilterSnoopLock();
 
     /* protect req->binding->portdevname & req->threadkey */
     virNWFilterSnoopReqLock(req);
 
-    if (req->binding->portdevname && req->threadkey) {
-        for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-            pcapConf[i].handle =
-                virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                         &req->binding->mac,
-                                         pcapConf[i].filter,
-                                         pcapConf[i].dir);
-            if (!pcapConf[i].handle) {
-                error = true;
-                break;
-            }
-            fds[i].fd = pcap_fileno(pcapConf[i].handle);
+    /* nothing to do if snooping on the interface was cancelled or
+     * restarted meanwhile */
+    if (STREQ_NULLABLE(req->threadkey, iface->threadkey)) {
+        virNWFilterSnoopCancel(&req->threadkey);
+
+        ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
+                                        req->binding->portdevname));
+
+        VIR_FREE(req->binding->portdevname);
+    }
+
+    virNWFilterSnoopReqUnlock(req);
+    virNWFilterSnoopUnlock();
+}
+
+static void
+virNWFilterSnoopCaptureRemove(virNWFilterSnoopCapturePtr capture,
+                              virNWFilterSnoopIfacePtr iface)
+{
+    virNWFilterSnoopIfaceFree(iface);
+
+    virMutexLock(&capture->lock);
+    capture->nifaces--;
+    virMutexUnlock(&capture->lock);
+
+    ignore_value(!!g_atomic_int_dec_and_test(&virNWFilterSnoopState.nIfaces));
+}
+
+/*
+ * Read a packet from the pcap handle @i of the interface and submit
+ * it to the decode workers.
+ *
+ * Returns -1 if snooping on the interface has failed, 0 otherwise.
+ */
+static int
+virNWFilterSnoopIfaceRead(virNWFilterSnoopIfacePtr iface, size_t i)
+{
+    virNWFilterSnoopReqPtr req = iface->req;
+    virNWFilterSnoopPcapConfPtr pc = &iface->pcapConf[i];
+    struct pcap_pkthdr *hdr;
+    virNWFilterSnoopEthHdrPtr packet;
+    unsigned int diff;
+    int rv, tmp;
+
+    rv = pcap_next_ex(pc->handle, &hdr, (const u_char **)&packet);
+
+    if (rv < 0) {
+        /* error reading from socket */
+        tmp = -1;
+
+        /* protect req->binding->portdevname */
+        virNWFilterSnoopReqLock(req);
+
+        if (req->binding->portdevname)
+            tmp = virNetDevValidateConfig(req->binding->portdevname, NULL,
+                                          iface->ifindex);
+
+        virNWFilterSnoopReqUnlock(req);
+
+        if (tmp <= 0)
+            return -1;
+
+        if (++iface->errcount > PCAP_READ_MAXERRS) {
+            pcap_close(pc->handle);
+            pc->handle = NULL;
+
+            /* protect req->binding->portdevname */
+            virNWFilterSnoopReqLock(req);
+
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("interface '%s' failing; "
+                             "reopening"),
+                           req->binding->portdevname);
+            if (req->binding->portdevname)
+                pc->handle = virNWFilterSnoopDHCPOpen(req->binding->portdevname,
+                                                      &req->binding->mac,
+                                                      pc->filter, pc->dir);
+
+            virNWFilterSnoopReqUnlock(req);
+
+            if (!pc->handle)
+                return -1;
         }
-        tmp = virNetDevGetIndex(req->binding->portdevname, &ifindex);
-        threadkey = g_strdup(req->threadkey);
-        worker = virThreadPoolNewFull(1, 1, 0,
-                                      virNWFilterDHCPDecodeWorker,
-                                      "dhcp-decode",
-                                      req);
-    }
-
-    /* let creator know how well we initialized */
-    if (error || !threadkey || tmp < 0 || !worker ||
-        ifindex != req->ifindex) {
-        virErrorPreserveLast(&req->threadError);
-        req->threadStatus = THREAD_STATUS_FAIL;
-    } else {
-        req->threadStatus = THREAD_STATUS_OK;
+        return 0;
     }
 
-    virCondSignal(&req->threadStatusCond);
+    /* the handle is non-blocking, so a wakeup may find nothing to read */
+    if (rv == 0)
+        return 0;
 
-    virNWFilterSnoopReqUnlock(req);
+    iface->errcount = 0;
 
-    if (req->threadStatus != THREAD_STATUS_OK)
-        goto exit;
+    /* submit packet to the decode workers */
+    if (g_atomic_int_get(&req->qCtr[i]) > pc->maxQSize) {
+        if (iface->last_displayed_queue - time(0) > 10) {
+            iface->last_displayed_queue = time(0);
+            VIR_WARN("Worker thread for interface '%s' has a "
+                     "job queue that is too long",
+                     req->binding->portdevname);
+        }
+        return 0;
+    }
 
-    while (!error) {
-        if (virNWFilterSnoopAdjustPoll(pcapConf,
-                                       G_N_ELEMENTS(pcapConf),
-                                       fds, &pollTo) < 0) {
-            break;
+    diff = virNWFilterSnoopRateLimit(&pc->rateLimit);
+    if (diff > 0) {
+        virNWFilterSnoopRatePenalty(pc, diff, DHCP_PKT_RATE);
+        /* rate-limited warnings */
+        if (time(0) - iface->last_displayed > 10) {
+             iface->last_displayed = time(0);
+             VIR_WARN("Too many DHCP packets on interface '%s'",
+                      req->binding->portdevname);
         }
+        return 0;
+    }
 
-        /* cap pollTo so we don't hold up the join for too long */
-        if (pollTo < 0 || pollTo > SNOOP_POLL_MAX_TIMEOUT_MS)
-            pollTo = SNOOP_POLL_MAX_TIMEOUT_MS;
+    if (virNWFilterSnoopDHCPDecodeJobSubmit(req, packet, hdr->caplen,
+                                            pc->dir, &req->qCtr[i]) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Job submission failed on "
+                         "interface '%s'"), req->binding->portdevname);
+        return -1;
+    }
 
-        n = poll(fds, G_N_ELEMENTS(fds), pollTo);
+    return 0;
+}
+
+/*
+ * A DHCP snooping thread. It polls the pcap handles of all interfaces
+ * assigned to it, spending most of its time in the pcap library, and
+ * if it gets suitable packets, it queues them for the decode workers.
+ */
+static void
+virNWFilterDHCPSnoopThread(void *opaque)
+{
+    virNWFilterSnoopCapturePtr capture = opaque;
+    virNWFilterSnoopIfacePtr *ifaces = NULL;
+    size_t nifaces = 0;
+    size_t ifaces_max = 0;
+    virNWFilterSnoopIfacePtr *added = NULL;
+    size_t nadded = 0;
+    struct pollfd *fds = NULL;
+    size_t nfds;
+    char buf[64];
+    size_t i, j;
+    int pollTo, tmp;
+    bool failed;
+    bool quit;
+    time_t now;
 
-        if (n < 0) {
-            if (errno != EAGAIN && errno != EINTR)
-                error = true;
+    while (true) {
+        /* pick up the interfaces added since the last round */
+        virMutexLock(&capture->lock);
+        quit = capture->quit;
+        if (VIR_RESIZE_N(ifaces, ifaces_max, nifaces, capture->nadded) < 0) {
+            virMutexUnlock(&capture->lock);
+            break;
         }
+        for (i = 0; i < capture->nadded; i++)
+            VIR_APPEND_ELEMENT_INPLACE(ifaces, nifaces, capture->added[i]);
+        VIR_FREE(capture->added);
+        capture->nadded = 0;
+        virMutexUnlock(&capture->lock);
 
-        virNWFilterSnoopReqLeaseTimerRun(req);
+        if (quit)
+            break;
 
         /*
-         * Check whether we were cancelled or whether
-         * a previously submitted job failed.
+         * Drop the interfaces we were cancelled on, whose capture
+         * failed or for which a previously submitted job failed.
          */
-        if (!virNWFilterSnoopIsActive(threadkey) ||
-            req->jobCompletionStatus != 0)
-            goto exit;
+        for (i = 0; i < nifaces;) {
+            virNWFilterSnoopIfacePtr iface = ifaces[i];
 
-        for (i = 0; n > 0 && i < G_N_ELEMENTS(fds); i++) {
-            if (!fds[i].revents)
+            if (!iface->failed &&
+                virNWFilterSnoopIsActive(iface->threadkey) &&
+                iface->req->jobCompletionStatus == 0) {
+                i++;
                 continue;
+            }
 
-            fds[i].revents = 0;
-            n--;
+            /* a failed decode job fails the interface */
+            if (iface->req->jobCompletionStatus != 0)
+                iface->failed = true;
 
-            rv = pcap_next_ex(pcapConf[i].handle, &hdr,
-                              (const u_char **)&packet);
+            if (iface->failed)
+                virNWFilterSnoopIfaceDetach(iface);
 
-            if (rv < 0) {
-                /* error reading from socket */
-                tmp = -1;
+            VIR_DELETE_ELEMENT_INPLACE(ifaces, i, nifaces);
+            virNWFilterSnoopCaptureRemove(capture, iface);
+        }
 
-                /* protect req->binding->portdevname */
-                virNWFilterSnoopReqLock(req);
+        failed = false;
+        now = time(0);
+        nfds = 1 + nifaces * G_N_ELEMENTS(virNWFilterSnoopPcapConfs);
+        if (VIR_REALLOC_N(fds, nfds) < 0)
+            break;
 
-                if (req->binding->portdevname)
-                    tmp = virNetDevValidateConfig(req->binding->portdevname, NULL, ifindex);
+        fds[0].fd = capture->wakeupFD[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        pollTo = SNOOP_POLL_MAX_TIMEOUT_MS;
 
-                virNWFilterSnoopReqUnlock(req);
+        for (i = 0; i < nifaces; i++) {
+            virNWFilterSnoopIfacePtr iface = ifaces[i];
+            struct pollfd *pfd = &fds[1 + i * G_N_ELEMENTS(iface->pcapConf)];
 
-                if (tmp <= 0) {
-                    error = true;
-                    break;
-                }
+            /* the lease timers run in the decode workers */
+            if (iface->lastTimerRun != now) {
+                iface->lastTimerRun = now;
+                if (virNWFilterSnoopReqQueueJob(iface->req, NULL) < 0)
+                    iface->failed = failed = true;
+            }
 
-                if (++errcount > PCAP_READ_MAXERRS) {
-                    pcap_close(pcapConf[i].handle);
-                    pcapConf[i].handle = NULL;
-
-                    /* protect req->binding->portdevname */
-                    virNWFilterSnoopReqLock(req);
-
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("interface '%s' failing; "
-                                     "reopening"),
-                                   req->binding->portdevname);
-                    if (req->binding->portdevname)
-                        pcapConf[i].handle =
-                            virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                                     &req->binding->mac,
-                                                     pcapConf[i].filter,
-                                                     pcapConf[i].dir);
-
-                    virNWFilterSnoopReqUnlock(req);
-
-                    if (!pcapConf[i].handle) {
-                        error = true;
-                        break;
-                    }
-                }
+            for (j = 0; j < G_N_ELEMENTS(iface->pcapConf); j++) {
+                pfd[j].fd = pcap_fileno(iface->pcapConf[j].handle);
+                /* get a POLLERR if interface goes down or disappears */
+                pfd[j].events = POLLIN | POLLERR;
+                pfd[j].revents = 0;
+            }
+
+            if (virNWFilterSnoopAdjustPoll(iface->pcapConf,
+                                           G_N_ELEMENTS(iface->pcapConf),
+                                           pfd, &tmp) < 0) {
+                iface->failed = failed = true;
                 continue;
             }
 
-            errcount = 0;
+            if (tmp >= 0 && tmp < pollTo)
+                pollTo = tmp;
+        }
 
-            if (rv) {
-                unsigned int diff;
+        if (failed)
+            continue;
 
-                /* submit packet to worker thread */
-                if (g_atomic_int_get(&pcapConf[i].qCtr) >
-                    pcapConf[i].maxQSize) {
-                    if (last_displayed_queue - time(0) > 10) {
-                        last_displayed_queue = time(0);
-                        VIR_WARN("Worker thread for interface '%s' has a "
-                                 "job queue that is too long",
-                                 req->binding->portdevname);
-                    }
-                    continue;
-                }
+        /* pollTo is capped so lease timers get run regularly */
+        if (poll(fds, nfds, pollTo) < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                virReportSystemError(errno, "%s",
+                                     _("unable to poll on DHCP snooping "
+                                       "interfaces"));
+                for (i = 0; i < nifaces; i++)
+                    ifaces[i]->failed = true;
+            }
+            continue;
+        }
+
+        if (fds[0].revents) {
+            while (read(capture->wakeupFD[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+
+        for (i = 0; i < nifaces; i++) {
+            virNWFilterSnoopIfacePtr iface = ifaces[i];
+            struct pollfd *pfd = &fds[1 + i * G_N_ELEMENTS(iface->pcapConf)];
 
-                diff = virNWFilterSnoopRateLimit(&pcapConf[i].rateLimit);
-                if (diff > 0) {
-                    virNWFilterSnoopRatePenalty(&pcapConf[i], diff,
-                                                DHCP_PKT_RATE);
-                    /* rate-limited warnings */
-                    if (time(0) - last_displayed > 10) {
-                         last_displayed = time(0);
-                         VIR_WARN("Too many DHCP packets on interface '%s'",
-                                  req->binding->portdevname);
-                    }
+            for (j = 0; j < G_N_ELEMENTS(iface->pcapConf); j++) {
+                if (!pfd[j].revents)
                     continue;
-                }
 
-                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, packet,
-                                                      hdr->caplen,
-                                                      pcapConf[i].dir,
-                                                      &pcapConf[i].qCtr) < 0) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("Job submission failed on "
-                                     "interface '%s'"), req->binding->portdevname);
-                    error = true;
+                if (virNWFilterSnoopIfaceRead(iface, j) < 0) {
+                    iface->failed = true;
                     break;
                 }
             }
-        } /* for all fds */
-    } /* while (!error) */
+        }
+    }
 
-    /* protect IfNameToKey */
-    virNWFilterSnoopLock();
+    /* also release the interfaces which were never picked up */
+    virMutexLock(&capture->lock);
+    added = g_steal_pointer(&capture->added);
+    nadded = capture->nadded;
+    capture->nadded = 0;
+    virMutexUnlock(&capture->lock);
+
+    for (i = 0; i < nifaces; i++)
+        virNWFilterSnoopCaptureRemove(capture, ifaces[i]);
+    for (i = 0; i < nadded; i++)
+        virNWFilterSnoopCaptureRemove(capture, added[i]);
+    VIR_FREE(ifaces);
+    VIR_FREE(added);
+    VIR_FREE(fds);
+}
 
-    /* protect req->binding->portdevname & req->threadkey */
-    virNWFilterSnoopReqLock(req);
+static int
+virNWFilterSnoopCaptureInit(virNWFilterSnoopCapturePtr capture)
+{
+    if (virPipeNonBlock(capture->wakeupFD) < 0)
+        return -1;
 
-    virNWFilterSnoopCancel(&req->threadkey);
+    if (virMutexInit(&capture->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        goto error;
+    }
 
-    ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
-                                    req->binding->portdevname));
+    if (virThreadCreateFull(&capture->thread, true,
+                            virNWFilterDHCPSnoopThread,
+                            "dhcp-snoop", false, capture) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create DHCP snooping thread"));
+        virMutexDestroy(&capture->lock);
+        goto error;
+    }
 
-    VIR_FREE(req->binding->portdevname);
+    return 0;
 
-    virNWFilterSnoopReqUnlock(req);
-    virNWFilterSnoopUnlock();
+ error:
+    VIR_FORCE_CLOSE(capture->wakeupFD[0]);
+    VIR_FORCE_CLOSE(capture->wakeupFD[1]);
+    return -1;
+}
 
- exit:
-    virThreadPoolFree(worker);
+/*
+ * Stop the capture threads and the decode workers; to be called once
+ * snooping has ended on all interfaces.
+ */
+static void
+virNWFilterSnoopCaptureStop(void)
+{
+    virNWFilterSnoopCapturePtr captures;
+    size_t ncaptures;
+    size_t i, j;
 
-    virNWFilterSnoopReqPut(req);
+    virNWFilterSnoopActiveLock();
+    captures = g_steal_pointer(&virNWFilterSnoopState.captures);
+    ncaptures = virNWFilterSnoopState.nCaptures;
+    virNWFilterSnoopState.nCaptures = 0;
+    virNWFilterSnoopActiveUnlock();
+
+    for (i = 0; i < ncaptures; i++) {
+        virNWFilterSnoopCapturePtr capture = &captures[i];
+
+        virMutexLock(&capture->lock);
+        capture->quit = true;
+        virMutexUnlock(&capture->lock);
+
+        virNWFilterSnoopCaptureWakeup(capture);
+        virThreadJoin(&capture->thread);
 
-    VIR_FREE(threadkey);
+        for (j = 0; j < capture->nadded; j++)
+            virNWFilterSnoopCaptureRemove(capture, capture->added[j]);
+        VIR_FREE(capture->added);
 
-    for (i = 0; i < G_N_ELEMENTS(pcapConf); i++) {
-        if (pcapConf[i].handle)
-            pcap_close(pcapConf[i].handle);
+        VIR_FORCE_CLOSE(capture->wakeupFD[0]);
+        VIR_FORCE_CLOSE(capture->wakeupFD[1]);
+        virMutexDestroy(&capture->lock);
     }
+    VIR_FREE(captures);
 
-    ignore_value(!!g_atomic_int_dec_and_test(&virNWFilterSnoopState.nThreads));
+    virThreadPoolFree(virNWFilterSnoopState.decodePool);
+    virNWFilterSnoopState.decodePool = NULL;
+}
 
-    return;
+/*
+ * Start the capture threads and the decode workers shared by all
+ * interfaces, one of each per host CPU up to SNOOP_MAX_CAPTURE_THREADS.
+ *
+ * The caller must hold the SnoopLock.
+ */
+static int
+virNWFilterSnoopCaptureStart(void)
+{
+    virNWFilterSnoopCapturePtr captures;
+    int ncpus;
+    size_t ncaptures;
+    size_t i;
+
+    if (virNWFilterSnoopState.captures)
+        return 0;
+
+    ncpus = virHostCPUGetCount();
+    ncaptures = MIN(MAX(ncpus, 1), SNOOP_MAX_CAPTURE_THREADS);
+
+    virNWFilterSnoopState.decodePool =
+        virThreadPoolNewFull(1, ncaptures, 0,
+                             virNWFilterDHCPDecodeWorker,
+                             "dhcp-decode",
+                             NULL);
+    if (!virNWFilterSnoopState.decodePool)
+        return -1;
+
+    captures = g_new0(virNWFilterSnoopCapture, ncaptures);
+
+    virNWFilterSnoopActiveLock();
+    virNWFilterSnoopState.captures = captures;
+    virNWFilterSnoopActiveUnlock();
+
+    for (i = 0; i < ncaptures; i++) {
+        if (virNWFilterSnoopCaptureInit(&captures[i]) < 0) {
+            virNWFilterSnoopCaptureStop();
+            return -1;
+        }
+
+        virNWFilterSnoopActiveLock();
+        virNWFilterSnoopState.nCaptures++;
+        virNWFilterSnoopActiveUnlock();
+    }
+
+    return 0;
+}
+
+/*
+ * Open the pcap handles on the interface of the request and hand
+ * them to the least loaded capture thread. The reference the caller
+ * holds on the request is passed on to the capture thread.
+ *
+ * The caller must hold the SnoopLock and the lock of the request.
+ */
+static int
+virNWFilterSnoopIfaceAdd(virNWFilterSnoopReqPtr req)
+{
+    virNWFilterSnoopIfacePtr iface;
+    virNWFilterSnoopCapturePtr capture = NULL;
+    size_t load = 0;
+    size_t i;
+    int ifindex;
+
+    if (virNWFilterSnoopCaptureStart() < 0)
+        return -1;
+
+    if (VIR_ALLOC(iface) < 0)
+        return -1;
+
+    iface->threadkey = g_strdup(req->threadkey);
+    iface->ifindex = req->ifindex;
+
+    for (i = 0; i < G_N_ELEMENTS(iface->pcapConf); i++) {
+        iface->pcapConf[i] = virNWFilterSnoopPcapConfs[i];
+        iface->pcapConf[i].rateLimit.prev = time(0);
+        iface->pcapConf[i].handle =
+            virNWFilterSnoopDHCPOpen(req->binding->portdevname,
+                                     &req->binding->mac,
+                                     iface->pcapConf[i].filter,
+                                     iface->pcapConf[i].dir);
+        if (!iface->pcapConf[i].handle)
+            goto error;
+    }
+
+    if (virNetDevGetIndex(req->binding->portdevname, &ifindex) < 0)
+        goto error;
+
+    if (ifindex != req->ifindex) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("interface '%s' was replaced while setting up "
+                         "DHCP snooping"), req->binding->portdevname);
+        goto error;
+    }
+
+    iface->req = req;
+
+    virNWFilterSnoopActiveLock();
+
+    for (i = 0; i < virNWFilterSnoopState.nCaptures; i++) {
+        virNWFilterSnoopCapturePtr tmp = &virNWFilterSnoopState.captures[i];
+        size_t tmpload;
+
+        virMutexLock(&tmp->lock);
+        tmpload = tmp->nifaces;
+        virMutexUnlock(&tmp->lock);
+
+        if (!capture || tmpload < load) {
+            capture = tmp;
+            load = tmpload;
+        }
+    }
+
+    virMutexLock(&capture->lock);
+    if (VIR_APPEND_ELEMENT(capture->added, capture->nadded, iface) < 0) {
+        virMutexUnlock(&capture->lock);
+        virNWFilterSnoopActiveUnlock();
+        goto error;
+    }
+    capture->nifaces++;
+    virMutexUnlock(&capture->lock);
+
+    g_atomic_int_add(&virNWFilterSnoopState.nIfaces, 1);
+
+    virNWFilterSnoopCaptureWakeup(capture);
+
+    virNWFilterSnoopActiveUnlock();
+
+    return 0;
+
+ error:
+    virNWFilterSnoopIfaceFree(iface);
+    return -1;
 }
 
 static void
@@ -1566,9 +2015,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
     bool isnewreq;
     char ifkey[VIR_IFKEY_LEN];
     int tmp;
-    virThread thread;
     virNWFilterVarValuePtr dhcpsrvrs;
-    bool threadPuts = false;
 
     virNWFilterSnoopIFKeyFMT(ifkey, binding->owneruuid, &binding->mac);
 
@@ -1636,21 +2083,9 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_rem_ifnametokey;
     }
 
-    /* prevent thread from holding req */
+    /* prevent the capture threads from using req */
     virNWFilterSnoopReqLock(req);
 
-    if (virThreadCreateFull(&thread, false, virNWFilterDHCPSnoopThread,
-                            "dhcp-snoop", false, req) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("virNWFilterDHCPSnoopReq virThreadCreate "
-                         "failed on interface '%s'"), binding->portdevname);
-        goto exit_snoopreq_unlock;
-    }
-
-    threadPuts = true;
-
-    g_atomic_int_add(&virNWFilterSnoopState.nThreads, 1);
-
     req->threadkey = virNWFilterSnoopActivate(req);
     if (!req->threadkey) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1666,23 +2101,14 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_snoop_cancel;
     }
 
-    /* sync with thread */
-    if (virCondWait(&req->threadStatusCond, &req->lock) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("unable to wait on dhcp snoop thread"));
+    if (virNWFilterSnoopIfaceAdd(req) < 0)
         goto exit_snoop_cancel;
-    }
-
-    if (req->threadStatus != THREAD_STATUS_OK) {
-        virErrorRestore(&req->threadError);
-        goto exit_snoop_cancel;
-    }
 
     virNWFilterSnoopReqUnlock(req);
 
     virNWFilterSnoopUnlock();
 
-    /* do not 'put' the req -- the thread will do this */
+    /* do not 'put' the req -- the capture thread will do this */
 
     return 0;
 
@@ -1695,8 +2121,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
  exit_snoopunlock:
     virNWFilterSnoopUnlock();
  exit_snoopreqput:
-    if (!threadPuts)
-        virNWFilterSnoopReqPut(req);
+    virNWFilterSnoopReqPut(req);
 
     return -1;
 }
@@ -1968,14 +2393,14 @@ virNWFilterSnoopLeaseFileLoad(void)
 }
 
 /*
- * Wait until all threads have ended.
+ * Wait until snooping has ended on all interfaces.
  */
 static void
 virNWFilterSnoopJoinThreads(void)
 {
-    while (g_atomic_int_get(&virNWFilterSnoopState.nThreads) != 0) {
-        VIR_WARN("Waiting for snooping threads to terminate: %u",
-                 g_atomic_int_get(&virNWFilterSnoopState.nThreads));
+    while (g_atomic_int_get(&virNWFilterSnoopState.nIfaces) != 0) {
+        VIR_WARN("Waiting for snooping on interfaces to terminate: %u",
+                 g_atomic_int_get(&virNWFilterSnoopState.nIfaces));
         g_usleep(1000 * 1000);
     }
 }
@@ -2142,6 +2567,7 @@ virNWFilterDHCPSnoopShutdown(void)
 {
     virNWFilterSnoopEndThreads();
     virNWFilterSnoopJoinThreads();
+    virNWFilterSnoopCaptureStop();
 
     virNWFilterSnoopLock();
 
@@ -37,6 +37,7 @@
 #include "datatypes.h"
 #include "virsocketaddr.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -240,9 +241,29 @@ virNWFilterInstReset(virNWFilterInstPtr inst)
     for (i = 0; i < inst->nrules; i++)
         virNWFilterRuleInstFree(inst->rules[i]);
     VIR_FREE(inst->rules);
+    inst->nrules = 0;
 }
 
 
+/* Rules of a single binding built during virNWFilterBuildAll, which
+ * are applied by a pool of worker threads once all bindings have
+ * been instantiated */
+typedef struct _virNWFilterBuildJob virNWFilterBuildJob;
+typedef virNWFilterBuildJob *virNWFilterBuildJobPtr;
+struct _virNWFilterBuildJob {
+    virNWFilterBindingObjPtr obj;
+    virNWFilterBindingDefPtr binding;
+
+    bool skip; /* filter tree unchanged, nothing to do */
+    bool pending; /* @inst holds rules yet to be applied */
+    int ifindex;
+    virNWFilterInst inst;
+
+    int rc;
+    virErrorPtr err;
+};
+
+
 
 static int
 virNWFilterDefToInst(virNWFilterDriverStatePtr driver,
@@ -486,6 +507,36 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
 }
 
 
+static int
+virNWFilterApplyInst(virNWFilterTechDriverPtr techdriver,
+                     const char *ifname,
+                     int ifindex,
+                     bool teardownOld,
+                     virNWFilterInstPtr inst)
+{
+    int rc;
+
+    if (virNWFilterLockIface(ifname) < 0)
+        return -1;
+
+    rc = techdriver->applyNewRules(ifname, inst->rules, inst->nrules);
+
+    if (teardownOld && rc == 0)
+        techdriver->tearOldRules(ifname);
+
+    if (rc == 0 && (virNetDevValidateConfig(ifname, NULL, ifindex) <= 0)) {
+        virResetLastError();
+        /* interface changed/disappeared */
+        techdriver->allTeardown(ifname);
+        rc = -1;
+    }
+
+    virNWFilterUnlockIface(ifname);
+
+    return rc;
+}
+
+
 /**
  * virNWFilterDoInstantiate:
  * @techdriver: The driver to use for instantiation
@@ -493,6 +544,8 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
  * @filter: The filter to instantiate
  * @forceWithPendingReq: Ignore the check whether a pending learn request
  *  is active; 'true' only when the rules are applied late
+ * @job: if not NULL, the rules are not applied but handed over to @job
+ *  for applying them later using virNWFilterApplyInst
  *
  * Returns 0 on success, a value otherwise.
  *
@@ -512,7 +565,8 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
                          bool *foundNewFilter,
                          bool teardownOld,
                          virNWFilterDriverStatePtr driver,
-                         bool forceWithPendingReq)
+                         bool forceWithPendingReq,
+                         virNWFilterBuildJobPtr job)
 {
     int rc;
     virNWFilterInst inst;
@@ -606,22 +660,15 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     }
 
     if (instantiate) {
-        if (virNWFilterLockIface(binding->portdevname) < 0)
-            goto err_exit;
-
-        rc = techdriver->applyNewRules(binding->portdevname, inst.rules, inst.nrules);
-
-        if (teardownOld && rc == 0)
-            techdriver->tearOldRules(binding->portdevname);
-
-        if (rc == 0 && (virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0)) {
-            virResetLastError();
-            /* interface changed/disappeared */
-            techdriver->allTeardown(binding->portdevname);
-            rc = -1;
+        if (job) {
+            job->inst = inst;
+            job->ifindex = ifindex;
+            job->pending = true;
+            memset(&inst, 0, sizeof(inst));
+        } else {
+            rc = virNWFilterApplyInst(techdriver, binding->portdevname,
+                                      ifindex, teardownOld, &inst);
         }
-
-        virNWFilterUnlockIface(binding->portdevname);
     }
 
  err_exit:
@@ -677,7 +724,8 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
                                    int ifindex,
                                    enum instCase useNewFilter,
                                    bool forceWithPendingReq,
-                                   bool *foundNewFilter)
+                                   bool *foundNewFilter,
+                                   virNWFilterBuildJobPtr job)
 {
     int rc = -1;
     const char *drvname = EBIPTABLES_DRIVER_ID;
@@ -736,7 +784,13 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
     rc = virNWFilterDoInstantiate(techdriver, binding, filter,
                                   ifindex, useNewFilter, foundNewFilter,
                                   teardownOld, driver,
-                                  forceWithPendingReq);
+                                  forceWithPendingReq, job);
+
+    /* the rules handed over to @job reference the filter, keep it
+     * locked until they have been applied */
+    if (rc == 0 && job && job->pending &&
+        VIR_APPEND_ELEMENT(job->inst.filters, job->inst.nfilters, obj) == 0)
+        return 0;
 
  err_exit:
     virNWFilterObjUnlock(obj);
@@ -750,7 +804,8 @@ virNWFilterInstantiateFilterInternal(virNWFilterDriverStatePtr driver,
                                      virNWFilterBindingDefPtr binding,
                                      bool teardownOld,
                                      enum instCase useNewFilter,
-                                     bool *foundNewFilter)
+                                     bool *foundNewFilter,
+                                     virNWFilterBuildJobPtr job)
 {
     int ifindex;
     int rc;
@@ -773,7 +828,7 @@ virNWFilterInstantiateFilterInternal(virNWFilterDriverStatePtr driver,
                                             binding,
                                             ifindex,
                                             useNewFilter,
-                                            false, foundNewFilter);
+                                            false, foundNewFilter, job);
 
  cleanup:
     virMutexUnlock(&updateMutex);
@@ -796,7 +851,7 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
     rc = virNWFilterInstantiateFilterUpdate(driver, true,
                                             binding, ifindex,
                                             INSTANTIATE_ALWAYS, true,
-                                            &foundNewFilter);
+                                            &foundNewFilter, NULL);
     if (rc < 0) {
         /* something went wrong... 'DOWN' the interface */
         if ((virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0) ||
@@ -823,26 +878,10 @@ virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
     return virNWFilterInstantiateFilterInternal(driver, binding,
                                                 1,
                                                 INSTANTIATE_ALWAYS,
-                                                &foundNewFilter);
+                                                &foundNewFilter, NULL);
 }
 
 
-int
-virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
-                                   virNWFilterBindingDefPtr binding,
-                                   bool *skipIface)
-{
-    bool foundNewFilter = false;
-
-    int rc = virNWFilterInstantiateFilterInternal(driver, binding,
-                                                  0,
-                                                  INSTANTIATE_FOLLOW_NEWFILTER,
-                                                  &foundNewFilter);
-
-    *skipIface = !foundNewFilter;
-    return rc;
-}
-
 static int
 virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 {
@@ -944,65 +983,181 @@ enum {
     STEP_APPLY_CURRENT,
 };
 
+/* Number of threads applying the rules of the bindings while
+ * rebuilding all filters unless set in the driver state */
+#define VIR_NWFILTER_BUILD_WORKERS_DEFAULT 2
+
+
+struct virNWFilterBuildData {
+    virNWFilterDriverStatePtr driver;
+    virNWFilterBuildJobPtr jobs;
+    size_t njobs;
+    int step;
+    int next;
+};
+
+static int
+virNWFilterBuildCollect(virNWFilterBindingObjPtr binding, void *opaque)
+{
+    struct virNWFilterBuildData *data = opaque;
+    virNWFilterBuildJob job;
+
+    memset(&job, 0, sizeof(job));
+    job.obj = virObjectRef(binding);
+    job.binding = virNWFilterBindingObjGetDef(binding);
+
+    return VIR_APPEND_ELEMENT(data->jobs, data->njobs, job);
+}
+
+
+/*
+ * Instantiate the filter of a single binding, leaving the rules
+ * in @job for virNWFilterBuildOne to apply them.
+ *
+ * Call this function while holding the NWFilter filter update lock
+ */
 static int
-virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
-                    virNWFilterBindingDefPtr binding,
-                    virHashTablePtr skipInterfaces,
+virNWFilterBuildPrepare(virNWFilterDriverStatePtr driver,
+                        virNWFilterBuildJobPtr job,
+                        int step)
+{
+    bool foundNewFilter = false;
+
+    VIR_DEBUG("Instantiating filter for portdev=%s step=%d",
+              job->binding->portdevname, step);
+
+    switch (step) {
+    case STEP_APPLY_NEW:
+        job->rc = virNWFilterInstantiateFilterInternal(driver,
+                                                       job->binding,
+                                                       false,
+                                                       INSTANTIATE_FOLLOW_NEWFILTER,
+                                                       &foundNewFilter,
+                                                       job);
+        /* filter tree unchanged -- no update needed */
+        if (job->rc == 0 && !foundNewFilter)
+            job->skip = true;
+        break;
+
+    case STEP_APPLY_CURRENT:
+        job->rc = virNWFilterInstantiateFilterInternal(driver,
+                                                       job->binding,
+                                                       true,
+                                                       INSTANTIATE_ALWAYS,
+                                                       &foundNewFilter,
+                                                       job);
+        break;
+    }
+
+    return job->rc;
+}
+
+
+static void
+virNWFilterBuildOne(virNWFilterBuildJobPtr job,
                     int step)
 {
-    bool skipIface;
-    int ret = 0;
-    VIR_DEBUG("Building filter for portdev=%s step=%d", binding->portdevname, step);
+    virNWFilterTechDriverPtr techdriver;
+
+    if (job->skip)
+        return;
+
+    VIR_DEBUG("Building filter for portdev=%s step=%d",
+              job->binding->portdevname, step);
 
     switch (step) {
     case STEP_APPLY_NEW:
-        ret = virNWFilterUpdateInstantiateFilter(driver,
-                                                 binding,
-                                                 &skipIface);
-        if (ret == 0 && skipIface) {
-            /* filter tree unchanged -- no update needed */
-            ret = virHashAddEntry(skipInterfaces,
-                                  binding->portdevname,
-                                  (void *)~0);
-        }
+    case STEP_APPLY_CURRENT:
+        if (job->rc < 0 || !job->pending)
+            return;
+
+        /* presence of the driver was checked when instantiating */
+        techdriver = virNWFilterTechDriverForName(EBIPTABLES_DRIVER_ID);
+        job->rc = virNWFilterApplyInst(techdriver,
+                                       job->binding->portdevname,
+                                       job->ifindex,
+                                       step == STEP_APPLY_CURRENT,
+                                       &job->inst);
         break;
 
     case STEP_ROLLBACK:
-        if (!virHashLookup(skipInterfaces, binding->portdevname))
-            ret = virNWFilterRollbackUpdateFilter(binding);
+        job->rc = virNWFilterRollbackUpdateFilter(job->binding);
         break;
 
     case STEP_SWITCH:
-        if (!virHashLookup(skipInterfaces, binding->portdevname))
-            ret = virNWFilterTearOldFilter(binding);
-        break;
-
-    case STEP_APPLY_CURRENT:
-        ret = virNWFilterInstantiateFilter(driver,
-                                           binding);
+        job->rc = virNWFilterTearOldFilter(job->binding);
         break;
     }
 
-    return ret;
+    if (job->rc < 0)
+        virErrorPreserveLast(&job->err);
 }
 
 
-struct virNWFilterBuildData {
-    virNWFilterDriverStatePtr driver;
-    virHashTablePtr skipInterfaces;
-    int step;
-};
+static void
+virNWFilterBuildWorker(void *opaque)
+{
+    struct virNWFilterBuildData *data = opaque;
+    size_t i;
 
+    while ((i = g_atomic_int_add(&data->next, 1)) < data->njobs)
+        virNWFilterBuildOne(&data->jobs[i], data->step);
+}
+
+
+/*
+ * Run @step for all jobs, fanned out across up to driver->buildWorkers
+ * threads including the calling one. The firewall commands of a binding
+ * are run under the lock of virFirewallApply, so the threads don't run
+ * commands in parallel: they turn the rules of some bindings into
+ * commands while those of another binding are being run, which is why
+ * a couple of threads gets all there is to get. The first error hit by
+ * any of the jobs is reported to the caller.
+ */
 static int
-virNWFilterBuildIter(virNWFilterBindingObjPtr binding, void *opaque)
+virNWFilterBuildRun(struct virNWFilterBuildData *data,
+                    int step)
 {
-    struct virNWFilterBuildData *data = opaque;
-    virNWFilterBindingDefPtr def = virNWFilterBindingObjGetDef(binding);
+    size_t nworkers = data->driver->buildWorkers;
+    virErrorPtr err = NULL;
+    size_t i;
+    int ret = 0;
 
-    return virNWFilterBuildOne(data->driver, def,
-                               data->skipInterfaces, data->step);
+    data->step = step;
+    data->next = 0;
+
+    if (nworkers == 0)
+        nworkers = VIR_NWFILTER_BUILD_WORKERS_DEFAULT;
+
+    virThreadPoolRunParallel(MIN(nworkers, data->njobs),
+                             virNWFilterBuildWorker,
+                             "nwfilter-build", data);
+
+    for (i = 0; i < data->njobs; i++) {
+        virNWFilterBuildJobPtr job = &data->jobs[i];
+
+        if (job->skip)
+            continue;
+
+        if (job->rc < 0)
+            ret = -1;
+
+        if (job->err) {
+            if (!err)
+                err = job->err;
+            else
+                virFreeError(job->err);
+            job->err = NULL;
+        }
+    }
+
+    if (err)
+        virErrorRestore(&err);
+
+    return ret;
 }
 
+
 int
 virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
                     bool newFilters)
@@ -1010,39 +1165,74 @@ virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
     struct virNWFilterBuildData data = {
         .driver = driver,
     };
+    virHashTablePtr deps = NULL;
+    virErrorPtr saved_error;
+    int step = newFilters ? STEP_APPLY_NEW : STEP_APPLY_CURRENT;
+    size_t i;
     int ret = 0;
 
     VIR_DEBUG("Build all filters newFilters=%d", newFilters);
 
-    if (newFilters) {
-        if (!(data.skipInterfaces = virHashCreate(0, NULL)))
-            return -1;
+    if (virNWFilterBindingObjListForEach(driver->bindings,
+                                         virNWFilterBuildCollect,
+                                         &data) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
 
-        data.step = STEP_APPLY_NEW;
-        if (virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data) < 0)
-            ret = -1;
+    /* Instantiating the filters needs to look them up, which is
+     * serialized by the update lock. Keep holding it while the
+     * workers apply the rules so no one else modifies the rules
+     * of the interfaces in between. */
+    virMutexLock(&updateMutex);
+
+    /* only bindings using one of the filters being updated
+     * need to be rebuilt, skip all others right away */
+    if (newFilters &&
+        !(deps = virNWFilterObjListGetUpdateDeps(driver->nwfilters))) {
+        virMutexUnlock(&updateMutex);
+        ret = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < data.njobs; i++) {
+        virNWFilterBuildJobPtr job = &data.jobs[i];
 
-        if (ret == -1) {
-            data.step = STEP_ROLLBACK;
-            virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data);
-        } else  {
-            data.step = STEP_SWITCH;
-            virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data);
+        if (deps && !virHashLookup(deps, job->binding->filter)) {
+            job->skip = true;
+            continue;
         }
 
-        virHashFree(data.skipInterfaces);
-    } else {
-        data.step = STEP_APPLY_CURRENT;
-        if (virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data) < 0)
+        if (virNWFilterBuildPrepare(driver, job, step) < 0)
             ret = -1;
     }
+
+    /* when updating, don't apply anything unless all bindings
+     * could be instantiated with the new filters */
+    if (ret == 0 || !newFilters) {
+        if (virNWFilterBuildRun(&data, step) < 0)
+            ret = -1;
+    }
+
+    for (i = 0; i < data.njobs; i++)
+        virNWFilterInstReset(&data.jobs[i].inst);
+
+    virMutexUnlock(&updateMutex);
+
+    if (newFilters) {
+        if (ret < 0) {
+            virErrorPreserveLast(&saved_error);
+            virNWFilterBuildRun(&data, STEP_ROLLBACK);
+            virErrorRestore(&saved_error);
+        } else {
+            virNWFilterBuildRun(&data, STEP_SWITCH);
+        }
+    }
+
+ cleanup:
+    for (i = 0; i < data.njobs; i++)
+        virObjectUnref(data.jobs[i].obj);
+    VIR_FREE(data.jobs);
+    virHashFree(deps);
     return ret;
 }
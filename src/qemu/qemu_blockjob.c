@@ -807,7 +807,7 @@ qemuBlockJobEventProcessLegacy(virQEMUDriverPtr driver,
 
     case VIR_DOMAIN_BLOCK_JOB_READY:
         disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusLater(vm);
         break;
 
     case VIR_DOMAIN_BLOCK_JOB_FAILED:
@@ -1586,7 +1586,7 @@ qemuBlockJobEventProcessConcluded(qemuBlockJobDataPtr job,
         job->newstate = QEMU_BLOCKJOB_STATE_CANCELLED;
 
     if (refreshed)
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusLater(vm);
 
     VIR_DEBUG("handling job '%s' state '%d' newstate '%d'", job->name, job->state, job->newstate);
 
@@ -1636,7 +1636,7 @@ qemuBlockJobEventProcess(virQEMUDriverPtr driver,
         }
         job->state = job->newstate;
         job->newstate = -1;
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusLater(vm);
         break;
 
     case QEMU_BLOCKJOB_STATE_NEW:
@@ -271,6 +271,13 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged,
 
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
+    cfg->imageIOBufferSize = 1024;
+    cfg->imageIOBuffers = 1;
+    cfg->queryJobTimeout = 30;
+    cfg->modifyJobTimeout = 30;
+    cfg->nestedJobTimeout = 30;
+    cfg->statsMaxWorkers = 8;
+    cfg->statsDomainTimeout = 5;
     cfg->seccompSandbox = -1;
 
     cfg->logTimestamp = true;
@@ -598,6 +605,22 @@ virQEMUDriverConfigLoadSaveEntry(virQEMUDriverConfigPtr cfg,
         return -1;
     if (virConfGetValueBool(conf, "auto_start_bypass_cache", &cfg->autoStartBypassCache) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "image_io_buffer_size", &cfg->imageIOBufferSize) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "image_io_buffers", &cfg->imageIOBuffers) < 0)
+        return -1;
+
+    if (cfg->imageIOBufferSize == 0 || cfg->imageIOBufferSize % 64 != 0) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("image_io_buffer_size must be a non-zero multiple of 64"));
+        return -1;
+    }
+
+    if (cfg->imageIOBuffers == 0 || cfg->imageIOBuffers > 1024) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("image_io_buffers must be between 1 and 1024"));
+        return -1;
+    }
 
     return 0;
 }
@@ -724,6 +747,25 @@ virQEMUDriverConfigLoadRPCEntry(virQEMUDriverConfigPtr cfg,
 {
     if (virConfGetValueUInt(conf, "max_queued", &cfg->maxQueuedJobs) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "query_job_timeout", &cfg->queryJobTimeout) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "modify_job_timeout", &cfg->modifyJobTimeout) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "nested_job_timeout", &cfg->nestedJobTimeout) < 0)
+        return -1;
+    if (cfg->queryJobTimeout == 0 ||
+        cfg->modifyJobTimeout == 0 ||
+        cfg->nestedJobTimeout == 0) {
+        virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                       _("job timeouts must be greater than zero"));
+        return -1;
+    }
+    if (virConfGetValueUInt(conf, "stats_max_workers", &cfg->statsMaxWorkers) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_domain_timeout", &cfg->statsDomainTimeout) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_cache_ttl", &cfg->statsCacheTTL) < 0)
+        return -1;
     if (virConfGetValueInt(conf, "keepalive_interval", &cfg->keepAliveInterval) < 0)
         return -1;
     if (virConfGetValueUInt(conf, "keepalive_count", &cfg->keepAliveCount) < 0)
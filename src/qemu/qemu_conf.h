@@ -48,9 +48,20 @@
 #include "virfile.h"
 #include "virfilecache.h"
 #include "virfirmware.h"
+#include "virdomainstatuswriter.h"
 
 #define QEMU_DRIVER_NAME "QEMU"
 
+/* VIR_DOMAIN_EVENT_ID_STATS_CHANGE setting of a connection */
+typedef struct _virQEMUDriverStatsEventSub virQEMUDriverStatsEventSub;
+typedef virQEMUDriverStatsEventSub *virQEMUDriverStatsEventSubPtr;
+struct _virQEMUDriverStatsEventSub {
+    virConnectPtr conn; /* not referenced, dropped in qemuConnectClose */
+    unsigned int stats;
+    unsigned int interval;
+    unsigned long long generation; /* stats events generation when set */
+};
+
 typedef struct _virQEMUDriver virQEMUDriver;
 typedef virQEMUDriver *virQEMUDriverPtr;
 
@@ -172,6 +183,13 @@ struct _virQEMUDriverConfig {
     bool dumpGuestCore;
 
     unsigned int maxQueuedJobs;
+    unsigned int queryJobTimeout;
+    unsigned int modifyJobTimeout;
+    unsigned int nestedJobTimeout;
+
+    unsigned int statsMaxWorkers;
+    unsigned int statsDomainTimeout;
+    unsigned int statsCacheTTL;
 
     char **securityDriverNames;
     bool securityDefaultConfined;
@@ -185,6 +203,9 @@ struct _virQEMUDriverConfig {
     bool autoDumpBypassCache;
     bool autoStartBypassCache;
 
+    unsigned int imageIOBufferSize; /* in KiB */
+    unsigned int imageIOBuffers;
+
     char *lockManagerName;
 
     int keepAliveInterval;
@@ -237,6 +258,10 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable pointer, self-locking APIs. NULL if parallel
+     * stats collection is disabled */
+    virThreadPoolPtr statsPool;
+
     /* Atomic increment only */
     int lastvmid;
 
@@ -315,6 +340,19 @@ struct _virQEMUDriver {
 
     /* Immutable pointer, self-locking APIs */
     virHashAtomicPtr migrationErrors;
+
+    /* Immutable pointer, self-locking APIs */
+    virDomainStatusWriterPtr statusWriter;
+
+    /* Periodic VIR_DOMAIN_EVENT_ID_STATS_CHANGE emission. The thread is
+     * started on first use, everything else requires 'lock' */
+    virThread statsEventThread;
+    bool statsEventThreadActive;
+    virCond statsEventCond;
+    bool statsEventQuit;
+    virQEMUDriverStatsEventSubPtr statsEventSubs;
+    size_t nstatsEventSubs;
+    unsigned long long statsEventGeneration;
 };
 
 virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged,
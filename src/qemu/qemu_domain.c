@@ -374,6 +374,8 @@ qemuDomainObjResetJob(qemuDomainObjPrivatePtr priv)
     job->owner = 0;
     job->ownerAPI = NULL;
     job->started = 0;
+    /* the array is kept for the next shared job */
+    job->sharedQueries = 0;
 }
 
 
@@ -435,6 +437,8 @@ qemuDomainObjFreeJob(qemuDomainObjPrivatePtr priv)
 {
     qemuDomainObjResetJob(priv);
     qemuDomainObjResetAsyncJob(priv);
+    VIR_FREE(priv->job.sharedHolders);
+    priv->job.sharedHolders_max = 0;
     g_clear_pointer(&priv->job.current, qemuDomainJobInfoFree);
     g_clear_pointer(&priv->job.completed, qemuDomainJobInfoFree);
     virCondDestroy(&priv->job.cond);
@@ -2254,6 +2258,19 @@ qemuDomainObjPrivateAlloc(void *opaque)
     return NULL;
 }
 
+
+void
+qemuDomainStatsEventGroupsFree(qemuDomainStatsEventGroupPtr groups,
+                               size_t ngroups)
+{
+    size_t i;
+
+    for (i = 0; i < ngroups; i++)
+        virTypedParamsFree(groups[i].params, groups[i].nparams);
+    g_free(groups);
+}
+
+
 /**
  * qemuDomainObjPrivateDataClear:
  * @priv: domain private data
@@ -2330,6 +2347,13 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     priv->dbusVMStateIds = NULL;
 
     priv->dbusVMState = false;
+
+    qemuDomainStatsEventGroupsFree(priv->statsEventGroups,
+                                   priv->nstatsEventGroups);
+    priv->statsEventGroups = NULL;
+    priv->nstatsEventGroups = 0;
+    priv->statsEventGeneration = 0;
+    priv->statsEventFull = false;
 }
 
 
@@ -6061,6 +6085,10 @@ qemuDomainPostParseDataFree(void *parseOpaque)
 }
 
 
+/* The callbacks run in parallel while the configs are loaded. They only
+ * read the driver config and the QEMU capabilities, which are not
+ * modified once handed out, and use the capabilities cache and the
+ * security manager, both of which lock themselves. */
 virDomainDefParserConfig virQEMUDriverDomainDefParserConfig = {
     .domainPostParseBasicCallback = qemuDomainDefPostParseBasic,
     .domainPostParseDataAlloc = qemuDomainPostParseDataAlloc,
@@ -6084,12 +6112,42 @@ static void
 qemuDomainObjSaveStatus(virQEMUDriverPtr driver,
                         virDomainObjPtr obj)
 {
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    int rc;
+
+    if (!virDomainObjIsActive(obj))
+        return;
+
+    if (driver->statusWriter) {
+        rc = virDomainStatusWriterSave(driver->statusWriter, obj);
+    } else {
+        cfg = virQEMUDriverGetConfig(driver);
+        rc = virDomainObjSave(obj, driver->xmlopt, cfg->stateDir);
+    }
 
-    if (virDomainObjIsActive(obj)) {
-        if (virDomainObjSave(obj, driver->xmlopt, cfg->stateDir) < 0)
-            VIR_WARN("Failed to save status on vm %s", obj->def->name);
+    if (rc < 0)
+        VIR_WARN("Failed to save status on vm %s", obj->def->name);
+}
+
+
+/*
+ * Like qemuDomainObjSaveStatus, but the status XML is written from the
+ * status writer thread shortly afterwards so that a burst of updates
+ * results in a single write. Only to be used where losing the update on
+ * a daemon crash is harmless, i.e. the state is either refreshed from
+ * QEMU on reconnect or a later synchronous save follows.
+ */
+static void
+qemuDomainObjSaveStatusLater(virQEMUDriverPtr driver,
+                             virDomainObjPtr obj)
+{
+    if (!driver->statusWriter) {
+        qemuDomainObjSaveStatus(driver, obj);
+        return;
     }
+
+    if (virDomainObjIsActive(obj))
+        virDomainStatusWriterSchedule(driver->statusWriter, obj);
 }
 
 
@@ -6100,6 +6158,13 @@ qemuDomainSaveStatus(virDomainObjPtr obj)
 }
 
 
+void
+qemuDomainSaveStatusLater(virDomainObjPtr obj)
+{
+    qemuDomainObjSaveStatusLater(QEMU_DOMAIN_PRIVATE(obj)->driver, obj);
+}
+
+
 void
 qemuDomainSaveConfig(virDomainObjPtr obj)
 {
@@ -6201,19 +6266,259 @@ qemuDomainJobAllowed(qemuDomainObjPrivatePtr priv, qemuDomainJob job)
     return !priv->job.active && qemuDomainNestedJobAllowed(priv, job);
 }
 
+static bool
+qemuDomainObjCanShareJob(qemuDomainObjPrivatePtr priv,
+                         qemuDomainJob job,
+                         bool shared)
+{
+    return shared && job == QEMU_JOB_QUERY &&
+           priv->job.active == QEMU_JOB_QUERY &&
+           priv->job.sharedQueries > 0;
+}
+
 static bool
 qemuDomainObjCanSetJob(qemuDomainObjPrivatePtr priv,
                        qemuDomainJob job,
-                       qemuDomainAgentJob agentJob)
+                       qemuDomainAgentJob agentJob,
+                       bool shared)
 {
     return ((job == QEMU_JOB_NONE ||
-             priv->job.active == QEMU_JOB_NONE) &&
+             priv->job.active == QEMU_JOB_NONE ||
+             qemuDomainObjCanShareJob(priv, job, shared)) &&
             (agentJob == QEMU_AGENT_JOB_NONE ||
              priv->job.agentActive == QEMU_AGENT_JOB_NONE));
 }
 
-/* Give up waiting for mutex after 30 seconds */
-#define QEMU_JOB_WAIT_TIME (1000ull * 30)
+/* A waiter can be overtaken by this many waiters of a higher class before
+ * it gets the job regardless of its class */
+#define QEMU_JOB_QUEUE_MAX_BYPASS 8
+
+static qemuDomainJobClass
+qemuDomainJobGetClass(qemuDomainJob job,
+                      qemuDomainAgentJob agentJob)
+{
+    if (job == QEMU_JOB_ASYNC_NESTED)
+        return QEMU_DOMAIN_JOB_CLASS_NESTED;
+
+    if (job == QEMU_JOB_QUERY ||
+        (job == QEMU_JOB_NONE && agentJob == QEMU_AGENT_JOB_QUERY))
+        return QEMU_DOMAIN_JOB_CLASS_QUERY;
+
+    return QEMU_DOMAIN_JOB_CLASS_MODIFY;
+}
+
+
+static unsigned long long
+qemuDomainJobClassTimeout(virQEMUDriverConfigPtr cfg,
+                          qemuDomainJobClass jobClass)
+{
+    switch (jobClass) {
+    case QEMU_DOMAIN_JOB_CLASS_QUERY:
+        return cfg->queryJobTimeout * 1000ull;
+    case QEMU_DOMAIN_JOB_CLASS_NESTED:
+        return cfg->nestedJobTimeout * 1000ull;
+    case QEMU_DOMAIN_JOB_CLASS_MODIFY:
+    case QEMU_DOMAIN_JOB_CLASS_LAST:
+        break;
+    }
+
+    return cfg->modifyJobTimeout * 1000ull;
+}
+
+
+/* Queues @waiter in its class, ordered by tickets */
+static void
+qemuDomainObjJobQueueAdd(qemuDomainObjPrivatePtr priv,
+                         qemuDomainJobWaiterPtr waiter)
+{
+    qemuDomainJobWaiterPtr *tail = &priv->job.queue[waiter->jobClass];
+
+    while (*tail && (*tail)->ticket < waiter->ticket)
+        tail = &(*tail)->next;
+
+    waiter->next = *tail;
+    waiter->inQueue = true;
+    *tail = waiter;
+    priv->job.queueDepth++;
+}
+
+
+static void
+qemuDomainObjJobQueueRemove(qemuDomainObjPrivatePtr priv,
+                            qemuDomainJobWaiterPtr waiter)
+{
+    qemuDomainJobWaiterPtr *prev = &priv->job.queue[waiter->jobClass];
+
+    if (!waiter->inQueue)
+        return;
+
+    while (*prev != waiter)
+        prev = &(*prev)->next;
+
+    *prev = waiter->next;
+    waiter->next = NULL;
+    waiter->inQueue = false;
+    priv->job.queueDepth--;
+}
+
+
+/* Returns the waiter that is supposed to get the job next: the head of the
+ * highest class unless a waiter of a lower class was overtaken too often */
+static qemuDomainJobWaiterPtr
+qemuDomainObjJobQueueNext(qemuDomainObjPrivatePtr priv)
+{
+    qemuDomainJobWaiterPtr next = NULL;
+    qemuDomainJobWaiterPtr starved = NULL;
+    size_t i;
+
+    for (i = 0; i < QEMU_DOMAIN_JOB_CLASS_LAST; i++) {
+        qemuDomainJobWaiterPtr head = priv->job.queue[i];
+
+        if (!head)
+            continue;
+
+        next = head;
+
+        if (head->bypassed >= QEMU_JOB_QUEUE_MAX_BYPASS &&
+            (!starved || head->queued < starved->queued))
+            starved = head;
+    }
+
+    return starved ? starved : next;
+}
+
+
+/* Takes @waiter out of the queue once it got the job */
+static void
+qemuDomainObjJobQueueGrant(qemuDomainObjPrivatePtr priv,
+                           qemuDomainJobWaiterPtr waiter,
+                           unsigned long long now)
+{
+    size_t i;
+
+    if (!waiter->inQueue) {
+        priv->job.queueLastWait = 0;
+        return;
+    }
+
+    qemuDomainObjJobQueueRemove(priv, waiter);
+    priv->job.queueLastWait = now - waiter->queued;
+
+    for (i = 0; i < waiter->jobClass; i++) {
+        if (priv->job.queue[i])
+            priv->job.queue[i]->bypassed++;
+    }
+}
+
+
+/* Records the calling thread as a holder of the shared job. The room
+ * for it must have been reserved in advance. */
+static void
+qemuDomainObjAddJobHolder(qemuDomainObjPrivatePtr priv)
+{
+    qemuDomainJobHolder holder = {
+        .owner = virThreadSelfID(),
+        .ownerAPI = virThreadJobGet(),
+    };
+
+    VIR_APPEND_ELEMENT_INPLACE(priv->job.sharedHolders,
+                               priv->job.sharedQueries, holder);
+}
+
+
+/* Forgets the calling thread as a holder of the shared job. The job is
+ * handed over to the oldest remaining holder if the caller owned it. */
+static void
+qemuDomainObjRemoveJobHolder(qemuDomainObjPrivatePtr priv)
+{
+    unsigned long long self = virThreadSelfID();
+    size_t i;
+
+    for (i = 0; i < priv->job.sharedQueries - 1; i++) {
+        if (priv->job.sharedHolders[i].owner == self)
+            break;
+    }
+
+    ignore_value(VIR_DELETE_ELEMENT(priv->job.sharedHolders, i,
+                                    priv->job.sharedQueries));
+
+    priv->job.owner = priv->job.sharedHolders[0].owner;
+    priv->job.ownerAPI = priv->job.sharedHolders[0].ownerAPI;
+}
+
+
+/**
+ * qemuDomainObjGetJobQueueInfo:
+ * @obj: domain object
+ * @depth: filled with the number of threads waiting for a job
+ * @wait: filled with how long the longest waiting thread waits (ms)
+ * @lastWait: filled with how long the last started job waited (ms)
+ *
+ * @obj must be locked before calling.
+ */
+void
+qemuDomainObjGetJobQueueInfo(virDomainObjPtr obj,
+                             size_t *depth,
+                             unsigned long long *wait,
+                             unsigned long long *lastWait)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    unsigned long long now;
+    size_t i;
+
+    *depth = priv->job.queueDepth;
+    *lastWait = priv->job.queueLastWait;
+    *wait = 0;
+
+    if (virTimeMillisNow(&now) < 0)
+        return;
+
+    for (i = 0; i < QEMU_DOMAIN_JOB_CLASS_LAST; i++) {
+        qemuDomainJobWaiterPtr head = priv->job.queue[i];
+
+        if (head && now - head->queued > *wait)
+            *wait = now - head->queued;
+    }
+}
+
+
+/**
+ * qemuDomainObjJobQueueInfoToParams:
+ * @obj: domain object
+ * @params: typed parameters to append the queue statistics to
+ * @nparams: number of @params
+ *
+ * Appends the job queue statistics of @obj to @params. They are
+ * meaningful whether or not there's an active job. @obj must be
+ * locked before calling.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainObjJobQueueInfoToParams(virDomainObjPtr obj,
+                                  virTypedParameterPtr *params,
+                                  int *nparams)
+{
+    size_t depth;
+    unsigned long long wait;
+    unsigned long long lastWait;
+    int maxpar = *nparams;
+
+    qemuDomainObjGetJobQueueInfo(obj, &depth, &wait, &lastWait);
+
+    if (virTypedParamsAddULLong(params, nparams, &maxpar,
+                                VIR_DOMAIN_JOB_QUEUE_DEPTH,
+                                depth) < 0 ||
+        virTypedParamsAddULLong(params, nparams, &maxpar,
+                                VIR_DOMAIN_JOB_QUEUE_WAIT,
+                                wait) < 0 ||
+        virTypedParamsAddULLong(params, nparams, &maxpar,
+                                VIR_DOMAIN_JOB_QUEUE_WAIT_LAST,
+                                lastWait) < 0)
+        return -1;
+
+    return 0;
+}
 
 /**
  * qemuDomainObjBeginJobInternal:
@@ -6222,11 +6527,18 @@ qemuDomainObjCanSetJob(qemuDomainObjPrivatePtr priv,
  * @job: qemuDomainJob to start
  * @asyncJob: qemuDomainAsyncJob to start
  * @nowait: don't wait trying to acquire @job
+ * @timeout: how long to wait for @job (in milliseconds), 0 to use
+ *           the timeout configured for the class of @job
+ * @shared: allow other threads to hold the same QEMU_JOB_QUERY
  *
  * Acquires job for a domain object which must be locked before
- * calling. If there's already a job running waits up to
- * QEMU_JOB_WAIT_TIME after which the functions fails reporting
- * an error unless @nowait is set.
+ * calling. If there's already a job running waits up to @timeout
+ * after which the functions fails reporting an error unless
+ * @nowait is set.
+ *
+ * Threads waiting for @job are queued and get the job in the order
+ * they came, higher classes first (see qemuDomainJobClass). A thread
+ * can't get the job ahead of a waiting one even if the job is free.
  *
  * If @nowait is true this function tries to acquire job and if
  * it fails, then it returns immediately without waiting. No
@@ -6243,7 +6555,9 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
                               qemuDomainJob job,
                               qemuDomainAgentJob agentJob,
                               qemuDomainAsyncJob asyncJob,
-                              bool nowait)
+                              bool nowait,
+                              unsigned long long timeout,
+                              bool shared)
 {
     qemuDomainObjPrivatePtr priv = obj->privateData;
     unsigned long long now;
@@ -6257,6 +6571,8 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     unsigned long long duration = 0;
     unsigned long long agentDuration = 0;
     unsigned long long asyncDuration = 0;
+    qemuDomainJobWaiter waiter = { 0 };
+    int saved_errno;
 
     VIR_DEBUG("Starting job: job=%s agentJob=%s asyncJob=%s "
               "(vm=%p name=%s, current job=%s agentJob=%s async=%s)",
@@ -6271,8 +6587,12 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
+    waiter.jobClass = qemuDomainJobGetClass(job, agentJob);
+    if (timeout == 0)
+        timeout = qemuDomainJobClassTimeout(cfg, waiter.jobClass);
+
     priv->jobs_queued++;
-    then = now + QEMU_JOB_WAIT_TIME;
+    then = now + timeout;
 
  retry:
     if ((!async && job != QEMU_JOB_DESTROY) &&
@@ -6290,23 +6610,62 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
             goto error;
     }
 
-    while (!qemuDomainObjCanSetJob(priv, job, agentJob)) {
+    if (job) {
+        /* Don't jump the queue */
+        if (nowait && priv->job.queueDepth > 0)
+            goto cleanup;
+
+        if (!nowait) {
+            /* keep the place in the queue when coming back after an
+             * async job was started */
+            if (!waiter.ticket) {
+                ignore_value(virTimeMillisNow(&waiter.queued));
+                waiter.ticket = ++priv->job.queueTickets;
+            }
+            qemuDomainObjJobQueueAdd(priv, &waiter);
+        }
+    }
+
+    while (!qemuDomainObjCanSetJob(priv, job, agentJob, shared) ||
+           (waiter.inQueue && qemuDomainObjJobQueueNext(priv) != &waiter)) {
         if (nowait)
             goto cleanup;
 
-        VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
+        VIR_DEBUG("Waiting for job (vm=%p name=%s queued=%zu)",
+                  obj, obj->def->name, priv->job.queueDepth);
         if (virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then) < 0)
             goto error;
     }
 
     /* No job is active but a new async job could have been started while obj
      * was unlocked, so we need to recheck it. */
-    if (!nested && !qemuDomainNestedJobAllowed(priv, job))
+    if (!nested && !qemuDomainNestedJobAllowed(priv, job)) {
+        /* let the next waiter in line have the job meanwhile */
+        qemuDomainObjJobQueueRemove(priv, &waiter);
+        virCondBroadcast(&priv->job.cond);
         goto retry;
+    }
+
+    /* Once the job is granted there's no way back, so make room for
+     * the holder first */
+    if (shared &&
+        VIR_RESIZE_N(priv->job.sharedHolders, priv->job.sharedHolders_max,
+                     priv->job.sharedQueries, 1) < 0)
+        goto error;
 
     ignore_value(virTimeMillisNow(&now));
 
-    if (job) {
+    if (job)
+        qemuDomainObjJobQueueGrant(priv, &waiter, now);
+
+    if (qemuDomainObjCanShareJob(priv, job, shared)) {
+        qemuDomainObjAddJobHolder(priv);
+        VIR_DEBUG("Joined shared job: %s (holders=%zu vm=%p name=%s)",
+                  qemuDomainJobTypeToString(job), priv->job.sharedQueries,
+                  obj, obj->def->name);
+        /* the next waiter in line may want to share the job as well */
+        virCondBroadcast(&priv->job.cond);
+    } else if (job) {
         qemuDomainObjResetJob(priv);
 
         if (job != QEMU_JOB_ASYNC) {
@@ -6318,6 +6677,10 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
             priv->job.owner = virThreadSelfID();
             priv->job.ownerAPI = virThreadJobGet();
             priv->job.started = now;
+            if (shared) {
+                qemuDomainObjAddJobHolder(priv);
+                virCondBroadcast(&priv->job.cond);
+            }
         } else {
             VIR_DEBUG("Started async job: %s (vm=%p name=%s)",
                       qemuDomainAsyncJobTypeToString(asyncJob),
@@ -6347,12 +6710,22 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
         priv->job.agentStarted = now;
     }
 
+    /* qemuProcessRecoverJob relies on tracked jobs being recorded in
+     * the status XML in case the daemon dies, don't defer the write */
     if (qemuDomainTrackJob(job))
         qemuDomainObjSaveStatus(driver, obj);
 
     return 0;
 
  error:
+    saved_errno = errno;
+    if (waiter.inQueue) {
+        /* the waiters behind us might be able to get the job now */
+        qemuDomainObjJobQueueRemove(priv, &waiter);
+        virCondBroadcast(&priv->job.cond);
+    }
+    errno = saved_errno;
+
     ignore_value(virTimeMillisNow(&now));
     if (priv->job.active && priv->job.started)
         duration = now - priv->job.started;
@@ -6458,7 +6831,8 @@ int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
 {
     if (qemuDomainObjBeginJobInternal(driver, obj, job,
                                       QEMU_AGENT_JOB_NONE,
-                                      QEMU_ASYNC_JOB_NONE, false) < 0)
+                                      QEMU_ASYNC_JOB_NONE, false, 0,
+                                      false) < 0)
         return -1;
     else
         return 0;
@@ -6478,7 +6852,8 @@ qemuDomainObjBeginAgentJob(virQEMUDriverPtr driver,
 {
     return qemuDomainObjBeginJobInternal(driver, obj, QEMU_JOB_NONE,
                                          agentJob,
-                                         QEMU_ASYNC_JOB_NONE, false);
+                                         QEMU_ASYNC_JOB_NONE, false, 0,
+                                         false);
 }
 
 int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
@@ -6491,7 +6866,7 @@ int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
 
     if (qemuDomainObjBeginJobInternal(driver, obj, QEMU_JOB_ASYNC,
                                       QEMU_AGENT_JOB_NONE,
-                                      asyncJob, false) < 0)
+                                      asyncJob, false, 0, false) < 0)
         return -1;
 
     priv = obj->privateData;
@@ -6523,7 +6898,7 @@ qemuDomainObjBeginNestedJob(virQEMUDriverPtr driver,
                                          QEMU_JOB_ASYNC_NESTED,
                                          QEMU_AGENT_JOB_NONE,
                                          QEMU_ASYNC_JOB_NONE,
-                                         false);
+                                         false, 0, false);
 }
 
 /**
@@ -6546,7 +6921,37 @@ qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
 {
     return qemuDomainObjBeginJobInternal(driver, obj, job,
                                          QEMU_AGENT_JOB_NONE,
-                                         QEMU_ASYNC_JOB_NONE, true);
+                                         QEMU_ASYNC_JOB_NONE, true, 0,
+                                         false);
+}
+
+/**
+ * qemuDomainObjBeginSharedQueryJob:
+ *
+ * @driver: qemu driver
+ * @obj: domain object
+ * @nowait: don't wait trying to acquire the job
+ * @timeout: how long to wait for the job (in milliseconds), 0 to use
+ *           the configured query_job_timeout
+ *
+ * Acquires a QEMU_JOB_QUERY which other threads can hold at the same
+ * time as long as they acquired it by this function as well. Callers
+ * must only read the domain state and the data they gather must not
+ * depend on the domain being unchanged between two monitor calls.
+ * Shared jobs are ended by qemuDomainObjEndJob.
+ *
+ * Returns: see qemuDomainObjBeginJobInternal
+ */
+int
+qemuDomainObjBeginSharedQueryJob(virQEMUDriverPtr driver,
+                                 virDomainObjPtr obj,
+                                 bool nowait,
+                                 unsigned long long timeout)
+{
+    return qemuDomainObjBeginJobInternal(driver, obj, QEMU_JOB_QUERY,
+                                         QEMU_AGENT_JOB_NONE,
+                                         QEMU_ASYNC_JOB_NONE, nowait,
+                                         timeout, true);
 }
 
 /*
@@ -6563,6 +6968,14 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
 
     priv->jobs_queued--;
 
+    if (priv->job.sharedQueries > 1) {
+        qemuDomainObjRemoveJobHolder(priv);
+        VIR_DEBUG("Leaving shared job: %s (holders=%zu vm=%p name=%s)",
+                  qemuDomainJobTypeToString(job), priv->job.sharedQueries,
+                  obj, obj->def->name);
+        return;
+    }
+
     VIR_DEBUG("Stopping job: %s (async=%s vm=%p name=%s)",
               qemuDomainJobTypeToString(job),
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
@@ -6654,7 +7067,8 @@ qemuDomainObjEnterMonitorInternal(virQEMUDriverPtr driver,
     } else if (priv->job.asyncOwner == virThreadSelfID()) {
         VIR_WARN("This thread seems to be the async job owner; entering"
                  " monitor without asking for a nested job is dangerous");
-    } else if (priv->job.owner != virThreadSelfID()) {
+    } else if (priv->job.owner != virThreadSelfID() &&
+               priv->job.sharedQueries == 0) {
         VIR_WARN("Entering a monitor without owning a job. "
                  "Job %s owner %s (%llu)",
                  qemuDomainJobTypeToString(priv->job.active),
@@ -13620,3 +14034,319 @@ qemuDomainInitializePflashStorageSource(virDomainObjPtr vm)
 
     return 0;
 }
+
+
+typedef struct _qemuDomainStatsBatchTask qemuDomainStatsBatchTask;
+typedef qemuDomainStatsBatchTask *qemuDomainStatsBatchTaskPtr;
+typedef struct _qemuDomainStatsBatch qemuDomainStatsBatch;
+typedef qemuDomainStatsBatch *qemuDomainStatsBatchPtr;
+
+struct _qemuDomainStatsBatchTask {
+    qemuDomainStatsBatchPtr batch;
+    virDomainObjPtr vm;
+
+    /* the following members are protected by the lock of @batch */
+    bool done;
+    bool abandoned; /* the caller stopped waiting for the task */
+    int rv;
+    virErrorPtr err;
+    virDomainStatsRecordPtr record;
+};
+
+struct _qemuDomainStatsBatch {
+    virMutex lock;
+    virCond cond;
+    size_t refs; /* the caller and each task not finished yet */
+    size_t pending; /* number of tasks not finished yet */
+    unsigned long long deadline;
+
+    qemuDomainStatsBatchCollect collect;
+    void *opaque;
+    virFreeCallback opaqueFree;
+
+    qemuDomainStatsBatchTaskPtr tasks;
+    size_t ntasks;
+};
+
+
+static void
+qemuDomainStatsRecordFree(virDomainStatsRecordPtr record)
+{
+    if (!record)
+        return;
+
+    virTypedParamsFree(record->params, record->nparams);
+    virObjectUnref(record->dom);
+    g_free(record);
+}
+
+
+static void
+qemuDomainStatsBatchFree(qemuDomainStatsBatchPtr batch)
+{
+    size_t i;
+
+    for (i = 0; i < batch->ntasks; i++) {
+        virObjectUnref(batch->tasks[i].vm);
+        virFreeError(batch->tasks[i].err);
+        qemuDomainStatsRecordFree(batch->tasks[i].record);
+    }
+    g_free(batch->tasks);
+
+    if (batch->opaqueFree)
+        batch->opaqueFree(batch->opaque);
+
+    virCondDestroy(&batch->cond);
+    virMutexDestroy(&batch->lock);
+    g_free(batch);
+}
+
+
+/*
+ * Drops a reference to @batch, whose lock must be held by the caller.
+ * The lock is released. Returns true if @batch was freed.
+ */
+static bool
+qemuDomainStatsBatchUnrefLocked(qemuDomainStatsBatchPtr batch)
+{
+    bool last = --batch->refs == 0;
+
+    virMutexUnlock(&batch->lock);
+
+    if (last)
+        qemuDomainStatsBatchFree(batch);
+
+    return last;
+}
+
+
+/**
+ * qemuDomainStatsBatchWorker:
+ * @jobdata: the task to run
+ * @opaque: unused
+ *
+ * Thread pool worker running a single task of qemuDomainStatsBatchRun.
+ * A task which takes longer than the batch allows is detached: its
+ * record is dropped once it finishes. Monitor commands of the task
+ * give up at the deadline of the batch, so that the task releases the
+ * domain job and the thread soon after it was detached.
+ */
+void
+qemuDomainStatsBatchWorker(void *jobdata,
+                           void *opaque G_GNUC_UNUSED)
+{
+    qemuDomainStatsBatchTaskPtr task = jobdata;
+    qemuDomainStatsBatchPtr batch = task->batch;
+    qemuDomainObjPrivatePtr priv = task->vm->privateData;
+    virDomainStatsRecordPtr record = NULL;
+    virErrorPtr err = NULL;
+    unsigned long long now;
+    unsigned long long timeout = 1;
+    bool abandoned;
+    int rv = 0;
+
+    virMutexLock(&batch->lock);
+    abandoned = task->abandoned;
+    virMutexUnlock(&batch->lock);
+
+    /* the task might have waited in the queue for too long already */
+    if (!abandoned) {
+        /* give up waiting for the job at the deadline of the batch,
+         * but try to acquire it at least */
+        if (virTimeMillisNow(&now) == 0 && batch->deadline > now)
+            timeout = batch->deadline - now;
+
+        qemuMonitorSetThreadDeadline(batch->deadline);
+
+        virObjectLock(task->vm);
+        rv = batch->collect(task->vm, false, timeout, &record, batch->opaque);
+        virObjectUnlock(task->vm);
+
+        qemuMonitorSetThreadDeadline(0);
+
+        if (rv < 0)
+            virErrorPreserveLast(&err);
+    }
+
+    virMutexLock(&batch->lock);
+    if (task->abandoned) {
+        qemuDomainStatsRecordFree(record);
+        virFreeError(err);
+        g_atomic_int_add(&priv->statsStuck, -1);
+    } else {
+        task->rv = rv;
+        task->err = err;
+        task->record = record;
+    }
+    task->done = true;
+
+    if (--batch->pending == 0)
+        virCondSignal(&batch->cond);
+    qemuDomainStatsBatchUnrefLocked(batch);
+}
+
+
+/**
+ * qemuDomainStatsBatchRun:
+ * @pool: thread pool created with qemuDomainStatsBatchWorker
+ * @vms: domain objects to gather the statistics of
+ * @nvms: number of domains in @vms
+ * @timeout: how long to wait for all statistics (in milliseconds)
+ * @collect: callback gathering the statistics of a single domain
+ * @opaque: data passed to @collect
+ * @opaqueFree: callback to free @opaque with
+ * @records: array of at least @nvms elements to store the records into
+ *
+ * Runs @collect for each domain in @vms on @pool and stores the records
+ * into @records in the order of @vms. Tasks which did not finish within
+ * @timeout are detached. For their domains @collect is called with
+ * @partial set instead, which must only gather the statistics that
+ * don't need the monitor. Since detached tasks may still access it,
+ * @opaque is owned by the batch and freed once all tasks are done.
+ *
+ * Domains with a detached task still running don't get another task,
+ * which would only wait for the same monitor, but a partial record right
+ * away. A domain whose monitor hangs thus occupies at most one thread of
+ * @pool.
+ *
+ * Returns the number of records stored on success, -1 otherwise.
+ */
+int
+qemuDomainStatsBatchRun(virThreadPoolPtr pool,
+                        virDomainObjPtr *vms,
+                        size_t nvms,
+                        unsigned long long timeout,
+                        qemuDomainStatsBatchCollect collect,
+                        void *opaque,
+                        virFreeCallback opaqueFree,
+                        virDomainStatsRecordPtr *records)
+{
+    qemuDomainStatsBatchPtr batch;
+    g_autofree bool *abandoned = NULL;
+    virErrorPtr err = NULL;
+    int nrecords = 0;
+    size_t i;
+
+    batch = g_new0(qemuDomainStatsBatch, 1);
+    batch->collect = collect;
+    batch->opaque = opaque;
+    batch->opaqueFree = opaqueFree;
+
+    if (virMutexInit(&batch->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        if (opaqueFree)
+            opaqueFree(opaque);
+        g_free(batch);
+        return -1;
+    }
+
+    if (virCondInit(&batch->cond) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize condition"));
+        virMutexDestroy(&batch->lock);
+        if (opaqueFree)
+            opaqueFree(opaque);
+        g_free(batch);
+        return -1;
+    }
+
+    if (virTimeMillisNow(&batch->deadline) < 0) {
+        virMutexLock(&batch->lock);
+        batch->refs = 1;
+        qemuDomainStatsBatchUnrefLocked(batch);
+        return -1;
+    }
+    batch->deadline += timeout;
+
+    batch->tasks = g_new0(qemuDomainStatsBatchTask, nvms);
+    batch->ntasks = nvms;
+    batch->refs = 1;
+    abandoned = g_new0(bool, nvms);
+
+    for (i = 0; i < nvms; i++) {
+        qemuDomainStatsBatchTaskPtr task = &batch->tasks[i];
+        qemuDomainObjPrivatePtr priv = vms[i]->privateData;
+
+        task->batch = batch;
+        task->vm = virObjectRef(vms[i]);
+
+        if (g_atomic_int_get(&priv->statsStuck) > 0) {
+            VIR_DEBUG("Statistics of domain %p still being gathered",
+                      vms[i]);
+            task->done = true;
+            abandoned[i] = true;
+            continue;
+        }
+
+        virMutexLock(&batch->lock);
+        batch->refs++;
+        batch->pending++;
+        virMutexUnlock(&batch->lock);
+
+        /* Gather the stats in this thread if the job can't be queued */
+        if (virThreadPoolSendJob(pool, 0, task) < 0) {
+            virResetLastError();
+            qemuDomainStatsBatchWorker(task, NULL);
+        }
+    }
+
+    virMutexLock(&batch->lock);
+    while (batch->pending > 0) {
+        if (virCondWaitUntil(&batch->cond, &batch->lock,
+                             batch->deadline) < 0) {
+            if (errno == ETIMEDOUT)
+                break;
+            VIR_WARN("Unable to wait on stats collection condition");
+        }
+    }
+
+    for (i = 0; i < nvms; i++) {
+        qemuDomainStatsBatchTaskPtr task = &batch->tasks[i];
+        qemuDomainObjPrivatePtr priv = task->vm->privateData;
+
+        if (task->done)
+            continue;
+
+        /* dropped by the task when it finishes, which can't happen
+         * before it sees the flag under the lock */
+        task->abandoned = abandoned[i] = true;
+        g_atomic_int_inc(&priv->statsStuck);
+    }
+    virMutexUnlock(&batch->lock);
+
+    /* The tasks are either done or abandoned now, so their results
+     * can be accessed without the lock */
+    for (i = 0; i < nvms; i++) {
+        qemuDomainStatsBatchTaskPtr task = &batch->tasks[i];
+        virDomainStatsRecordPtr record = NULL;
+        int rv;
+
+        if (abandoned[i]) {
+            virObjectLock(task->vm);
+            VIR_WARN("Statistics of domain '%s' not gathered in time, "
+                     "reporting partial record", task->vm->def->name);
+            rv = collect(task->vm, true, 0, &record, batch->opaque);
+            virObjectUnlock(task->vm);
+
+            if (rv < 0 && !err)
+                virErrorPreserveLast(&err);
+        } else {
+            if (task->rv < 0 && !err)
+                err = g_steal_pointer(&task->err);
+            record = g_steal_pointer(&task->record);
+        }
+
+        if (record)
+            records[nrecords++] = record;
+    }
+
+    virMutexLock(&batch->lock);
+    qemuDomainStatsBatchUnrefLocked(batch);
+
+    if (err) {
+        virErrorRestore(&err);
+        return -1;
+    }
+
+    return nrecords;
+}
@@ -94,6 +94,35 @@ typedef enum {
 } qemuDomainAgentJob;
 VIR_ENUM_DECL(qemuDomainAgentJob);
 
+/* Priority classes of threads waiting for a job, in ascending order */
+typedef enum {
+    QEMU_DOMAIN_JOB_CLASS_QUERY = 0,    /* QEMU_JOB_QUERY */
+    QEMU_DOMAIN_JOB_CLASS_MODIFY,       /* any other job */
+    QEMU_DOMAIN_JOB_CLASS_NESTED,       /* QEMU_JOB_ASYNC_NESTED */
+
+    QEMU_DOMAIN_JOB_CLASS_LAST
+} qemuDomainJobClass;
+
+typedef struct _qemuDomainJobWaiter qemuDomainJobWaiter;
+typedef qemuDomainJobWaiter *qemuDomainJobWaiterPtr;
+struct _qemuDomainJobWaiter {
+    qemuDomainJobClass jobClass;
+    unsigned long long queued;          /* When the thread started waiting */
+    unsigned long long ticket;          /* Position in the queue, kept when
+                                           the waiter has to requeue */
+    unsigned int bypassed;              /* How many times a waiter of higher
+                                           class got the job first */
+    bool inQueue;
+    qemuDomainJobWaiterPtr next;
+};
+
+typedef struct _qemuDomainJobHolder qemuDomainJobHolder;
+typedef qemuDomainJobHolder *qemuDomainJobHolderPtr;
+struct _qemuDomainJobHolder {
+    unsigned long long owner;           /* Thread id */
+    const char *ownerAPI;               /* The API the thread runs */
+};
+
 /* Async job consists of a series of jobs that may change state. Independent
  * jobs that do not change state (and possibly others if explicitly allowed by
  * current async job) are allowed to be run even if async job is active.
@@ -197,6 +226,18 @@ struct _qemuDomainJobObj {
     unsigned long long owner;           /* Thread id which set current job */
     const char *ownerAPI;               /* The API which owns the job */
     unsigned long long started;         /* When the current job started */
+    qemuDomainJobHolderPtr sharedHolders; /* Threads holding a shared
+                                             QEMU_JOB_QUERY, the owner is
+                                             the oldest of them */
+    size_t sharedQueries;               /* Number of shared holders */
+    size_t sharedHolders_max;
+
+    /* Threads waiting for QEMU_JOB_*, one FIFO per class */
+    qemuDomainJobWaiterPtr queue[QEMU_DOMAIN_JOB_CLASS_LAST];
+    size_t queueDepth;                  /* Number of waiting threads */
+    unsigned long long queueTickets;    /* Last ticket given to a waiter */
+    unsigned long long queueLastWait;   /* How long the most recently
+                                           started job waited */
 
     /* The following members are for QEMU_AGENT_JOB_* */
     qemuDomainAgentJob agentActive;     /* Currently running agent job */
@@ -231,6 +272,7 @@ typedef void (*qemuDomainCleanupCallback)(virQEMUDriverPtr driver,
 #define QEMU_DOMAIN_MASTER_KEY_LEN 32  /* 32 bytes for 256 bit random key */
 
 void qemuDomainSaveStatus(virDomainObjPtr obj);
+void qemuDomainSaveStatusLater(virDomainObjPtr obj);
 void qemuDomainSaveConfig(virDomainObjPtr obj);
 
 
@@ -303,6 +345,17 @@ struct _qemuDomainSecretInfo {
     } s;
 };
 
+typedef struct _qemuDomainStatsEventGroup qemuDomainStatsEventGroup;
+typedef qemuDomainStatsEventGroup *qemuDomainStatsEventGroupPtr;
+struct _qemuDomainStatsEventGroup {
+    unsigned int stats; /* a single virDomainStatsTypes flag */
+    virTypedParameterPtr params;
+    int nparams;
+};
+
+void qemuDomainStatsEventGroupsFree(qemuDomainStatsEventGroupPtr groups,
+                                    size_t ngroups);
+
 typedef struct _qemuDomainObjPrivate qemuDomainObjPrivate;
 typedef qemuDomainObjPrivate *qemuDomainObjPrivatePtr;
 struct _qemuDomainObjPrivate {
@@ -338,6 +391,10 @@ struct _qemuDomainObjPrivate {
 
     int jobs_queued;
 
+    /* Number of stats tasks which outlived their batch and didn't finish
+     * yet, accessed atomically, see qemuDomainStatsBatchRun */
+    int statsStuck;
+
     unsigned long migMaxBandwidth;
     char *origname;
     int nbdPort; /* Port used for migration with NBD */
@@ -438,6 +495,15 @@ struct _qemuDomainObjPrivate {
     char **dbusVMStateIds;
     /* true if -object dbus-vmstate was added */
     bool dbusVMState;
+
+    /* statistics reported by the last VIR_DOMAIN_EVENT_ID_STATS_CHANGE
+     * events, one set per stats group, and the stats events generation
+     * of the collection they come from; statsEventFull is false if the
+     * listeners have to get the full set next time */
+    qemuDomainStatsEventGroupPtr statsEventGroups;
+    size_t nstatsEventGroups;
+    unsigned long long statsEventGeneration;
+    bool statsEventFull;
 };
 
 #define QEMU_DOMAIN_PRIVATE(vm) \
@@ -692,6 +758,11 @@ int qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
                                 virDomainObjPtr obj,
                                 qemuDomainJob job)
     G_GNUC_WARN_UNUSED_RESULT;
+int qemuDomainObjBeginSharedQueryJob(virQEMUDriverPtr driver,
+                                     virDomainObjPtr obj,
+                                     bool nowait,
+                                     unsigned long long timeout)
+    G_GNUC_WARN_UNUSED_RESULT;
 
 void qemuDomainObjEndJob(virQEMUDriverPtr driver,
                          virDomainObjPtr obj);
@@ -860,6 +931,14 @@ void qemuDomainSetFakeReboot(virQEMUDriverPtr driver,
                              virDomainObjPtr vm,
                              bool value);
 
+void qemuDomainObjGetJobQueueInfo(virDomainObjPtr obj,
+                                  size_t *depth,
+                                  unsigned long long *wait,
+                                  unsigned long long *lastWait);
+int qemuDomainObjJobQueueInfoToParams(virDomainObjPtr obj,
+                                      virTypedParameterPtr *params,
+                                      int *nparams);
+
 bool qemuDomainJobAllowed(qemuDomainObjPrivatePtr priv,
                           qemuDomainJob job);
 
@@ -1292,3 +1371,21 @@ qemuDomainMakeCPUMigratable(virCPUDefPtr cpu);
 
 int
 qemuDomainInitializePflashStorageSource(virDomainObjPtr vm);
+
+typedef int (*qemuDomainStatsBatchCollect)(virDomainObjPtr vm,
+                                           bool partial,
+                                           unsigned long long timeout,
+                                           virDomainStatsRecordPtr *record,
+                                           void *opaque);
+
+void qemuDomainStatsBatchWorker(void *jobdata,
+                                void *opaque);
+
+int qemuDomainStatsBatchRun(virThreadPoolPtr pool,
+                            virDomainObjPtr *vms,
+                            size_t nvms,
+                            unsigned long long timeout,
+                            qemuDomainStatsBatchCollect collect,
+                            void *opaque,
+                            virFreeCallback opaqueFree,
+                            virDomainStatsRecordPtr *records);
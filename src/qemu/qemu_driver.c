@@ -130,6 +130,10 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 #define QEMU_GUEST_VCPU_MAX_ID 4096
 
+/* Time in milliseconds status XML updates are collected before
+ * being written out, see qemuDomainSaveStatusLater */
+#define QEMU_STATUS_WRITE_DELAY 200
+
 #define QEMU_NB_BLKIO_PARAM  6
 
 #define QEMU_NB_BANDWIDTH_PARAM 7
@@ -138,6 +142,9 @@ static void qemuProcessEventHandler(void *data, void *opaque);
 
 static int qemuStateCleanup(void);
 
+static void qemuDomainStatsEventUnsubscribeLocked(virQEMUDriverPtr driver,
+                                                  virConnectPtr conn);
+
 static int qemuDomainObjStart(virConnectPtr conn,
                               virQEMUDriverPtr driver,
                               virDomainObjPtr vm,
@@ -652,6 +659,14 @@ qemuStateInitialize(bool privileged,
         return VIR_DRV_STATE_INIT_ERROR;
     }
 
+    if (virCondInit(&qemu_driver->statsEventCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition"));
+        virMutexDestroy(&qemu_driver->lock);
+        VIR_FREE(qemu_driver);
+        return VIR_DRV_STATE_INIT_ERROR;
+    }
+
     qemu_driver->inhibitCallback = callback;
     qemu_driver->inhibitOpaque = opaque;
 
@@ -937,6 +952,11 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->closeCallbacks = virCloseCallbacksNew()))
         goto error;
 
+    if (!(qemu_driver->statusWriter = virDomainStatusWriterNew(qemu_driver->xmlopt,
+                                                               cfg->stateDir,
+                                                               QEMU_STATUS_WRITE_DELAY)))
+        goto error;
+
     /* Get all the running persistent or transient configs first */
     if (virDomainObjListLoadAllConfigs(qemu_driver->domains,
                                        cfg->stateDir,
@@ -989,6 +1009,14 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    if (cfg->statsMaxWorkers > 0) {
+        qemu_driver->statsPool = virThreadPoolNewFull(0, cfg->statsMaxWorkers, 0,
+                                                      qemuDomainStatsBatchWorker,
+                                                      "qemu-stats", NULL);
+        if (!qemu_driver->statsPool)
+            goto error;
+    }
+
     qemuProcessReconnectAll(qemu_driver);
 
     if (virDriverShouldAutostart(cfg->stateDir, &autostart) < 0)
@@ -1031,6 +1059,10 @@ qemuStateReload(void)
     if (!qemu_driver)
         return 0;
 
+    /* status updates queued so far must not get lost if reloading
+     * the configs goes wrong */
+    virDomainStatusWriterFlush(qemu_driver->statusWriter);
+
     cfg = virQEMUDriverGetConfig(qemu_driver);
     virDomainObjListLoadAllConfigs(qemu_driver->domains,
                                    cfg->configDir,
@@ -1089,6 +1121,10 @@ qemuStateStop(void)
             ret = -1;
 
  cleanup:
+    /* the host is about to go down, get the status of the domains
+     * on disk */
+    virDomainStatusWriterFlush(qemu_driver->statusWriter);
+
     if (domains) {
         for (i = 0; i < numDomains; i++)
             virObjectUnref(domains[i]);
@@ -1109,6 +1145,16 @@ qemuStateCleanup(void)
     if (!qemu_driver)
         return -1;
 
+    if (qemu_driver->statsEventThreadActive) {
+        virMutexLock(&qemu_driver->lock);
+        qemu_driver->statsEventQuit = true;
+        virCondSignal(&qemu_driver->statsEventCond);
+        virMutexUnlock(&qemu_driver->lock);
+        virThreadJoin(&qemu_driver->statsEventThread);
+    }
+
+    /* write out whatever status updates are still queued */
+    virDomainStatusWriterFree(qemu_driver->statusWriter);
     virObjectUnref(qemu_driver->migrationErrors);
     virObjectUnref(qemu_driver->closeCallbacks);
     virLockManagerPluginUnref(qemu_driver->lockManager);
@@ -1129,11 +1175,14 @@ qemuStateCleanup(void)
     VIR_FREE(qemu_driver->qemuImgBinary);
     virObjectUnref(qemu_driver->domains);
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->statsPool);
 
     if (qemu_driver->lockFD != -1)
         virPidFileRelease(qemu_driver->config->stateDir, "driver", qemu_driver->lockFD);
 
     virObjectUnref(qemu_driver->config);
+    VIR_FREE(qemu_driver->statsEventSubs);
+    virCondDestroy(&qemu_driver->statsEventCond);
     virMutexDestroy(&qemu_driver->lock);
     VIR_FREE(qemu_driver);
 
@@ -1208,6 +1257,10 @@ static int qemuConnectClose(virConnectPtr conn)
     /* Get rid of callbacks registered for this conn */
     virCloseCallbacksRun(driver->closeCallbacks, conn, driver->domains, driver);
 
+    virMutexLock(&driver->lock);
+    qemuDomainStatsEventUnsubscribeLocked(driver, conn);
+    virMutexUnlock(&driver->lock);
+
     conn->privateData = NULL;
 
     return 0;
@@ -3180,6 +3233,18 @@ qemuOpenFileAs(uid_t fallback_uid, gid_t fallback_gid,
 }
 
 
+static virFileWrapperFdPtr
+qemuFileWrapperFDNew(virQEMUDriverConfigPtr cfg,
+                     int *fd,
+                     const char *path,
+                     unsigned int flags)
+{
+    return virFileWrapperFdNewFull(fd, path, flags,
+                                   cfg->imageIOBufferSize * 1024ULL,
+                                   cfg->imageIOBuffers);
+}
+
+
 static int
 qemuFileWrapperFDClose(virDomainObjPtr vm,
                        virFileWrapperFdPtr fd)
@@ -3248,7 +3313,7 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
     if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
         goto cleanup;
 
-    if (!(wrapperFd = virFileWrapperFdNew(&fd, path, wrapperFlags)))
+    if (!(wrapperFd = qemuFileWrapperFDNew(cfg, &fd, path, wrapperFlags)))
         goto cleanup;
 
     if (virQEMUSaveDataWrite(data, fd, path) < 0)
@@ -3822,7 +3887,7 @@ doCoreDump(virQEMUDriverPtr driver,
                              NULL)) < 0)
         goto cleanup;
 
-    if (!(wrapperFd = virFileWrapperFdNew(&fd, path, flags)))
+    if (!(wrapperFd = qemuFileWrapperFDNew(cfg, &fd, path, flags)))
         goto cleanup;
 
     if (dump_flags & VIR_DUMP_MEMORY_ONLY) {
@@ -6694,6 +6759,7 @@ qemuDomainSaveImageOpen(virQEMUDriverPtr driver,
                         bool open_write,
                         bool unlink_corrupt)
 {
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     VIR_AUTOCLOSE fd = -1;
     int ret = -1;
     g_autoptr(virQEMUSaveData) data = NULL;
@@ -6717,8 +6783,8 @@ qemuDomainSaveImageOpen(virQEMUDriverPtr driver,
         return -1;
 
     if (bypass_cache &&
-        !(*wrapperFd = virFileWrapperFdNew(&fd, path,
-                                           VIR_FILE_WRAPPER_BYPASS_CACHE)))
+        !(*wrapperFd = qemuFileWrapperFDNew(cfg, &fd, path,
+                                            VIR_FILE_WRAPPER_BYPASS_CACHE)))
         return -1;
 
     data = g_new0(virQEMUSaveData, 1);
@@ -11927,7 +11993,7 @@ qemuDomainGetBlockInfo(virDomainPtr dom,
     if (virDomainGetBlockInfoEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedQueryJob(driver, vm, false, 0) < 0)
         goto cleanup;
 
     if (!(disk = virDomainDiskByName(vm->def, path, false))) {
@@ -13723,15 +13789,27 @@ qemuDomainGetJobStats(virDomainPtr dom,
         *type = VIR_DOMAIN_JOB_NONE;
         *params = NULL;
         *nparams = 0;
-        ret = 0;
+    } else if (qemuDomainJobInfoToParams(jobInfo, type, params, nparams) < 0) {
         goto cleanup;
     }
 
-    ret = qemuDomainJobInfoToParams(jobInfo, type, params, nparams);
+    /* APIs may be queued behind a synchronous job even if there's no
+     * job to report, so the queue is reported unless asking for the
+     * completed job */
+    if (!completed &&
+        qemuDomainObjJobQueueInfoToParams(vm, params, nparams) < 0) {
+        virTypedParamsFree(*params, *nparams);
+        *params = NULL;
+        *nparams = 0;
+        goto cleanup;
+    }
 
-    if (completed && ret == 0 && !(flags & VIR_DOMAIN_JOB_STATS_KEEP_COMPLETED))
+    if (completed && jobInfo &&
+        !(flags & VIR_DOMAIN_JOB_STATS_KEEP_COMPLETED))
         g_clear_pointer(&priv->job.completed, qemuDomainJobInfoFree);
 
+    ret = 0;
+
  cleanup:
     virDomainObjEndAPI(&vm);
     return ret;
@@ -21700,6 +21778,27 @@ qemuDomainGetStatsNeedMonitor(unsigned int stats)
 }
 
 
+static int
+qemuDomainGetStatsParams(virQEMUDriverPtr driver,
+                         virDomainObjPtr dom,
+                         unsigned int stats,
+                         virTypedParamListPtr params,
+                         unsigned int flags)
+{
+    size_t i;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        if (stats & qemuDomainGetStatsWorkers[i].stats) {
+            if (qemuDomainGetStatsWorkers[i].func(driver, dom, params,
+                                                  flags) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 static int
 qemuDomainGetStats(virConnectPtr conn,
                    virDomainObjPtr dom,
@@ -21709,18 +21808,13 @@ qemuDomainGetStats(virConnectPtr conn,
 {
     g_autofree virDomainStatsRecordPtr tmp = NULL;
     g_autoptr(virTypedParamList) params = NULL;
-    size_t i;
 
     if (VIR_ALLOC(params) < 0)
         return -1;
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
-        if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params,
-                                                  flags) < 0)
-                return -1;
-        }
-    }
+    if (qemuDomainGetStatsParams(conn->privateData, dom, stats, params,
+                                 flags) < 0)
+        return -1;
 
     if (VIR_ALLOC(tmp) < 0)
         return -1;
@@ -21735,6 +21829,222 @@ qemuDomainGetStats(virConnectPtr conn,
 }
 
 
+/**
+ * qemuDomainGetStatsPrefetch:
+ * @driver: qemu driver object
+ * @dom: domain object, the caller must hold a job
+ * @stats: statistics groups which are going to be gathered
+ *
+ * Sends the queries the statistics workers for @stats would issue one
+ * by one to QEMU in a single batch, so that they find the replies ready.
+ * Failure is not fatal as the workers issue the queries themselves then.
+ *
+ * Returns true if the replies need to be dropped using
+ * qemuDomainGetStatsPrefetchDrop.
+ */
+static bool
+qemuDomainGetStatsPrefetch(virQEMUDriverPtr driver,
+                           virDomainObjPtr dom,
+                           unsigned int stats)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    const char *commands[4];
+    size_t ncommands = 0;
+    int rc;
+
+    if (!virDomainObjIsActive(dom))
+        return false;
+
+    if (stats & VIR_DOMAIN_STATS_VCPU &&
+        dom->def->virtType != VIR_DOMAIN_VIRT_QEMU &&
+        ARCH_IS_S390(dom->def->os.arch) &&
+        virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_CPUS_FAST))
+        commands[ncommands++] = "query-cpus-fast";
+
+    if (stats & VIR_DOMAIN_STATS_BLOCK) {
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV)) {
+            commands[ncommands++] = "query-named-block-nodes";
+        } else {
+            commands[ncommands++] = "query-block";
+            if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_NAMED_BLOCK_NODES))
+                commands[ncommands++] = "query-named-block-nodes";
+        }
+    }
+
+    if (stats & VIR_DOMAIN_STATS_IOTHREAD &&
+        virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_OBJECT_IOTHREAD))
+        commands[ncommands++] = "query-iothreads";
+
+    /* nothing to gain from a single command */
+    if (ncommands < 2)
+        return false;
+
+    qemuDomainObjEnterMonitor(driver, dom);
+    rc = qemuMonitorPrefetchQueries(priv->mon, commands, ncommands);
+    if (qemuDomainObjExitMonitor(driver, dom) < 0 || rc < 0) {
+        virResetLastError();
+        return false;
+    }
+
+    return true;
+}
+
+
+static void
+qemuDomainGetStatsPrefetchDrop(virQEMUDriverPtr driver,
+                               virDomainObjPtr dom)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+
+    if (!virDomainObjIsActive(dom))
+        return;
+
+    qemuDomainObjEnterMonitor(driver, dom);
+    qemuMonitorDropPrefetched(priv->mon);
+    if (qemuDomainObjExitMonitor(driver, dom) < 0)
+        virResetLastError();
+}
+
+
+/**
+ * qemuDomainGetStatsOne:
+ * @conn: connection object
+ * @vm: locked domain object
+ * @stats: stats groups to gather
+ * @privflags: QEMU_DOMAIN_STATS_HAVE_JOB if monitor access is needed
+ * @timeout: how long to wait for the job (in milliseconds), 0 for default
+ * @record: filled with the statistics record of @vm
+ * @flags: bitwise-OR of virConnectGetAllDomainStatsFlags
+ *
+ * Gathers statistics of a single domain. If the job needed for
+ * monitor access can't be acquired, only statistics that don't
+ * involve the monitor are reported.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+static int
+qemuDomainGetStatsOne(virConnectPtr conn,
+                      virDomainObjPtr vm,
+                      unsigned int stats,
+                      unsigned int privflags,
+                      unsigned long long timeout,
+                      virDomainStatsRecordPtr *record,
+                      unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    unsigned int domflags = 0;
+    bool prefetched = false;
+    int ret;
+
+    if (HAVE_JOB(privflags)) {
+        bool nowait = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT);
+        int rv;
+
+        /* Statistics are only read, concurrent callers can share the job
+         * and the monitor queries */
+        rv = qemuDomainObjBeginSharedQueryJob(driver, vm, nowait, timeout);
+
+        if (rv == 0)
+            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+        else
+            virResetLastError();
+    }
+    /* else: without a job it's still possible to gather some data */
+
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    if (HAVE_JOB(domflags))
+        prefetched = qemuDomainGetStatsPrefetch(driver, vm, stats);
+
+    ret = qemuDomainGetStats(conn, vm, stats, record, domflags);
+
+    if (prefetched)
+        qemuDomainGetStatsPrefetchDrop(driver, vm);
+
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(driver, vm);
+
+    return ret;
+}
+
+
+typedef struct _qemuDomainGetStatsData qemuDomainGetStatsData;
+typedef qemuDomainGetStatsData *qemuDomainGetStatsDataPtr;
+struct _qemuDomainGetStatsData {
+    virConnectPtr conn;
+    unsigned int stats;
+    unsigned int privflags;
+    unsigned int flags;
+};
+
+
+static void
+qemuDomainGetStatsDataFree(void *opaque)
+{
+    qemuDomainGetStatsDataPtr data = opaque;
+
+    virObjectUnref(data->conn);
+    g_free(data);
+}
+
+
+static int
+qemuDomainGetStatsCollect(virDomainObjPtr vm,
+                          bool partial,
+                          unsigned long long timeout,
+                          virDomainStatsRecordPtr *record,
+                          void *opaque)
+{
+    qemuDomainGetStatsDataPtr data = opaque;
+    unsigned int privflags = data->privflags;
+
+    /* gather only what doesn't need the monitor */
+    if (partial)
+        privflags &= ~QEMU_DOMAIN_STATS_HAVE_JOB;
+
+    return qemuDomainGetStatsOne(data->conn, vm, data->stats, privflags,
+                                 timeout, record, data->flags);
+}
+
+
+/**
+ * qemuDomainGetStatsParallel:
+ *
+ * Gathers statistics of @vms using the driver's stats thread pool
+ * and stores the records into @retStats in the order of @vms. Domains
+ * whose statistics are not gathered within the stats_domain_timeout
+ * config option, e.g. because their monitor doesn't respond, get a
+ * record with just the statistics that don't need the monitor.
+ *
+ * Returns the number of records stored on success, -1 otherwise.
+ */
+static int
+qemuDomainGetStatsParallel(virConnectPtr conn,
+                           virDomainObjPtr *vms,
+                           size_t nvms,
+                           unsigned int stats,
+                           unsigned int privflags,
+                           virDomainStatsRecordPtr *retStats,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainGetStatsDataPtr data = g_new0(qemuDomainGetStatsData, 1);
+
+    data->conn = virObjectRef(conn);
+    data->stats = stats;
+    data->privflags = privflags;
+    data->flags = flags;
+
+    return qemuDomainStatsBatchRun(driver->statsPool, vms, nvms,
+                                   cfg->statsDomainTimeout * 1000ull,
+                                   qemuDomainGetStatsCollect,
+                                   data, qemuDomainGetStatsDataFree,
+                                   retStats);
+}
+
+
 static int
 qemuConnectGetAllDomainStats(virConnectPtr conn,
                              virDomainPtr *doms,
@@ -21754,7 +22064,6 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     size_t i;
     int ret = -1;
     unsigned int privflags = 0;
-    unsigned int domflags = 0;
     unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
@@ -21762,6 +22071,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_PARALLEL |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
@@ -21790,43 +22100,30 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     if (qemuDomainGetStatsNeedMonitor(stats))
         privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-    for (i = 0; i < nvms; i++) {
-        virDomainStatsRecordPtr tmp = NULL;
-        domflags = 0;
-        vm = vms[i];
-
-        virObjectLock(vm);
-
-        if (HAVE_JOB(privflags)) {
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_PARALLEL &&
+        driver->statsPool && nvms > 1) {
+        if ((nstats = qemuDomainGetStatsParallel(conn, vms, nvms, stats,
+                                                 privflags, tmpstats,
+                                                 flags)) < 0)
+            goto cleanup;
+    } else {
+        for (i = 0; i < nvms; i++) {
+            virDomainStatsRecordPtr tmp = NULL;
             int rv;
 
-            if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
-                rv = qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY);
-            else
-                rv = qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY);
-
-            if (rv == 0)
-                domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        }
-        /* else: without a job it's still possible to gather some data */
-
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
-            if (HAVE_JOB(domflags) && vm)
-                qemuDomainObjEndJob(driver, vm);
+            vm = vms[i];
 
+            virObjectLock(vm);
+            rv = qemuDomainGetStatsOne(conn, vm, stats, privflags, 0,
+                                       &tmp, flags);
             virObjectUnlock(vm);
-            goto cleanup;
-        }
-
-        if (tmp)
-            tmpstats[nstats++] = tmp;
 
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(driver, vm);
+            if (rv < 0)
+                goto cleanup;
 
-        virObjectUnlock(vm);
+            if (tmp)
+                tmpstats[nstats++] = tmp;
+        }
     }
 
     *retStats = tmpstats;
@@ -21844,6 +22141,425 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 }
 
 
+/*
+ * Gathers each stats group of @stats separately into @groups, so that
+ * the statistics can be told apart by the group they belong to.
+ */
+static int
+qemuDomainStatsEventGather(virQEMUDriverPtr driver,
+                           virDomainObjPtr vm,
+                           unsigned int stats,
+                           unsigned int privflags,
+                           qemuDomainStatsEventGroupPtr *groups,
+                           size_t *ngroups)
+{
+    qemuDomainStatsEventGroupPtr tmp = NULL;
+    size_t ntmp = 0;
+    size_t i;
+
+    tmp = g_new0(qemuDomainStatsEventGroup,
+                 G_N_ELEMENTS(qemuDomainGetStatsWorkers));
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        unsigned int group = qemuDomainGetStatsWorkers[i].stats;
+        g_autoptr(virTypedParamList) list = NULL;
+
+        if (!(stats & group))
+            continue;
+
+        list = g_new0(virTypedParamList, 1);
+
+        if (qemuDomainGetStatsParams(driver, vm, group, list, privflags) < 0) {
+            qemuDomainStatsEventGroupsFree(tmp, ntmp);
+            return -1;
+        }
+
+        tmp[ntmp].stats = group;
+        tmp[ntmp].nparams = virTypedParamListStealParams(list,
+                                                         &tmp[ntmp].params);
+        ntmp++;
+    }
+
+    *groups = tmp;
+    *ngroups = ntmp;
+    return 0;
+}
+
+
+static qemuDomainStatsEventGroupPtr
+qemuDomainStatsEventGroupFind(qemuDomainStatsEventGroupPtr groups,
+                              size_t ngroups,
+                              unsigned int stats)
+{
+    size_t i;
+
+    for (i = 0; i < ngroups; i++) {
+        if (groups[i].stats == stats)
+            return &groups[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Appends the statistics of @groups selected by @stats to @params,
+ * or only those which differ from @old if it's non-NULL. Sets @removed
+ * if some statistics of the selected groups disappeared since @old.
+ */
+static int
+qemuDomainStatsEventAddParams(qemuDomainStatsEventGroupPtr groups,
+                              size_t ngroups,
+                              qemuDomainStatsEventGroupPtr old,
+                              size_t nold,
+                              unsigned int stats,
+                              virTypedParamListPtr params,
+                              bool *removed)
+{
+    size_t i;
+
+    for (i = 0; i < ngroups; i++) {
+        qemuDomainStatsEventGroupPtr group = &groups[i];
+        virTypedParameterPtr add = NULL;
+        int nadd;
+
+        if (!(stats & group->stats))
+            continue;
+
+        if (old) {
+            qemuDomainStatsEventGroupPtr prev;
+            bool gone = false;
+
+            prev = qemuDomainStatsEventGroupFind(old, nold, group->stats);
+            nadd = virTypedParamsGetChanged(prev ? prev->params : NULL,
+                                            prev ? prev->nparams : 0,
+                                            group->params, group->nparams,
+                                            &add, &gone);
+            if (nadd < 0)
+                return -1;
+            if (gone)
+                *removed = true;
+        } else {
+            if (virTypedParamsCopy(&add, group->params, group->nparams) < 0)
+                return -1;
+            nadd = group->nparams;
+        }
+
+        if (nadd <= 0)
+            continue;
+
+        /* move the copies over, including their strings */
+        if (VIR_RESIZE_N(params->par, params->par_alloc,
+                         params->npar, nadd) < 0) {
+            virTypedParamsFree(add, nadd);
+            return -1;
+        }
+
+        memcpy(params->par + params->npar, add, nadd * sizeof(*add));
+        params->npar += nadd;
+        VIR_FREE(add);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Emits VIR_DOMAIN_EVENT_ID_STATS_CHANGE with the statistics @sub asked
+ * for, as stored in @groups. Only statistics differing from @old are
+ * reported unless @full is set or some statistics disappeared, in which
+ * case all of them are sent along with VIR_DOMAIN_STATS_CHANGE_FULL.
+ */
+static int
+qemuDomainStatsEventEmitOne(virQEMUDriverPtr driver,
+                            virDomainObjPtr vm,
+                            virQEMUDriverStatsEventSubPtr sub,
+                            qemuDomainStatsEventGroupPtr groups,
+                            size_t ngroups,
+                            qemuDomainStatsEventGroupPtr old,
+                            size_t nold,
+                            bool full)
+{
+    g_autoptr(virTypedParamList) params = g_new0(virTypedParamList, 1);
+    virTypedParameterPtr par = NULL;
+    virObjectEventPtr event;
+    bool removed = false;
+    int npar;
+
+    if (!full &&
+        qemuDomainStatsEventAddParams(groups, ngroups, old, nold,
+                                      sub->stats, params, &removed) < 0)
+        return -1;
+
+    if (full || removed) {
+        virTypedParamListFree(params);
+        params = g_new0(virTypedParamList, 1);
+
+        if (qemuDomainStatsEventAddParams(groups, ngroups, NULL, 0,
+                                          sub->stats, params, NULL) < 0 ||
+            virTypedParamListAddBoolean(params, true, "%s",
+                                        VIR_DOMAIN_STATS_CHANGE_FULL) < 0)
+            return -1;
+    }
+
+    if (params->npar == 0)
+        return 0;
+
+    npar = virTypedParamListStealParams(params, &par);
+    event = virDomainEventStatsChangeNewFromObj(vm, sub->conn, par, npar);
+    virObjectEventStateQueue(driver->domainEventState, event);
+    return 0;
+}
+
+
+/**
+ * qemuDomainStatsEventEmit:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ * @subs: listeners to emit the events for
+ * @nsubs: number of @subs
+ * @generation: stats events generation the collection belongs to
+ *
+ * Gathers the stats groups requested by @subs for @vm and emits
+ * VIR_DOMAIN_EVENT_ID_STATS_CHANGE for each listener, carrying the
+ * statistics of its groups which differ from those reported by the
+ * previous events. A listener which didn't get any event of @vm since it
+ * subscribed gets all of its statistics along with
+ * VIR_DOMAIN_STATS_CHANGE_FULL, as does every listener if some of its
+ * statistics disappeared. A domain which is busy with another job is
+ * skipped so that the stored statistics always form a complete set.
+ */
+static void
+qemuDomainStatsEventEmit(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm,
+                         virQEMUDriverStatsEventSubPtr subs,
+                         size_t nsubs,
+                         unsigned long long generation)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainStatsEventGroupPtr groups = NULL;
+    size_t ngroups = 0;
+    unsigned int stats = 0;
+    unsigned int privflags = 0;
+    bool failed = false;
+    size_t i;
+
+    for (i = 0; i < nsubs; i++)
+        stats |= subs[i].stats;
+
+    if (qemuDomainGetStatsNeedMonitor(stats)) {
+        if (qemuDomainObjBeginSharedQueryJob(driver, vm, true, 0) < 0)
+            return;
+        privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
+
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
+
+    if (qemuDomainStatsEventGather(driver, vm, stats, privflags,
+                                   &groups, &ngroups) < 0) {
+        VIR_WARN("Unable to gather stats of domain %s: %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+        goto endjob;
+    }
+
+    for (i = 0; i < nsubs; i++) {
+        /* Checking statsEventFull rather than the stored statistics
+         * makes sure a domain without any statistics gets a single full
+         * event only. */
+        bool full = !priv->statsEventFull ||
+                    subs[i].generation > priv->statsEventGeneration;
+
+        if (qemuDomainStatsEventEmitOne(driver, vm, &subs[i], groups, ngroups,
+                                        priv->statsEventGroups,
+                                        priv->nstatsEventGroups, full) < 0) {
+            VIR_WARN("Unable to emit stats event of domain %s: %s",
+                     vm->def->name, virGetLastErrorMessage());
+            virResetLastError();
+            failed = true;
+        }
+    }
+
+    /* report everything next time if some listener missed an event */
+    qemuDomainStatsEventGroupsFree(priv->statsEventGroups,
+                                   priv->nstatsEventGroups);
+    priv->statsEventGroups = groups;
+    priv->nstatsEventGroups = ngroups;
+    priv->statsEventGeneration = generation;
+    priv->statsEventFull = !failed;
+
+ endjob:
+    if (HAVE_JOB(privflags))
+        qemuDomainObjEndJob(driver, vm);
+}
+
+
+static void
+qemuDomainStatsEventCollect(virQEMUDriverPtr driver,
+                            virQEMUDriverStatsEventSubPtr subs,
+                            size_t nsubs,
+                            unsigned long long generation)
+{
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms, NULL,
+                                VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        qemuDomainStatsEventEmit(driver, vms[i], subs, nsubs, generation);
+        virObjectUnlock(vms[i]);
+    }
+
+    virObjectListFreeCount(vms, nvms);
+}
+
+
+static void
+qemuDomainStatsEventThread(void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+
+    virMutexLock(&driver->lock);
+
+    while (!driver->statsEventQuit) {
+        g_autofree virQEMUDriverStatsEventSubPtr subs = NULL;
+        size_t nsubs = driver->nstatsEventSubs;
+        unsigned int interval = 0;
+        unsigned long long generation = driver->statsEventGeneration;
+        unsigned long long then = 0;
+        size_t i;
+
+        /* serve all connections with a single collection */
+        for (i = 0; i < nsubs; i++) {
+            virQEMUDriverStatsEventSubPtr sub = &driver->statsEventSubs[i];
+
+            if (interval == 0 || sub->interval < interval)
+                interval = sub->interval;
+        }
+
+        if (interval == 0) {
+            if (virCondWait(&driver->statsEventCond, &driver->lock) < 0)
+                break;
+            continue;
+        }
+
+        /* the connections are only compared, they are never accessed */
+        subs = g_new0(virQEMUDriverStatsEventSub, nsubs);
+        memcpy(subs, driver->statsEventSubs, nsubs * sizeof(*subs));
+
+        virMutexUnlock(&driver->lock);
+        qemuDomainStatsEventCollect(driver, subs, nsubs, generation);
+        virMutexLock(&driver->lock);
+
+        ignore_value(virTimeMillisNow(&then));
+        then += interval * 1000ull;
+
+        /* Sleep until the next period unless the setting changes */
+        while (!driver->statsEventQuit &&
+               driver->statsEventGeneration == generation) {
+            if (virCondWaitUntil(&driver->statsEventCond,
+                                 &driver->lock, then) < 0)
+                break;
+        }
+    }
+
+    virMutexUnlock(&driver->lock);
+}
+
+
+/*
+ * Drops the stats events setting of @conn. The caller must hold
+ * the driver lock.
+ */
+static void
+qemuDomainStatsEventUnsubscribeLocked(virQEMUDriverPtr driver,
+                                      virConnectPtr conn)
+{
+    size_t i;
+
+    for (i = 0; i < driver->nstatsEventSubs; i++) {
+        if (driver->statsEventSubs[i].conn == conn) {
+            VIR_DELETE_ELEMENT(driver->statsEventSubs, i,
+                               driver->nstatsEventSubs);
+            driver->statsEventGeneration++;
+            virCondSignal(&driver->statsEventCond);
+            return;
+        }
+    }
+}
+
+
+static int
+qemuConnectSetAllDomainStatsEvents(virConnectPtr conn,
+                                   unsigned int stats,
+                                   unsigned int interval,
+                                   unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (virConnectSetAllDomainStatsEventsEnsureACL(conn) < 0)
+        return -1;
+
+    if (qemuDomainGetStatsCheckSupport(&stats, false) < 0)
+        return -1;
+
+    virMutexLock(&driver->lock);
+
+    if (interval == 0) {
+        qemuDomainStatsEventUnsubscribeLocked(driver, conn);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!driver->statsEventThreadActive) {
+        if (virThreadCreateFull(&driver->statsEventThread, true,
+                                qemuDomainStatsEventThread,
+                                "qemu-stats-event", false, driver) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create stats event thread"));
+            goto cleanup;
+        }
+        driver->statsEventThreadActive = true;
+    }
+
+    for (i = 0; i < driver->nstatsEventSubs; i++) {
+        if (driver->statsEventSubs[i].conn == conn)
+            break;
+    }
+
+    if (i == driver->nstatsEventSubs) {
+        virQEMUDriverStatsEventSub sub = { .conn = conn };
+
+        if (VIR_APPEND_ELEMENT(driver->statsEventSubs,
+                               driver->nstatsEventSubs, sub) < 0)
+            goto cleanup;
+    }
+
+    /* the listener gets all statistics of each domain first */
+    driver->statsEventSubs[i].stats = stats;
+    driver->statsEventSubs[i].interval = interval;
+    driver->statsEventSubs[i].generation = ++driver->statsEventGeneration;
+    virCondSignal(&driver->statsEventCond);
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&driver->lock);
+    return ret;
+}
+
+
 static int
 qemuNodeAllocPages(virConnectPtr conn,
                    unsigned int npages,
@@ -23344,6 +24060,7 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .nodeGetFreePages = qemuNodeGetFreePages, /* 1.2.6 */
     .connectGetDomainCapabilities = qemuConnectGetDomainCapabilities, /* 1.2.7 */
     .connectGetAllDomainStats = qemuConnectGetAllDomainStats, /* 1.2.8 */
+    .connectSetAllDomainStatsEvents = qemuConnectSetAllDomainStatsEvents, /* 6.4.0 */
     .nodeAllocPages = qemuNodeAllocPages, /* 1.2.9 */
     .domainGetFSInfo = qemuDomainGetFSInfo, /* 1.2.11 */
     .domainInterfaceAddresses = qemuDomainInterfaceAddresses, /* 1.2.14 */
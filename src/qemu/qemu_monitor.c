@@ -67,6 +67,33 @@ VIR_LOG_INIT("qemu.qemu_monitor");
  */
 #define QEMU_MONITOR_MAX_RESPONSE (10 * 1024 * 1024)
 
+/* Maximum number of commands sent to QEMU before their replies arrive.
+ *
+ * This is not the depth of QEMU's request queue, which only matters with
+ * out-of-band execution. We never enable that in qmp_capabilities, so
+ * QEMU executes one command at a time and doesn't read the next one
+ * before it replied to the previous one. Commands sent ahead simply wait
+ * in the socket buffer and are answered in order, which only saves the
+ * round trip per command. Since replies can't overtake each other, this
+ * is safe without out-of-band support, the limit merely keeps a batch
+ * from piling up unread data in the socket. */
+#define QEMU_MONITOR_MAX_PIPELINE 8
+
+typedef struct _qemuMonitorSharedQuery qemuMonitorSharedQuery;
+typedef qemuMonitorSharedQuery *qemuMonitorSharedQueryPtr;
+struct _qemuMonitorSharedQuery {
+    char *key;
+    size_t waiters;             /* threads waiting for the result */
+    bool finished;
+    int rc;
+    virErrorPtr error;          /* set if rc < 0 */
+    void *result;
+    virFreeCallback freeResult;
+    bool cached;                /* linked in mon->queryCache */
+    unsigned long long expires; /* when the cached result gets stale */
+    qemuMonitorSharedQueryPtr next;
+};
+
 struct _qemuMonitor {
     virObjectLockable parent;
 
@@ -83,9 +110,26 @@ struct _qemuMonitor {
     qemuMonitorCallbacksPtr cb;
     void *callbackOpaque;
 
-    /* If there's a command being processed this will be
-     * non-NULL */
-    qemuMonitorMessagePtr msg;
+    /* Commands sent (or being sent) to QEMU in the order they were
+     * issued, see qemuMonitorSendBatch */
+    qemuMonitorMessagePtr *msgs;
+    size_t nmsgs;
+
+    /* Number of threads waiting to send a command using a reply decoder */
+    size_t decodersWaiting;
+
+    /* Queries other threads may share the result of, see
+     * qemuMonitorSharedQueryFind */
+    qemuMonitorSharedQueryPtr sharedQueries;
+
+    /* Recently finished shared queries whose results are reused for
+     * queryCacheTTL milliseconds */
+    qemuMonitorSharedQueryPtr queryCache;
+    unsigned long long queryCacheTTL;
+
+    /* Replies to commands sent by qemuMonitorPrefetchQueries which
+     * weren't used yet, indexed by the command name */
+    virHashTablePtr prefetched;
 
     /* Buffer incoming data ready for Text/QMP monitor
      * code to process & find message boundaries */
@@ -93,6 +137,16 @@ struct _qemuMonitor {
     size_t bufferLength;
     char *buffer;
 
+    /* The first bufferConsumed bytes of buffer were processed already,
+     * they are dropped only once room for more data is needed */
+    size_t bufferConsumed;
+
+    /* Incoming data is parsed as soon as it's read, the first
+     * bufferParsed bytes after the consumed ones were fed to parser
+     * already */
+    virJSONStreamParserPtr parser;
+    size_t bufferParsed;
+
     /* If anything went wrong, this will be fed back
      * the next monitor msg */
     virError lastError;
@@ -148,11 +202,21 @@ struct _qemuMonitor {
 static virClassPtr qemuMonitorClass;
 static void qemuMonitorDispose(void *obj);
 
+/* Deadline for the replies to commands sent by the current thread,
+ * see qemuMonitorSetThreadDeadline */
+static virThreadLocal qemuMonitorDeadline;
+
 static int qemuMonitorOnceInit(void)
 {
     if (!VIR_CLASS_NEW(qemuMonitor, virClassForObjectLockable()))
         return -1;
 
+    if (virThreadLocalInit(&qemuMonitorDeadline, g_free) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize monitor deadline"));
+        return -1;
+    }
+
     return 0;
 }
 
@@ -216,10 +280,43 @@ qemuMonitorEscapeNonPrintable(const char *text)
 #endif
 
 
+static void
+qemuMonitorAbandonedMessageFree(qemuMonitorMessagePtr msg)
+{
+    g_free((char *) msg->id);
+    g_free(msg->txBuffer);
+    virJSONValueFree(msg->rxObject);
+    g_free(msg);
+}
+
+
+/* Drops abandoned messages which were answered or finished because of
+ * an error on the monitor */
+static void
+qemuMonitorReapAbandonedMessages(qemuMonitorPtr mon)
+{
+    size_t i = 0;
+
+    while (i < mon->nmsgs) {
+        qemuMonitorMessagePtr msg = mon->msgs[i];
+
+        if (!msg->abandoned || !msg->finished) {
+            i++;
+            continue;
+        }
+
+        VIR_DEBUG("Dropping reply to abandoned command %s", NULLSTR(msg->id));
+        VIR_DELETE_ELEMENT(mon->msgs, i, mon->nmsgs);
+        qemuMonitorAbandonedMessageFree(msg);
+    }
+}
+
+
 static void
 qemuMonitorDispose(void *obj)
 {
     qemuMonitorPtr mon = obj;
+    size_t i;
 
     VIR_DEBUG("mon=%p", mon);
     if (mon->cb && mon->cb->destroy)
@@ -227,9 +324,15 @@ qemuMonitorDispose(void *obj)
     virObjectUnref(mon->vm);
 
     g_main_context_unref(mon->context);
+    qemuMonitorInvalidateQueryCache(mon);
+    /* Only abandoned messages can be left, their senders are gone */
+    for (i = 0; i < mon->nmsgs; i++)
+        qemuMonitorAbandonedMessageFree(mon->msgs[i]);
+    VIR_FREE(mon->msgs);
     virResetError(&mon->lastError);
     virCondDestroy(&mon->notify);
     VIR_FREE(mon->buffer);
+    virJSONStreamParserFree(mon->parser);
     virJSONValueFree(mon->options);
     VIR_FREE(mon->balloonpath);
 }
@@ -310,54 +413,53 @@ qemuMonitorOpenUnix(const char *monitor,
 static int
 qemuMonitorIOProcess(qemuMonitorPtr mon)
 {
+    char *data = mon->buffer + mon->bufferConsumed;
+    size_t datalen = mon->bufferOffset - mon->bufferConsumed;
     int len;
-    qemuMonitorMessagePtr msg = NULL;
-
-    /* See if there's a message & whether its ready for its reply
-     * ie whether its completed writing all its data */
-    if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
-        msg = mon->msg;
 
 #if DEBUG_IO
 # if DEBUG_RAW_IO
-    char *str1 = qemuMonitorEscapeNonPrintable(msg ? msg->txBuffer : "");
-    char *str2 = qemuMonitorEscapeNonPrintable(mon->buffer);
-    VIR_ERROR(_("Process %d %p %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, mon->msg, msg, str1, str2);
-    VIR_FREE(str1);
-    VIR_FREE(str2);
+    char *str = qemuMonitorEscapeNonPrintable(data);
+    VIR_ERROR(_("Process %d %zu [[[%s]]]"), (int)datalen, mon->nmsgs, str);
+    VIR_FREE(str);
 # else
-    VIR_DEBUG("Process %d", (int)mon->bufferOffset);
+    VIR_DEBUG("Process %d", (int)datalen);
 # endif
 #endif
 
     PROBE_QUIET(QEMU_MONITOR_IO_PROCESS, "mon=%p buf=%s len=%zu",
-                mon, mon->buffer, mon->bufferOffset);
+                mon, data, datalen);
 
-    len = qemuMonitorJSONIOProcess(mon,
-                                   mon->buffer, mon->bufferOffset,
-                                   msg);
+    len = qemuMonitorJSONIOProcess(mon, mon->parser,
+                                   data, datalen,
+                                   mon->bufferParsed);
     if (len < 0)
         return -1;
 
     if (len && mon->waitGreeting)
         mon->waitGreeting = false;
 
-    if (len < mon->bufferOffset) {
-        memmove(mon->buffer, mon->buffer + len, mon->bufferOffset - len);
-        mon->bufferOffset -= len;
+    /* The rest of the data was fed to the parser already, it's kept in
+     * place until qemuMonitorIORead needs room for more */
+    if (len < datalen) {
+        mon->bufferConsumed += len;
+        mon->bufferParsed = datalen - len;
     } else {
         VIR_FREE(mon->buffer);
         mon->bufferOffset = mon->bufferLength = 0;
+        mon->bufferConsumed = 0;
+        mon->bufferParsed = 0;
     }
 #if DEBUG_IO
-    VIR_DEBUG("Process done %d used %d", (int)mon->bufferOffset, len);
+    VIR_DEBUG("Process done %d used %d", (int)(datalen - len), len);
 #endif
 
-    /* As the monitor mutex was unlocked in qemuMonitorJSONIOProcess()
-     * while dealing with qemu event, mon->msg could be changed which
-     * means the above 'msg' may be invalid, thus we use 'mon->msg' here */
-    if (mon->msg && mon->msg->finished)
+    /* Wake up the threads whose replies were received, as well as those
+     * waiting for room in the pipeline */
+    if (len > 0 && mon->nmsgs > 0) {
+        qemuMonitorReapAbandonedMessages(mon);
         virCondBroadcast(&mon->notify);
+    }
     return len;
 }
 
@@ -404,48 +506,88 @@ qemuMonitorIOWriteWithFD(qemuMonitorPtr mon,
 }
 
 
+/* Returns the oldest message which wasn't fully transmitted yet */
+static qemuMonitorMessagePtr
+qemuMonitorNextTxMessage(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (mon->msgs[i]->txOffset < mon->msgs[i]->txLength)
+            return mon->msgs[i];
+    }
+
+    return NULL;
+}
+
+
+/* Marks all queued messages as finished after a fatal error on the
+ * monitor and wakes up the threads waiting for them */
+static void
+qemuMonitorFinishMessages(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    if (mon->nmsgs == 0)
+        return;
+
+    for (i = 0; i < mon->nmsgs; i++)
+        mon->msgs[i]->finished = true;
+
+    qemuMonitorReapAbandonedMessages(mon);
+    virCondBroadcast(&mon->notify);
+}
+
+
 /*
  * Called when the monitor is able to write data
  * Call this function while holding the monitor lock.
+ *
+ * Writes queued messages one after another until the socket
+ * would block.
  */
 static int
 qemuMonitorIOWrite(qemuMonitorPtr mon)
 {
-    int done;
-    char *buf;
-    size_t len;
+    qemuMonitorMessagePtr msg;
+    int total = 0;
 
-    /* If no active message, or fully transmitted, the no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
-        return 0;
+    while ((msg = qemuMonitorNextTxMessage(mon))) {
+        int done;
+        char *buf = msg->txBuffer + msg->txOffset;
+        size_t len = msg->txLength - msg->txOffset;
 
-    buf = mon->msg->txBuffer + mon->msg->txOffset;
-    len = mon->msg->txLength - mon->msg->txOffset;
-    if (mon->msg->txFD == -1)
-        done = write(mon->fd, buf, len);
-    else
-        done = qemuMonitorIOWriteWithFD(mon, buf, len, mon->msg->txFD);
+        if (msg->txFD == -1)
+            done = write(mon->fd, buf, len);
+        else
+            done = qemuMonitorIOWriteWithFD(mon, buf, len, msg->txFD);
 
-    PROBE(QEMU_MONITOR_IO_WRITE,
-          "mon=%p buf=%s len=%zu ret=%d errno=%d",
-          mon, buf, len, done, done < 0 ? errno : 0);
+        PROBE(QEMU_MONITOR_IO_WRITE,
+              "mon=%p buf=%s len=%zu ret=%d errno=%d",
+              mon, buf, len, done, done < 0 ? errno : 0);
 
-    if (mon->msg->txFD != -1) {
-        PROBE(QEMU_MONITOR_IO_SEND_FD,
-              "mon=%p fd=%d ret=%d errno=%d",
-              mon, mon->msg->txFD, done, done < 0 ? errno : 0);
-    }
+        if (msg->txFD != -1) {
+            PROBE(QEMU_MONITOR_IO_SEND_FD,
+                  "mon=%p fd=%d ret=%d errno=%d",
+                  mon, msg->txFD, done, done < 0 ? errno : 0);
+        }
 
-    if (done < 0) {
-        if (errno == EAGAIN)
-            return 0;
+        if (done < 0) {
+            if (errno == EAGAIN)
+                break;
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to write to monitor"));
-        return -1;
+            virReportSystemError(errno, "%s",
+                                 _("Unable to write to monitor"));
+            return -1;
+        }
+        msg->txOffset += done;
+        total += done;
+
+        if (msg->txOffset < msg->txLength)
+            break;
     }
-    mon->msg->txOffset += done;
-    return done;
+
+    return total;
 }
 
 
@@ -461,6 +603,17 @@ qemuMonitorIORead(qemuMonitorPtr mon)
     size_t avail = mon->bufferLength - mon->bufferOffset;
     int ret = 0;
 
+    /* Drop the data processed already only when it's worth it rather
+     * than moving the rest after each processed message */
+    if (avail < 1024 && mon->bufferConsumed > 0) {
+        memmove(mon->buffer, mon->buffer + mon->bufferConsumed,
+                mon->bufferOffset - mon->bufferConsumed);
+        mon->bufferOffset -= mon->bufferConsumed;
+        mon->buffer[mon->bufferOffset] = '\0';
+        avail += mon->bufferConsumed;
+        mon->bufferConsumed = 0;
+    }
+
     if (avail < 1024) {
         if (mon->bufferLength >= QEMU_MONITOR_MAX_RESPONSE) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -614,12 +767,9 @@ qemuMonitorIO(GSocket *socket G_GNUC_UNUSED,
         }
 
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
-        /* If IO process resulted in an error & we have a message,
-         * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = true;
-            virCondSignal(&mon->notify);
-        }
+        /* If IO process resulted in an error & we have messages,
+         * then wakeup their waiters */
+        qemuMonitorFinishMessages(mon);
     }
 
     qemuMonitorUpdateWatch(mon);
@@ -632,7 +782,7 @@ qemuMonitorIO(GSocket *socket G_GNUC_UNUSED,
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering EOF callback");
         (eofNotify)(mon, vm, mon->callbackOpaque);
@@ -642,7 +792,7 @@ qemuMonitorIO(GSocket *socket G_GNUC_UNUSED,
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering error callback");
         (errorNotify)(mon, vm, mon->callbackOpaque);
@@ -688,6 +838,10 @@ qemuMonitorOpenInternal(virDomainObjPtr vm,
                        _("cannot initialize monitor condition"));
         goto cleanup;
     }
+
+    if (!(mon->parser = virJSONStreamParserNew()))
+        goto cleanup;
+
     mon->fd = fd;
     mon->context = g_main_context_ref(context);
     mon->vm = virObjectRef(vm);
@@ -814,8 +968,7 @@ qemuMonitorRegister(qemuMonitorPtr mon)
     if (mon->lastError.code == VIR_ERR_OK) {
         cond |= G_IO_IN;
 
-        if ((mon->msg && mon->msg->txOffset < mon->msg->txLength) &&
-            !mon->waitGreeting)
+        if (qemuMonitorNextTxMessage(mon) && !mon->waitGreeting)
             cond |= G_IO_OUT;
     }
 
@@ -866,7 +1019,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
     /* In case another thread is waiting for its monitor command to be
      * processed, we need to wake it up with appropriate error set.
      */
-    if (mon->msg) {
+    if (mon->nmsgs > 0) {
         if (mon->lastError.code == VIR_ERR_OK) {
             virErrorPtr err;
 
@@ -880,8 +1033,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
             else
                 virResetLastError();
         }
-        mon->msg->finished = true;
-        virCondSignal(&mon->notify);
+        qemuMonitorFinishMessages(mon);
     }
 
     /* Propagate existing monitor error in case the current thread has no
@@ -913,33 +1065,265 @@ qemuMonitorResetCommandID(qemuMonitorPtr mon)
 }
 
 
-int
-qemuMonitorSend(qemuMonitorPtr mon,
-                qemuMonitorMessagePtr msg)
+/* Whether @msg can be sent while the messages queued already are
+ * waiting for their replies */
+static bool
+qemuMonitorCanQueueMessage(qemuMonitorPtr mon,
+                           qemuMonitorMessagePtr msg)
 {
-    int ret = -1;
+    size_t inflight = 0;
+    size_t i;
 
-    /* Check whether qemu quit unexpectedly */
-    if (mon->lastError.code != VIR_ERR_OK) {
-        VIR_DEBUG("Attempt to send command while error is set %s",
-                  NULLSTR(mon->lastError.message));
-        virSetError(&mon->lastError);
-        return -1;
+    for (i = 0; i < mon->nmsgs; i++) {
+        /* The decoder is attached to whichever reply is parsed next,
+         * thus a command using it must be the only one in flight */
+        if (mon->msgs[i]->rxDecoder)
+            return false;
+
+        if (!mon->msgs[i]->finished)
+            inflight++;
     }
 
-    mon->msg = msg;
-    qemuMonitorUpdateWatch(mon);
+    if (msg->rxDecoder)
+        return mon->nmsgs == 0;
+
+    /* Commands using a decoder wait for the pipeline to drain, don't
+     * let new commands keep it busy forever */
+    if (mon->decodersWaiting > 0)
+        return false;
+
+    return inflight < QEMU_MONITOR_MAX_PIPELINE;
+}
+
+
+static void
+qemuMonitorDequeueMessage(qemuMonitorPtr mon,
+                          qemuMonitorMessagePtr msg)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (mon->msgs[i] == msg) {
+            VIR_DELETE_ELEMENT(mon->msgs, i, mon->nmsgs);
+            break;
+        }
+    }
+
+    if (msg->rxDecoder)
+        virJSONStreamParserSetSink(mon->parser, NULL, NULL, NULL);
+}
+
+
+/*
+ * Replaces @msg, whose sender stops waiting for the reply, by a copy
+ * owned by the monitor. The rest of the command is still sent if it
+ * was written partially and the reply is dropped once it arrives, so
+ * that it can't be mistaken for the reply to another command. A
+ * command which wasn't written at all is just dequeued.
+ */
+static void
+qemuMonitorAbandonMessage(qemuMonitorPtr mon,
+                          qemuMonitorMessagePtr msg)
+{
+    qemuMonitorMessagePtr copy;
+    size_t i;
+
+    if (msg->txOffset == 0) {
+        qemuMonitorDequeueMessage(mon, msg);
+        return;
+    }
 
-    PROBE(QEMU_MONITOR_SEND_MSG,
-          "mon=%p msg=%s fd=%d",
-          mon, mon->msg->txBuffer, mon->msg->txFD);
+    VIR_DEBUG("Abandoning command %s", NULLSTR(msg->id));
 
-    while (!mon->msg->finished) {
-        if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
+    copy = g_new0(qemuMonitorMessage, 1);
+    copy->txFD = -1;
+    copy->txBuffer = g_strndup(msg->txBuffer, msg->txLength);
+    copy->txOffset = msg->txOffset;
+    copy->txLength = msg->txLength;
+    copy->id = g_strdup(msg->id);
+    copy->abandoned = true;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (mon->msgs[i] == msg) {
+            mon->msgs[i] = copy;
+            break;
+        }
+    }
+
+    /* The decoder belongs to the sender, build the reply as usual */
+    if (msg->rxDecoder)
+        virJSONStreamParserSetSink(mon->parser, NULL, NULL, NULL);
+}
+
+
+/**
+ * qemuMonitorSetThreadDeadline:
+ * @deadline: time in milliseconds as returned by virTimeMillisNow,
+ *            0 to wait for replies for as long as it takes
+ *
+ * Limits how long monitor commands issued by the calling thread wait
+ * to be sent and for their replies. Commands still waiting at
+ * @deadline fail with VIR_ERR_OPERATION_TIMEOUT and their replies are
+ * dropped once they arrive.
+ */
+void
+qemuMonitorSetThreadDeadline(unsigned long long deadline)
+{
+    unsigned long long *val;
+
+    if (qemuMonitorInitialize() < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (!(val = virThreadLocalGet(&qemuMonitorDeadline))) {
+        if (deadline == 0)
+            return;
+
+        val = g_new0(unsigned long long, 1);
+        if (virThreadLocalSet(&qemuMonitorDeadline, val) < 0) {
+            VIR_WARN("Unable to set monitor deadline of thread");
+            g_free(val);
+            return;
+        }
+    }
+
+    *val = deadline;
+}
+
+
+static unsigned long long
+qemuMonitorGetThreadDeadline(void)
+{
+    unsigned long long *val = virThreadLocalGet(&qemuMonitorDeadline);
+
+    return val ? *val : 0;
+}
+
+
+/*
+ * Waits for @mon->notify, but at most until @deadline unless it's 0.
+ * Reports an error on failure.
+ */
+static int
+qemuMonitorWaitNotify(qemuMonitorPtr mon,
+                      unsigned long long deadline)
+{
+    int rc;
+
+    if (deadline == 0)
+        rc = virCondWait(&mon->notify, &mon->parent.lock);
+    else
+        rc = virCondWaitUntil(&mon->notify, &mon->parent.lock, deadline);
+
+    if (rc < 0) {
+        if (deadline != 0 && errno == ETIMEDOUT)
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("timed out waiting for monitor reply"));
+        else
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to wait on monitor condition"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * qemuMonitorSendBatch:
+ * @mon: monitor object
+ * @msgs: messages to send
+ * @nmsgs: number of @msgs
+ *
+ * Sends all @msgs to QEMU back to back without waiting for the reply
+ * to the previous one and then waits until all of them are answered.
+ * Messages of other threads using the monitor may be in flight at the
+ * same time. Replies are matched to the messages by their 'id'. A message
+ * using a reply decoder can't be sent as part of a larger batch.
+ *
+ * The wait is limited by the deadline set by qemuMonitorSetThreadDeadline.
+ * Messages not answered by then are abandoned.
+ *
+ * Returns 0 when all replies were received, -1 on error.
+ */
+int
+qemuMonitorSendBatch(qemuMonitorPtr mon,
+                     qemuMonitorMessagePtr *msgs,
+                     size_t nmsgs)
+{
+    unsigned long long deadline = qemuMonitorGetThreadDeadline();
+    unsigned long long now;
+    size_t queued;
+    size_t i;
+    int ret = -1;
+
+    if (nmsgs > 1) {
+        for (i = 0; i < nmsgs; i++) {
+            if (msgs[i]->rxDecoder) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("monitor commands using a reply decoder can't be batched"));
+                return -1;
+            }
+        }
+    }
+
+    if (deadline != 0) {
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+
+        if (now >= deadline) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("timed out waiting for monitor reply"));
+            return -1;
+        }
+    }
+
+    for (queued = 0; queued < nmsgs; queued++) {
+        qemuMonitorMessagePtr msg = msgs[queued];
+
+        /* Threads sharing a query job may use the monitor concurrently */
+        if (msg->rxDecoder)
+            mon->decodersWaiting++;
+
+        while (mon->lastError.code == VIR_ERR_OK &&
+               !qemuMonitorCanQueueMessage(mon, msg)) {
+            if (qemuMonitorWaitNotify(mon, deadline) < 0) {
+                if (msg->rxDecoder)
+                    mon->decodersWaiting--;
+                goto cleanup;
+            }
+        }
+
+        if (msg->rxDecoder)
+            mon->decodersWaiting--;
+
+        /* Check whether qemu quit unexpectedly */
+        if (mon->lastError.code != VIR_ERR_OK) {
+            VIR_DEBUG("Attempt to send command while error is set %s",
+                      NULLSTR(mon->lastError.message));
+            virSetError(&mon->lastError);
             goto cleanup;
         }
+
+        if (VIR_APPEND_ELEMENT_COPY(mon->msgs, mon->nmsgs, msg) < 0)
+            goto cleanup;
+
+        if (msg->rxDecoder)
+            virJSONStreamParserSetSink(mon->parser, "return",
+                                       msg->rxDecoder, msg->rxDecoderOpaque);
+        qemuMonitorUpdateWatch(mon);
+
+        PROBE(QEMU_MONITOR_SEND_MSG,
+              "mon=%p msg=%s fd=%d",
+              mon, msg->txBuffer, msg->txFD);
+    }
+
+    for (i = 0; i < nmsgs; i++) {
+        while (!msgs[i]->finished) {
+            if (qemuMonitorWaitNotify(mon, deadline) < 0)
+                goto cleanup;
+        }
     }
 
     if (mon->lastError.code != VIR_ERR_OK) {
@@ -952,13 +1336,420 @@ qemuMonitorSend(qemuMonitorPtr mon,
     ret = 0;
 
  cleanup:
-    mon->msg = NULL;
+    for (i = 0; i < queued; i++) {
+        if (msgs[i]->finished)
+            qemuMonitorDequeueMessage(mon, msgs[i]);
+        else
+            qemuMonitorAbandonMessage(mon, msgs[i]);
+    }
     qemuMonitorUpdateWatch(mon);
+    /* wake up threads waiting to send their commands */
+    virCondBroadcast(&mon->notify);
 
     return ret;
 }
 
 
+int
+qemuMonitorSend(qemuMonitorPtr mon,
+                qemuMonitorMessagePtr msg)
+{
+    return qemuMonitorSendBatch(mon, &msg, 1);
+}
+
+
+/**
+ * qemuMonitorFindReplyMessage:
+ * @mon: monitor object
+ * @id: 'id' of the reply received from QEMU, may be NULL
+ *
+ * Looks up the message the reply belongs to. A reply with @id must
+ * match a message sent with the same id, including the copies of
+ * abandoned messages. A reply without @id can only be matched if a
+ * single message waits for its reply, since guessing would hand the
+ * reply to the wrong caller. Both cases mean that the monitor is out of
+ * sync and are reported as errors.
+ *
+ * Returns the message or NULL on error.
+ */
+qemuMonitorMessagePtr
+qemuMonitorFindReplyMessage(qemuMonitorPtr mon,
+                            const char *id)
+{
+    qemuMonitorMessagePtr found = NULL;
+    size_t npending = 0;
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        qemuMonitorMessagePtr msg = mon->msgs[i];
+
+        if (msg->finished || msg->txOffset < msg->txLength)
+            continue;
+
+        if (id) {
+            if (msg->id && STREQ(id, msg->id))
+                return msg;
+            continue;
+        }
+
+        if (!found)
+            found = msg;
+        npending++;
+    }
+
+    if (id) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unexpected monitor reply with id '%s'"), id);
+        return NULL;
+    }
+
+    if (npending == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unexpected monitor reply"));
+        return NULL;
+    }
+
+    if (npending > 1) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("monitor reply without id while %zu commands "
+                         "are in flight"), npending);
+        return NULL;
+    }
+
+    return found;
+}
+
+
+int
+qemuMonitorStorePrefetched(qemuMonitorPtr mon,
+                           const char *command,
+                           virJSONValuePtr reply)
+{
+    if (!mon->prefetched &&
+        !(mon->prefetched = virHashCreate(5, virJSONValueHashFree)))
+        return -1;
+
+    return virHashUpdateEntry(mon->prefetched, command, reply);
+}
+
+
+virJSONValuePtr
+qemuMonitorTakePrefetched(qemuMonitorPtr mon,
+                          const char *command)
+{
+    virJSONValuePtr reply;
+
+    if (!mon->prefetched ||
+        !(reply = virHashSteal(mon->prefetched, command)))
+        return NULL;
+
+    VIR_DEBUG("Using prefetched reply to %s", command);
+    return reply;
+}
+
+
+/**
+ * qemuMonitorPrefetchQueries:
+ * @mon: monitor object
+ * @commands: names of query commands taking no arguments
+ * @ncommands: number of @commands
+ *
+ * Sends all @commands to QEMU in one batch and keeps their replies,
+ * which are then used the first time each of the commands is issued
+ * on @mon instead of asking QEMU again. This allows a series of
+ * queries to be answered in a single round trip. Replies not used
+ * yet are forgotten by qemuMonitorDropPrefetched, when QEMU emits an
+ * event, or when a command which may change the VM is issued.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMonitorPrefetchQueries(qemuMonitorPtr mon,
+                           const char **commands,
+                           size_t ncommands)
+{
+    VIR_DEBUG("ncommands=%zu", ncommands);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONPrefetchQueries(mon, commands, ncommands);
+}
+
+
+void
+qemuMonitorDropPrefetched(qemuMonitorPtr mon)
+{
+    virHashFree(mon->prefetched);
+    mon->prefetched = NULL;
+}
+
+
+static void
+qemuMonitorSharedQueryFree(qemuMonitorSharedQueryPtr query)
+{
+    if (query->result && query->freeResult)
+        query->freeResult(query->result);
+    virFreeError(query->error);
+    g_free(query->key);
+    g_free(query);
+}
+
+
+static void
+qemuMonitorQueryCacheDrop(qemuMonitorPtr mon,
+                          qemuMonitorSharedQueryPtr query)
+{
+    qemuMonitorSharedQueryPtr *prev = &mon->queryCache;
+
+    while (*prev != query)
+        prev = &(*prev)->next;
+    *prev = query->next;
+
+    query->next = NULL;
+    query->cached = false;
+    if (query->waiters == 0)
+        qemuMonitorSharedQueryFree(query);
+}
+
+
+/**
+ * qemuMonitorInvalidateQueryCache:
+ * @mon: monitor object, must be locked
+ *
+ * Forgets all cached and prefetched query results, to be called
+ * whenever the state of the VM may have changed.
+ */
+void
+qemuMonitorInvalidateQueryCache(qemuMonitorPtr mon)
+{
+    while (mon->queryCache)
+        qemuMonitorQueryCacheDrop(mon, mon->queryCache);
+
+    qemuMonitorDropPrefetched(mon);
+}
+
+
+/**
+ * qemuMonitorSetQueryCacheTTL:
+ * @mon: monitor object
+ * @ttl: for how long results are reused (in milliseconds), 0 to disable
+ *
+ * Results of queries used for gathering statistics are reused for @ttl
+ * milliseconds unless QEMU emits an event or libvirt issues a command
+ * which may change the state of the VM in the meantime.
+ */
+void
+qemuMonitorSetQueryCacheTTL(qemuMonitorPtr mon,
+                            unsigned long long ttl)
+{
+    virObjectLock(mon);
+    mon->queryCacheTTL = ttl;
+    if (ttl == 0)
+        qemuMonitorInvalidateQueryCache(mon);
+    virObjectUnlock(mon);
+}
+
+
+static qemuMonitorSharedQueryPtr
+qemuMonitorQueryCacheLookup(qemuMonitorPtr mon,
+                            const char *key)
+{
+    qemuMonitorSharedQueryPtr query;
+    unsigned long long now;
+
+    for (query = mon->queryCache; query; query = query->next) {
+        if (STREQ(query->key, key))
+            break;
+    }
+
+    if (!query)
+        return NULL;
+
+    if (virTimeMillisNow(&now) < 0 || now >= query->expires) {
+        qemuMonitorQueryCacheDrop(mon, query);
+        virResetLastError();
+        return NULL;
+    }
+
+    VIR_DEBUG("Using cached result of query %s", key);
+
+    query->waiters++;
+    return query;
+}
+
+
+static void
+qemuMonitorQueryCacheAdd(qemuMonitorPtr mon,
+                         qemuMonitorSharedQueryPtr query)
+{
+    qemuMonitorSharedQueryPtr old;
+
+    if (virTimeMillisNow(&query->expires) < 0) {
+        virResetLastError();
+        return;
+    }
+    query->expires += mon->queryCacheTTL;
+
+    for (old = mon->queryCache; old; old = old->next) {
+        if (STREQ(old->key, query->key)) {
+            qemuMonitorQueryCacheDrop(mon, old);
+            break;
+        }
+    }
+
+    query->cached = true;
+    query->next = mon->queryCache;
+    mon->queryCache = query;
+}
+
+
+/**
+ * qemuMonitorSharedQueryFind:
+ * @mon: monitor object
+ * @key: identification of the query and its arguments
+ *
+ * Looks for a fresh cached result of the query identified by @key or
+ * for such query which another thread is running on @mon right now and
+ * waits for it to finish, at most until the deadline of the calling
+ * thread. The result is retrieved by qemuMonitorSharedQueryResult.
+ *
+ * Returns the finished query or NULL if there's no such query in flight,
+ * in which case the caller should announce its own query with
+ * qemuMonitorSharedQueryNew.
+ */
+static qemuMonitorSharedQueryPtr
+qemuMonitorSharedQueryFind(qemuMonitorPtr mon,
+                           const char *key)
+{
+    qemuMonitorSharedQueryPtr query;
+
+    if ((query = qemuMonitorQueryCacheLookup(mon, key)))
+        return query;
+
+    for (query = mon->sharedQueries; query; query = query->next) {
+        if (STREQ(query->key, key))
+            break;
+    }
+
+    if (!query)
+        return NULL;
+
+    VIR_DEBUG("Waiting for result of in-flight query %s", key);
+
+    query->waiters++;
+    while (!query->finished) {
+        if (qemuMonitorWaitNotify(mon, qemuMonitorGetThreadDeadline()) < 0) {
+            /* let the caller run the query, which fails past the deadline */
+            virResetLastError();
+            query->waiters--;
+            return NULL;
+        }
+    }
+
+    return query;
+}
+
+
+static qemuMonitorSharedQueryPtr
+qemuMonitorSharedQueryNew(qemuMonitorPtr mon,
+                          const char *key)
+{
+    qemuMonitorSharedQueryPtr query = g_new0(qemuMonitorSharedQuery, 1);
+
+    query->key = g_strdup(key);
+    query->next = mon->sharedQueries;
+    mon->sharedQueries = query;
+
+    return query;
+}
+
+
+/**
+ * qemuMonitorSharedQueryFinish:
+ * @mon: monitor object
+ * @query: query announced by qemuMonitorSharedQueryNew
+ * @rc: return value of the query
+ * @result: result of the query, left untouched
+ * @copyResult: function creating a copy of @result
+ * @freeResult: function freeing a copy of @result
+ *
+ * Hands a copy of @result (or the error reported by the query if @rc is
+ * negative) to threads waiting for @query. Successful results are also
+ * cached if enabled by qemuMonitorSetQueryCacheTTL.
+ */
+static void
+qemuMonitorSharedQueryFinish(qemuMonitorPtr mon,
+                             qemuMonitorSharedQueryPtr query,
+                             int rc,
+                             const void *result,
+                             void *(*copyResult)(const void *result),
+                             virFreeCallback freeResult)
+{
+    qemuMonitorSharedQueryPtr *prev = &mon->sharedQueries;
+    bool cache = rc >= 0 && result && mon->queryCacheTTL > 0;
+
+    while (*prev != query)
+        prev = &(*prev)->next;
+    *prev = query->next;
+    query->next = NULL;
+
+    if (query->waiters == 0 && !cache) {
+        qemuMonitorSharedQueryFree(query);
+        return;
+    }
+
+    VIR_DEBUG("Sharing result of query %s with %zu threads (cache=%d)",
+              query->key, query->waiters, cache);
+
+    query->rc = rc;
+    if (rc < 0) {
+        if (virGetLastErrorCode() != VIR_ERR_OK)
+            query->error = virSaveLastError();
+    } else if (result) {
+        query->result = copyResult(result);
+    }
+    query->freeResult = freeResult;
+    query->finished = true;
+
+    if (cache && query->result)
+        qemuMonitorQueryCacheAdd(mon, query);
+
+    if (query->waiters > 0)
+        virCondBroadcast(&mon->notify);
+    else if (!query->cached)
+        qemuMonitorSharedQueryFree(query);
+}
+
+
+/**
+ * qemuMonitorSharedQueryResult:
+ * @query: query returned by qemuMonitorSharedQueryFind
+ * @result: filled with a copy of the result
+ * @copyResult: function creating a copy of the result
+ *
+ * Returns the return value of the query, reporting its error if negative.
+ */
+static int
+qemuMonitorSharedQueryResult(qemuMonitorSharedQueryPtr query,
+                             void **result,
+                             void *(*copyResult)(const void *result))
+{
+    int rc = query->rc;
+
+    if (rc < 0) {
+        if (query->error)
+            virSetError(query->error);
+    } else if (query->result) {
+        *result = copyResult(query->result);
+    }
+
+    if (--query->waiters == 0 && !query->cached)
+        qemuMonitorSharedQueryFree(query);
+
+    return rc;
+}
+
+
 /**
  * This function returns a new virError object; the caller is responsible
  * for freeing it.
@@ -1137,6 +1928,9 @@ qemuMonitorEmitEvent(qemuMonitorPtr mon, const char *event,
     int ret = -1;
     VIR_DEBUG("mon=%p event=%s", mon, event);
 
+    /* Events announce changes of the VM state */
+    qemuMonitorInvalidateQueryCache(mon);
+
     QEMU_MONITOR_CALLBACK(mon, ret, domainEvent, mon->vm, event, seconds,
                           micros, details);
     return ret;
@@ -1660,6 +2454,87 @@ qemuMonitorQueryCpusFree(struct qemuMonitorQueryCpusEntry *entries,
 }
 
 
+typedef struct _qemuMonitorQueryCpusResult qemuMonitorQueryCpusResult;
+typedef qemuMonitorQueryCpusResult *qemuMonitorQueryCpusResultPtr;
+struct _qemuMonitorQueryCpusResult {
+    struct qemuMonitorQueryCpusEntry *entries;
+    size_t nentries;
+};
+
+
+static void *
+qemuMonitorQueryCpusResultCopy(const void *opaque)
+{
+    const qemuMonitorQueryCpusResult *src = opaque;
+    qemuMonitorQueryCpusResultPtr dst = g_new0(qemuMonitorQueryCpusResult, 1);
+    size_t i;
+
+    dst->entries = g_new0(struct qemuMonitorQueryCpusEntry, src->nentries);
+    dst->nentries = src->nentries;
+
+    for (i = 0; i < src->nentries; i++) {
+        dst->entries[i] = src->entries[i];
+        dst->entries[i].qom_path = g_strdup(src->entries[i].qom_path);
+    }
+
+    return dst;
+}
+
+
+static void
+qemuMonitorQueryCpusResultFree(void *opaque)
+{
+    qemuMonitorQueryCpusResultPtr result = opaque;
+
+    qemuMonitorQueryCpusFree(result->entries, result->nentries);
+    g_free(result);
+}
+
+
+/* Runs query-cpus[-fast] unless another thread is running the same
+ * query already in which case its result is used */
+static int
+qemuMonitorQueryCpus(qemuMonitorPtr mon,
+                     struct qemuMonitorQueryCpusEntry **entries,
+                     size_t *nentries,
+                     bool force,
+                     bool fast)
+{
+    g_autofree char *key = NULL;
+    qemuMonitorSharedQueryPtr query;
+    qemuMonitorQueryCpusResult result = { 0 };
+    qemuMonitorQueryCpusResultPtr shared = NULL;
+    int rc;
+
+    *entries = NULL;
+    *nentries = 0;
+
+    key = g_strdup_printf("query-cpus:%d:%d", force, fast);
+
+    if ((query = qemuMonitorSharedQueryFind(mon, key))) {
+        rc = qemuMonitorSharedQueryResult(query, (void **)&shared,
+                                          qemuMonitorQueryCpusResultCopy);
+        if (shared) {
+            *entries = g_steal_pointer(&shared->entries);
+            *nentries = shared->nentries;
+            g_free(shared);
+        }
+        return rc;
+    }
+
+    query = qemuMonitorSharedQueryNew(mon, key);
+    rc = qemuMonitorJSONQueryCPUs(mon, &result.entries, &result.nentries,
+                                  force, fast);
+    qemuMonitorSharedQueryFinish(mon, query, rc, &result,
+                                 qemuMonitorQueryCpusResultCopy,
+                                 qemuMonitorQueryCpusResultFree);
+
+    *entries = result.entries;
+    *nentries = result.nentries;
+    return rc;
+}
+
+
 /**
  * Legacy approach doesn't allow out of order cpus, thus no complex matching
  * algorithm is necessary */
@@ -1868,8 +2743,8 @@ qemuMonitorGetCPUInfo(qemuMonitorPtr mon,
         (qemuMonitorJSONGetHotpluggableCPUs(mon, &hotplugcpus, &nhotplugcpus)) < 0)
         goto cleanup;
 
-    rc = qemuMonitorJSONQueryCPUs(mon, &cpuentries, &ncpuentries, hotplug,
-                                  fast);
+    rc = qemuMonitorQueryCpus(mon, &cpuentries, &ncpuentries, hotplug,
+                              fast);
 
     if (rc < 0) {
         if (!hotplug && rc == -2) {
@@ -1920,8 +2795,8 @@ qemuMonitorGetCpuHalted(qemuMonitorPtr mon,
 
     QEMU_CHECK_MONITOR_NULL(mon);
 
-    rc = qemuMonitorJSONQueryCPUs(mon, &cpuentries, &ncpuentries, false,
-                                  fast);
+    rc = qemuMonitorQueryCpus(mon, &cpuentries, &ncpuentries, false,
+                              fast);
 
     if (rc < 0)
         goto cleanup;
@@ -1963,6 +2838,13 @@ qemuMonitorGetVirtType(qemuMonitorPtr mon,
 }
 
 
+static void *
+qemuMonitorBalloonInfoCopy(const void *src)
+{
+    return g_memdup(src, sizeof(unsigned long long));
+}
+
+
 /**
  * Returns: 0 if balloon not supported, +1 if balloon query worked
  * or -1 on failure
@@ -1971,9 +2853,30 @@ int
 qemuMonitorGetBalloonInfo(qemuMonitorPtr mon,
                           unsigned long long *currmem)
 {
+    g_autofree unsigned long long *mem = NULL;
+    qemuMonitorSharedQueryPtr query;
+    int ret;
+
     QEMU_CHECK_MONITOR(mon);
 
-    return qemuMonitorJSONGetBalloonInfo(mon, currmem);
+    if ((query = qemuMonitorSharedQueryFind(mon, "query-balloon"))) {
+        ret = qemuMonitorSharedQueryResult(query, (void **)&mem,
+                                           qemuMonitorBalloonInfoCopy);
+        *currmem = 0;
+        if (ret == 1)
+            *currmem = *mem;
+        return ret;
+    }
+
+    /* only a working balloon has a value to share, the waiters get the
+     * return value alone otherwise */
+    query = qemuMonitorSharedQueryNew(mon, "query-balloon");
+    ret = qemuMonitorJSONGetBalloonInfo(mon, currmem);
+    qemuMonitorSharedQueryFinish(mon, query, ret,
+                                 ret == 1 ? currmem : NULL,
+                                 qemuMonitorBalloonInfoCopy, g_free);
+
+    return ret;
 }
 
 
@@ -2118,16 +3021,75 @@ qemuMonitorQueryBlockstats(qemuMonitorPtr mon)
  *
  * Returns < 0 on error, count of supported block stats fields on success.
  */
+static int
+qemuMonitorBlockStatsCopyOne(void *payload,
+                             const void *name,
+                             void *opaque)
+{
+    virHashTablePtr dst = opaque;
+    qemuBlockStatsPtr stats = g_new0(qemuBlockStats, 1);
+
+    *stats = *(qemuBlockStatsPtr)payload;
+
+    if (virHashAddEntry(dst, name, stats) < 0) {
+        g_free(stats);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void *
+qemuMonitorBlockStatsCopy(const void *src)
+{
+    virHashTablePtr dst;
+
+    if (!(dst = virHashCreate(10, virHashValueFree)))
+        return NULL;
+
+    if (virHashForEach((virHashTablePtr)src,
+                       qemuMonitorBlockStatsCopyOne, dst) < 0) {
+        virHashFree(dst);
+        return NULL;
+    }
+
+    return dst;
+}
+
+
+static void
+qemuMonitorBlockStatsFree(void *stats)
+{
+    virHashFree(stats);
+}
+
+
 int
 qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                 virHashTablePtr *ret_stats,
                                 bool backingChain)
 {
+    g_autofree char *key = NULL;
+    qemuMonitorSharedQueryPtr query;
     int ret = -1;
     VIR_DEBUG("ret_stats=%p, backing=%d", ret_stats, backingChain);
 
     QEMU_CHECK_MONITOR(mon);
 
+    *ret_stats = NULL;
+    key = g_strdup_printf("query-blockstats:%d", backingChain);
+
+    if ((query = qemuMonitorSharedQueryFind(mon, key))) {
+        ret = qemuMonitorSharedQueryResult(query, (void **)ret_stats,
+                                           qemuMonitorBlockStatsCopy);
+        if (ret >= 0 && !*ret_stats)
+            ret = -1;
+        return ret;
+    }
+
+    query = qemuMonitorSharedQueryNew(mon, key);
+
     if (!(*ret_stats = virHashCreate(10, virHashValueFree)))
         goto error;
 
@@ -2137,9 +3099,13 @@ qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
     if (ret < 0)
         goto error;
 
+    qemuMonitorSharedQueryFinish(mon, query, ret, *ret_stats,
+                                 qemuMonitorBlockStatsCopy,
+                                 qemuMonitorBlockStatsFree);
     return ret;
 
  error:
+    qemuMonitorSharedQueryFinish(mon, query, -1, NULL, NULL, NULL);
     virHashFree(*ret_stats);
     *ret_stats = NULL;
     return -1;
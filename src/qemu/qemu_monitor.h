@@ -46,16 +46,27 @@ struct _qemuMonitorMessage {
     int txOffset;
     int txLength;
 
+    /* QMP 'id' of the command, used to match the reply to it */
+    const char *id;
+
     /* Used by the text monitor reply / error */
     char *rxBuffer;
     int rxLength;
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
+    /* Optionally used by the JSON monitor to decode the 'return'
+     * member of the reply instead of storing it in rxObject */
+    const virJSONSAXCallbacks *rxDecoder;
+    void *rxDecoderOpaque;
 
     /* True if rxBuffer / rxObject are ready, or a
      * fatal error occurred on the monitor channel
      */
     bool finished;
+
+    /* The sender gave up waiting for the reply, the message is a copy
+     * owned by the monitor which is freed once the reply is received */
+    bool abandoned;
 };
 
 typedef enum {
@@ -402,10 +413,30 @@ int qemuMonitorSetLink(qemuMonitorPtr mon,
                        virDomainNetInterfaceLinkState state)
     ATTRIBUTE_NONNULL(2);
 
+void qemuMonitorSetQueryCacheTTL(qemuMonitorPtr mon,
+                                 unsigned long long ttl);
+
+int qemuMonitorPrefetchQueries(qemuMonitorPtr mon,
+                               const char **commands,
+                               size_t ncommands);
+void qemuMonitorDropPrefetched(qemuMonitorPtr mon);
+
 /* These APIs are for use by the internal Text/JSON monitor impl code only */
 char *qemuMonitorNextCommandID(qemuMonitorPtr mon);
+void qemuMonitorInvalidateQueryCache(qemuMonitorPtr mon);
 int qemuMonitorSend(qemuMonitorPtr mon,
                     qemuMonitorMessagePtr msg);
+int qemuMonitorSendBatch(qemuMonitorPtr mon,
+                         qemuMonitorMessagePtr *msgs,
+                         size_t nmsgs);
+void qemuMonitorSetThreadDeadline(unsigned long long deadline);
+qemuMonitorMessagePtr qemuMonitorFindReplyMessage(qemuMonitorPtr mon,
+                                                  const char *id);
+int qemuMonitorStorePrefetched(qemuMonitorPtr mon,
+                               const char *command,
+                               virJSONValuePtr reply);
+virJSONValuePtr qemuMonitorTakePrefetched(qemuMonitorPtr mon,
+                                          const char *command);
 virJSONValuePtr qemuMonitorGetOptions(qemuMonitorPtr mon)
     ATTRIBUTE_NONNULL(1);
 void qemuMonitorSetOptions(qemuMonitorPtr mon, virJSONValuePtr options)
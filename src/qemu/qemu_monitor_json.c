@@ -210,18 +210,15 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
 }
 
 int
-qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
-                             const char *line,
-                             qemuMonitorMessagePtr msg)
+qemuMonitorJSONIOProcessMessage(qemuMonitorPtr mon,
+                                virJSONValuePtr obj,
+                                const char *line)
 {
-    virJSONValuePtr obj = NULL;
+    qemuMonitorMessagePtr msg;
     int ret = -1;
 
     VIR_DEBUG("Line [%s]", line);
 
-    if (!(obj = virJSONValueFromString(line)))
-        goto cleanup;
-
     if (virJSONValueGetType(obj) != VIR_JSON_TYPE_OBJECT) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Parsed JSON reply '%s' isn't an object"), line);
@@ -238,14 +235,14 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                virJSONValueObjectHasKey(obj, "return") == 1) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
+        /* an unmatched reply means the monitor is out of sync */
+        msg = qemuMonitorFindReplyMessage(mon,
+                                          virJSONValueObjectGetString(obj, "id"));
         if (msg) {
             msg->rxObject = obj;
             msg->finished = 1;
             obj = NULL;
             ret = 0;
-        } else {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Unexpected JSON reply '%s'"), line);
         }
     } else {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -257,73 +254,147 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
     return ret;
 }
 
+/*
+ * Feeds the data not parsed yet into the monitor's stream parser and
+ * processes every reply or event completed by it. @data holds @len
+ * bytes of which the first @parsed were fed to @parser already.
+ *
+ * Returns the number of bytes of @data taken by complete messages or
+ * -1 on error.
+ */
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
-                             const char *data,
+                             virJSONStreamParserPtr parser,
+                             char *data,
                              size_t len,
-                             qemuMonitorMessagePtr msg)
+                             size_t parsed)
 {
-    int used = 0;
+    virJSONValuePtr obj;
+    size_t objlen;
+    size_t used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
 
-    while (used < len) {
-        char *nl = strstr(data + used, LINE_ENDING);
-
-        if (nl) {
-            int got = nl - (data + used);
-            char *line;
-            line = g_strndup(data + used, got);
-            used += got + strlen(LINE_ENDING);
-            line[got] = '\0'; /* kill \n */
-            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0) {
-                VIR_FREE(line);
-                return -1;
-            }
+    if (parsed < len &&
+        virJSONStreamParserFeed(parser, data + parsed, len - parsed) < 0)
+        return -1;
 
-            VIR_FREE(line);
-        } else {
-            break;
-        }
+    while ((obj = virJSONStreamParserNext(parser, &objlen))) {
+        char *line = data + used;
+        char *end = line + objlen;
+        char saved = *end;
+        int rc;
+
+        used += objlen;
+
+        /* The message has been parsed already, so terminate it in place
+         * just for logging and probes */
+        *end = '\0';
+        line += strspn(line, " \t" LINE_ENDING);
+        rc = qemuMonitorJSONIOProcessMessage(mon, obj, line);
+        *end = saved;
+
+        if (rc < 0)
+            return -1;
     }
 
 #if DEBUG_IO
-    VIR_DEBUG("Total used %d bytes out of %zd available in buffer", used, len);
+    VIR_DEBUG("Total used %zu bytes out of %zd available in buffer", used, len);
 #endif
 
     return used;
 }
 
+/* Whether @cmd only reads the state of the VM */
+static bool
+qemuMonitorJSONCommandIsQuery(virJSONValuePtr cmd)
+{
+    const char *name = virJSONValueObjectGetString(cmd, "execute");
+
+    return name &&
+           (STRPREFIX(name, "query-") ||
+            STREQ(name, "qom-get") ||
+            STREQ(name, "qom-list"));
+}
+
+
+/*
+ * Fills @msg with @cmd tagged by a new command 'id', which is stored
+ * in @id for the caller to free.
+ */
 static int
-qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
-                             virJSONValuePtr cmd,
-                             int scm_fd,
-                             virJSONValuePtr *reply)
+qemuMonitorJSONMessageInit(qemuMonitorPtr mon,
+                           virJSONValuePtr cmd,
+                           qemuMonitorMessagePtr msg,
+                           char **id)
 {
-    int ret = -1;
-    qemuMonitorMessage msg;
     g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
-    char *id = NULL;
-
-    *reply = NULL;
 
-    memset(&msg, 0, sizeof(msg));
+    memset(msg, 0, sizeof(*msg));
+    msg->txFD = -1;
 
     if (virJSONValueObjectHasKey(cmd, "execute") == 1) {
-        if (!(id = qemuMonitorNextCommandID(mon)))
-            goto cleanup;
-        if (virJSONValueObjectAppendString(cmd, "id", id) < 0) {
+        if (!(*id = qemuMonitorNextCommandID(mon)))
+            return -1;
+        if (virJSONValueObjectAppendString(cmd, "id", *id) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to append command 'id' string"));
-            goto cleanup;
+            return -1;
         }
+        msg->id = *id;
     }
 
+    if (!qemuMonitorJSONCommandIsQuery(cmd))
+        qemuMonitorInvalidateQueryCache(mon);
+
     if (virJSONValueToBuffer(cmd, &cmdbuf, false) < 0)
-        goto cleanup;
+        return -1;
     virBufferAddLit(&cmdbuf, "\r\n");
 
-    msg.txLength = virBufferUse(&cmdbuf);
-    msg.txBuffer = virBufferContentAndReset(&cmdbuf);
+    msg->txLength = virBufferUse(&cmdbuf);
+    msg->txBuffer = virBufferContentAndReset(&cmdbuf);
+
+    return 0;
+}
+
+
+/* Returns the reply to @cmd if it was prefetched by
+ * qemuMonitorJSONPrefetchQueries */
+static virJSONValuePtr
+qemuMonitorJSONTakePrefetched(qemuMonitorPtr mon,
+                              virJSONValuePtr cmd)
+{
+    const char *name = virJSONValueObjectGetString(cmd, "execute");
+
+    if (!name || virJSONValueObjectHasKey(cmd, "arguments") == 1)
+        return NULL;
+
+    return qemuMonitorTakePrefetched(mon, name);
+}
+
+
+static int
+qemuMonitorJSONCommandFull(qemuMonitorPtr mon,
+                           virJSONValuePtr cmd,
+                           int scm_fd,
+                           const virJSONSAXCallbacks *decoder,
+                           void *decoderOpaque,
+                           virJSONValuePtr *reply)
+{
+    int ret = -1;
+    qemuMonitorMessage msg;
+    char *id = NULL;
+
+    *reply = NULL;
+
+    if (scm_fd == -1 && !decoder &&
+        (*reply = qemuMonitorJSONTakePrefetched(mon, cmd)))
+        return 0;
+
+    if (qemuMonitorJSONMessageInit(mon, cmd, &msg, &id) < 0)
+        goto cleanup;
+
     msg.txFD = scm_fd;
+    msg.rxDecoder = decoder;
+    msg.rxDecoderOpaque = decoderOpaque;
 
     ret = qemuMonitorSend(mon, &msg);
 
@@ -345,6 +416,68 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
 }
 
 
+/*
+ * Sends all @cmds to QEMU back to back and waits for all the replies,
+ * which are stored into @replies of the same length as @cmds. Error
+ * replies have to be checked by the caller as with qemuMonitorJSONCommand.
+ */
+static int
+qemuMonitorJSONCommandBatch(qemuMonitorPtr mon,
+                            virJSONValuePtr *cmds,
+                            size_t ncmds,
+                            virJSONValuePtr *replies)
+{
+    g_autofree qemuMonitorMessage *msgs = g_new0(qemuMonitorMessage, ncmds);
+    g_autofree qemuMonitorMessagePtr *msgptrs = g_new0(qemuMonitorMessagePtr, ncmds);
+    g_auto(GStrv) ids = g_new0(char *, ncmds + 1);
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < ncmds; i++)
+        replies[i] = NULL;
+
+    for (i = 0; i < ncmds; i++) {
+        if (qemuMonitorJSONMessageInit(mon, cmds[i], &msgs[i], &ids[i]) < 0)
+            goto cleanup;
+        msgptrs[i] = &msgs[i];
+    }
+
+    if (qemuMonitorSendBatch(mon, msgptrs, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (!msgs[i].rxObject) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Missing monitor reply object"));
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < ncmds; i++)
+        replies[i] = g_steal_pointer(&msgs[i].rxObject);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncmds; i++) {
+        VIR_FREE(msgs[i].txBuffer);
+        virJSONValueFree(msgs[i].rxObject);
+    }
+
+    return ret;
+}
+
+
+static int
+qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             int scm_fd,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, scm_fd, NULL, NULL, reply);
+}
+
+
 static int
 qemuMonitorJSONCommand(qemuMonitorPtr mon,
                        virJSONValuePtr cmd,
@@ -353,6 +486,23 @@ qemuMonitorJSONCommand(qemuMonitorPtr mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/*
+ * Like qemuMonitorJSONCommand, but the 'return' member of the reply is
+ * passed to @decoder as it's being parsed. The member is replaced by
+ * an empty value of the same type in @reply.
+ */
+static int
+qemuMonitorJSONCommandDecode(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             const virJSONSAXCallbacks *decoder,
+                             void *decoderOpaque,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, decoder, decoderOpaque,
+                                      reply);
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -2546,126 +2696,581 @@ int qemuMonitorJSONGetBlockInfo(qemuMonitorPtr mon,
 }
 
 
-static qemuBlockStatsPtr
-qemuMonitorJSONBlockStatsCollectData(virJSONValuePtr dev,
-                                     int *nstats)
+/*
+ * query-blockstats replies carry dozens of statistics for every node of
+ * every disk of which only a few are used. Rather than building a
+ * virJSONValue tree of the whole reply first, the 'return' member is
+ * decoded into qemuBlockStats while it's being parsed by the monitor.
+ */
+typedef enum {
+    QEMU_MONITOR_JSON_BLOCKSTATS_IGNORE = 0, /* value not of interest */
+    QEMU_MONITOR_JSON_BLOCKSTATS_DEVICES, /* the returned array */
+    QEMU_MONITOR_JSON_BLOCKSTATS_DEVICE, /* BlockStats of an entry or its backing */
+    QEMU_MONITOR_JSON_BLOCKSTATS_STATS, /* its 'stats' */
+    QEMU_MONITOR_JSON_BLOCKSTATS_PARENT, /* its 'parent' */
+    QEMU_MONITOR_JSON_BLOCKSTATS_PARENT_STATS, /* 'stats' of the 'parent' */
+} qemuMonitorJSONBlockStatsContext;
+
+typedef enum {
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_OTHER = 0,
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_DEVICE,
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_QDEV,
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_NODE_NAME,
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_STATS,
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_PARENT,
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_BACKING,
+    QEMU_MONITOR_JSON_BLOCKSTATS_KEY_FIELD,
+} qemuMonitorJSONBlockStatsKey;
+
+static const struct {
+    const char *name;
+    size_t offset;
+    bool mandatory;
+} qemuMonitorJSONBlockStatsFields[] = {
+    { "rd_bytes", offsetof(qemuBlockStats, rd_bytes), true },
+    { "wr_bytes", offsetof(qemuBlockStats, wr_bytes), true },
+    { "rd_operations", offsetof(qemuBlockStats, rd_req), true },
+    { "wr_operations", offsetof(qemuBlockStats, wr_req), true },
+    { "rd_total_time_ns", offsetof(qemuBlockStats, rd_total_times), false },
+    { "wr_total_time_ns", offsetof(qemuBlockStats, wr_total_times), false },
+    { "flush_operations", offsetof(qemuBlockStats, flush_req), false },
+    { "flush_total_time_ns", offsetof(qemuBlockStats, flush_total_times), false },
+};
+
+typedef struct _qemuMonitorJSONBlockStatsNode qemuMonitorJSONBlockStatsNode;
+typedef qemuMonitorJSONBlockStatsNode *qemuMonitorJSONBlockStatsNodePtr;
+struct _qemuMonitorJSONBlockStatsNode {
+    qemuBlockStats stats;
+    unsigned int fields; /* bitmap of qemuMonitorJSONBlockStatsFields found */
+    bool hasStats;
+    char *qdev;
+    char *nodename;
+};
+
+typedef struct _qemuMonitorJSONBlockStatsDecoder qemuMonitorJSONBlockStatsDecoder;
+typedef qemuMonitorJSONBlockStatsDecoder *qemuMonitorJSONBlockStatsDecoderPtr;
+struct _qemuMonitorJSONBlockStatsDecoder {
+    virHashTablePtr hash;
+    bool backingChain;
+    int nstats;
+
+    /* The decoder runs in the thread processing monitor I/O so the first
+     * error is only reported once the command finishes */
+    char *error;
+
+    qemuMonitorJSONBlockStatsContext *stack; /* containers being parsed */
+    size_t nstack;
+    size_t stack_max;
+    size_t ignore; /* nesting level within an ignored value */
+
+    qemuMonitorJSONBlockStatsKey key;
+    size_t field;
+
+    /* the entry being parsed followed by its backing chain */
+    char *device;
+    qemuMonitorJSONBlockStatsNodePtr nodes;
+    size_t nnodes;
+    size_t nodes_max;
+    size_t node;
+};
+
+
+static void G_GNUC_PRINTF(2, 3)
+qemuMonitorJSONBlockStatsDecodeError(qemuMonitorJSONBlockStatsDecoderPtr dec,
+                                     const char *fmt, ...)
+{
+    va_list args;
+
+    if (dec->error)
+        return;
+
+    va_start(args, fmt);
+    dec->error = g_strdup_vprintf(fmt, args);
+    va_end(args);
+}
+
+
+static bool
+qemuMonitorJSONBlockStatsKeyIs(const char *key,
+                               size_t len,
+                               const char *name)
 {
-    g_autofree qemuBlockStatsPtr bstats = NULL;
-    virJSONValuePtr parent;
-    virJSONValuePtr parentstats;
-    virJSONValuePtr stats;
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
 
-    if ((stats = virJSONValueObjectGetObject(dev, "stats")) == NULL) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("blockstats stats entry was not "
-                         "in expected format"));
-        return NULL;
+
+static int
+qemuMonitorJSONBlockStatsParseNumber(const char *value,
+                                     size_t len,
+                                     unsigned long long *result)
+{
+    char buf[32];
+
+    if (len >= sizeof(buf))
+        return -1;
+
+    memcpy(buf, value, len);
+    buf[len] = '\0';
+
+    return virStrToLong_ull(buf, NULL, 10, result);
+}
+
+
+static void
+qemuMonitorJSONBlockStatsNodeClear(qemuMonitorJSONBlockStatsNodePtr node)
+{
+    g_free(node->qdev);
+    g_free(node->nodename);
+    memset(node, 0, sizeof(*node));
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecoderClear(qemuMonitorJSONBlockStatsDecoderPtr dec)
+{
+    size_t i;
+
+    for (i = 0; i < dec->nnodes; i++)
+        qemuMonitorJSONBlockStatsNodeClear(&dec->nodes[i]);
+    g_free(dec->nodes);
+    g_free(dec->device);
+    g_free(dec->stack);
+    g_free(dec->error);
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecodeAdd(qemuMonitorJSONBlockStatsDecoderPtr dec,
+                                   qemuMonitorJSONBlockStatsNodePtr node,
+                                   const char *name)
+{
+    qemuBlockStatsPtr copy;
+
+    if (virHashHasEntry(dec->hash, name)) {
+        qemuMonitorJSONBlockStatsDecodeError(dec,
+                                             _("Duplicate hash table key '%s'"),
+                                             name);
+        return;
     }
 
-    if (VIR_ALLOC(bstats) < 0)
-        return NULL;
+    copy = g_new0(qemuBlockStats, 1);
+    *copy = node->stats;
 
-#define QEMU_MONITOR_BLOCK_STAT_GET(NAME, VAR, MANDATORY) \
-    if (MANDATORY || virJSONValueObjectHasKey(stats, NAME)) { \
-        (*nstats)++; \
-        if (virJSONValueObjectGetNumberUlong(stats, NAME, &VAR) < 0) { \
-            virReportError(VIR_ERR_INTERNAL_ERROR, \
-                           _("cannot read %s statistic"), NAME); \
-            return NULL; \
-        } \
+    if (virHashAddEntry(dec->hash, name, copy) < 0) {
+        VIR_FREE(copy);
+        qemuMonitorJSONBlockStatsDecodeError(dec, "%s",
+                                             _("failed to store block stats"));
     }
-    QEMU_MONITOR_BLOCK_STAT_GET("rd_bytes", bstats->rd_bytes, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("wr_bytes", bstats->wr_bytes, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("rd_operations", bstats->rd_req, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("wr_operations", bstats->wr_req, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("rd_total_time_ns", bstats->rd_total_times, false);
-    QEMU_MONITOR_BLOCK_STAT_GET("wr_total_time_ns", bstats->wr_total_times, false);
-    QEMU_MONITOR_BLOCK_STAT_GET("flush_operations", bstats->flush_req, false);
-    QEMU_MONITOR_BLOCK_STAT_GET("flush_total_time_ns", bstats->flush_total_times, false);
-#undef QEMU_MONITOR_BLOCK_STAT_GET
+}
+
+
+/* Stores the stats of the entry which was just parsed and all of its
+ * backing chain */
+static void
+qemuMonitorJSONBlockStatsDecodeEntry(qemuMonitorJSONBlockStatsDecoderPtr dec)
+{
+    const char *dev_name = dec->device;
+    size_t i;
+    size_t j;
 
-    if ((parent = virJSONValueObjectGetObject(dev, "parent")) &&
-        (parentstats = virJSONValueObjectGetObject(parent, "stats"))) {
-        if (virJSONValueObjectGetNumberUlong(parentstats, "wr_highest_offset",
-                                             &bstats->wr_highest_offset) == 0)
-            bstats->wr_highest_offset_valid = true;
+    if (!dev_name) {
+        qemuMonitorJSONBlockStatsDecodeError(dec, "%s",
+                                             _("blockstats device entry was not "
+                                               "in expected format"));
+        return;
     }
 
-    return g_steal_pointer(&bstats);
+    if (*dev_name == '\0')
+        dev_name = NULL;
+
+    for (i = 0; i < dec->nnodes && !dec->error; i++) {
+        qemuMonitorJSONBlockStatsNodePtr node = &dec->nodes[i];
+        g_autofree char *devicename = NULL;
+        int nstats = 0;
+
+        if (dev_name &&
+            !(devicename = qemuDomainStorageAlias(dev_name, i))) {
+            qemuMonitorJSONBlockStatsDecodeError(dec, "%s",
+                                                 _("failed to format storage alias"));
+            return;
+        }
+
+        if (!devicename && !node->qdev && !node->nodename) {
+            qemuMonitorJSONBlockStatsDecodeError(dec, "%s",
+                                                 _("blockstats device entry was not "
+                                                   "in expected format"));
+            return;
+        }
+
+        if (!node->hasStats) {
+            qemuMonitorJSONBlockStatsDecodeError(dec, "%s",
+                                                 _("blockstats stats entry was not "
+                                                   "in expected format"));
+            return;
+        }
+
+        for (j = 0; j < G_N_ELEMENTS(qemuMonitorJSONBlockStatsFields); j++) {
+            bool found = node->fields & (1U << j);
+
+            if (qemuMonitorJSONBlockStatsFields[j].mandatory && !found) {
+                qemuMonitorJSONBlockStatsDecodeError(dec,
+                                                     _("cannot read %s statistic"),
+                                                     qemuMonitorJSONBlockStatsFields[j].name);
+                return;
+            }
+
+            if (found || qemuMonitorJSONBlockStatsFields[j].mandatory)
+                nstats++;
+        }
+
+        /* only the number of stats of the entry itself is reported */
+        if (i == 0 && nstats > dec->nstats)
+            dec->nstats = nstats;
+
+        if (devicename)
+            qemuMonitorJSONBlockStatsDecodeAdd(dec, node, devicename);
+
+        if (node->qdev && STRNEQ_NULLABLE(node->qdev, devicename))
+            qemuMonitorJSONBlockStatsDecodeAdd(dec, node, node->qdev);
+
+        if (node->nodename)
+            qemuMonitorJSONBlockStatsDecodeAdd(dec, node, node->nodename);
+    }
 }
 
 
-static int
-qemuMonitorJSONAddOneBlockStatsInfo(qemuBlockStatsPtr bstats,
-                                    const char *name,
-                                    virHashTablePtr stats)
+static void
+qemuMonitorJSONBlockStatsDecodeStart(qemuMonitorJSONBlockStatsDecoderPtr dec,
+                                     bool array)
 {
-    qemuBlockStatsPtr copy = NULL;
+    qemuMonitorJSONBlockStatsContext ctx = QEMU_MONITOR_JSON_BLOCKSTATS_IGNORE;
+    qemuMonitorJSONBlockStatsKey key = dec->key;
+    size_t i;
 
-    if (VIR_ALLOC(copy) < 0)
-        return -1;
+    dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_OTHER;
 
-    if (bstats)
-        *copy = *bstats;
+    if (dec->error)
+        return;
 
-    if (virHashAddEntry(stats, name, copy) < 0) {
-        VIR_FREE(copy);
-        return -1;
+    if (dec->ignore > 0) {
+        dec->ignore++;
+        return;
     }
 
-    return 0;
+    if (dec->nstack == 0) {
+        /* the 'return' member, qemuMonitorJSONCheckReply checks its type */
+        if (array)
+            ctx = QEMU_MONITOR_JSON_BLOCKSTATS_DEVICES;
+    } else {
+        switch (dec->stack[dec->nstack - 1]) {
+        case QEMU_MONITOR_JSON_BLOCKSTATS_DEVICES:
+            if (array) {
+                qemuMonitorJSONBlockStatsDecodeError(dec, "%s",
+                                                     _("blockstats device entry was not "
+                                                       "in expected format"));
+                return;
+            }
+
+            for (i = 0; i < dec->nnodes; i++)
+                qemuMonitorJSONBlockStatsNodeClear(&dec->nodes[i]);
+            g_clear_pointer(&dec->device, g_free);
+            if (VIR_RESIZE_N(dec->nodes, dec->nodes_max, 0, 1) < 0)
+                return;
+            dec->nnodes = 1;
+            dec->node = 0;
+            ctx = QEMU_MONITOR_JSON_BLOCKSTATS_DEVICE;
+            break;
+
+        case QEMU_MONITOR_JSON_BLOCKSTATS_DEVICE:
+            if (array)
+                break;
+
+            if (key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_STATS) {
+                dec->nodes[dec->node].hasStats = true;
+                ctx = QEMU_MONITOR_JSON_BLOCKSTATS_STATS;
+            } else if (key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_PARENT) {
+                ctx = QEMU_MONITOR_JSON_BLOCKSTATS_PARENT;
+            } else if (key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_BACKING &&
+                       dec->backingChain) {
+                /* every node has at most one backing node */
+                dec->node++;
+                if (VIR_RESIZE_N(dec->nodes, dec->nodes_max, dec->node, 1) < 0)
+                    return;
+                dec->nnodes = dec->node + 1;
+                ctx = QEMU_MONITOR_JSON_BLOCKSTATS_DEVICE;
+            }
+            break;
+
+        case QEMU_MONITOR_JSON_BLOCKSTATS_PARENT:
+            if (!array && key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_STATS)
+                ctx = QEMU_MONITOR_JSON_BLOCKSTATS_PARENT_STATS;
+            break;
+
+        case QEMU_MONITOR_JSON_BLOCKSTATS_STATS:
+        case QEMU_MONITOR_JSON_BLOCKSTATS_PARENT_STATS:
+        case QEMU_MONITOR_JSON_BLOCKSTATS_IGNORE:
+            break;
+        }
+    }
+
+    if (ctx == QEMU_MONITOR_JSON_BLOCKSTATS_IGNORE) {
+        dec->ignore = 1;
+        return;
+    }
+
+    if (VIR_RESIZE_N(dec->stack, dec->stack_max, dec->nstack, 1) < 0)
+        return;
+    dec->stack[dec->nstack++] = ctx;
 }
 
 
-static int
-qemuMonitorJSONGetOneBlockStatsInfo(virJSONValuePtr dev,
-                                    const char *dev_name,
-                                    int depth,
-                                    virHashTablePtr hash,
-                                    bool backingChain)
+static void
+qemuMonitorJSONBlockStatsDecodeEnd(qemuMonitorJSONBlockStatsDecoderPtr dec)
 {
-    g_autofree qemuBlockStatsPtr bstats = NULL;
-    int nstats = 0;
-    const char *qdevname = NULL;
-    const char *nodename = NULL;
-    g_autofree char *devicename = NULL;
-    virJSONValuePtr backing;
+    dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_OTHER;
 
-    if (dev_name &&
-        !(devicename = qemuDomainStorageAlias(dev_name, depth)))
-        return -1;
+    if (dec->error)
+        return;
+
+    if (dec->ignore > 0) {
+        dec->ignore--;
+        return;
+    }
 
-    qdevname = virJSONValueObjectGetString(dev, "qdev");
-    nodename = virJSONValueObjectGetString(dev, "node-name");
+    if (dec->nstack == 0)
+        return;
 
-    if (!devicename && !qdevname && !nodename) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("blockstats device entry was not in expected format"));
-        return -1;
+    if (dec->stack[--dec->nstack] != QEMU_MONITOR_JSON_BLOCKSTATS_DEVICE)
+        return;
+
+    if (dec->node > 0)
+        dec->node--;
+    else
+        qemuMonitorJSONBlockStatsDecodeEntry(dec);
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecodeStartObject(void *opaque)
+{
+    qemuMonitorJSONBlockStatsDecodeStart(opaque, false);
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecodeStartArray(void *opaque)
+{
+    qemuMonitorJSONBlockStatsDecodeStart(opaque, true);
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecodeEndContainer(void *opaque)
+{
+    qemuMonitorJSONBlockStatsDecodeEnd(opaque);
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecodeKey(void *opaque,
+                                   const char *key,
+                                   size_t len)
+{
+    qemuMonitorJSONBlockStatsDecoderPtr dec = opaque;
+    size_t i;
+
+    dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_OTHER;
+
+    if (dec->error || dec->ignore > 0 || dec->nstack == 0)
+        return;
+
+    switch (dec->stack[dec->nstack - 1]) {
+    case QEMU_MONITOR_JSON_BLOCKSTATS_DEVICE:
+        if (qemuMonitorJSONBlockStatsKeyIs(key, len, "device"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_DEVICE;
+        else if (qemuMonitorJSONBlockStatsKeyIs(key, len, "qdev"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_QDEV;
+        else if (qemuMonitorJSONBlockStatsKeyIs(key, len, "node-name"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_NODE_NAME;
+        else if (qemuMonitorJSONBlockStatsKeyIs(key, len, "stats"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_STATS;
+        else if (qemuMonitorJSONBlockStatsKeyIs(key, len, "parent"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_PARENT;
+        else if (qemuMonitorJSONBlockStatsKeyIs(key, len, "backing"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_BACKING;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_STATS:
+        for (i = 0; i < G_N_ELEMENTS(qemuMonitorJSONBlockStatsFields); i++) {
+            if (qemuMonitorJSONBlockStatsKeyIs(key, len,
+                                               qemuMonitorJSONBlockStatsFields[i].name)) {
+                dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_FIELD;
+                dec->field = i;
+                break;
+            }
+        }
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_PARENT:
+        if (qemuMonitorJSONBlockStatsKeyIs(key, len, "stats"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_STATS;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_PARENT_STATS:
+        if (qemuMonitorJSONBlockStatsKeyIs(key, len, "wr_highest_offset"))
+            dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_FIELD;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_DEVICES:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_IGNORE:
+        break;
     }
+}
 
-    if (!(bstats = qemuMonitorJSONBlockStatsCollectData(dev, &nstats)))
-        return -1;
 
-    if (devicename &&
-        qemuMonitorJSONAddOneBlockStatsInfo(bstats, devicename, hash) < 0)
-        return -1;
+static void
+qemuMonitorJSONBlockStatsDecodeScalar(void *opaque,
+                                      virJSONType type,
+                                      const char *value,
+                                      size_t len)
+{
+    qemuMonitorJSONBlockStatsDecoderPtr dec = opaque;
+    qemuMonitorJSONBlockStatsKey key = dec->key;
+    qemuMonitorJSONBlockStatsNodePtr node;
+    unsigned long long num;
 
-    if (qdevname && STRNEQ_NULLABLE(qdevname, devicename) &&
-        qemuMonitorJSONAddOneBlockStatsInfo(bstats, qdevname, hash) < 0)
-        return -1;
+    dec->key = QEMU_MONITOR_JSON_BLOCKSTATS_KEY_OTHER;
 
-    if (nodename &&
-        qemuMonitorJSONAddOneBlockStatsInfo(bstats, nodename, hash) < 0)
-        return -1;
+    if (dec->error || dec->ignore > 0 || dec->nstack == 0)
+        return;
 
-    if (backingChain &&
-        (backing = virJSONValueObjectGetObject(dev, "backing")) &&
-        qemuMonitorJSONGetOneBlockStatsInfo(backing, dev_name, depth + 1,
-                                            hash, true) < 0)
+    node = dec->nodes ? &dec->nodes[dec->node] : NULL;
+
+    switch (dec->stack[dec->nstack - 1]) {
+    case QEMU_MONITOR_JSON_BLOCKSTATS_DEVICES:
+        qemuMonitorJSONBlockStatsDecodeError(dec, "%s",
+                                             _("blockstats device entry was not "
+                                               "in expected format"));
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_DEVICE:
+        if (type != VIR_JSON_TYPE_STRING)
+            break;
+
+        if (key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_DEVICE && dec->node == 0) {
+            g_free(dec->device);
+            dec->device = g_strndup(value, len);
+        } else if (key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_QDEV) {
+            g_free(node->qdev);
+            node->qdev = g_strndup(value, len);
+        } else if (key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_NODE_NAME) {
+            g_free(node->nodename);
+            node->nodename = g_strndup(value, len);
+        }
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_STATS:
+        if (key != QEMU_MONITOR_JSON_BLOCKSTATS_KEY_FIELD)
+            break;
+
+        if (type != VIR_JSON_TYPE_NUMBER ||
+            qemuMonitorJSONBlockStatsParseNumber(value, len, &num) < 0) {
+            qemuMonitorJSONBlockStatsDecodeError(dec,
+                                                 _("cannot read %s statistic"),
+                                                 qemuMonitorJSONBlockStatsFields[dec->field].name);
+            break;
+        }
+
+        *(unsigned long long *)((char *)&node->stats +
+                                qemuMonitorJSONBlockStatsFields[dec->field].offset) = num;
+        node->fields |= 1U << dec->field;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_PARENT_STATS:
+        if (key == QEMU_MONITOR_JSON_BLOCKSTATS_KEY_FIELD &&
+            type == VIR_JSON_TYPE_NUMBER &&
+            qemuMonitorJSONBlockStatsParseNumber(value, len, &num) == 0) {
+            node->stats.wr_highest_offset = num;
+            node->stats.wr_highest_offset_valid = true;
+        }
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_PARENT:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_IGNORE:
+        break;
+    }
+}
+
+
+static const virJSONSAXCallbacks qemuMonitorJSONBlockStatsDecoderCallbacks = {
+    .startObject = qemuMonitorJSONBlockStatsDecodeStartObject,
+    .key = qemuMonitorJSONBlockStatsDecodeKey,
+    .endObject = qemuMonitorJSONBlockStatsDecodeEndContainer,
+    .startArray = qemuMonitorJSONBlockStatsDecodeStartArray,
+    .endArray = qemuMonitorJSONBlockStatsDecodeEndContainer,
+    .scalar = qemuMonitorJSONBlockStatsDecodeScalar,
+};
+
+
+/* Reports the error found while decoding, if any, in the calling thread
+ * and returns the number of stats per device or -1 */
+static int
+qemuMonitorJSONBlockStatsDecoderFinish(qemuMonitorJSONBlockStatsDecoderPtr dec)
+{
+    if (dec->error) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", dec->error);
         return -1;
+    }
+
+    return dec->nstats;
+}
 
-    return nstats;
+
+/**
+ * qemuMonitorJSONParseBlockStatsReply:
+ * @reply: complete reply to the query-blockstats command
+ * @hash: hash table to fill with qemuBlockStats
+ * @backingChain: whether to also fill stats of backing chain members
+ *
+ * Decodes @reply the same way qemuMonitorJSONGetAllBlockStatsInfo does
+ * with replies received from the monitor.
+ *
+ * Returns the number of stats per device or -1 on error.
+ */
+int
+qemuMonitorJSONParseBlockStatsReply(const char *reply,
+                                    virHashTablePtr hash,
+                                    bool backingChain)
+{
+    qemuMonitorJSONBlockStatsDecoder dec = { .hash = hash,
+                                             .backingChain = backingChain };
+    g_autoptr(virJSONStreamParser) parser = NULL;
+    g_autoptr(virJSONValue) obj = NULL;
+    size_t len;
+    int ret = -1;
+
+    if (!(parser = virJSONStreamParserNew()))
+        goto cleanup;
+
+    virJSONStreamParserSetSink(parser, "return",
+                               &qemuMonitorJSONBlockStatsDecoderCallbacks,
+                               &dec);
+
+    if (virJSONStreamParserFeed(parser, reply, strlen(reply)) < 0)
+        goto cleanup;
+
+    if (!(obj = virJSONStreamParserNext(parser, &len)) ||
+        !virJSONValueObjectGetArray(obj, "return")) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("blockstats reply was not in expected format"));
+        goto cleanup;
+    }
+
+    ret = qemuMonitorJSONBlockStatsDecoderFinish(&dec);
+
+ cleanup:
+    qemuMonitorJSONBlockStatsDecoderClear(&dec);
+    return ret;
 }
 
 
@@ -2699,46 +3304,28 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                     virHashTablePtr hash,
                                     bool backingChain)
 {
-    int nstats = 0;
-    int rc;
-    size_t i;
-    g_autoptr(virJSONValue) devices = NULL;
-
-    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
-        return -1;
-
-    for (i = 0; i < virJSONValueArraySize(devices); i++) {
-        virJSONValuePtr dev = virJSONValueArrayGet(devices, i);
-        const char *dev_name;
-
-        if (!dev || virJSONValueGetType(dev) != VIR_JSON_TYPE_OBJECT) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("blockstats device entry was not "
-                             "in expected format"));
-            return -1;
-        }
-
-        if (!(dev_name = virJSONValueObjectGetString(dev, "device"))) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("blockstats device entry was not "
-                             "in expected format"));
-            return -1;
-        }
+    qemuMonitorJSONBlockStatsDecoder dec = { .hash = hash,
+                                             .backingChain = backingChain };
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+    int ret = -1;
 
-        if (*dev_name == '\0')
-            dev_name = NULL;
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
+        goto cleanup;
 
-        rc = qemuMonitorJSONGetOneBlockStatsInfo(dev, dev_name, 0, hash,
-                                                 backingChain);
+    if (qemuMonitorJSONCommandDecode(mon, cmd,
+                                     &qemuMonitorJSONBlockStatsDecoderCallbacks,
+                                     &dec, &reply) < 0)
+        goto cleanup;
 
-        if (rc < 0)
-            return -1;
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
+        goto cleanup;
 
-        if (rc > nstats)
-            nstats = rc;
-    }
+    ret = qemuMonitorJSONBlockStatsDecoderFinish(&dec);
 
-    return nstats;
+ cleanup:
+    qemuMonitorJSONBlockStatsDecoderClear(&dec);
+    return ret;
 }
 
 
@@ -9385,3 +9972,39 @@ qemuMonitorJSONGetJobInfo(qemuMonitorPtr mon,
 
     return 0;
 }
+
+
+int
+qemuMonitorJSONPrefetchQueries(qemuMonitorPtr mon,
+                               const char **commands,
+                               size_t ncommands)
+{
+    g_autofree virJSONValuePtr *cmds = g_new0(virJSONValuePtr, ncommands);
+    g_autofree virJSONValuePtr *replies = g_new0(virJSONValuePtr, ncommands);
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < ncommands; i++) {
+        if (!(cmds[i] = qemuMonitorJSONMakeCommand(commands[i], NULL)))
+            goto cleanup;
+    }
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, ncommands, replies) < 0)
+        goto cleanup;
+
+    /* error replies are kept too and reported to whoever uses them */
+    for (i = 0; i < ncommands; i++) {
+        if (qemuMonitorStorePrefetched(mon, commands[i], replies[i]) < 0)
+            goto cleanup;
+        replies[i] = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncommands; i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    return ret;
+}
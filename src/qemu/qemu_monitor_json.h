@@ -28,14 +28,19 @@
 #include "cpu/cpu.h"
 #include "util/virgic.h"
 
-int qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
-                                 const char *line,
-                                 qemuMonitorMessagePtr msg);
+int qemuMonitorJSONIOProcessMessage(qemuMonitorPtr mon,
+                                    virJSONValuePtr obj,
+                                    const char *line);
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
-                             const char *data,
+                             virJSONStreamParserPtr parser,
+                             char *data,
                              size_t len,
-                             qemuMonitorMessagePtr msg);
+                             size_t parsed);
+
+int qemuMonitorJSONPrefetchQueries(qemuMonitorPtr mon,
+                                   const char **commands,
+                                   size_t ncommands);
 
 int qemuMonitorJSONHumanCommand(qemuMonitorPtr mon,
                                 const char *cmd,
@@ -81,6 +86,9 @@ virJSONValuePtr qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon);
 int qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                         virHashTablePtr hash,
                                         bool backingChain);
+int qemuMonitorJSONParseBlockStatsReply(const char *reply,
+                                        virHashTablePtr hash,
+                                        bool backingChain);
 int qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                             virHashTablePtr stats,
                                             bool backingChain);
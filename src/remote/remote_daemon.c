@@ -1023,6 +1023,11 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (virNetServerSetEventThreads(srv, config->event_threads) < 0) {
+        ret = VIR_DAEMON_ERR_INIT;
+        goto cleanup;
+    }
+
     if (virNetDaemonAddServer(dmn, srv) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
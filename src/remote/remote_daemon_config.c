@@ -142,6 +142,7 @@ daemonConfigNew(bool privileged G_GNUC_UNUSED)
     data->max_anonymous_clients = 20;
 
     data->prio_workers = 5;
+    data->event_threads = 0;
 
     data->max_client_requests = 5;
 
@@ -323,6 +324,8 @@ daemonConfigLoadOptions(struct daemonConfig *data,
 
     if (virConfGetValueUInt(conf, "prio_workers", &data->prio_workers) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "event_threads", &data->event_threads) < 0)
+        return -1;
 
     if (virConfGetValueUInt(conf, "max_client_requests", &data->max_client_requests) < 0)
         return -1;
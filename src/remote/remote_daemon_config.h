@@ -72,6 +72,7 @@ struct daemonConfig {
     unsigned int max_anonymous_clients;
 
     unsigned int prio_workers;
+    unsigned int event_threads;
 
     unsigned int max_client_requests;
 
@@ -932,13 +932,24 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
-        if (virNetServerProgramSendStreamData(stream->prog,
-                                              client,
-                                              msg,
-                                              stream->procedure,
-                                              stream->serial,
-                                              buffer, rv) < 0)
-            goto cleanup;
+        if (rv == 0) {
+            if (virNetServerProgramSendStreamData(stream->prog,
+                                                  client,
+                                                  msg,
+                                                  stream->procedure,
+                                                  stream->serial,
+                                                  buffer, 0) < 0)
+                goto cleanup;
+        } else {
+            /* The message frees @buffer once it's sent */
+            if (virNetServerProgramSendStreamDataSteal(stream->prog,
+                                                       client,
+                                                       msg,
+                                                       stream->procedure,
+                                                       stream->serial,
+                                                       &buffer, rv) < 0)
+                goto cleanup;
+        }
         msg = NULL;
     }
 
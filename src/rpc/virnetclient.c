@@ -1299,19 +1299,19 @@ static ssize_t
 virNetClientIOWriteMessage(virNetClientPtr client,
                            virNetClientCallPtr thecall)
 {
+    GOutputVector vectors[VIR_NET_MESSAGE_WRITE_VECTORS];
+    size_t nvectors;
     ssize_t ret = 0;
 
-    if (thecall->msg->bufferOffset < thecall->msg->bufferLength) {
-        ret = virNetSocketWrite(client->sock,
-                                thecall->msg->buffer + thecall->msg->bufferOffset,
-                                thecall->msg->bufferLength - thecall->msg->bufferOffset);
+    if ((nvectors = virNetMessageGetWriteVectors(thecall->msg, vectors)) > 0) {
+        ret = virNetSocketWritev(client->sock, vectors, nvectors);
         if (ret <= 0)
             return ret;
 
-        thecall->msg->bufferOffset += ret;
+        virNetMessageWriteAdvance(thecall->msg, ret);
     }
 
-    if (thecall->msg->bufferOffset == thecall->msg->bufferLength) {
+    if (virNetMessageWriteDone(thecall->msg)) {
         size_t i;
         for (i = thecall->msg->donefds; i < thecall->msg->nfds; i++) {
             int rv;
@@ -2077,7 +2077,7 @@ virNetClientQueueNonBlocking(virNetClientPtr client,
     PROBE(RPC_CLIENT_MSG_TX_QUEUE,
           "client=%p len=%zu prog=%u vers=%u proc=%u"
           " type=%u status=%u serial=%u",
-          client, msg->bufferLength,
+          client, msg->bufferLength + msg->payloadLength,
           msg->header.prog, msg->header.vers, msg->header.proc,
           msg->header.type, msg->header.status, msg->header.serial);
 
@@ -2103,7 +2103,7 @@ static int virNetClientSendInternal(virNetClientPtr client,
 
     PROBE(RPC_CLIENT_MSG_TX_QUEUE,
           "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
-          client, msg->bufferLength,
+          client, msg->bufferLength + msg->payloadLength,
           msg->header.prog, msg->header.vers, msg->header.proc,
           msg->header.type, msg->header.status, msg->header.serial);
 
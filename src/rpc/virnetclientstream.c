@@ -389,10 +389,11 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
         goto error;
 
     /* Data packets are async fire&forget, but OK/ERROR packets
-     * need a synchronous confirmation
+     * need a synchronous confirmation. Either way we wait until
+     * the packet is sent, so @data doesn't need to be copied.
      */
     if (status == VIR_NET_CONTINUE) {
-        if (virNetMessageEncodePayloadRaw(msg, data, nbytes) < 0)
+        if (virNetMessageEncodePayloadRawBorrow(msg, data, nbytes) < 0)
             goto error;
     } else {
         if (virNetMessageEncodePayloadRaw(msg, NULL, 0) < 0)
@@ -63,6 +63,14 @@ virNetMessageClearPayload(virNetMessagePtr msg)
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
     VIR_FREE(msg->buffer);
+
+    if (msg->payloadBorrowed)
+        msg->payload = NULL;
+    else
+        VIR_FREE(msg->payload);
+    msg->payloadOffset = 0;
+    msg->payloadLength = 0;
+    msg->payloadBorrowed = false;
 }
 
 
@@ -509,6 +517,165 @@ int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 }
 
 
+static int
+virNetMessageAttachPayloadRaw(virNetMessagePtr msg,
+                              char *data,
+                              size_t len,
+                              bool borrowed)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    if ((msg->bufferOffset + len) >
+        (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Stream data too long to send "
+                         "(%zu bytes needed, %zu bytes available)"),
+                       len,
+                       VIR_NET_MESSAGE_MAX +
+                       VIR_NET_MESSAGE_LEN_MAX -
+                       msg->bufferOffset);
+        return -1;
+    }
+
+    /* Re-encode the length word to cover the payload as well. */
+    VIR_DEBUG("Encode length as %zu", msg->bufferOffset + len);
+    xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
+    msglen = msg->bufferOffset + len;
+    if (!xdr_u_int(&xdr, &msglen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message length"));
+        goto error;
+    }
+    xdr_destroy(&xdr);
+
+    msg->payload = data;
+    msg->payloadLength = len;
+    msg->payloadOffset = 0;
+    msg->payloadBorrowed = borrowed;
+
+    msg->bufferLength = msg->bufferOffset;
+    msg->bufferOffset = 0;
+    return 0;
+
+ error:
+    xdr_destroy(&xdr);
+    return -1;
+}
+
+
+/**
+ * virNetMessageEncodePayloadRawSteal:
+ * @msg: message with encoded header
+ * @data: pointer to the stream data
+ * @len: length of @data
+ *
+ * Like virNetMessageEncodePayloadRaw, but instead of copying @data into
+ * the message buffer, it's sent as a separate segment right after it.
+ * The message takes ownership of @data and *@data is cleared on success.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetMessageEncodePayloadRawSteal(virNetMessagePtr msg,
+                                   char **data,
+                                   size_t len)
+{
+    if (virNetMessageAttachPayloadRaw(msg, *data, len, false) < 0)
+        return -1;
+
+    *data = NULL;
+    return 0;
+}
+
+
+/**
+ * virNetMessageEncodePayloadRawBorrow:
+ * @msg: message with encoded header
+ * @data: the stream data
+ * @len: length of @data
+ *
+ * Like virNetMessageEncodePayloadRawSteal, but @data remains owned by
+ * the caller who has to keep it intact until the message is sent and
+ * its payload cleared.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetMessageEncodePayloadRawBorrow(virNetMessagePtr msg,
+                                    const char *data,
+                                    size_t len)
+{
+    return virNetMessageAttachPayloadRaw(msg, (char *)data, len, true);
+}
+
+
+/**
+ * virNetMessageGetWriteVectors:
+ * @msg: encoded message being sent
+ * @vectors: array of VIR_NET_MESSAGE_WRITE_VECTORS elements to fill
+ *
+ * Fill @vectors with the segments of @msg which were not sent yet.
+ *
+ * Returns the number of segments stored in @vectors, 0 once the whole
+ * message was sent.
+ */
+size_t
+virNetMessageGetWriteVectors(virNetMessagePtr msg,
+                             GOutputVector *vectors)
+{
+    size_t nvectors = 0;
+
+    if (msg->bufferOffset < msg->bufferLength) {
+        vectors[nvectors].buffer = msg->buffer + msg->bufferOffset;
+        vectors[nvectors].size = msg->bufferLength - msg->bufferOffset;
+        nvectors++;
+    }
+
+    if (msg->payloadOffset < msg->payloadLength) {
+        vectors[nvectors].buffer = msg->payload + msg->payloadOffset;
+        vectors[nvectors].size = msg->payloadLength - msg->payloadOffset;
+        nvectors++;
+    }
+
+    return nvectors;
+}
+
+
+/**
+ * virNetMessageWriteAdvance:
+ * @msg: encoded message being sent
+ * @len: number of bytes written
+ *
+ * Record that next @len bytes of @msg were sent.
+ */
+void
+virNetMessageWriteAdvance(virNetMessagePtr msg,
+                          size_t len)
+{
+    size_t n = MIN(len, msg->bufferLength - msg->bufferOffset);
+
+    msg->bufferOffset += n;
+    len -= n;
+
+    n = MIN(len, msg->payloadLength - msg->payloadOffset);
+    msg->payloadOffset += n;
+}
+
+
+/**
+ * virNetMessageWriteDone:
+ * @msg: encoded message being sent
+ *
+ * Returns true if all data of @msg was sent.
+ */
+bool
+virNetMessageWriteDone(virNetMessagePtr msg)
+{
+    return msg->bufferOffset == msg->bufferLength &&
+        msg->payloadOffset == msg->payloadLength;
+}
+
+
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
 {
     /* This func may be called several times & the first
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <gio/gio.h>
+
 #include "virnetprotocol.h"
 
 typedef struct virNetMessageHeader *virNetMessageHeaderPtr;
@@ -38,6 +40,12 @@ struct _virNetMessage {
     size_t bufferLength;
     size_t bufferOffset;
 
+    /* Raw stream data sent after @buffer without being copied into it */
+    char *payload;
+    size_t payloadLength;
+    size_t payloadOffset;
+    bool payloadBorrowed; /* @payload is not freed with the message */
+
     virNetMessageHeader header;
 
     virNetMessageFreeCallback cb;
@@ -90,6 +98,26 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageEncodePayloadRawSteal(virNetMessagePtr msg,
+                                       char **data,
+                                       size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageEncodePayloadRawBorrow(virNetMessagePtr msg,
+                                        const char *data,
+                                        size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+
+/* Buffer and payload */
+#define VIR_NET_MESSAGE_WRITE_VECTORS 2
+
+size_t virNetMessageGetWriteVectors(virNetMessagePtr msg,
+                                    GOutputVector *vectors)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void virNetMessageWriteAdvance(virNetMessagePtr msg,
+                               size_t len)
+    ATTRIBUTE_NONNULL(1);
+bool virNetMessageWriteDone(virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1);
 
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
     ATTRIBUTE_NONNULL(1);
@@ -27,6 +27,7 @@
 #include "virerror.h"
 #include "virthread.h"
 #include "virthreadpool.h"
+#include "vireventthread.h"
 #include "virstring.h"
 #include "virutil.h"
 
@@ -42,6 +43,7 @@ struct _virNetServerJob {
     virNetServerClientPtr client;
     virNetMessagePtr msg;
     virNetServerProgramPtr prog;
+    gint64 queued; /* monotonic time the job was queued at */
 };
 
 struct _virNetServer {
@@ -70,6 +72,10 @@ struct _virNetServer {
 
     virNetTLSContextPtr tls;
 
+    /* Event loops client IO is spread across, if any */
+    size_t neventThreads;
+    virEventThread **eventThreads;
+
     virNetServerClientPrivNew clientPrivNew;
     virNetServerClientPrivPreExecRestart clientPrivPreExecRestart;
     virFreeCallback clientPrivFree;
@@ -84,6 +90,9 @@ static void virNetServerUpdateServicesLocked(virNetServerPtr srv,
 static inline size_t virNetServerTrackPendingAuthLocked(virNetServerPtr srv);
 static inline size_t virNetServerTrackCompletedAuthLocked(virNetServerPtr srv);
 
+static void virNetServerApplyEventContextsLocked(virNetServerPtr srv,
+                                                 virNetServerServicePtr svc);
+
 static int virNetServerOnceInit(void)
 {
     if (!VIR_CLASS_NEW(virNetServer, virClassForObjectLockable()))
@@ -151,6 +160,12 @@ static void virNetServerHandleJob(void *jobOpaque, void *opaque)
     VIR_DEBUG("server=%p client=%p message=%p prog=%p",
               srv, job->client, job->msg, job->prog);
 
+    if (job->prog &&
+        (job->msg->header.type == VIR_NET_CALL ||
+         job->msg->header.type == VIR_NET_CALL_WITH_FDS))
+        virNetServerProgramAddQueueWait(job->prog, job->msg->header.proc,
+                                        g_get_monotonic_time() - job->queued);
+
     if (virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
         goto error;
 
@@ -216,6 +231,7 @@ virNetServerDispatchNewMessage(virNetServerClientPtr client,
 
         job->client = virObjectRef(client);
         job->msg = msg;
+        job->queued = g_get_monotonic_time();
 
         if (prog) {
             job->prog = virObjectRef(prog);
@@ -664,6 +680,7 @@ int virNetServerAddService(virNetServerPtr srv,
     virNetServerServiceSetDispatcher(svc,
                                      virNetServerDispatchNewClient,
                                      srv);
+    virNetServerApplyEventContextsLocked(srv, svc);
 
     virObjectUnlock(srv);
     return 0;
@@ -925,6 +942,10 @@ void virNetServerDispose(void *obj)
     for (i = 0; i < srv->nclients; i++)
         virObjectUnref(srv->clients[i]);
     VIR_FREE(srv->clients);
+
+    for (i = 0; i < srv->neventThreads; i++)
+        g_object_unref(srv->eventThreads[i]);
+    VIR_FREE(srv->eventThreads);
 }
 
 void virNetServerClose(virNetServerPtr srv)
@@ -1039,6 +1060,44 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
     return 0;
 }
 
+/**
+ * virNetServerGetProcedureStats:
+ * @srv: server to query
+ * @stats: filled with a newly allocated array of statistics
+ * @nstats: filled with the number of elements in @stats
+ *
+ * Collects queue wait and execution time histograms of every
+ * procedure of every program registered with @srv which has been
+ * called at least once. The caller must free @stats.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerGetProcedureStats(virNetServerPtr srv,
+                              virNetServerProgramProcStatsPtr *stats,
+                              size_t *nstats)
+{
+    g_autofree virNetServerProgramProcStats *tmp = NULL;
+    size_t ntmp = 0;
+    size_t i;
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    for (i = 0; i < srv->nprograms; i++) {
+        if (virNetServerProgramGetProcStats(srv->programs[i], &tmp, &ntmp) < 0)
+            goto cleanup;
+    }
+
+    *stats = g_steal_pointer(&tmp);
+    *nstats = ntmp;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+}
+
 int
 virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                     long long int minWorkers,
@@ -1208,6 +1267,82 @@ virNetServerSetClientLimits(virNetServerPtr srv,
     return ret;
 }
 
+static void
+virNetServerApplyEventContextsLocked(virNetServerPtr srv,
+                                     virNetServerServicePtr svc)
+{
+    g_autofree GMainContext **contexts = NULL;
+    size_t i;
+
+    if (srv->neventThreads == 0)
+        return;
+
+    contexts = g_new0(GMainContext *, srv->neventThreads);
+    for (i = 0; i < srv->neventThreads; i++)
+        contexts[i] = virEventThreadGetContext(srv->eventThreads[i]);
+
+    virNetServerServiceSetEventContexts(svc, contexts, srv->neventThreads);
+}
+
+
+/**
+ * virNetServerSetEventThreads:
+ * @srv: server object
+ * @nthreads: number of event loop threads
+ *
+ * Start @nthreads event loop threads and spread the socket IO of
+ * clients connecting to any service of @srv from now on across
+ * them, rather than running it all in the default event loop.
+ * Listening sockets, timers and clients that are already connected
+ * stay on the default event loop. With @nthreads of zero this is a
+ * no-op. It can be called at most once per server, before its
+ * services are enabled.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerSetEventThreads(virNetServerPtr srv,
+                            size_t nthreads)
+{
+    size_t i;
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    if (srv->neventThreads > 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("event threads are already set up for this server"));
+        goto cleanup;
+    }
+
+    if (nthreads == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    srv->eventThreads = g_new0(virEventThread *, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        g_autofree char *name = g_strdup_printf("%s-evt%zu", srv->name, i);
+
+        if (!(srv->eventThreads[i] = virEventThreadNew(name))) {
+            while (i-- > 0)
+                g_object_unref(srv->eventThreads[i]);
+            VIR_FREE(srv->eventThreads);
+            goto cleanup;
+        }
+    }
+    srv->neventThreads = nthreads;
+
+    for (i = 0; i < srv->nservices; i++)
+        virNetServerApplyEventContextsLocked(srv, srv->services[i]);
+
+    ret = 0;
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+}
+
+
 static virNetTLSContextPtr
 virNetServerGetTLSContext(virNetServerPtr srv)
 {
@@ -109,11 +109,18 @@ int virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                         size_t *nPrioWorkers,
                                         size_t *jobQueueDepth);
 
+int virNetServerGetProcedureStats(virNetServerPtr srv,
+                                  virNetServerProgramProcStatsPtr *stats,
+                                  size_t *nstats);
+
 int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int minWorkers,
                                         long long int maxWorkers,
                                         long long int prioWorkers);
 
+int virNetServerSetEventThreads(virNetServerPtr srv,
+                                size_t nthreads);
+
 unsigned long long virNetServerNextClientID(virNetServerPtr srv);
 
 virNetServerClientPtr virNetServerGetClient(virNetServerPtr srv,
@@ -1331,6 +1331,8 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
  */
 static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 {
+    GOutputVector vectors[VIR_NET_MESSAGE_WRITE_VECTORS];
+    size_t nvectors;
     ssize_t ret;
 
     if (client->tx->bufferLength < client->tx->bufferOffset) {
@@ -1341,16 +1343,14 @@ static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
         return -1;
     }
 
-    if (client->tx->bufferLength == client->tx->bufferOffset)
+    if (!(nvectors = virNetMessageGetWriteVectors(client->tx, vectors)))
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    ret = virNetSocketWritev(client->sock, vectors, nvectors);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
-    client->tx->bufferOffset += ret;
+    virNetMessageWriteAdvance(client->tx, ret);
     return ret;
 }
 
@@ -1363,7 +1363,7 @@ static void
 virNetServerClientDispatchWrite(virNetServerClientPtr client)
 {
     while (client->tx) {
-        if (client->tx->bufferOffset < client->tx->bufferLength) {
+        if (!virNetMessageWriteDone(client->tx)) {
             ssize_t ret;
             ret = virNetServerClientWrite(client);
             if (ret < 0) {
@@ -1374,7 +1374,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                 return; /* Would block on write EAGAIN */
         }
 
-        if (client->tx->bufferOffset == client->tx->bufferLength) {
+        if (virNetMessageWriteDone(client->tx)) {
             virNetMessagePtr msg;
             size_t i;
 
@@ -1513,7 +1513,7 @@ virNetServerClientSendMessageLocked(virNetServerClientPtr client,
     if (client->sock && !client->wantClose) {
         PROBE(RPC_SERVER_CLIENT_MSG_TX_QUEUE,
               "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
-              client, msg->bufferLength,
+              client, msg->bufferLength + msg->payloadLength,
               msg->header.prog, msg->header.vers, msg->header.proc,
               msg->header.type, msg->header.status, msg->header.serial);
         virNetMessageQueuePush(&client->tx, msg);
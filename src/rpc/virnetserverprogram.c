@@ -34,6 +34,30 @@
 
 VIR_LOG_INIT("rpc.netserverprogram");
 
+typedef struct _virNetServerProgramShardProc virNetServerProgramShardProc;
+typedef virNetServerProgramShardProc *virNetServerProgramShardProcPtr;
+
+struct _virNetServerProgramShardProc {
+    virNetServerProgramLatency wait;
+    virNetServerProgramLatency exec;
+};
+
+typedef struct _virNetServerProgramShard virNetServerProgramShard;
+typedef virNetServerProgramShard *virNetServerProgramShardPtr;
+
+/* Latencies recorded by a single thread. Only the owning thread writes
+ * to a shard, so the 64 bit counters need no atomic updates even on
+ * 32 bit hosts. Readers copy them without locking and retry if @seq
+ * was odd or changed meanwhile. */
+struct _virNetServerProgramShard {
+    virNetServerProgramShardPtr next;
+    unsigned long long thread;
+    int seq;
+
+    /* Indexed by procedure number, allocated on the first call */
+    virNetServerProgramShardProcPtr *procs;
+};
+
 struct _virNetServerProgram {
     virObject parent;
 
@@ -41,6 +65,9 @@ struct _virNetServerProgram {
     unsigned version;
     virNetServerProgramProcPtr procs;
     size_t nprocs;
+
+    /* Shards are prepended atomically and only freed with @prog */
+    virNetServerProgramShardPtr shards;
 };
 
 
@@ -122,6 +149,160 @@ static virNetServerProgramProcPtr virNetServerProgramGetProc(virNetServerProgram
     return proc;
 }
 
+static virNetServerProgramShardPtr
+virNetServerProgramGetShard(virNetServerProgramPtr prog)
+{
+    unsigned long long self = virThreadSelfID();
+    virNetServerProgramShardPtr shard;
+    virNetServerProgramShardPtr head;
+
+    for (shard = g_atomic_pointer_get(&prog->shards); shard; shard = shard->next) {
+        if (shard->thread == self)
+            return shard;
+    }
+
+    shard = g_new0(virNetServerProgramShard, 1);
+    shard->thread = self;
+    shard->procs = g_new0(virNetServerProgramShardProcPtr, prog->nprocs);
+
+    do {
+        head = g_atomic_pointer_get(&prog->shards);
+        shard->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange(&prog->shards, head, shard));
+
+    return shard;
+}
+
+
+/* @procedure must be a valid procedure of @prog */
+static void
+virNetServerProgramLatencyAdd(virNetServerProgramPtr prog,
+                              int procedure,
+                              bool exec,
+                              unsigned long long usecs)
+{
+    virNetServerProgramShardPtr shard = virNetServerProgramGetShard(prog);
+    virNetServerProgramShardProcPtr proc = shard->procs[procedure];
+    virNetServerProgramLatencyPtr latency;
+
+    if (!proc) {
+        proc = g_new0(virNetServerProgramShardProc, 1);
+        g_atomic_pointer_set(&shard->procs[procedure], proc);
+    }
+
+    latency = exec ? &proc->exec : &proc->wait;
+
+    g_atomic_int_inc(&shard->seq);
+    latency->buckets[virLatencyBucket(usecs)]++;
+    latency->sum += usecs;
+    latency->count++;
+    g_atomic_int_inc(&shard->seq);
+}
+
+
+/* Adds the latencies of @procedure recorded in @shard to @stats */
+static void
+virNetServerProgramShardRead(virNetServerProgramShardPtr shard,
+                             int procedure,
+                             virNetServerProgramProcStatsPtr stats)
+{
+    virNetServerProgramShardProcPtr proc;
+    virNetServerProgramShardProc copy;
+    size_t i;
+    int seq;
+
+    if (!(proc = g_atomic_pointer_get(&shard->procs[procedure])))
+        return;
+
+    do {
+        /* The owner is in the middle of an update */
+        while ((seq = g_atomic_int_get(&shard->seq)) % 2)
+            g_thread_yield();
+
+        copy = *proc;
+    } while (g_atomic_int_get(&shard->seq) != seq);
+
+    stats->wait.count += copy.wait.count;
+    stats->wait.sum += copy.wait.sum;
+    stats->exec.count += copy.exec.count;
+    stats->exec.sum += copy.exec.sum;
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; i++) {
+        stats->wait.buckets[i] += copy.wait.buckets[i];
+        stats->exec.buckets[i] += copy.exec.buckets[i];
+    }
+}
+
+
+/**
+ * virNetServerProgramAddQueueWait:
+ * @prog: the program @procedure belongs to
+ * @procedure: procedure number of the call
+ * @usecs: time the call spent waiting for a worker thread
+ *
+ * Records the time an incoming call to @procedure spent in the
+ * server's job queue. Unknown procedures are ignored. This is safe
+ * to call from any thread.
+ */
+void
+virNetServerProgramAddQueueWait(virNetServerProgramPtr prog,
+                                int procedure,
+                                unsigned long long usecs)
+{
+    if (!virNetServerProgramGetProc(prog, procedure))
+        return;
+
+    virNetServerProgramLatencyAdd(prog, procedure, false, usecs);
+}
+
+
+/**
+ * virNetServerProgramGetProcStats:
+ * @prog: the program to query
+ * @stats: array to append the statistics to
+ * @nstats: number of elements in @stats
+ *
+ * Appends latency statistics of every procedure of @prog which has
+ * been called at least once to @stats. This doesn't block the threads
+ * recording latencies, so calls finishing meanwhile may or may not be
+ * included, but the count of each procedure always matches the sum of
+ * its buckets.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerProgramGetProcStats(virNetServerProgramPtr prog,
+                                virNetServerProgramProcStatsPtr *stats,
+                                size_t *nstats)
+{
+    virNetServerProgramShardPtr shards = g_atomic_pointer_get(&prog->shards);
+    virNetServerProgramShardPtr shard;
+    size_t i;
+
+    for (i = 0; i < prog->nprocs; i++) {
+        virNetServerProgramProcStats proc;
+
+        if (!prog->procs[i].func)
+            continue;
+
+        memset(&proc, 0, sizeof(proc));
+        proc.program = prog->program;
+        proc.version = prog->version;
+        proc.procedure = i;
+
+        for (shard = shards; shard; shard = shard->next)
+            virNetServerProgramShardRead(shard, i, &proc);
+
+        if (proc.wait.count == 0 && proc.exec.count == 0)
+            continue;
+
+        if (VIR_APPEND_ELEMENT(*stats, *nstats, proc) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 unsigned int
 virNetServerProgramGetPriority(virNetServerProgramPtr prog,
                                int procedure)
@@ -274,6 +455,8 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
 {
     int ret = -1;
     virNetMessageError rerr;
+    int procedure = msg->header.proc;
+    gint64 start;
 
     memset(&rerr, 0, sizeof(rerr));
 
@@ -299,7 +482,12 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
     switch (msg->header.type) {
     case VIR_NET_CALL:
     case VIR_NET_CALL_WITH_FDS:
+        start = g_get_monotonic_time();
         ret = virNetServerProgramDispatchCall(prog, server, client, msg);
+        /* @msg may be gone by now, hence the saved @procedure */
+        if (virNetServerProgramGetProc(prog, procedure))
+            virNetServerProgramLatencyAdd(prog, procedure, true,
+                                          g_get_monotonic_time() - start);
         break;
 
     case VIR_NET_STREAM:
@@ -534,6 +722,42 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+/**
+ * virNetServerProgramSendStreamDataSteal:
+ *
+ * Like virNetServerProgramSendStreamData with non-empty @data, except
+ * that the message takes ownership of *@data and sends it without
+ * copying it into the message buffer. *@data is cleared on success.
+ */
+int virNetServerProgramSendStreamDataSteal(virNetServerProgramPtr prog,
+                                           virNetServerClientPtr client,
+                                           virNetMessagePtr msg,
+                                           int procedure,
+                                           unsigned int serial,
+                                           char **data,
+                                           size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, *data, len);
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return -1;
+
+    if (virNetMessageEncodePayloadRawSteal(msg, data, len) < 0)
+        return -1;
+
+    VIR_DEBUG("Total %zu", msg->bufferLength + msg->payloadLength);
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -569,6 +793,17 @@ int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
 }
 
 
-void virNetServerProgramDispose(void *obj G_GNUC_UNUSED)
+void virNetServerProgramDispose(void *obj)
 {
+    virNetServerProgramPtr prog = obj;
+    virNetServerProgramShardPtr shard;
+    size_t i;
+
+    while ((shard = prog->shards)) {
+        prog->shards = shard->next;
+        for (i = 0; i < prog->nprocs; i++)
+            g_free(shard->procs[i]);
+        g_free(shard->procs);
+        g_free(shard);
+    }
 }
@@ -24,6 +24,7 @@
 #include "virnetmessage.h"
 #include "virnetserverclient.h"
 #include "virobject.h"
+#include "virlatency.h"
 
 typedef struct _virNetDaemon virNetDaemon;
 typedef virNetDaemon *virNetDaemonPtr;
@@ -54,6 +55,30 @@ struct _virNetServerProgramProc {
     unsigned int priority;
 };
 
+/* Latencies of calls are recorded in log2 microsecond buckets, see
+ * virLatencyBucket */
+#define VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS VIR_LATENCY_BUCKETS
+
+typedef struct _virNetServerProgramLatency virNetServerProgramLatency;
+typedef virNetServerProgramLatency *virNetServerProgramLatencyPtr;
+
+struct _virNetServerProgramLatency {
+    unsigned long long count;
+    unsigned long long sum; /* in microseconds */
+    unsigned long long buckets[VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
+};
+
+typedef struct _virNetServerProgramProcStats virNetServerProgramProcStats;
+typedef virNetServerProgramProcStats *virNetServerProgramProcStatsPtr;
+
+struct _virNetServerProgramProcStats {
+    unsigned int program;
+    unsigned int version;
+    int procedure;
+    virNetServerProgramLatency wait; /* time spent in the job queue */
+    virNetServerProgramLatency exec; /* time spent in the worker */
+};
+
 virNetServerProgramPtr virNetServerProgramNew(unsigned program,
                                               unsigned version,
                                               virNetServerProgramProcPtr procs,
@@ -68,6 +93,14 @@ unsigned int virNetServerProgramGetPriority(virNetServerProgramPtr prog,
 int virNetServerProgramMatches(virNetServerProgramPtr prog,
                                virNetMessagePtr msg);
 
+void virNetServerProgramAddQueueWait(virNetServerProgramPtr prog,
+                                     int procedure,
+                                     unsigned long long usecs);
+
+int virNetServerProgramGetProcStats(virNetServerProgramPtr prog,
+                                    virNetServerProgramProcStatsPtr *stats,
+                                    size_t *nstats);
+
 int virNetServerProgramDispatch(virNetServerProgramPtr prog,
                                 virNetServerPtr server,
                                 virNetServerClientPtr client,
@@ -98,6 +131,14 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       const char *data,
                                       size_t len);
 
+int virNetServerProgramSendStreamDataSteal(virNetServerProgramPtr prog,
+                                           virNetServerClientPtr client,
+                                           virNetMessagePtr msg,
+                                           int procedure,
+                                           unsigned int serial,
+                                           char **data,
+                                           size_t len);
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
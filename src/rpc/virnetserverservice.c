@@ -48,6 +48,11 @@ struct _virNetServerService {
 
     virNetServerServiceDispatchFunc dispatchFunc;
     void *dispatchOpaque;
+
+    /* Event loops accepted clients are spread across, round robin */
+    size_t ncontexts;
+    GMainContext **contexts;
+    size_t nextContext;
 };
 
 
@@ -81,6 +86,14 @@ static void virNetServerServiceAccept(virNetSocketPtr sock,
     if (!svc->dispatchFunc)
         goto cleanup;
 
+    if (svc->ncontexts > 0) {
+        GMainContext *context = svc->contexts[svc->nextContext];
+
+        svc->nextContext = (svc->nextContext + 1) % svc->ncontexts;
+        if (virNetSocketSetEventContext(clientsock, context) < 0)
+            goto cleanup;
+    }
+
     svc->dispatchFunc(svc, clientsock, svc->dispatchOpaque);
 
  cleanup:
@@ -415,6 +428,36 @@ void virNetServerServiceSetDispatcher(virNetServerServicePtr svc,
 }
 
 
+/**
+ * virNetServerServiceSetEventContexts:
+ * @svc: service object
+ * @contexts: event loop contexts
+ * @ncontexts: number of items in @contexts
+ *
+ * Spread the IO of clients accepted on @svc from now on across
+ * @contexts, instead of handling it in the default event loop.
+ * Passing no contexts reverts to the default event loop. This
+ * must not race with accepting clients, i.e. it must be called
+ * while the service is disabled or from the default event loop.
+ */
+void virNetServerServiceSetEventContexts(virNetServerServicePtr svc,
+                                         GMainContext **contexts,
+                                         size_t ncontexts)
+{
+    size_t i;
+
+    for (i = 0; i < svc->ncontexts; i++)
+        g_main_context_unref(svc->contexts[i]);
+    VIR_FREE(svc->contexts);
+
+    svc->contexts = g_new0(GMainContext *, ncontexts);
+    for (i = 0; i < ncontexts; i++)
+        svc->contexts[i] = g_main_context_ref(contexts[i]);
+    svc->ncontexts = ncontexts;
+    svc->nextContext = 0;
+}
+
+
 void virNetServerServiceDispose(void *obj)
 {
     virNetServerServicePtr svc = obj;
@@ -424,6 +467,10 @@ void virNetServerServiceDispose(void *obj)
        virObjectUnref(svc->socks[i]);
     VIR_FREE(svc->socks);
 
+    for (i = 0; i < svc->ncontexts; i++)
+        g_main_context_unref(svc->contexts[i]);
+    g_free(svc->contexts);
+
     virObjectUnref(svc->tls);
 }
 
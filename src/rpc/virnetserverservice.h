@@ -34,6 +34,10 @@ typedef int (*virNetServerServiceDispatchFunc)(virNetServerServicePtr svc,
                                                virNetSocketPtr sock,
                                                void *opaque);
 
+void virNetServerServiceSetEventContexts(virNetServerServicePtr svc,
+                                         GMainContext **contexts,
+                                         size_t ncontexts);
+
 virNetServerServicePtr virNetServerServiceNewTCP(const char *nodename,
                                                  const char *service,
                                                  int family,
@@ -25,6 +25,9 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
+#ifndef WIN32
+# include <sys/uio.h>
+#endif
 #ifdef HAVE_IFADDRS_H
 # include <ifaddrs.h>
 #endif
@@ -49,6 +52,7 @@
 #include "virprobe.h"
 #include "virprocess.h"
 #include "virstring.h"
+#include "vireventglibwatch.h"
 
 #if WITH_SSH2
 # include "virnetsshsession.h"
@@ -67,6 +71,12 @@ struct _virNetSocket {
 
     int fd;
     int watch;
+    /* When @context is set the IO callback is attached to it via
+     * @source instead of the default event loop via @watch */
+    GMainContext *context;
+    GSource *source;
+    int sourceEvents;
+    bool contextWatch;
     pid_t pid;
     int errfd;
     bool isClient;
@@ -1333,6 +1343,13 @@ void virNetSocketDispose(void *obj)
         virEventRemoveHandle(sock->watch);
         sock->watch = -1;
     }
+    if (sock->source) {
+        g_source_destroy(sock->source);
+        g_source_unref(sock->source);
+        sock->source = NULL;
+    }
+    if (sock->context)
+        g_main_context_unref(sock->context);
 
 #ifndef WIN32
     /* If a server socket, then unlink UNIX path */
@@ -2014,6 +2031,109 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+#ifndef WIN32
+/* Maximum number of segments passed to a single writev() call */
+# define VIR_NET_SOCKET_WRITEV_MAX 8
+
+/* Whether data can be written directly to the file descriptor */
+static bool
+virNetSocketCanWritev(virNetSocketPtr sock)
+{
+# if WITH_SSH2
+    if (sock->sshSession)
+        return false;
+# endif
+# if WITH_LIBSSH
+    if (sock->libsshSession)
+        return false;
+# endif
+
+    return !(sock->tlsSession &&
+             virNetTLSSessionGetHandshakeStatus(sock->tlsSession) ==
+             VIR_NET_TLS_HANDSHAKE_COMPLETE);
+}
+
+
+static ssize_t
+virNetSocketWritevWire(virNetSocketPtr sock,
+                       const GOutputVector *vectors,
+                       size_t nvectors)
+{
+    struct iovec iov[VIR_NET_SOCKET_WRITEV_MAX];
+    size_t i;
+    ssize_t ret;
+
+    nvectors = MIN(nvectors, VIR_NET_SOCKET_WRITEV_MAX);
+    for (i = 0; i < nvectors; i++) {
+        iov[i].iov_base = (void *)vectors[i].buffer;
+        iov[i].iov_len = vectors[i].size;
+    }
+
+ rewrite:
+    ret = writev(sock->fd, iov, nvectors);
+
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto rewrite;
+        if (errno == EAGAIN)
+            return 0;
+
+        virReportSystemError(errno, "%s",
+                             _("Cannot write data"));
+        return -1;
+    }
+    if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while writing data"));
+        return -1;
+    }
+
+    return ret;
+}
+#endif /* !WIN32 */
+
+
+/**
+ * virNetSocketWritev:
+ * @sock: socket to write to
+ * @vectors: segments of data to write
+ * @nvectors: number of elements in @vectors
+ *
+ * Write data gathered from @vectors. Plain sockets write all the
+ * segments with a single system call, while sockets with an encryption
+ * or tunnelling layer write just the first segment. Just like with
+ * virNetSocketWrite, the caller has to be prepared for partial writes.
+ *
+ * Returns the number of bytes written, 0 if the write would block
+ * or -1 on error.
+ */
+ssize_t
+virNetSocketWritev(virNetSocketPtr sock,
+                   const GOutputVector *vectors,
+                   size_t nvectors)
+{
+    ssize_t ret;
+
+    if (nvectors == 0)
+        return 0;
+
+    virObjectLock(sock);
+#if WITH_SASL
+    if (sock->saslSession)
+        ret = virNetSocketWriteSASL(sock, vectors[0].buffer, vectors[0].size);
+    else
+#endif
+#ifndef WIN32
+    if (virNetSocketCanWritev(sock))
+        ret = virNetSocketWritevWire(sock, vectors, nvectors);
+    else
+#endif
+        ret = virNetSocketWriteWire(sock, vectors[0].buffer, vectors[0].size);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -2181,6 +2301,118 @@ static void virNetSocketEventFree(void *opaque)
     virObjectUnref(sock);
 }
 
+static GIOCondition
+virNetSocketEventsToCondition(int events)
+{
+    GIOCondition cond = 0;
+    if (events & VIR_EVENT_HANDLE_READABLE)
+        cond |= G_IO_IN;
+    if (events & VIR_EVENT_HANDLE_WRITABLE)
+        cond |= G_IO_OUT;
+    if (events & VIR_EVENT_HANDLE_ERROR)
+        cond |= G_IO_ERR;
+    if (events & VIR_EVENT_HANDLE_HANGUP)
+        cond |= G_IO_HUP;
+    return cond;
+}
+
+
+static int
+virNetSocketConditionToEvents(GIOCondition cond)
+{
+    int events = 0;
+    if (cond & G_IO_IN)
+        events |= VIR_EVENT_HANDLE_READABLE;
+    if (cond & G_IO_OUT)
+        events |= VIR_EVENT_HANDLE_WRITABLE;
+    if (cond & (G_IO_ERR | G_IO_NVAL))
+        events |= VIR_EVENT_HANDLE_ERROR;
+    if (cond & G_IO_HUP)
+        events |= VIR_EVENT_HANDLE_HANGUP;
+    return events;
+}
+
+
+static gboolean
+virNetSocketContextEventHandle(int fd,
+                               GIOCondition cond,
+                               gpointer opaque)
+{
+    virNetSocketEventHandle(-1, fd, virNetSocketConditionToEvents(cond), opaque);
+    return G_SOURCE_CONTINUE;
+}
+
+
+static gboolean
+virNetSocketContextEventRemoved(gpointer opaque G_GNUC_UNUSED)
+{
+    return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Replace the source watching @sock in its event context with
+ * one waiting for @events. Must be called with @sock locked.
+ */
+static void
+virNetSocketContextWatchUpdate(virNetSocketPtr sock,
+                               int events)
+{
+    if (sock->source && events == sock->sourceEvents)
+        return;
+
+    if (sock->source) {
+        g_source_destroy(sock->source);
+        g_source_unref(sock->source);
+        sock->source = NULL;
+    }
+
+    if (events == 0)
+        return;
+
+    sock->source = virEventGLibCreateSocketWatch(sock->fd,
+                                                 virNetSocketEventsToCondition(events));
+    g_source_set_callback(sock->source,
+                          (GSourceFunc)virNetSocketContextEventHandle,
+                          virObjectRef(sock),
+                          virObjectFreeCallback);
+    g_source_attach(sock->source, sock->context);
+    sock->sourceEvents = events;
+}
+
+
+/**
+ * virNetSocketSetEventContext:
+ * @sock: socket object
+ * @context: event loop context to dispatch IO callbacks from
+ *
+ * Make the IO callback registered by virNetSocketAddIOCallback
+ * run from @context, typically owned by a virEventThread, rather
+ * than from the default event loop. Must be called before the
+ * callback is registered. The socket drops @context once the
+ * callback is removed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNetSocketSetEventContext(virNetSocketPtr sock,
+                                GMainContext *context)
+{
+    virObjectLock(sock);
+    if (sock->watch >= 0 || sock->contextWatch) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot change event context of a watched socket"));
+        virObjectUnlock(sock);
+        return -1;
+    }
+
+    if (sock->context)
+        g_main_context_unref(sock->context);
+    sock->context = context ? g_main_context_ref(context) : NULL;
+    virObjectUnlock(sock);
+    return 0;
+}
+
+
 int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               int events,
                               virNetSocketIOFunc func,
@@ -2191,16 +2423,19 @@ int virNetSocketAddIOCallback(virNetSocketPtr sock,
 
     virObjectRef(sock);
     virObjectLock(sock);
-    if (sock->watch >= 0) {
+    if (sock->watch >= 0 || sock->contextWatch) {
         VIR_DEBUG("Watch already registered on socket %p", sock);
         goto cleanup;
     }
 
-    if ((sock->watch = virEventAddHandle(sock->fd,
-                                         events,
-                                         virNetSocketEventHandle,
-                                         sock,
-                                         virNetSocketEventFree)) < 0) {
+    if (sock->context) {
+        virNetSocketContextWatchUpdate(sock, events);
+        sock->contextWatch = true;
+    } else if ((sock->watch = virEventAddHandle(sock->fd,
+                                                events,
+                                                virNetSocketEventHandle,
+                                                sock,
+                                                virNetSocketEventFree)) < 0) {
         VIR_DEBUG("Failed to register watch on socket %p", sock);
         goto cleanup;
     }
@@ -2221,6 +2456,12 @@ void virNetSocketUpdateIOCallback(virNetSocketPtr sock,
                                   int events)
 {
     virObjectLock(sock);
+    if (sock->contextWatch) {
+        virNetSocketContextWatchUpdate(sock, events);
+        virObjectUnlock(sock);
+        return;
+    }
+
     if (sock->watch < 0) {
         VIR_DEBUG("Watch not registered on socket %p", sock);
         virObjectUnlock(sock);
@@ -2236,6 +2477,32 @@ void virNetSocketRemoveIOCallback(virNetSocketPtr sock)
 {
     virObjectLock(sock);
 
+    if (sock->contextWatch) {
+        GSource *idle = g_idle_source_new();
+        GMainContext *context;
+
+        virNetSocketContextWatchUpdate(sock, 0);
+        sock->contextWatch = false;
+
+        /* Like the default event loop, release the callback data
+         * asynchronously so that a dispatch which is already running
+         * in the context's thread completes first. Doing so from the
+         * destroy notify makes it happen even if the context is torn
+         * down before the idle source gets to run. */
+        g_source_set_callback(idle, virNetSocketContextEventRemoved,
+                              sock, virNetSocketEventFree);
+        g_source_attach(idle, sock->context);
+        g_source_unref(idle);
+
+        /* The idle source holds a reference to @sock until the context
+         * releases it, so @sock must not keep the context alive. A
+         * callback added later is dispatched from the default loop. */
+        context = g_steal_pointer(&sock->context);
+        virObjectUnlock(sock);
+        g_main_context_unref(context);
+        return;
+    }
+
     if (sock->watch < 0) {
         VIR_DEBUG("Watch not registered on socket %p", sock);
         virObjectUnlock(sock);
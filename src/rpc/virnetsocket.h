@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <gio/gio.h>
+
 #include "virsocketaddr.h"
 #include "vircommand.h"
 #include "virnettlscontext.h"
@@ -146,6 +148,9 @@ void virNetSocketSetQuietEOF(virNetSocketPtr sock);
 
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len);
 ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len);
+ssize_t virNetSocketWritev(virNetSocketPtr sock,
+                           const GOutputVector *vectors,
+                           size_t nvectors);
 
 int virNetSocketSendFD(virNetSocketPtr sock, int fd);
 int virNetSocketRecvFD(virNetSocketPtr sock, int *fd);
@@ -168,6 +173,9 @@ int virNetSocketListen(virNetSocketPtr sock, int backlog);
 int virNetSocketAccept(virNetSocketPtr sock,
                        virNetSocketPtr *clientsock);
 
+int virNetSocketSetEventContext(virNetSocketPtr sock,
+                                GMainContext *context);
+
 int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               int events,
                               virNetSocketIOFunc func,
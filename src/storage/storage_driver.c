@@ -44,6 +44,7 @@
 #include "virfile.h"
 #include "virfdstream.h"
 #include "virpidfile.h"
+#include "virconf.h"
 #include "configmake.h"
 #include "virsecret.h"
 #include "virstring.h"
@@ -85,6 +86,7 @@ storagePoolRefreshFailCleanup(virStorageBackendPtr backend,
 
     virErrorPreserveLast(&orig_err);
     virStoragePoolObjClearVols(obj);
+    virStoragePoolObjSetVolCache(obj, NULL, NULL);
 
     if (stateFile)
         unlink(stateFile);
@@ -244,6 +246,37 @@ storageDriverAutostart(void)
                                  NULL);
 }
 
+static int
+storageDriverLoadConfig(const char *filename)
+{
+    g_autoptr(virConf) conf = NULL;
+    size_t refreshWorkers;
+    int rc;
+
+    /* Avoid error from non-existent or unreadable file. */
+    if (access(filename, R_OK) == -1)
+        return 0;
+
+    if (!(conf = virConfReadFile(filename, 0)))
+        return -1;
+
+    if ((rc = virConfGetValueSizeT(conf, "refresh_workers",
+                                   &refreshWorkers)) < 0)
+        return -1;
+
+    if (rc == 1) {
+        if (refreshWorkers == 0) {
+            virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                           _("refresh_workers must be greater than 0"));
+            return -1;
+        }
+        virStorageBackendRefreshSetWorkers(refreshWorkers);
+    }
+
+    return 0;
+}
+
+
 /**
  * virStorageStartup:
  *
@@ -256,6 +289,7 @@ storageStateInitialize(bool privileged,
                        void *opaque G_GNUC_UNUSED)
 {
     g_autofree char *configdir = NULL;
+    g_autofree char *configfile = NULL;
     g_autofree char *rundir = NULL;
     bool autostart = true;
 
@@ -282,6 +316,7 @@ storageStateInitialize(bool privileged,
         driver->configDir = g_strdup(SYSCONFDIR "/libvirt/storage");
         driver->autostartDir = g_strdup(SYSCONFDIR "/libvirt/storage/autostart");
         driver->stateDir = g_strdup(RUNSTATEDIR "/libvirt/storage");
+        configfile = g_strdup(SYSCONFDIR "/libvirt/storage.conf");
     } else {
         configdir = virGetUserConfigDirectory();
         rundir = virGetUserRuntimeDirectory();
@@ -289,9 +324,13 @@ storageStateInitialize(bool privileged,
         driver->configDir = g_strdup_printf("%s/storage", configdir);
         driver->autostartDir = g_strdup_printf("%s/storage/autostart", configdir);
         driver->stateDir = g_strdup_printf("%s/storage/run", rundir);
+        configfile = g_strdup_printf("%s/storage.conf", configdir);
     }
     driver->privileged = privileged;
 
+    if (storageDriverLoadConfig(configfile) < 0)
+        goto error;
+
     if (virFileMakePath(driver->stateDir) < 0) {
         virReportError(errno,
                        _("cannot create directory %s"),
@@ -1125,6 +1164,7 @@ storagePoolDestroy(virStoragePoolPtr pool)
         goto cleanup;
 
     virStoragePoolObjClearVols(obj);
+    virStoragePoolObjSetVolCache(obj, NULL, NULL);
 
     event = virStoragePoolEventLifecycleNew(def->name,
                                             def->uuid,
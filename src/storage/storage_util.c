@@ -25,6 +25,9 @@
 #include <sys/statvfs.h>
 #include <sys/param.h>
 #include <dirent.h>
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 #ifdef __linux__
 # include <sys/ioctl.h>
 # include <linux/fs.h>
@@ -74,6 +77,7 @@
 #include "virxml.h"
 #include "virfdstream.h"
 #include "virutil.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -3483,9 +3487,396 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol)
 }
 
 
+/*
+ * Volumes found by virStorageBackendRefreshLocal are remembered along
+ * with the identity and modification times of their files, so later
+ * refreshes of the pool only need to probe the files that changed.
+ *
+ * On local filesystems the directory is additionally watched with
+ * inotify. As long as no event was reported for a regular file, its
+ * cached volume is reused without even looking at the file.
+ */
+typedef struct _virStorageBackendVolCacheEntry virStorageBackendVolCacheEntry;
+typedef virStorageBackendVolCacheEntry *virStorageBackendVolCacheEntryPtr;
+struct _virStorageBackendVolCacheEntry {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+
+    virStorageVolDefPtr vol;
+};
+
+typedef struct _virStorageBackendVolCache virStorageBackendVolCache;
+typedef virStorageBackendVolCache *virStorageBackendVolCachePtr;
+struct _virStorageBackendVolCache {
+    char *path; /* directory the volumes were found in */
+    virHashTablePtr vols; /* name -> virStorageBackendVolCacheEntry */
+    int watch; /* inotify descriptor watching @path, or -1 */
+};
+
+
+static void
+storageBackendVolCacheEntryFree(void *opaque)
+{
+    virStorageBackendVolCacheEntryPtr entry = opaque;
+
+    if (!entry)
+        return;
+
+    virStorageVolDefFree(entry->vol);
+    g_free(entry);
+}
+
+
+static void
+storageBackendVolCacheFree(void *opaque)
+{
+    virStorageBackendVolCachePtr cache = opaque;
+
+    if (!cache)
+        return;
+
+    virHashFree(cache->vols);
+    VIR_FORCE_CLOSE(cache->watch);
+    g_free(cache->path);
+    g_free(cache);
+}
+
+
+/**
+ * storageBackendVolCacheGet:
+ * @pool: pool object
+ *
+ * Returns the volume cache of @pool, creating an empty one if there is
+ * none yet or the existing one describes another directory.
+ */
+static virStorageBackendVolCachePtr
+storageBackendVolCacheGet(virStoragePoolObjPtr pool)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
+    virStorageBackendVolCachePtr cache = virStoragePoolObjGetVolCache(pool);
+
+    if (cache && STREQ(cache->path, def->target.path))
+        return cache;
+
+    cache = g_new0(virStorageBackendVolCache, 1);
+    cache->path = g_strdup(def->target.path);
+    cache->watch = -1;
+
+    if (!(cache->vols = virHashCreate(0, storageBackendVolCacheEntryFree))) {
+        storageBackendVolCacheFree(cache);
+        return NULL;
+    }
+
+    virStoragePoolObjSetVolCache(pool, cache, storageBackendVolCacheFree);
+    return cache;
+}
+
+
+/**
+ * storageBackendVolCacheWatch:
+ * @cache: volume cache
+ *
+ * Drop the cached volumes whose files were reported to have changed
+ * since the last refresh and start watching the directory if it is
+ * on a local filesystem and not being watched yet.
+ *
+ * Returns true if every change to the regular files in the directory
+ * since the last refresh was reported, false otherwise.
+ */
+static bool
+storageBackendVolCacheWatch(virStorageBackendVolCachePtr cache)
+{
+#if HAVE_SYS_INOTIFY_H
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } events;
+    bool complete = cache->watch >= 0;
+    ssize_t len;
+
+    while (cache->watch >= 0 &&
+           (len = read(cache->watch, events.buf, sizeof(events.buf))) > 0) {
+        char *p;
+
+        for (p = events.buf; p < events.buf + len;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                complete = false;
+            } else if (ev->mask & (IN_IGNORED | IN_UNMOUNT |
+                                   IN_DELETE_SELF | IN_MOVE_SELF)) {
+                /* the directory is gone, no events will follow */
+                VIR_FORCE_CLOSE(cache->watch);
+                complete = false;
+                break;
+            } else if (ev->len > 0) {
+                virHashRemoveEntry(cache->vols, ev->name);
+            }
+
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+
+    if (cache->watch < 0 && virFileIsSharedFS(cache->path) == 0) {
+        if ((cache->watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+            inotify_add_watch(cache->watch, cache->path,
+                              IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE |
+                              IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_DELETE_SELF |
+                              IN_MOVE_SELF) < 0) {
+            VIR_DEBUG("Unable to watch '%s': %s",
+                      cache->path, g_strerror(errno));
+            VIR_FORCE_CLOSE(cache->watch);
+        }
+    }
+
+    return complete;
+#else /* !HAVE_SYS_INOTIFY_H */
+    return false;
+#endif /* !HAVE_SYS_INOTIFY_H */
+}
+
+
+static void
+storageBackendStatTimes(const struct stat *sb,
+                        struct timespec *mtime,
+                        struct timespec *ctime)
+{
+#ifdef __APPLE__
+    *mtime = sb->st_mtimespec;
+    *ctime = sb->st_ctimespec;
+#else /* ! __APPLE__ */
+    *mtime = sb->st_mtim;
+    *ctime = sb->st_ctim;
+#endif /* ! __APPLE__ */
+}
+
+
+static bool
+storageBackendVolCacheEntryMatch(virStorageBackendVolCacheEntryPtr entry,
+                                 const struct stat *sb)
+{
+    struct timespec mtime;
+    struct timespec ctime;
+
+    storageBackendStatTimes(sb, &mtime, &ctime);
+
+    return entry->dev == sb->st_dev &&
+        entry->ino == sb->st_ino &&
+        entry->size == sb->st_size &&
+        entry->mtime.tv_sec == mtime.tv_sec &&
+        entry->mtime.tv_nsec == mtime.tv_nsec &&
+        entry->ctime.tv_sec == ctime.tv_sec &&
+        entry->ctime.tv_nsec == ctime.tv_nsec;
+}
+
+
+/*
+ * Copy a volume found in a directory, the only parts filled in are
+ * the name, key, type and target.
+ */
+static virStorageVolDefPtr
+storageBackendVolDefCopy(virStorageVolDefPtr src)
+{
+    g_autoptr(virStorageVolDef) vol = NULL;
+
+    vol = g_new0(virStorageVolDef, 1);
+    vol->name = g_strdup(src->name);
+    vol->key = g_strdup(src->key);
+    vol->type = src->type;
+
+    if (virStorageSourceCopyInto(&vol->target, &src->target, true) < 0)
+        return NULL;
+
+    return g_steal_pointer(&vol);
+}
+
+
+/**
+ * storageBackendVolCacheEntryNew:
+ * @sb: result of stat() on the volume file before it was probed
+ * @vol: the probed volume
+ *
+ * Returns a cache entry holding a copy of @vol, or NULL if the file
+ * was modified too recently for a later modification to be guaranteed
+ * to change its timestamps.
+ */
+static virStorageBackendVolCacheEntryPtr
+storageBackendVolCacheEntryNew(const struct stat *sb,
+                               virStorageVolDefPtr vol)
+{
+    virStorageBackendVolCacheEntryPtr entry;
+
+    entry = g_new0(virStorageBackendVolCacheEntry, 1);
+    entry->dev = sb->st_dev;
+    entry->ino = sb->st_ino;
+    entry->size = sb->st_size;
+    storageBackendStatTimes(sb, &entry->mtime, &entry->ctime);
+
+    /* filesystems may only keep timestamps with a granularity of
+     * one second, a write within the same second would go unnoticed */
+    if (entry->mtime.tv_sec >= time(NULL) - 1 ||
+        !(entry->vol = storageBackendVolDefCopy(vol))) {
+        g_free(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+
+/**
+ * storageBackendVolCacheLookup:
+ * @cache: volume cache
+ * @ent: directory entry of the volume
+ * @path: path of the volume
+ * @complete: whether all changes to regular files were reported
+ *
+ * Take the cached volume for @ent out of @cache if its file is known
+ * to be unchanged.
+ *
+ * Returns the cache entry or NULL if the volume needs to be probed.
+ */
+static virStorageBackendVolCacheEntryPtr
+storageBackendVolCacheLookup(virStorageBackendVolCachePtr cache,
+                             struct dirent *ent,
+                             const char *path,
+#if HAVE_SYS_INOTIFY_H
+                             bool complete)
+#else
+                             bool complete G_GNUC_UNUSED)
+#endif
+{
+    virStorageBackendVolCacheEntryPtr entry;
+    struct stat sb;
+
+    if (!(entry = virHashSteal(cache->vols, ent->d_name)))
+        return NULL;
+
+#if HAVE_SYS_INOTIFY_H
+    /* changes to the target of a link or files in a subdirectory
+     * are not reported */
+    if (complete && ent->d_type == DT_REG)
+        return entry;
+#endif /* HAVE_SYS_INOTIFY_H */
+
+    if (stat(path, &sb) < 0 ||
+        !storageBackendVolCacheEntryMatch(entry, &sb)) {
+        storageBackendVolCacheEntryFree(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+
+/* Number of threads probing the volumes of a pool while refreshing it
+ * unless set by refresh_workers in storage.conf */
+#define VIR_STORAGE_BACKEND_REFRESH_WORKERS_DEFAULT 8
+
+/* 0 for the default, set once when the storage driver starts */
+static size_t refreshWorkers;
+
+
+void
+virStorageBackendRefreshSetWorkers(size_t nworkers)
+{
+    refreshWorkers = nworkers;
+}
+
+
+typedef struct _virStorageBackendRefreshJob virStorageBackendRefreshJob;
+typedef virStorageBackendRefreshJob *virStorageBackendRefreshJobPtr;
+struct _virStorageBackendRefreshJob {
+    virStorageVolDefPtr vol;
+    virStorageBackendVolCacheEntryPtr entry;
+    bool probe; /* @vol was not found in the cache */
+    int rc;
+    virErrorPtr err;
+};
+
+struct virStorageBackendRefreshData {
+    virStorageBackendRefreshJobPtr jobs;
+    size_t njobs;
+    size_t nprobe;
+    int next;
+};
+
+
+static void
+storageBackendRefreshJobClear(virStorageBackendRefreshJobPtr job)
+{
+    virStorageVolDefFree(job->vol);
+    storageBackendVolCacheEntryFree(job->entry);
+    virFreeError(job->err);
+}
+
+
+static void
+storageBackendRefreshProbe(virStorageBackendRefreshJobPtr job)
+{
+    struct stat sb;
+    bool haveStat;
+
+    /* remember the state of the file before probing it so that any
+     * change made while probing is noticed by the next refresh */
+    haveStat = stat(job->vol->target.path, &sb) == 0;
+
+    if ((job->rc = virStorageBackendRefreshVolTargetUpdate(job->vol)) < 0) {
+        if (job->rc == -1)
+            virErrorPreserveLast(&job->err);
+        return;
+    }
+
+    if (haveStat)
+        job->entry = storageBackendVolCacheEntryNew(&sb, job->vol);
+}
+
+
+static void
+storageBackendRefreshWorker(void *opaque)
+{
+    struct virStorageBackendRefreshData *data = opaque;
+    size_t i;
+
+    while ((i = g_atomic_int_add(&data->next, 1)) < data->njobs) {
+        if (data->jobs[i].probe)
+            storageBackendRefreshProbe(&data->jobs[i]);
+    }
+}
+
+
+/*
+ * Probe the volumes not found in the cache, fanned out across up to
+ * refreshWorkers threads including the calling one. Opening and
+ * reading the images is mostly waiting for the storage to respond,
+ * on network filesystems in particular.
+ */
+static void
+storageBackendRefreshRun(struct virStorageBackendRefreshData *data)
+{
+    size_t nworkers = refreshWorkers;
+
+    if (nworkers == 0)
+        nworkers = VIR_STORAGE_BACKEND_REFRESH_WORKERS_DEFAULT;
+
+    virThreadPoolRunParallel(MIN(nworkers, data->nprobe),
+                             storageBackendRefreshWorker,
+                             "storage-refresh", data);
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * Only the images that changed since the last refresh of the pool
+ * are probed, the others are taken from the volume cache of the pool.
+ * Probing is spread across several threads and the volumes are added
+ * to the pool once all of them are known.
  */
 int
 virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
@@ -3497,15 +3888,29 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     struct stat statbuf;
     int direrr;
     int ret = -1;
-    g_autoptr(virStorageVolDef) vol = NULL;
     VIR_AUTOCLOSE fd = -1;
     g_autoptr(virStorageSource) target = NULL;
+    virStorageBackendVolCachePtr cache;
+    virHashTablePtr vols = NULL;
+    struct virStorageBackendRefreshData data = { 0 };
+    bool complete;
+    size_t i;
+
+    if (!(cache = storageBackendVolCacheGet(pool)))
+        return -1;
+
+    complete = storageBackendVolCacheWatch(cache);
+
+    /* the entries of the volumes found in this refresh */
+    if (!(vols = virHashCreate(0, storageBackendVolCacheEntryFree)))
+        return -1;
 
     if (virDirOpen(&dir, def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
+        virStorageBackendRefreshJob job = { 0 };
+        g_autofree char *path = NULL;
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
@@ -3513,35 +3918,65 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
             continue;
         }
 
-        if (VIR_ALLOC(vol) < 0)
-            goto cleanup;
-
-        vol->name = g_strdup(ent->d_name);
+        path = g_strdup_printf("%s/%s", def->target.path, ent->d_name);
 
-        vol->type = VIR_STORAGE_VOL_FILE;
-        vol->target.path = g_strdup_printf("%s/%s", def->target.path, vol->name);
+        if ((job.entry = storageBackendVolCacheLookup(cache, ent, path,
+                                                      complete))) {
+            if (!(job.vol = storageBackendVolDefCopy(job.entry->vol))) {
+                storageBackendRefreshJobClear(&job);
+                goto cleanup;
+            }
+        } else {
+            job.vol = g_new0(virStorageVolDef, 1);
+            job.vol->name = g_strdup(ent->d_name);
 
-        vol->key = g_strdup(vol->target.path);
+            job.vol->type = VIR_STORAGE_VOL_FILE;
+            job.vol->target.path = g_steal_pointer(&path);
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            }
-            goto cleanup;
+            job.vol->key = g_strdup(job.vol->target.path);
+            job.probe = true;
+            data.nprobe++;
         }
 
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
+        if (VIR_APPEND_ELEMENT(data.jobs, data.njobs, job) < 0) {
+            storageBackendRefreshJobClear(&job);
             goto cleanup;
-        vol = NULL;
+        }
     }
     if (direrr < 0)
         goto cleanup;
     VIR_DIR_CLOSE(dir);
 
+    storageBackendRefreshRun(&data);
+
+    for (i = 0; i < data.njobs; i++) {
+        virStorageBackendRefreshJobPtr job = &data.jobs[i];
+
+        if (job->rc == -1) {
+            virErrorRestore(&job->err);
+            goto cleanup;
+        }
+
+        /* Silently ignore non-regular files,
+         * eg 'lost+found', dangling symbolic link */
+        if (job->rc == -2)
+            continue;
+
+        if (job->entry) {
+            if (virHashAddEntry(vols, job->vol->name, job->entry) < 0)
+                goto cleanup;
+            job->entry = NULL;
+        }
+
+        if (virStoragePoolObjAddVol(pool, job->vol) < 0)
+            goto cleanup;
+        job->vol = NULL;
+    }
+
+    /* volumes not found anymore are dropped from the cache */
+    virHashFree(cache->vols);
+    cache->vols = g_steal_pointer(&vols);
+
     if (!(target = virStorageSourceNew()))
         goto cleanup;
 
@@ -3585,6 +4020,10 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     ret = 0;
  cleanup:
     VIR_DIR_CLOSE(dir);
+    virHashFree(vols);
+    for (i = 0; i < data.njobs; i++)
+        storageBackendRefreshJobClear(&data.jobs[i]);
+    VIR_FREE(data.jobs);
     return ret;
 }
 
@@ -105,6 +105,8 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol);
 
 int virStorageBackendRefreshLocal(virStoragePoolObjPtr pool);
 
+void virStorageBackendRefreshSetWorkers(size_t nworkers);
+
 int virStorageUtilGlusterExtractPoolSources(const char *host,
                                             const char *xml,
                                             virStoragePoolSourceListPtr list,
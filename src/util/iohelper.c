@@ -27,6 +27,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include "virthread.h"
 #include "virfile.h"
@@ -35,6 +36,7 @@
 #include "virrandom.h"
 #include "virstring.h"
 #include "virgettext.h"
+#include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -42,55 +44,395 @@
 # define O_DIRECT 0
 #endif
 
+/* Alignment of buffers and of their length, suitable for O_DIRECT */
+#define IOHELPER_ALIGN (64 * 1024)
+#define IOHELPER_BUFLEN_DEFAULT (1024 * 1024)
+#define IOHELPER_NBUFS_MAX 1024
+
+typedef struct _runIOData runIOData;
+struct _runIOData {
+    int fd;
+    int fdin;
+    int fdout;
+    const char *fdinname;
+    const char *fdoutname;
+    bool direct;
+    size_t buflen;
+    unsigned long long total;
+    int cancelfd; /* Reading stops once readable, or -1 */
+};
+
+typedef struct _runIOBuffer runIOBuffer;
+struct _runIOBuffer {
+    void *base; /* Location to be freed */
+    char *buf; /* Aligned location within base */
+    ssize_t len; /* Amount of data read into @buf, or -1 */
+    int err; /* errno if reading failed */
+};
+
+/* Ring of buffers filled by a reader thread and emptied by the writer */
+typedef struct _runIOPipeline runIOPipeline;
+struct _runIOPipeline {
+    runIOData *data;
+    virMutex lock;
+    virCond cond;
+    runIOBuffer *bufs;
+    size_t nbufs;
+    size_t head; /* First filled buffer */
+    size_t count; /* Number of filled buffers */
+    bool quit; /* Set once the writer stops */
+    int cancel[2]; /* Closing the write end stops a blocked reader */
+};
+
+
 static int
-runIO(const char *path, int fd, int oflags)
+runIOBufferInit(runIOBuffer *buffer,
+                size_t buflen)
 {
-    g_autofree void *base = NULL; /* Location to be freed */
-    char *buf = NULL; /* Aligned location within base */
-    size_t buflen = 1024*1024;
-    intptr_t alignMask = 64*1024 - 1;
-    int ret = -1;
-    int fdin, fdout;
-    const char *fdinname, *fdoutname;
-    unsigned long long total = 0;
-    bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
-    off_t end = 0;
+    intptr_t alignMask = IOHELPER_ALIGN - 1;
 
 #if HAVE_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen)) {
+    if (posix_memalign(&buffer->base, alignMask + 1, buflen)) {
         virReportOOMError();
-        goto cleanup;
+        return -1;
     }
-    buf = base;
+    buffer->buf = buffer->base;
 #else
-    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
-        goto cleanup;
-    base = buf;
-    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
+    if (VIR_ALLOC_N(buffer->buf, buflen + alignMask) < 0)
+        return -1;
+    buffer->base = buffer->buf;
+    buffer->buf = (char *) (((intptr_t) buffer->base + alignMask) & ~alignMask);
 #endif
 
+    return 0;
+}
+
+
+/*
+ * Like saferead, or a single read() if @once is true, but waits for
+ * input with poll() so that it can give up as soon as @data->cancelfd
+ * becomes readable. A reader thread would otherwise block forever on
+ * a pipe whose other end is never closed. Returns -1 with errno set to
+ * ECANCELED in that case.
+ */
+static ssize_t
+runIOReadCancellable(runIOData *data,
+                     char *buf,
+                     bool once)
+{
+    size_t nread = 0;
+
+    while (nread < data->buflen) {
+        struct pollfd fds[] = {
+            { .fd = data->fdin, .events = POLLIN },
+            { .fd = data->cancelfd, .events = POLLIN },
+        };
+        ssize_t got;
+
+        if (poll(fds, G_N_ELEMENTS(fds), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        if (fds[1].revents) {
+            errno = ECANCELED;
+            return -1;
+        }
+
+        if ((got = read(data->fdin, buf + nread, data->buflen - nread)) < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+
+        if (got == 0)
+            break;
+
+        nread += got;
+        if (once)
+            break;
+    }
+
+    return nread;
+}
+
+
+/*
+ * Fill @buf with the next chunk of input. Returns the amount of data
+ * read, 0 on EOF or -1 with errno set on failure.
+ */
+static ssize_t
+runIORead(runIOData *data,
+          char *buf)
+{
+    ssize_t got;
+
+    if (data->cancelfd >= 0)
+        return runIOReadCancellable(data, buf,
+                                    data->fdin == data->fd && data->direct);
+
+    /* If we read with O_DIRECT from file we can't use saferead as
+     * it can lead to unaligned read after reading last bytes.
+     * If we write with O_DIRECT use should use saferead so that
+     * writes will be aligned.
+     * In other cases using saferead reduces number of syscalls.
+     */
+    if (data->fdin == data->fd && data->direct) {
+        while ((got = read(data->fdin, buf, data->buflen)) < 0 &&
+               errno == EINTR)
+            ;
+    } else {
+        got = saferead(data->fdin, buf, data->buflen);
+    }
+
+    return got;
+}
+
+
+/*
+ * Write @got bytes from @buf. Sets @done if no more data may be written.
+ * Returns 0 on success, -1 with an error reported on failure.
+ */
+static int
+runIOWrite(runIOData *data,
+           char *buf,
+           size_t got,
+           bool *done)
+{
+    data->total += got;
+
+    /* handle last write size align in direct case */
+    if (got < data->buflen && data->direct && data->fdout == data->fd) {
+        ssize_t aligned_got = (got + IOHELPER_ALIGN - 1) & ~(IOHELPER_ALIGN - 1);
+
+        memset(buf + got, 0, aligned_got - got);
+
+        if (safewrite(data->fdout, buf, aligned_got) < 0) {
+            virReportSystemError(errno, _("Unable to write %s"), data->fdoutname);
+            return -1;
+        }
+
+        if (ftruncate(data->fd, data->total) < 0) {
+            virReportSystemError(errno, _("Unable to truncate %s"), data->fdoutname);
+            return -1;
+        }
+
+        *done = true;
+        return 0;
+    }
+
+    if (safewrite(data->fdout, buf, got) < 0) {
+        virReportSystemError(errno, _("Unable to write %s"), data->fdoutname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+runIOSerial(runIOData *data)
+{
+    runIOBuffer buffer = { 0 };
+    bool done = false;
+    int ret = -1;
+
+    if (runIOBufferInit(&buffer, data->buflen) < 0)
+        return -1;
+
+    while (!done) {
+        ssize_t got;
+
+        if ((got = runIORead(data, buffer.buf)) < 0) {
+            virReportSystemError(errno, _("Unable to read %s"), data->fdinname);
+            goto cleanup;
+        }
+        if (got == 0)
+            break;
+
+        if (runIOWrite(data, buffer.buf, got, &done) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    g_free(buffer.base);
+    return ret;
+}
+
+
+static void
+runIOPipelineReader(void *opaque)
+{
+    runIOPipeline *pipeline = opaque;
+
+    while (1) {
+        runIOBuffer *buffer;
+
+        virMutexLock(&pipeline->lock);
+        while (pipeline->count == pipeline->nbufs && !pipeline->quit)
+            virCondWait(&pipeline->cond, &pipeline->lock);
+
+        if (pipeline->quit) {
+            virMutexUnlock(&pipeline->lock);
+            return;
+        }
+
+        buffer = &pipeline->bufs[(pipeline->head + pipeline->count) %
+                                 pipeline->nbufs];
+        virMutexUnlock(&pipeline->lock);
+
+        /* The writer doesn't touch buffers which are not filled yet */
+        if ((buffer->len = runIORead(pipeline->data, buffer->buf)) < 0)
+            buffer->err = errno;
+
+        virMutexLock(&pipeline->lock);
+        pipeline->count++;
+        virCondBroadcast(&pipeline->cond);
+        virMutexUnlock(&pipeline->lock);
+
+        if (buffer->len <= 0)
+            return;
+    }
+}
+
+
+/*
+ * Copy the data using a ring of @nbufs buffers, reading in a separate
+ * thread so that reads and writes overlap.
+ */
+static int
+runIOPipelined(runIOData *data,
+               size_t nbufs)
+{
+    runIOPipeline pipeline = { .data = data, .nbufs = nbufs,
+                               .cancel = { -1, -1 } };
+    virThread reader;
+    bool haveLock = false;
+    bool haveCond = false;
+    bool haveThread = false;
+    bool done = false;
+    size_t i;
+    int ret = -1;
+
+    pipeline.bufs = g_new0(runIOBuffer, nbufs);
+    for (i = 0; i < nbufs; i++) {
+        if (runIOBufferInit(&pipeline.bufs[i], data->buflen) < 0)
+            goto cleanup;
+    }
+
+    if (virMutexInit(&pipeline.lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize mutex"));
+        goto cleanup;
+    }
+    haveLock = true;
+
+    if (virCondInit(&pipeline.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition variable"));
+        goto cleanup;
+    }
+    haveCond = true;
+
+    if (virPipe(pipeline.cancel) < 0)
+        goto cleanup;
+    data->cancelfd = pipeline.cancel[0];
+
+    if (virThreadCreate(&reader, true, runIOPipelineReader, &pipeline) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to create reader thread"));
+        goto cleanup;
+    }
+    haveThread = true;
+
+    while (!done) {
+        runIOBuffer *buffer;
+        int rc;
+
+        virMutexLock(&pipeline.lock);
+        while (pipeline.count == 0)
+            virCondWait(&pipeline.cond, &pipeline.lock);
+        buffer = &pipeline.bufs[pipeline.head];
+        virMutexUnlock(&pipeline.lock);
+
+        if (buffer->len < 0) {
+            virReportSystemError(buffer->err, _("Unable to read %s"),
+                                 data->fdinname);
+            goto cleanup;
+        }
+        if (buffer->len == 0)
+            break;
+
+        rc = runIOWrite(data, buffer->buf, buffer->len, &done);
+
+        virMutexLock(&pipeline.lock);
+        pipeline.head = (pipeline.head + 1) % nbufs;
+        pipeline.count--;
+        virCondBroadcast(&pipeline.cond);
+        virMutexUnlock(&pipeline.lock);
+
+        if (rc < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (haveThread) {
+        virMutexLock(&pipeline.lock);
+        pipeline.quit = true;
+        virCondBroadcast(&pipeline.cond);
+        virMutexUnlock(&pipeline.lock);
+        /* wakes up the reader if it is waiting for input */
+        VIR_FORCE_CLOSE(pipeline.cancel[1]);
+        virThreadJoin(&reader);
+    }
+    data->cancelfd = -1;
+    VIR_FORCE_CLOSE(pipeline.cancel[0]);
+    VIR_FORCE_CLOSE(pipeline.cancel[1]);
+    if (haveCond)
+        virCondDestroy(&pipeline.cond);
+    if (haveLock)
+        virMutexDestroy(&pipeline.lock);
+    for (i = 0; i < nbufs; i++)
+        g_free(pipeline.bufs[i].base);
+    g_free(pipeline.bufs);
+    return ret;
+}
+
+
+static int
+runIO(const char *path, int fd, int oflags, size_t buflen, size_t nbufs)
+{
+    runIOData data = { .fd = fd, .buflen = buflen, .cancelfd = -1 };
+    int ret = -1;
+    off_t end = 0;
+
+    data.direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
+
     switch (oflags & O_ACCMODE) {
     case O_RDONLY:
-        fdin = fd;
-        fdinname = path;
-        fdout = STDOUT_FILENO;
-        fdoutname = "stdout";
+        data.fdin = fd;
+        data.fdinname = path;
+        data.fdout = STDOUT_FILENO;
+        data.fdoutname = "stdout";
         /* To make the implementation simpler, we give up on any
          * attempt to use O_DIRECT in a non-trivial manner.  */
-        if (direct && ((end = lseek(fd, 0, SEEK_CUR)) != 0)) {
+        if (data.direct && ((end = lseek(fd, 0, SEEK_CUR)) != 0)) {
             virReportSystemError(end < 0 ? errno : EINVAL, "%s",
                                  _("O_DIRECT read needs entire seekable file"));
             goto cleanup;
         }
         break;
     case O_WRONLY:
-        fdin = STDIN_FILENO;
-        fdinname = "stdin";
-        fdout = fd;
-        fdoutname = path;
+        data.fdin = STDIN_FILENO;
+        data.fdinname = "stdin";
+        data.fdout = fd;
+        data.fdoutname = path;
         /* To make the implementation simpler, we give up on any
          * attempt to use O_DIRECT in a non-trivial manner.  */
-        if (direct && (end = lseek(fd, 0, SEEK_END)) != 0) {
+        if (data.direct && (end = lseek(fd, 0, SEEK_END)) != 0) {
             virReportSystemError(end < 0 ? errno : EINVAL, "%s",
                                  _("O_DIRECT write needs empty seekable file"));
             goto cleanup;
@@ -105,62 +447,19 @@ runIO(const char *path, int fd, int oflags)
         goto cleanup;
     }
 
-    while (1) {
-        ssize_t got;
-
-        /* If we read with O_DIRECT from file we can't use saferead as
-         * it can lead to unaligned read after reading last bytes.
-         * If we write with O_DIRECT use should use saferead so that
-         * writes will be aligned.
-         * In other cases using saferead reduces number of syscalls.
-         */
-        if (fdin == fd && direct) {
-            if ((got = read(fdin, buf, buflen)) < 0 &&
-                errno == EINTR)
-                continue;
-        } else {
-            got = saferead(fdin, buf, buflen);
-        }
-
-        if (got < 0) {
-            virReportSystemError(errno, _("Unable to read %s"), fdinname);
+    if (nbufs > 1) {
+        if (runIOPipelined(&data, nbufs) < 0)
             goto cleanup;
-        }
-        if (got == 0)
-            break;
-
-        total += got;
-
-        /* handle last write size align in direct case */
-        if (got < buflen && direct && fdout == fd) {
-            ssize_t aligned_got = (got + alignMask) & ~alignMask;
-
-            memset(buf + got, 0, aligned_got - got);
-
-            if (safewrite(fdout, buf, aligned_got) < 0) {
-                virReportSystemError(errno, _("Unable to write %s"), fdoutname);
-                goto cleanup;
-            }
-
-            if (ftruncate(fd, total) < 0) {
-                virReportSystemError(errno, _("Unable to truncate %s"), fdoutname);
-                goto cleanup;
-            }
-
-            break;
-        }
-
-        if (safewrite(fdout, buf, got) < 0) {
-            virReportSystemError(errno, _("Unable to write %s"), fdoutname);
+    } else {
+        if (runIOSerial(&data) < 0)
             goto cleanup;
-        }
     }
 
     /* Ensure all data is written */
-    if (virFileDataSync(fdout) < 0) {
+    if (virFileDataSync(data.fdout) < 0) {
         if (errno != EINVAL && errno != EROFS) {
             /* fdatasync() may fail on some special FDs, e.g. pipes */
-            virReportSystemError(errno, _("unable to fsync %s"), fdoutname);
+            virReportSystemError(errno, _("unable to fsync %s"), data.fdoutname);
             goto cleanup;
         }
     }
@@ -184,7 +483,7 @@ usage(int status)
     if (status) {
         fprintf(stderr, _("%s: try --help for more details"), program_name);
     } else {
-        printf(_("Usage: %s FILENAME FD"), program_name);
+        printf(_("Usage: %s FILENAME FD [BUFFER-SIZE BUFFERS]"), program_name);
     }
     exit(status);
 }
@@ -195,6 +494,8 @@ main(int argc, char **argv)
     const char *path;
     int oflags = -1;
     int fd = -1;
+    unsigned long long buflen = IOHELPER_BUFLEN_DEFAULT;
+    unsigned int nbufs = 1;
 
     program_name = argv[0];
 
@@ -208,10 +509,10 @@ main(int argc, char **argv)
 
     if (argc > 1 && STREQ(argv[1], "--help"))
         usage(EXIT_SUCCESS);
-    if (argc == 3) { /* FILENAME FD */
+    if (argc == 3 || argc == 5) { /* FILENAME FD [BUFFER-SIZE BUFFERS] */
         if (virStrToLong_i(argv[2], NULL, 10, &fd) < 0) {
             fprintf(stderr, _("%s: malformed fd %s"),
-                    program_name, argv[3]);
+                    program_name, argv[2]);
             exit(EXIT_FAILURE);
         }
 #ifdef F_GETFL
@@ -228,11 +529,30 @@ main(int argc, char **argv)
                     program_name, fd);
             exit(EXIT_FAILURE);
         }
+        if (argc == 5) {
+            if (virStrToLong_ullp(argv[3], NULL, 10, &buflen) < 0 ||
+                buflen == 0 || buflen > SSIZE_MAX) {
+                fprintf(stderr, _("%s: buffer size %s must be between 1 and %zd"),
+                        program_name, argv[3], (ssize_t) SSIZE_MAX);
+                exit(EXIT_FAILURE);
+            }
+            if (buflen % IOHELPER_ALIGN != 0) {
+                fprintf(stderr, _("%s: buffer size %s is not a multiple of %d"),
+                        program_name, argv[3], IOHELPER_ALIGN);
+                exit(EXIT_FAILURE);
+            }
+            if (virStrToLong_uip(argv[4], NULL, 10, &nbufs) < 0 ||
+                nbufs == 0 || nbufs > IOHELPER_NBUFS_MAX) {
+                fprintf(stderr, _("%s: number of buffers %s must be between 1 and %d"),
+                        program_name, argv[4], IOHELPER_NBUFS_MAX);
+                exit(EXIT_FAILURE);
+            }
+        }
     } else { /* unknown argc pattern */
         usage(EXIT_FAILURE);
     }
 
-    if (fd < 0 || runIO(path, fd, oflags) < 0)
+    if (fd < 0 || runIO(path, fd, oflags, buflen, nbufs) < 0)
         goto error;
 
     return 0;
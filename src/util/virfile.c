@@ -203,34 +203,23 @@ struct _virFileWrapperFd {
 
 #ifndef WIN32
 /**
- * virFileWrapperFdNew:
+ * virFileWrapperFdNewFull:
  * @fd: pointer to fd to wrap
  * @name: name of fd, for diagnostics
  * @flags: bitwise-OR of virFileWrapperFdFlags
+ * @bufferSize: size of each I/O buffer in bytes, or 0 for the default
+ * @nbuffers: number of I/O buffers, or 0 for the default
  *
- * Update @fd so that it meets parameters requested by @flags.
- *
- * If VIR_FILE_WRAPPER_BYPASS_CACHE bit is set in @flags, @fd will be updated
- * in a way that all I/O to that file will bypass the system cache.  The
- * original fd must have been created with virFileDirectFdFlag() among the
- * flags to open().
- *
- * If VIR_FILE_WRAPPER_NON_BLOCKING bit is set in @flags, @fd will be updated
- * to ensure it properly supports non-blocking I/O, i.e., it will report
- * EAGAIN.
- *
- * This must be called after open() and optional fchown() or fchmod(), but
- * before any seek or I/O, and only on seekable fd.  The file must be O_RDONLY
- * (to read the entire existing file) or O_WRONLY (to write to an empty file).
- * In some cases, @fd is changed to a non-seekable pipe; in this case, the
- * caller must not do anything further with the original fd.
- *
- * On success, the new wrapper object is returned, which must be later
- * freed with virFileWrapperFdFree().  On failure, @fd is unchanged, an
- * error message is output, and NULL is returned.
+ * Like virFileWrapperFdNew, but allows tuning the buffers used to copy
+ * the data. @bufferSize must be a multiple of 64 KiB. With more than one
+ * buffer, reading and writing is done in parallel.
  */
 virFileWrapperFdPtr
-virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
+virFileWrapperFdNewFull(int *fd,
+                        const char *name,
+                        unsigned int flags,
+                        size_t bufferSize,
+                        size_t nbuffers)
 {
     virFileWrapperFdPtr ret = NULL;
     bool output = false;
@@ -294,6 +283,12 @@ virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
         virCommandAddArg(ret->cmd, "0");
     }
 
+    if (bufferSize || nbuffers) {
+        virCommandAddArgFormat(ret->cmd, "%zu",
+                               bufferSize ? bufferSize : 1024 * 1024);
+        virCommandAddArgFormat(ret->cmd, "%zu", nbuffers ? nbuffers : 1);
+    }
+
     /* In order to catch iohelper stderr, we must change
      * iohelper's env so virLog functions print to stderr
      */
@@ -319,11 +314,15 @@ virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
     virFileWrapperFdFree(ret);
     return NULL;
 }
+
+
 #else /* WIN32 */
 virFileWrapperFdPtr
-virFileWrapperFdNew(int *fd G_GNUC_UNUSED,
-                    const char *name G_GNUC_UNUSED,
-                    unsigned int fdflags G_GNUC_UNUSED)
+virFileWrapperFdNewFull(int *fd G_GNUC_UNUSED,
+                        const char *name G_GNUC_UNUSED,
+                        unsigned int fdflags G_GNUC_UNUSED,
+                        size_t bufferSize G_GNUC_UNUSED,
+                        size_t nbuffers G_GNUC_UNUSED)
 {
     virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                    _("virFileWrapperFd unsupported on this platform"));
@@ -331,6 +330,40 @@ virFileWrapperFdNew(int *fd G_GNUC_UNUSED,
 }
 #endif /* WIN32 */
 
+
+/**
+ * virFileWrapperFdNew:
+ * @fd: pointer to fd to wrap
+ * @name: name of fd, for diagnostics
+ * @flags: bitwise-OR of virFileWrapperFdFlags
+ *
+ * Update @fd so that it meets parameters requested by @flags.
+ *
+ * If VIR_FILE_WRAPPER_BYPASS_CACHE bit is set in @flags, @fd will be updated
+ * in a way that all I/O to that file will bypass the system cache.  The
+ * original fd must have been created with virFileDirectFdFlag() among the
+ * flags to open().
+ *
+ * If VIR_FILE_WRAPPER_NON_BLOCKING bit is set in @flags, @fd will be updated
+ * to ensure it properly supports non-blocking I/O, i.e., it will report
+ * EAGAIN.
+ *
+ * This must be called after open() and optional fchown() or fchmod(), but
+ * before any seek or I/O, and only on seekable fd.  The file must be O_RDONLY
+ * (to read the entire existing file) or O_WRONLY (to write to an empty file).
+ * In some cases, @fd is changed to a non-seekable pipe; in this case, the
+ * caller must not do anything further with the original fd.
+ *
+ * On success, the new wrapper object is returned, which must be later
+ * freed with virFileWrapperFdFree().  On failure, @fd is unchanged, an
+ * error message is output, and NULL is returned.
+ */
+virFileWrapperFdPtr
+virFileWrapperFdNew(int *fd, const char *name, unsigned int flags)
+{
+    return virFileWrapperFdNewFull(fd, name, flags, 0, 0);
+}
+
 /**
  * virFileWrapperFdClose:
  * @wfd: fd wrapper, or NULL
@@ -107,6 +107,12 @@ virFileWrapperFdPtr virFileWrapperFdNew(int *fd,
                                         const char *name,
                                         unsigned int flags)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+virFileWrapperFdPtr virFileWrapperFdNewFull(int *fd,
+                                            const char *name,
+                                            unsigned int flags,
+                                            size_t bufferSize,
+                                            size_t nbuffers)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
 
 int virFileWrapperFdClose(virFileWrapperFdPtr dfd);
 
@@ -48,6 +48,14 @@ VIR_ENUM_IMPL(virFirewallLayerCommand,
               IP6TABLES_PATH,
 );
 
+VIR_ENUM_DECL(virFirewallLayerRestoreCommand);
+VIR_ENUM_IMPL(virFirewallLayerRestoreCommand,
+              VIR_FIREWALL_LAYER_LAST,
+              EBTABLES_PATH "-restore",
+              IPTABLES_PATH "-restore",
+              IP6TABLES_PATH "-restore",
+);
+
 struct _virFirewallRule {
     virFirewallLayer layer;
 
@@ -101,12 +109,33 @@ static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
 
+/* Whether the *-restore command of a layer accepts --noflush */
+static bool restoreAvailable[VIR_FIREWALL_LAYER_LAST];
+static bool restoreOverride; /* true to avoid restore probes */
+
 void
 virFirewallSetLockOverride(bool avoid)
 {
     lockOverride = avoid;
 }
 
+/**
+ * virFirewallSetRestoreOverride:
+ * @available: whether to use the *-restore commands
+ *
+ * Skip probing for the *-restore commands and assume they are
+ * (or are not) usable for applying rules in batches.
+ */
+void
+virFirewallSetRestoreOverride(bool available)
+{
+    size_t i;
+
+    restoreOverride = true;
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++)
+        restoreAvailable[i] = available;
+}
+
 static void
 virFirewallCheckUpdateLock(bool *lockflag,
                            const char *const*args)
@@ -143,6 +172,40 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+static void
+virFirewallCheckUpdateRestore(void)
+{
+    size_t i;
+
+    if (lockOverride || restoreOverride)
+        return;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        const char *bin = virFirewallLayerRestoreCommandTypeToString(i);
+        g_autoptr(virCommand) cmd = NULL;
+        int status;
+
+        restoreAvailable[i] = false;
+        if (!virFileIsExecutable(bin)) {
+            VIR_INFO("%s not available", bin);
+            continue;
+        }
+
+        /* An empty payload with --noflush must not change anything */
+        cmd = virCommandNewArgList(bin, "--noflush", NULL);
+        if ((i == VIR_FIREWALL_LAYER_IPV4 && iptablesUseLock) ||
+            (i == VIR_FIREWALL_LAYER_IPV6 && ip6tablesUseLock))
+            virCommandAddArg(cmd, "-w");
+        virCommandSetInputBuffer(cmd, "");
+        if (virCommandRun(cmd, &status) < 0 || status) {
+            VIR_INFO("%s does not support --noflush", bin);
+        } else {
+            VIR_INFO("using %s to apply rules in batches", bin);
+            restoreAvailable[i] = true;
+        }
+    }
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
@@ -191,6 +254,8 @@ virFirewallValidateBackend(virFirewallBackend backend)
     currentBackend = backend;
 
     virFirewallCheckUpdateLocking();
+    if (backend == VIR_FIREWALL_BACKEND_DIRECT)
+        virFirewallCheckUpdateRestore();
 
     return 0;
 }
@@ -641,7 +706,7 @@ static char *
 virFirewallRuleToString(virFirewallRulePtr rule)
 {
     const char *bin = virFirewallLayerCommandTypeToString(rule->layer);
-    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
     size_t i;
 
     virBufferAdd(&buf, bin, -1);
@@ -761,22 +826,211 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return 0;
 }
 
+/*
+ * Check whether @rule can be applied as a line of a *-restore
+ * payload rather than by running a command of its own. This is
+ * only the case for plain changes to rules and chains whose failure
+ * is not ignored: queries need their own output and a single failed
+ * line fails the whole payload. On success @table is filled with
+ * the table the rule operates on and @start with the index of the
+ * first argument which goes into the payload line.
+ */
+static bool
+virFirewallRuleGetRestoreLine(virFirewallRulePtr rule,
+                              bool ignoreErrors,
+                              const char **table,
+                              size_t *start)
+{
+    const char *commands[] = {
+        "-A", "--append", "-I", "--insert", "-D", "--delete",
+        "-R", "--replace", "-N", "--new-chain", "-F", "--flush",
+        "-X", "--delete-chain", "-E", "--rename-chain", "-P", "--policy",
+    };
+    size_t i = 0;
+    size_t j;
+
+    if (currentBackend != VIR_FIREWALL_BACKEND_DIRECT ||
+        !restoreAvailable[rule->layer] ||
+        ignoreErrors || rule->ignoreErrors || rule->queryCB)
+        return false;
+
+    if (i < rule->argsLen &&
+        (STREQ(rule->args[i], "-w") || STREQ(rule->args[i], "--concurrent")))
+        i++;
+
+    *table = "filter";
+    if (i + 1 < rule->argsLen &&
+        (STREQ(rule->args[i], "-t") || STREQ(rule->args[i], "--table"))) {
+        *table = rule->args[i + 1];
+        i += 2;
+    }
+
+    if (i >= rule->argsLen)
+        return false;
+
+    for (j = 0; j < G_N_ELEMENTS(commands); j++) {
+        if (STREQ(rule->args[i], commands[j]))
+            break;
+    }
+    if (j == G_N_ELEMENTS(commands))
+        return false;
+
+    for (j = i; j < rule->argsLen; j++) {
+        if (STREQ(rule->args[j], "-t") ||
+            STRPREFIX(rule->args[j], "--table") ||
+            strchr(rule->args[j], '\n'))
+            return false;
+    }
+
+    *start = i;
+    return true;
+}
+
+
+static void
+virFirewallBufferAddRestoreArg(virBufferPtr buf,
+                               const char *arg)
+{
+    const char *p;
+
+    if (*arg && !strpbrk(arg, " \t\"\\")) {
+        virBufferAdd(buf, arg, -1);
+        return;
+    }
+
+    virBufferAddChar(buf, '"');
+    for (p = arg; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            virBufferAddChar(buf, '\\');
+        virBufferAddChar(buf, *p);
+    }
+    virBufferAddChar(buf, '"');
+}
+
+
+/*
+ * Apply @nrules rules, which all operate on the same table of the
+ * same layer, with a single run of the layer's *-restore command.
+ * Since the payload only contains one table it is committed as a
+ * whole or not at all, so a failure leaves the same state behind as
+ * a failure of the first rule would have.
+ */
+static int
+virFirewallApplyRestore(virFirewallRulePtr *rules,
+                        size_t nrules)
+{
+    virFirewallLayer layer = rules[0]->layer;
+    const char *bin = virFirewallLayerRestoreCommandTypeToString(layer);
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *payload = NULL;
+    g_autofree char *error = NULL;
+    const char *table = NULL;
+    size_t start;
+    size_t i, j;
+    int status;
+
+    for (i = 0; i < nrules; i++) {
+        if (!virFirewallRuleGetRestoreLine(rules[i], false, &table, &start)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("firewall rule cannot be applied in a batch"));
+            return -1;
+        }
+
+        if (i == 0)
+            virBufferAsprintf(&buf, "*%s\n", table);
+
+        for (j = start; j < rules[i]->argsLen; j++) {
+            if (j > start)
+                virBufferAddChar(&buf, ' ');
+            virFirewallBufferAddRestoreArg(&buf, rules[i]->args[j]);
+        }
+        virBufferAddChar(&buf, '\n');
+    }
+    virBufferAddLit(&buf, "COMMIT\n");
+    payload = virBufferContentAndReset(&buf);
+
+    VIR_INFO("Applying %zu rules with '%s'", nrules, bin);
+    VIR_DEBUG("Rules payload:\n%s", payload);
+
+    cmd = virCommandNewArgList(bin, "--noflush", NULL);
+    if ((layer == VIR_FIREWALL_LAYER_IPV4 && iptablesUseLock) ||
+        (layer == VIR_FIREWALL_LAYER_IPV6 && ip6tablesUseLock))
+        virCommandAddArg(cmd, "-w");
+    virCommandSetInputBuffer(cmd, payload);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules %s: %s"),
+                       payload, NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
 {
     virFirewallGroupPtr group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    const char *batchTable = NULL;
+    size_t batchStart = 0;
+    size_t nbatch = 0;
     size_t i;
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=0x%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
-    for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
+
+    /* Consecutive rules for the same table are collected and applied
+     * in one go. The batch is flushed before any other rule is run,
+     * so the order of rules is kept and query callbacks, which may
+     * append rules to the group, always see the effect of earlier
+     * rules. */
+    for (i = 0; i <= group->naction; i++) {
+        virFirewallRulePtr rule = i < group->naction ? group->action[i] : NULL;
+        const char *table;
+        size_t start;
+        bool batch = rule &&
+            virFirewallRuleGetRestoreLine(rule, ignoreErrors, &table, &start);
+
+        if (batch && nbatch > 0 &&
+            rule->layer == group->action[batchStart]->layer &&
+            STREQ(table, batchTable)) {
+            nbatch++;
+            continue;
+        }
+
+        if (nbatch > 1) {
+            if (virFirewallApplyRestore(group->action + batchStart, nbatch) < 0)
+                return -1;
+        } else if (nbatch == 1) {
+            if (virFirewallApplyRule(firewall,
+                                     group->action[batchStart],
+                                     ignoreErrors) < 0)
+                return -1;
+        }
+        nbatch = 0;
+
+        if (!rule)
+            break;
+
+        if (batch) {
+            batchStart = i;
+            batchTable = table;
+            nbatch = 1;
+            continue;
+        }
+
+        if (virFirewallApplyRule(firewall, rule, ignoreErrors) < 0)
             return -1;
     }
     return 0;
@@ -112,5 +112,6 @@ void virFirewallStartRollback(virFirewallPtr firewall,
 int virFirewallApply(virFirewallPtr firewall);
 
 void virFirewallSetLockOverride(bool avoid);
+void virFirewallSetRestoreOverride(bool available);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virFirewall, virFirewallFree);
@@ -1,5 +1,5 @@
 /*
- * virhash.c: chained hash tables
+ * virhash.c: chained and open addressing hash tables
  *
  * Reference: Your favorite introductory book on algorithms
  *
@@ -47,11 +47,36 @@ struct _virHashEntry {
     void *payload;
 };
 
+/*
+ * A single slot of an open addressing hash table. Entries are kept in
+ * order of their distance from the slot their hash code maps to
+ * (robin hood hashing) so that lookups of missing keys terminate early
+ * and removals can shift the following entries back instead of leaving
+ * tombstones behind.
+ */
+typedef struct _virHashSlot virHashSlot;
+typedef virHashSlot *virHashSlotPtr;
+struct _virHashSlot {
+    uint32_t code;
+    uint32_t dist; /* probe distance + 1, 0 if the slot is empty */
+    void *name; /* NULL if removed while the table is iterated over */
+    void *payload;
+};
+
+/* Open addressing tables are grown once they're 7/8 full */
+#define VIR_HASH_FLAT_LOAD_NUM 7
+#define VIR_HASH_FLAT_LOAD_DEN 8
+
 /*
  * The entire hash table
  */
 struct _virHashTable {
     virHashEntryPtr *table;
+    virHashSlotPtr slots; /* used instead of @table by open addressing tables */
+    int iterating; /* number of iterations in progress, updated atomically
+                    * as readers may iterate concurrently; removals from
+                    * @slots meanwhile leave tombstones */
+    size_t ntombstones;
     uint32_t seed;
     size_t size;
     size_t nbElems;
@@ -190,6 +215,39 @@ virHashNew(virHashDataFree dataFree)
 }
 
 
+/**
+ * virHashNewFlat:
+ * @dataFree: callback to free data
+ *
+ * Create a new virHashTablePtr which stores its entries in a single
+ * array using open addressing rather than in separately allocated
+ * chained entries. Lookups in such table touch fewer cache lines, which
+ * is beneficial for large and frequently searched tables. The API is the
+ * same as for tables created by virHashNew, except that adding entries
+ * while iterating over the table is not possible.
+ *
+ * Returns the newly created object.
+ */
+virHashTablePtr
+virHashNewFlat(virHashDataFree dataFree)
+{
+    virHashTablePtr table = g_new0(virHashTable, 1);
+
+    table->seed = virRandomBits(32);
+    table->size = 32;
+    table->dataFree = dataFree;
+    table->keyCode = virHashStrCode;
+    table->keyEqual = virHashStrEqual;
+    table->keyCopy = virHashStrCopy;
+    table->keyPrint = virHashStrPrintHuman;
+    table->keyFree = virHashStrFree;
+
+    table->slots = g_new0(virHashSlot, table->size);
+
+    return table;
+}
+
+
 /**
  * virHashCreate:
  * @size: the size of the hash table
@@ -240,6 +298,146 @@ virHashAtomicDispose(void *obj)
 }
 
 
+/*
+ * Returns the index of the slot holding @name or -1 if there is none.
+ */
+static ssize_t
+virHashFlatFind(const virHashTable *table,
+                const void *name,
+                uint32_t code)
+{
+    size_t mask = table->size - 1;
+    size_t idx = code & mask;
+    uint32_t dist;
+
+    /* there's always an empty slot, so this terminates */
+    for (dist = 1; ; dist++) {
+        virHashSlotPtr slot = &table->slots[idx];
+
+        if (slot->dist < dist)
+            return -1;
+
+        if (slot->code == code && slot->name &&
+            table->keyEqual(slot->name, name))
+            return idx;
+
+        idx = (idx + 1) & mask;
+    }
+}
+
+
+static void
+virHashFlatInsert(virHashTablePtr table,
+                  uint32_t code,
+                  void *name,
+                  void *payload)
+{
+    virHashSlot entry = { .code = code, .dist = 1,
+                          .name = name, .payload = payload };
+    size_t mask = table->size - 1;
+    size_t idx = code & mask;
+
+    for (;; idx = (idx + 1) & mask, entry.dist++) {
+        virHashSlotPtr slot = &table->slots[idx];
+
+        if (slot->dist == 0) {
+            *slot = entry;
+            return;
+        }
+
+        /* take the slot from entries closer to their home slot */
+        if (slot->dist < entry.dist) {
+            virHashSlot tmp = *slot;
+            *slot = entry;
+            entry = tmp;
+        }
+    }
+}
+
+
+static void
+virHashFlatGrow(virHashTablePtr table)
+{
+    virHashSlotPtr oldslots = table->slots;
+    size_t oldsize = table->size;
+    size_t i;
+
+    table->size *= 2;
+    table->slots = g_new0(virHashSlot, table->size);
+
+    for (i = 0; i < oldsize; i++) {
+        if (oldslots[i].name)
+            virHashFlatInsert(table, oldslots[i].code,
+                              oldslots[i].name, oldslots[i].payload);
+    }
+
+    g_free(oldslots);
+    table->ntombstones = 0;
+}
+
+
+/* Removes the slot at @idx, shifting the following entries back */
+static void
+virHashFlatDeleteSlot(virHashTablePtr table,
+                      size_t idx)
+{
+    size_t mask = table->size - 1;
+    size_t next = (idx + 1) & mask;
+
+    while (table->slots[next].dist > 1) {
+        table->slots[idx] = table->slots[next];
+        table->slots[idx].dist--;
+        idx = next;
+        next = (next + 1) & mask;
+    }
+
+    memset(&table->slots[idx], 0, sizeof(table->slots[idx]));
+}
+
+
+static void
+virHashFlatFreeSlot(virHashTablePtr table,
+                    size_t idx)
+{
+    virHashSlotPtr slot = &table->slots[idx];
+
+    if (table->dataFree)
+        table->dataFree(slot->payload);
+    if (table->keyFree)
+        table->keyFree(slot->name);
+
+    table->nbElems--;
+
+    /* Shifting entries back would make iterators skip or revisit them,
+     * so only mark the slot as removed until the iteration finishes */
+    if (g_atomic_int_get(&table->iterating) > 0) {
+        slot->name = NULL;
+        slot->payload = NULL;
+        table->ntombstones++;
+    } else {
+        virHashFlatDeleteSlot(table, idx);
+    }
+}
+
+
+static void
+virHashFlatIterateEnd(virHashTablePtr table)
+{
+    size_t i;
+
+    if (!g_atomic_int_dec_and_test(&table->iterating) ||
+        table->ntombstones == 0)
+        return;
+
+    for (i = 0; i < table->size; i++) {
+        while (table->slots[i].dist != 0 && !table->slots[i].name)
+            virHashFlatDeleteSlot(table, i);
+    }
+
+    table->ntombstones = 0;
+}
+
+
 /**
  * virHashGrow:
  * @table: the hash table
@@ -318,6 +516,21 @@ virHashFree(virHashTablePtr table)
     if (table == NULL)
         return;
 
+    if (table->slots) {
+        for (i = 0; i < table->size; i++) {
+            if (!table->slots[i].name)
+                continue;
+            if (table->dataFree)
+                table->dataFree(table->slots[i].payload);
+            if (table->keyFree)
+                table->keyFree(table->slots[i].name);
+        }
+
+        VIR_FREE(table->slots);
+        VIR_FREE(table);
+        return;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr iter = table->table[i];
         while (iter) {
@@ -336,6 +549,51 @@ virHashFree(virHashTablePtr table)
     VIR_FREE(table);
 }
 
+static int
+virHashReportDuplicate(virHashTablePtr table,
+                       const void *name)
+{
+    g_autofree char *keystr = NULL;
+
+    if (table->keyPrint)
+        keystr = table->keyPrint(name);
+
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("Duplicate hash table key '%s'"), NULLSTR(keystr));
+    return -1;
+}
+
+
+static int
+virHashFlatAddOrUpdateEntry(virHashTablePtr table,
+                            const void *name,
+                            void *userdata,
+                            bool is_update)
+{
+    uint32_t code = table->keyCode(name, table->seed);
+    ssize_t idx;
+
+    if ((idx = virHashFlatFind(table, name, code)) >= 0) {
+        if (!is_update)
+            return virHashReportDuplicate(table, name);
+
+        if (table->dataFree)
+            table->dataFree(table->slots[idx].payload);
+        table->slots[idx].payload = userdata;
+        return 0;
+    }
+
+    if ((table->nbElems + table->ntombstones + 1) * VIR_HASH_FLAT_LOAD_DEN >
+        table->size * VIR_HASH_FLAT_LOAD_NUM)
+        virHashFlatGrow(table);
+
+    virHashFlatInsert(table, code, table->keyCopy(name), userdata);
+    table->nbElems++;
+
+    return 0;
+}
+
+
 static int
 virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
                         void *userdata,
@@ -348,6 +606,9 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
     if ((table == NULL) || (name == NULL))
         return -1;
 
+    if (table->slots)
+        return virHashFlatAddOrUpdateEntry(table, name, userdata, is_update);
+
     key = virHashComputeKey(table, name);
 
     /* Check for duplicate entry */
@@ -359,14 +620,7 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
                 entry->payload = userdata;
                 return 0;
             } else {
-                g_autofree char *keystr = NULL;
-
-                if (table->keyPrint)
-                    keystr = table->keyPrint(name);
-
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Duplicate hash table key '%s'"), NULLSTR(keystr));
-                return -1;
+                return virHashReportDuplicate(table, name);
             }
         }
         last = entry;
@@ -473,7 +727,16 @@ virHashGetEntry(const virHashTable *table,
 void *
 virHashLookup(const virHashTable *table, const void *name)
 {
-    virHashEntryPtr entry = virHashGetEntry(table, name);
+    virHashEntryPtr entry;
+
+    if (table && name && table->slots) {
+        ssize_t idx = virHashFlatFind(table, name,
+                                      table->keyCode(name, table->seed));
+
+        return idx < 0 ? NULL : table->slots[idx].payload;
+    }
+
+    entry = virHashGetEntry(table, name);
 
     if (!entry)
         return NULL;
@@ -495,6 +758,10 @@ bool
 virHashHasEntry(const virHashTable *table,
                 const void *name)
 {
+    if (table && name && table->slots)
+        return virHashFlatFind(table, name,
+                               table->keyCode(name, table->seed)) >= 0;
+
     return !!virHashGetEntry(table, name);
 }
 
@@ -590,6 +857,17 @@ virHashRemoveEntry(virHashTablePtr table, const void *name)
     if (table == NULL || name == NULL)
         return -1;
 
+    if (table->slots) {
+        ssize_t idx = virHashFlatFind(table, name,
+                                      table->keyCode(name, table->seed));
+
+        if (idx < 0)
+            return -1;
+
+        virHashFlatFreeSlot(table, idx);
+        return 0;
+    }
+
     nextptr = table->table + virHashComputeKey(table, name);
     for (entry = *nextptr; entry; entry = entry->next) {
         if (table->keyEqual(entry->name, name)) {
@@ -632,6 +910,22 @@ virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
     if (table == NULL || iter == NULL)
         return -1;
 
+    if (table->slots) {
+        ret = 0;
+        g_atomic_int_inc(&table->iterating);
+        for (i = 0; i < table->size; i++) {
+            if (!table->slots[i].name)
+                continue;
+
+            if ((ret = iter(table->slots[i].payload,
+                            table->slots[i].name, data)) < 0)
+                break;
+        }
+        virHashFlatIterateEnd(table);
+
+        return ret;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr entry = table->table[i];
         while (entry) {
@@ -672,6 +966,20 @@ virHashRemoveSet(virHashTablePtr table,
     if (table == NULL || iter == NULL)
         return -1;
 
+    if (table->slots) {
+        g_atomic_int_inc(&table->iterating);
+        for (i = 0; i < table->size; i++) {
+            if (table->slots[i].name &&
+                iter(table->slots[i].payload, table->slots[i].name, data)) {
+                count++;
+                virHashFlatFreeSlot(table, i);
+            }
+        }
+        virHashFlatIterateEnd(table);
+
+        return count;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr *nextptr = table->table + i;
 
@@ -739,6 +1047,7 @@ void *virHashSearch(const virHashTable *ctable,
                     void **name)
 {
     size_t i;
+    void *ret = NULL;
 
     /* Cast away const for internal detection of misuse.  */
     virHashTablePtr table = (virHashTablePtr)ctable;
@@ -746,18 +1055,37 @@ void *virHashSearch(const virHashTable *ctable,
     if (table == NULL || iter == NULL)
         return NULL;
 
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr entry;
-        for (entry = table->table[i]; entry; entry = entry->next) {
-            if (iter(entry->payload, entry->name, data)) {
+    /* Removals done by @iter must not move the slots being iterated */
+    g_atomic_int_inc(&table->iterating);
+
+    if (table->slots) {
+        for (i = 0; i < table->size; i++) {
+            if (table->slots[i].name &&
+                iter(table->slots[i].payload, table->slots[i].name, data)) {
                 if (name)
-                    *name = table->keyCopy(entry->name);
-                return entry->payload;
+                    *name = table->keyCopy(table->slots[i].name);
+                ret = table->slots[i].payload;
+                goto cleanup;
+            }
+        }
+    } else {
+        for (i = 0; i < table->size; i++) {
+            virHashEntryPtr entry;
+            for (entry = table->table[i]; entry; entry = entry->next) {
+                if (iter(entry->payload, entry->name, data)) {
+                    if (name)
+                        *name = table->keyCopy(entry->name);
+                    ret = entry->payload;
+                    goto cleanup;
+                }
             }
         }
     }
 
-    return NULL;
+ cleanup:
+    virHashFlatIterateEnd(table);
+
+    return ret;
 }
 
 struct getKeysIter
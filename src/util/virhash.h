@@ -112,6 +112,7 @@ typedef void (*virHashKeyFree)(void *name);
  * Constructor and destructor.
  */
 virHashTablePtr virHashNew(virHashDataFree dataFree);
+virHashTablePtr virHashNewFlat(virHashDataFree dataFree);
 virHashTablePtr virHashCreate(ssize_t size,
                               virHashDataFree dataFree);
 virHashAtomicPtr virHashAtomicNew(ssize_t size,
@@ -31,6 +31,8 @@
 #include "virutil.h"
 #include "virbuffer.h"
 #include "virenum.h"
+#include "virhash.h"
+#include "virhashcode.h"
 
 #if WITH_YAJL
 # include <yajl/yajl_gen.h>
@@ -58,9 +60,18 @@ struct _virJSONObjectPair {
     virJSONValuePtr value;
 };
 
+/* Objects with at least this many members get a hash table index
+ * which maps keys to values, so that lookups in large QMP replies
+ * don't need to compare every key. The index is built as soon as an
+ * object grows large enough, lookups never modify the object and can
+ * thus run concurrently. */
+#define VIR_JSON_OBJECT_INDEX_THRESHOLD 16
+
 struct _virJSONObject {
     size_t npairs;
     virJSONObjectPairPtr pairs;
+    virHashTablePtr index; /* key -> value, NULL for small objects,
+                            * borrows the keys from @pairs */
 };
 
 struct _virJSONArray {
@@ -95,6 +106,41 @@ struct _virJSONParser {
     virJSONParserStatePtr state;
     size_t nstate;
     int wrap;
+    virJSONStreamParserPtr stream; /* NULL unless parsing a stream */
+
+    /* member of the top level object passed to sink instead of
+     * being parsed, see virJSONStreamParserSetSink */
+    const char *sinkKey;
+    const virJSONSAXCallbacks *sink;
+    void *sinkOpaque;
+    /* the member is being sunk into sinkActive, which is NULL if
+     * the sink was removed while doing so */
+    bool sinking;
+    size_t sinkDepth;
+    const virJSONSAXCallbacks *sinkActive;
+    void *sinkActiveOpaque;
+};
+
+typedef struct _virJSONStreamParserValue virJSONStreamParserValue;
+typedef virJSONStreamParserValue *virJSONStreamParserValuePtr;
+struct _virJSONStreamParserValue {
+    virJSONValuePtr value;
+    size_t len;
+};
+
+struct _virJSONStreamParser {
+    virJSONParser parser;
+#if WITH_YAJL
+    yajl_handle hand;
+#endif
+
+    size_t fed; /* bytes fed before the chunk being parsed */
+    size_t end; /* stream offset just past the last complete value */
+
+    /* complete values not yet retrieved by virJSONStreamParserNext */
+    virJSONStreamParserValuePtr values;
+    size_t nvalues;
+    size_t valuesHead;
 };
 
 
@@ -397,6 +443,8 @@ virJSONValueFree(virJSONValuePtr value)
 
     switch ((virJSONType) value->type) {
     case VIR_JSON_TYPE_OBJECT:
+        /* the index borrows the keys */
+        virHashFree(value->data.object.index);
         for (i = 0; i < value->data.object.npairs; i++) {
             VIR_FREE(value->data.object.pairs[i].key);
             virJSONValueFree(value->data.object.pairs[i].value);
@@ -579,6 +627,86 @@ virJSONValueNewObject(void)
 }
 
 
+static uint32_t
+virJSONObjectIndexKeyCode(const void *name,
+                          uint32_t seed)
+{
+    return virHashCodeGen(name, strlen(name), seed);
+}
+
+
+static bool
+virJSONObjectIndexKeyEqual(const void *namea,
+                           const void *nameb)
+{
+    return STREQ(namea, nameb);
+}
+
+
+/* Keys are owned by the pairs of the object and outlive their index
+ * entries, so the index uses them as they are. */
+static void *
+virJSONObjectIndexKeyCopy(const void *name)
+{
+    return (void *) name;
+}
+
+
+static char *
+virJSONObjectIndexKeyPrintHuman(const void *name)
+{
+    return g_strdup(name);
+}
+
+
+/**
+ * virJSONValueObjectUpdateIndex:
+ * @object: JSON object
+ * @key: key of the member just added to @object, owned by @object
+ * @value: value of the member just added to @object
+ *
+ * Adds the new member to the key index of @object, building the index
+ * first if @object just grew large enough to benefit from it. Objects
+ * whose index can't be built are looked up by iterating over them.
+ */
+static void
+virJSONValueObjectUpdateIndex(virJSONValuePtr object,
+                              const char *key,
+                              virJSONValuePtr value)
+{
+    virJSONObjectPtr obj = &object->data.object;
+    size_t i;
+
+    if (obj->index) {
+        if (virHashAddEntry(obj->index, key, value) < 0) {
+            virHashFree(obj->index);
+            obj->index = NULL;
+        }
+        return;
+    }
+
+    if (obj->npairs < VIR_JSON_OBJECT_INDEX_THRESHOLD)
+        return;
+
+    obj->index = virHashCreateFull(obj->npairs * 2, NULL,
+                                   virJSONObjectIndexKeyCode,
+                                   virJSONObjectIndexKeyEqual,
+                                   virJSONObjectIndexKeyCopy,
+                                   virJSONObjectIndexKeyPrintHuman,
+                                   NULL);
+
+    for (i = 0; i < obj->npairs; i++) {
+        if (virHashAddEntry(obj->index, obj->pairs[i].key,
+                            obj->pairs[i].value) < 0) {
+            /* can't happen as keys are unique */
+            virHashFree(obj->index);
+            obj->index = NULL;
+            break;
+        }
+    }
+}
+
+
 static int
 virJSONValueObjectInsert(virJSONValuePtr object,
                          const char *key,
@@ -609,6 +737,14 @@ virJSONValueObjectInsert(virJSONValuePtr object,
                                  object->data.object.npairs, pair);
     }
 
+    if (ret == 0) {
+        size_t idx = prepend ? 0 : object->data.object.npairs - 1;
+
+        virJSONValueObjectUpdateIndex(object,
+                                      object->data.object.pairs[idx].key,
+                                      value);
+    }
+
     VIR_FREE(pair.key);
     return ret;
 }
@@ -839,11 +975,15 @@ int
 virJSONValueObjectHasKey(virJSONValuePtr object,
                          const char *key)
 {
+    virHashTablePtr index;
     size_t i;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
+    if ((index = object->data.object.index))
+        return virHashHasEntry(index, key) ? 1 : 0;
+
     for (i = 0; i < object->data.object.npairs; i++) {
         if (STREQ(object->data.object.pairs[i].key, key))
             return 1;
@@ -857,11 +997,15 @@ virJSONValuePtr
 virJSONValueObjectGet(virJSONValuePtr object,
                       const char *key)
 {
+    virHashTablePtr index;
     size_t i;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
+    if ((index = object->data.object.index))
+        return virHashLookup(index, key);
+
     for (i = 0; i < object->data.object.npairs; i++) {
         if (STREQ(object->data.object.pairs[i].key, key))
             return object->data.object.pairs[i].value;
@@ -884,6 +1028,8 @@ virJSONValueObjectSteal(virJSONValuePtr object,
     for (i = 0; i < object->data.object.npairs; i++) {
         if (STREQ(object->data.object.pairs[i].key, key)) {
             obj = g_steal_pointer(&object->data.object.pairs[i].value);
+            if (object->data.object.index)
+                virHashRemoveEntry(object->data.object.index, key);
             VIR_FREE(object->data.object.pairs[i].key);
             VIR_DELETE_ELEMENT(object->data.object.pairs, i,
                                object->data.object.npairs);
@@ -971,6 +1117,8 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
                 *value = object->data.object.pairs[i].value;
                 object->data.object.pairs[i].value = NULL;
             }
+            if (object->data.object.index)
+                virHashRemoveEntry(object->data.object.index, key);
             VIR_FREE(object->data.object.pairs[i].key);
             virJSONValueFree(object->data.object.pairs[i].value);
             VIR_DELETE_ELEMENT(object->data.object.pairs, i,
@@ -1598,14 +1746,123 @@ virJSONParserInsertValue(virJSONParserPtr parser,
 }
 
 
+/*
+ * Called whenever a value was finished. If it was a top level value
+ * of a stream, it is queued for virJSONStreamParserNext.
+ */
+static int
+virJSONParserValueDone(virJSONParserPtr parser)
+{
+    virJSONStreamParserPtr stream = parser->stream;
+    virJSONStreamParserValue value;
+    size_t end;
+
+    if (!stream || parser->nstate != 0)
+        return 1;
+
+    end = stream->fed + yajl_get_bytes_consumed(stream->hand);
+
+    value.value = g_steal_pointer(&parser->head);
+    value.len = end - stream->end;
+    stream->end = end;
+
+    if (VIR_APPEND_ELEMENT(stream->values, stream->nvalues, value) < 0) {
+        virJSONValueFree(value.value);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Inserts @placeholder into the parsed value in place of the value
+ * passed to the sink.
+ */
+static int
+virJSONParserSinkPlaceholder(virJSONParserPtr parser,
+                             virJSONValuePtr placeholder)
+{
+    if (virJSONParserInsertValue(parser, placeholder) < 0) {
+        virJSONValueFree(placeholder);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static int
+virJSONParserSinkScalar(virJSONParserPtr parser,
+                        virJSONType type,
+                        const char *value,
+                        size_t len)
+{
+    if (parser->sinkActive)
+        parser->sinkActive->scalar(parser->sinkActiveOpaque, type, value, len);
+
+    if (parser->sinkDepth > 0)
+        return 1;
+
+    parser->sinking = false;
+    parser->sinkActive = NULL;
+    return virJSONParserSinkPlaceholder(parser, virJSONValueNewNull());
+}
+
+
+static int
+virJSONParserSinkStart(virJSONParserPtr parser,
+                       bool array)
+{
+    if (parser->sinkActive) {
+        if (array)
+            parser->sinkActive->startArray(parser->sinkActiveOpaque);
+        else
+            parser->sinkActive->startObject(parser->sinkActiveOpaque);
+    }
+
+    if (parser->sinkDepth++ > 0)
+        return 1;
+
+    return virJSONParserSinkPlaceholder(parser,
+                                        array ? virJSONValueNewArray() :
+                                                virJSONValueNewObject());
+}
+
+
+static int
+virJSONParserSinkEnd(virJSONParserPtr parser,
+                     bool array)
+{
+    if (parser->sinkActive) {
+        if (array)
+            parser->sinkActive->endArray(parser->sinkActiveOpaque);
+        else
+            parser->sinkActive->endObject(parser->sinkActiveOpaque);
+    }
+
+    if (--parser->sinkDepth == 0) {
+        parser->sinking = false;
+        parser->sinkActive = NULL;
+    }
+
+    return 1;
+}
+
+
 static int
 virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->sinking)
+        return virJSONParserSinkScalar(parser, VIR_JSON_TYPE_NULL, NULL, 0);
+
+    value = virJSONValueNewNull();
+
     if (!value)
         return 0;
 
@@ -1614,7 +1871,7 @@ virJSONParserHandleNull(void *ctx)
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1623,10 +1880,17 @@ virJSONParserHandleBoolean(void *ctx,
                            int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
+    if (parser->sinking)
+        return virJSONParserSinkScalar(parser, VIR_JSON_TYPE_BOOLEAN,
+                                       boolean_ ? "true" : "false",
+                                       boolean_ ? 4 : 5);
+
+    value = virJSONValueNewBoolean(boolean_);
+
     if (!value)
         return 0;
 
@@ -1635,7 +1899,7 @@ virJSONParserHandleBoolean(void *ctx,
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1648,6 +1912,9 @@ virJSONParserHandleNumber(void *ctx,
     char *str;
     virJSONValuePtr value;
 
+    if (parser->sinking)
+        return virJSONParserSinkScalar(parser, VIR_JSON_TYPE_NUMBER, s, l);
+
     str = g_strndup(s, l);
     value = virJSONValueNewNumber(str);
     VIR_FREE(str);
@@ -1662,7 +1929,7 @@ virJSONParserHandleNumber(void *ctx,
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1672,11 +1939,16 @@ virJSONParserHandleString(void *ctx,
                           size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
+    if (parser->sinking)
+        return virJSONParserSinkScalar(parser, VIR_JSON_TYPE_STRING,
+                                       (const char *)stringVal, stringLen);
+
+    value = virJSONValueNewStringLen((const char *)stringVal, stringLen);
+
     if (!value)
         return 0;
 
@@ -1685,7 +1957,7 @@ virJSONParserHandleString(void *ctx,
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1699,6 +1971,13 @@ virJSONParserHandleMapKey(void *ctx,
 
     VIR_DEBUG("parser=%p key=%p", parser, (const char *)stringVal);
 
+    if (parser->sinking) {
+        if (parser->sinkActive)
+            parser->sinkActive->key(parser->sinkActiveOpaque,
+                                    (const char *)stringVal, stringLen);
+        return 1;
+    }
+
     if (!parser->nstate)
         return 0;
 
@@ -1706,6 +1985,18 @@ virJSONParserHandleMapKey(void *ctx,
     if (state->key)
         return 0;
     state->key = g_strndup((const char *)stringVal, stringLen);
+
+    if (parser->sink && parser->nstate == 1 &&
+        STREQ(state->key, parser->sinkKey)) {
+        parser->sinking = true;
+        parser->sinkDepth = 0;
+        parser->sinkActive = parser->sink;
+        parser->sinkActiveOpaque = parser->sinkOpaque;
+        parser->sinkKey = NULL;
+        parser->sink = NULL;
+        parser->sinkOpaque = NULL;
+    }
+
     return 1;
 }
 
@@ -1714,10 +2005,15 @@ static int
 virJSONParserHandleStartMap(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->sinking)
+        return virJSONParserSinkStart(parser, false);
+
+    value = virJSONValueNewObject();
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
         return 0;
@@ -1744,6 +2040,9 @@ virJSONParserHandleEndMap(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->sinking)
+        return virJSONParserSinkEnd(parser, false);
+
     if (!parser->nstate)
         return 0;
 
@@ -1755,7 +2054,7 @@ virJSONParserHandleEndMap(void *ctx)
 
     VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1763,10 +2062,15 @@ static int
 virJSONParserHandleStartArray(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->sinking)
+        return virJSONParserSinkStart(parser, true);
+
+    value = virJSONValueNewArray();
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
         return 0;
@@ -1792,6 +2096,9 @@ virJSONParserHandleEndArray(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (parser->sinking)
+        return virJSONParserSinkEnd(parser, true);
+
     if (!(parser->nstate - parser->wrap))
         return 0;
 
@@ -1803,7 +2110,7 @@ virJSONParserHandleEndArray(void *ctx)
 
     VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1822,7 +2129,6 @@ static const yajl_callbacks parserCallbacks = {
 };
 
 
-/* XXX add an incremental streaming parser - yajl trivially supports it */
 virJSONValuePtr
 virJSONValueFromString(const char *jsonstring)
 {
@@ -1882,6 +2188,164 @@ virJSONValueFromString(const char *jsonstring)
 }
 
 
+/**
+ * virJSONStreamParserNew:
+ *
+ * Creates a parser for a stream of JSON values which may be split
+ * arbitrarily into chunks, such as QMP replies and events read from
+ * the QEMU monitor socket. Unlike virJSONValueFromString, the data
+ * doesn't need to be accumulated first and is parsed only once.
+ *
+ * Returns the parser or NULL on error.
+ */
+virJSONStreamParserPtr
+virJSONStreamParserNew(void)
+{
+    virJSONStreamParserPtr stream = g_new0(virJSONStreamParser, 1);
+
+    stream->parser.stream = stream;
+
+    if (!(stream->hand = yajl_alloc(&parserCallbacks, NULL, &stream->parser))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to create JSON parser"));
+        g_free(stream);
+        return NULL;
+    }
+
+    yajl_config(stream->hand, yajl_allow_multiple_values, 1);
+
+    return stream;
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParserPtr stream)
+{
+    size_t i;
+
+    if (!stream)
+        return;
+
+    yajl_free(stream->hand);
+
+    virJSONValueFree(stream->parser.head);
+    for (i = 0; i < stream->parser.nstate; i++)
+        g_free(stream->parser.state[i].key);
+    g_free(stream->parser.state);
+
+    for (i = stream->valuesHead; i < stream->nvalues; i++)
+        virJSONValueFree(stream->values[i].value);
+    g_free(stream->values);
+
+    g_free(stream);
+}
+
+
+/**
+ * virJSONStreamParserFeed:
+ * @stream: stream parser
+ * @data: next chunk of the stream
+ * @len: length of @data
+ *
+ * Parses @data which continues where the previous chunk ended. Values
+ * completed by @data can be retrieved using virJSONStreamParserNext.
+ * The parser can't be used anymore after an error.
+ *
+ * Returns 0 on success, -1 on error (with error reported).
+ */
+int
+virJSONStreamParserFeed(virJSONStreamParserPtr stream,
+                        const char *data,
+                        size_t len)
+{
+    if (yajl_parse(stream->hand, (const unsigned char *)data, len) != yajl_status_ok) {
+        unsigned char *errstr = yajl_get_error(stream->hand, 1,
+                                               (const unsigned char *)data,
+                                               len);
+
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse json %.*s: %s"),
+                       (int) len, data, (const char *) errstr);
+        yajl_free_error(stream->hand, errstr);
+        return -1;
+    }
+
+    stream->fed += len;
+    return 0;
+}
+
+
+/**
+ * virJSONStreamParserSetSink:
+ * @stream: stream parser
+ * @key: name of the member to decode using @sink
+ * @sink: callbacks to pass the member to or NULL to stop using them
+ * @opaque: data passed to @sink
+ *
+ * Makes the parser pass the member @key of the next top level object
+ * which has such member to @sink piece by piece instead of building
+ * a virJSONValue out of it. This allows decoding large values directly
+ * into the structures they are needed in. The parsed object holds an
+ * empty array, empty object or null in place of the member depending
+ * on its type. @key must stay valid until the member is parsed or the
+ * sink is removed.
+ *
+ * Passing NULL @sink removes the sink even if it is in the middle of
+ * a member, the rest of which is then skipped without being passed to
+ * any sink set in the meantime.
+ */
+void
+virJSONStreamParserSetSink(virJSONStreamParserPtr stream,
+                           const char *key,
+                           const virJSONSAXCallbacks *sink,
+                           void *opaque)
+{
+    virJSONParserPtr parser = &stream->parser;
+
+    if (!sink) {
+        key = NULL;
+        opaque = NULL;
+        parser->sinkActive = NULL;
+        parser->sinkActiveOpaque = NULL;
+    }
+
+    parser->sinkKey = key;
+    parser->sink = sink;
+    parser->sinkOpaque = opaque;
+}
+
+
+/**
+ * virJSONStreamParserNext:
+ * @stream: stream parser
+ * @len: filled with length of the value in the stream
+ *
+ * Retrieves the next value completed by virJSONStreamParserFeed in the
+ * order they appeared in the stream. @len is filled with the number of
+ * bytes from the end of the previous value to the end of the returned
+ * one, which includes any whitespace separating the two.
+ *
+ * Returns the value which the caller has to free, or NULL if there is
+ * no complete value.
+ */
+virJSONValuePtr
+virJSONStreamParserNext(virJSONStreamParserPtr stream,
+                        size_t *len)
+{
+    virJSONStreamParserValuePtr value;
+
+    if (stream->valuesHead == stream->nvalues) {
+        VIR_FREE(stream->values);
+        stream->nvalues = stream->valuesHead = 0;
+        return NULL;
+    }
+
+    value = &stream->values[stream->valuesHead++];
+    *len = value->len;
+    return g_steal_pointer(&value->value);
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
@@ -1999,6 +2463,49 @@ virJSONValueFromString(const char *jsonstring G_GNUC_UNUSED)
 }
 
 
+virJSONStreamParserPtr
+virJSONStreamParserNew(void)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParserPtr stream G_GNUC_UNUSED)
+{
+}
+
+
+int
+virJSONStreamParserFeed(virJSONStreamParserPtr stream G_GNUC_UNUSED,
+                        const char *data G_GNUC_UNUSED,
+                        size_t len G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+
+
+void
+virJSONStreamParserSetSink(virJSONStreamParserPtr stream G_GNUC_UNUSED,
+                           const char *key G_GNUC_UNUSED,
+                           const virJSONSAXCallbacks *sink G_GNUC_UNUSED,
+                           void *opaque G_GNUC_UNUSED)
+{
+}
+
+
+virJSONValuePtr
+virJSONStreamParserNext(virJSONStreamParserPtr stream G_GNUC_UNUSED,
+                        size_t *len G_GNUC_UNUSED)
+{
+    return NULL;
+}
+
+
 int
 virJSONValueToBuffer(virJSONValuePtr object G_GNUC_UNUSED,
                      virBufferPtr buf G_GNUC_UNUSED,
@@ -2171,6 +2678,8 @@ virJSONValueObjectDeflattenArrays(virJSONValuePtr json)
         arraymembers[keynum] = pair->value;
     }
 
+    virHashFree(json->data.object.index);
+
     for (i = 0; i < obj->npairs; i++)
         g_free(obj->pairs[i].key);
 
@@ -143,6 +143,38 @@ int virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
 int virJSONValueArrayAppendString(virJSONValuePtr object, const char *value);
 
 virJSONValuePtr virJSONValueFromString(const char *jsonstring);
+
+typedef struct _virJSONStreamParser virJSONStreamParser;
+typedef virJSONStreamParser *virJSONStreamParserPtr;
+
+virJSONStreamParserPtr virJSONStreamParserNew(void);
+void virJSONStreamParserFree(virJSONStreamParserPtr stream);
+int virJSONStreamParserFeed(virJSONStreamParserPtr stream,
+                            const char *data,
+                            size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+virJSONValuePtr virJSONStreamParserNext(virJSONStreamParserPtr stream,
+                                        size_t *len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+/* Callbacks receiving a value piece by piece as it's parsed. Strings
+ * and numbers are not NUL terminated, null is passed as NULL. */
+typedef struct _virJSONSAXCallbacks virJSONSAXCallbacks;
+struct _virJSONSAXCallbacks {
+    void (*startObject)(void *opaque);
+    void (*key)(void *opaque, const char *key, size_t len);
+    void (*endObject)(void *opaque);
+    void (*startArray)(void *opaque);
+    void (*endArray)(void *opaque);
+    void (*scalar)(void *opaque, virJSONType type,
+                   const char *value, size_t len);
+};
+
+void virJSONStreamParserSetSink(virJSONStreamParserPtr stream,
+                                const char *key,
+                                const virJSONSAXCallbacks *sink,
+                                void *opaque)
+    ATTRIBUTE_NONNULL(1);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
 int virJSONValueToBuffer(virJSONValuePtr object,
@@ -165,3 +197,4 @@ char *virJSONStringReformat(const char *jsonstr, bool pretty);
 virJSONValuePtr virJSONValueObjectDeflatten(virJSONValuePtr json);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virJSONValue, virJSONValueFree);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virJSONStreamParser, virJSONStreamParserFree);
@@ -0,0 +1,83 @@
+/*
+ * virlatency.c: histograms of latencies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virlatency.h"
+
+
+/**
+ * virLatencyBucket:
+ * @usecs: latency in microseconds
+ *
+ * Returns the index of the histogram bucket @usecs falls into.
+ */
+size_t
+virLatencyBucket(unsigned long long usecs)
+{
+    size_t bucket = 0;
+
+    while (usecs && bucket < VIR_LATENCY_BUCKETS - 1) {
+        usecs >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+
+/**
+ * virLatencyPercentile:
+ * @buckets: histogram of latencies
+ * @nbuckets: number of @buckets
+ * @count: number of events counted in @buckets
+ * @percent: the percentile to compute
+ *
+ * Finds the bucket in which the @percent percentile of @count events
+ * lies. @count should equal the sum of @buckets, it's passed separately
+ * as callers keep it next to the histogram anyway. If it is lower, the
+ * events beyond @count are ignored.
+ *
+ * Returns the upper bound of the bucket in microseconds, or 0 if there
+ * are no events or the percentile falls into bucket 0.
+ */
+unsigned long long
+virLatencyPercentile(const unsigned long long *buckets,
+                     size_t nbuckets,
+                     unsigned long long count,
+                     unsigned int percent)
+{
+    unsigned long long seen = 0;
+    unsigned long long want;
+    size_t i;
+
+    if (count == 0)
+        return 0;
+
+    /* @percent percent of @count rounded up, without overflowing */
+    want = count / 100 * percent + (count % 100 * percent + 99) / 100;
+
+    for (i = 0; i < MIN(nbuckets, VIR_LATENCY_BUCKETS); i++) {
+        seen += buckets[i];
+
+        if (seen >= want)
+            return i == 0 ? 0 : 1ULL << i;
+    }
+
+    return 0;
+}
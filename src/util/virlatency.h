@@ -0,0 +1,35 @@
+/*
+ * virlatency.h: histograms of latencies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+
+/* Latencies are recorded in log2 microsecond buckets: bucket 0 counts
+ * events which took no measurable time, bucket N (N > 0) counts events
+ * which took at least 2^(N-1) and less than 2^N microseconds. The last
+ * bucket also counts everything slower than that. */
+#define VIR_LATENCY_BUCKETS 28
+
+size_t virLatencyBucket(unsigned long long usecs);
+
+unsigned long long virLatencyPercentile(const unsigned long long *buckets,
+                                        size_t nbuckets,
+                                        unsigned long long count,
+                                        unsigned int percent)
+    ATTRIBUTE_NONNULL(1);
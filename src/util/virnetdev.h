@@ -199,7 +199,7 @@ int virNetDevSetName(const char *ifname, const char *newifname)
 char *virNetDevGetName(int ifindex)
     G_GNUC_WARN_UNUSED_RESULT;
 int virNetDevGetIndex(const char *ifname, int *ifindex)
-    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT G_GNUC_NO_INLINE;
 
 int virNetDevGetVLanID(const char *ifname, int *vlanid)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
@@ -209,7 +209,7 @@ int virNetDevGetMaster(const char *ifname, char **master)
 
 int virNetDevValidateConfig(const char *ifname,
                             const virMacAddr *macaddr, int ifindex)
-    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT G_GNUC_NO_INLINE;
 
 int virNetDevIsVirtualFunction(const char *ifname)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
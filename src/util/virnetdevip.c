@@ -1058,6 +1058,39 @@ virNetDevIPInfoClear(virNetDevIPInfoPtr ip)
     ip->nroutes = 0;
 }
 
+/**
+ * virNetDevIPInfoCopy:
+ * @dst: destination object, assumed to be empty
+ * @src: source object
+ *
+ * Deep copies all IP addresses and routes from @src into @dst.
+ */
+void
+virNetDevIPInfoCopy(virNetDevIPInfoPtr dst,
+                    const virNetDevIPInfo *src)
+{
+    size_t i;
+
+    if (src->nips) {
+        dst->ips = g_new0(virNetDevIPAddrPtr, src->nips);
+        dst->nips = src->nips;
+        for (i = 0; i < src->nips; i++) {
+            dst->ips[i] = g_new0(virNetDevIPAddr, 1);
+            *dst->ips[i] = *src->ips[i];
+        }
+    }
+
+    if (src->nroutes) {
+        dst->routes = g_new0(virNetDevIPRoutePtr, src->nroutes);
+        dst->nroutes = src->nroutes;
+        for (i = 0; i < src->nroutes; i++) {
+            dst->routes[i] = g_new0(virNetDevIPRoute, 1);
+            *dst->routes[i] = *src->routes[i];
+            dst->routes[i]->family = g_strdup(src->routes[i]->family);
+        }
+    }
+}
+
 
 /**
  * virNetDevIPInfoAddToDev:
@@ -23,7 +23,9 @@
 
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <gio/gio.h>
 
 #include "virrotatingfile.h"
 #include "viralloc.h"
@@ -31,6 +33,8 @@
 #include "virstring.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virthread.h"
+#include "virhash.h"
 
 VIR_LOG_INIT("util.rotatingfile");
 
@@ -38,6 +42,16 @@ VIR_LOG_INIT("util.rotatingfile");
 
 #define VIR_MAX_MAX_BACKUP 32
 
+/* Suffix of backup files compressed after rollover */
+#define VIR_ROTATING_FILE_COMPRESSED_SUFFIX ".gz"
+
+/* Chunk size used when (de)compressing backup files */
+#define VIR_ROTATING_FILE_CONVERT_CHUNK (64 * 1024)
+
+/* Upper bound for the size of a compressed backup the reader is
+ * willing to load */
+#define VIR_ROTATING_FILE_MAX_COMPRESSED (64 * 1024 * 1024)
+
 typedef struct virRotatingFileWriterEntry virRotatingFileWriterEntry;
 typedef virRotatingFileWriterEntry *virRotatingFileWriterEntryPtr;
 
@@ -57,6 +71,13 @@ struct virRotatingFileWriter {
     size_t maxbackup;
     mode_t mode;
     size_t maxlen;
+
+    /* data appended, but not yet written to entry->fd */
+    char *buf;
+    size_t bufsize;
+    size_t buflen;
+
+    bool compress;
 };
 
 
@@ -64,6 +85,12 @@ struct virRotatingFileReaderEntry {
     char *path;
     int fd;
     off_t inode;
+
+    /* gzip compressed backup, decompressed on first access */
+    bool compressed;
+    char *data;
+    size_t datalen;
+    size_t datapos;
 };
 
 struct virRotatingFileReader {
@@ -91,11 +118,297 @@ virRotatingFileReaderEntryFree(virRotatingFileReaderEntryPtr entry)
         return;
 
     VIR_FREE(entry->path);
+    VIR_FREE(entry->data);
     VIR_FORCE_CLOSE(entry->fd);
     VIR_FREE(entry);
 }
 
 
+/*
+ * Feeds @inlen bytes from @in through @conv. The output is written to
+ * @fd if it is not -1, otherwise it is appended to @out / @outlen.
+ * @last must be set for the final chunk of input.
+ */
+static int
+virRotatingFileConvert(GConverter *conv,
+                       const char *in,
+                       size_t inlen,
+                       bool last,
+                       int fd,
+                       char **out,
+                       size_t *outlen)
+{
+    char buf[VIR_ROTATING_FILE_CONVERT_CHUNK];
+
+    while (inlen > 0 || last) {
+        g_autoptr(GError) err = NULL;
+        GConverterResult res;
+        gsize nread = 0;
+        gsize nwritten = 0;
+
+        res = g_converter_convert(conv, in, inlen, buf, sizeof(buf),
+                                  last ? G_CONVERTER_INPUT_AT_END :
+                                         G_CONVERTER_NO_FLAGS,
+                                  &nread, &nwritten, &err);
+        if (res == G_CONVERTER_ERROR) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to convert log data: %s"),
+                           err ? err->message : _("unknown error"));
+            return -1;
+        }
+
+        if (fd != -1) {
+            if (safewrite(fd, buf, nwritten) != nwritten) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to write compressed log"));
+                return -1;
+            }
+        } else if (nwritten > 0) {
+            if (VIR_REALLOC_N(*out, *outlen + nwritten) < 0)
+                return -1;
+            memcpy(*out + *outlen, buf, nwritten);
+            *outlen += nwritten;
+        }
+
+        in += nread;
+        inlen -= nread;
+
+        if (res == G_CONVERTER_FINISHED)
+            break;
+    }
+
+    return 0;
+}
+
+
+/* Writes a gzip compressed copy of @path, opened as @in, to @dst */
+static int
+virRotatingFileCompress(int in,
+                        const char *path,
+                        const char *dst,
+                        mode_t mode)
+{
+    g_autoptr(GZlibCompressor) conv = NULL;
+    g_autofree char *buf = g_new0(char, VIR_ROTATING_FILE_CONVERT_CHUNK);
+    VIR_AUTOCLOSE out = -1;
+    ssize_t got;
+
+    if ((out = open(dst, O_CREAT|O_TRUNC|O_WRONLY|O_CLOEXEC, mode)) < 0) {
+        virReportSystemError(errno, _("Unable to open file: %s"), dst);
+        return -1;
+    }
+
+    conv = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+
+    do {
+        if ((got = saferead(in, buf, VIR_ROTATING_FILE_CONVERT_CHUNK)) < 0) {
+            virReportSystemError(errno, _("Unable to read from file %s"), path);
+            goto error;
+        }
+
+        if (virRotatingFileConvert(G_CONVERTER(conv), buf, got, got == 0,
+                                   out, NULL, NULL) < 0)
+            goto error;
+    } while (got > 0);
+
+    if (VIR_CLOSE(out) < 0) {
+        virReportSystemError(errno, _("Unable to close file %s"), dst);
+        goto error;
+    }
+
+    return 0;
+
+ error:
+    unlink(dst);
+    return -1;
+}
+
+
+/*
+ * Compression jobs, indexed by the path of the file whose backups they
+ * compress. A job keeps compressing uncompressed backups of its file
+ * until there are none left, so backups created by a rollover while it
+ * runs are picked up too. The threads are detached and may outlive the
+ * writer which started them, so the table is global and a writer reopened
+ * for the same file finds the job of its predecessor. Backups are only
+ * renamed or deleted with @virRotatingFileCompressLock held.
+ */
+static virMutex virRotatingFileCompressLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virRotatingFileCompressJobs;
+
+typedef struct _virRotatingFileCompressJob virRotatingFileCompressJob;
+typedef virRotatingFileCompressJob *virRotatingFileCompressJobPtr;
+struct _virRotatingFileCompressJob {
+    char *basepath;
+    size_t maxbackup;
+    mode_t mode;
+
+    /* number of the backup being compressed, follows its rollovers */
+    size_t backup;
+    /* the backup being compressed was deleted */
+    bool stale;
+};
+
+
+static void
+virRotatingFileCompressJobFree(void *opaque)
+{
+    virRotatingFileCompressJobPtr job = opaque;
+
+    VIR_FREE(job->basepath);
+    VIR_FREE(job);
+}
+
+
+/* Picks the newest uncompressed backup as the next one to compress.
+ * Must be called with @virRotatingFileCompressLock held. */
+static bool
+virRotatingFileCompressJobNext(virRotatingFileCompressJobPtr job)
+{
+    size_t i;
+
+    for (i = 0; i < job->maxbackup; i++) {
+        g_autofree char *path = g_strdup_printf("%s.%zu", job->basepath, i);
+
+        if (virFileExists(path)) {
+            job->backup = i;
+            job->stale = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/* Replaces uncompressed backups by compressed copies with a ".gz"
+ * suffix until there are none left */
+static void
+virRotatingFileCompressWorker(void *opaque)
+{
+    virRotatingFileCompressJobPtr job = opaque;
+
+    virMutexLock(&virRotatingFileCompressLock);
+
+    while (virRotatingFileCompressJobNext(job)) {
+        g_autofree char *path = g_strdup_printf("%s.%zu",
+                                                job->basepath, job->backup);
+        g_autofree char *tmp = g_strdup_printf("%s%s.tmp", path,
+                                               VIR_ROTATING_FILE_COMPRESSED_SUFFIX);
+        g_autofree char *dst = NULL;
+        VIR_AUTOCLOSE fd = -1;
+        int rc;
+
+        /* open it before a rollover can put another file at @path */
+        if ((fd = open(path, O_RDONLY|O_CLOEXEC)) < 0) {
+            VIR_WARN("Unable to open file %s: %s", path, g_strerror(errno));
+            break;
+        }
+
+        virMutexUnlock(&virRotatingFileCompressLock);
+        rc = virRotatingFileCompress(fd, path, tmp, job->mode);
+        virMutexLock(&virRotatingFileCompressLock);
+
+        if (rc < 0) {
+            VIR_WARN("Unable to compress %s: %s",
+                     path, virGetLastErrorMessage());
+            break;
+        }
+
+        if (job->stale) {
+            VIR_DEBUG("Dropping compressed copy of deleted %s", path);
+            unlink(tmp);
+            continue;
+        }
+
+        /* the backup may have been rolled over meanwhile */
+        g_free(path);
+        path = g_strdup_printf("%s.%zu", job->basepath, job->backup);
+        dst = g_strdup_printf("%s%s", path, VIR_ROTATING_FILE_COMPRESSED_SUFFIX);
+
+        if (rename(tmp, dst) < 0) {
+            VIR_WARN("Unable to rename %s to %s: %s",
+                     tmp, dst, g_strerror(errno));
+            unlink(tmp);
+            break;
+        }
+
+        if (unlink(path) < 0) {
+            VIR_WARN("Unable to delete file %s: %s", path, g_strerror(errno));
+            break;
+        }
+    }
+
+    virHashRemoveEntry(virRotatingFileCompressJobs, job->basepath);
+
+    virMutexUnlock(&virRotatingFileCompressLock);
+}
+
+
+/* Starts compressing the uncompressed backups of @file in the background
+ * unless it's being done already. Must be called with
+ * @virRotatingFileCompressLock held. */
+static void
+virRotatingFileWriterCompressStart(virRotatingFileWriterPtr file)
+{
+    virRotatingFileCompressJobPtr job = NULL;
+    virThread thread;
+
+    if (virRotatingFileCompressJobs &&
+        virHashLookup(virRotatingFileCompressJobs, file->basepath))
+        return;
+
+    job = g_new0(virRotatingFileCompressJob, 1);
+    job->basepath = g_strdup(file->basepath);
+    job->maxbackup = file->maxbackup;
+    job->mode = file->mode;
+
+    if (!virRotatingFileCompressJobNext(job)) {
+        virRotatingFileCompressJobFree(job);
+        return;
+    }
+
+    if (!virRotatingFileCompressJobs &&
+        !(virRotatingFileCompressJobs = virHashNew(virRotatingFileCompressJobFree)))
+        goto error;
+
+    if (virHashAddEntry(virRotatingFileCompressJobs, job->basepath, job) < 0)
+        goto error;
+
+    if (virThreadCreateFull(&thread, false,
+                            virRotatingFileCompressWorker,
+                            "log-compress", false, job) < 0) {
+        virHashRemoveEntry(virRotatingFileCompressJobs, file->basepath);
+        VIR_WARN("Unable to start compression of %s backups", file->basepath);
+    }
+
+    return;
+
+ error:
+    VIR_WARN("Unable to start compression of %s backups: %s",
+             file->basepath, virGetLastErrorMessage());
+    virRotatingFileCompressJobFree(job);
+}
+
+
+/* Removes partial compressed copies left behind by a previous instance
+ * of the daemon. Must be called with @virRotatingFileCompressLock held
+ * and no job running for @file. */
+static void
+virRotatingFileWriterCompressCleanup(virRotatingFileWriterPtr file)
+{
+    size_t i;
+
+    for (i = 0; i < file->maxbackup; i++) {
+        g_autofree char *tmp = g_strdup_printf("%s.%zu%s.tmp", file->basepath, i,
+                                               VIR_ROTATING_FILE_COMPRESSED_SUFFIX);
+
+        if (unlink(tmp) < 0 && errno != ENOENT)
+            VIR_WARN("Unable to delete file %s: %s", tmp, g_strerror(errno));
+    }
+}
+
+
 static virRotatingFileWriterEntryPtr
 virRotatingFileWriterEntryNew(const char *path,
                               mode_t mode)
@@ -140,8 +453,13 @@ virRotatingFileWriterEntryNew(const char *path,
 }
 
 
+/*
+ * Opens @path for reading. If @compressed is true and @path does not
+ * exist, its gzip compressed variant is used instead.
+ */
 static virRotatingFileReaderEntryPtr
-virRotatingFileReaderEntryNew(const char *path)
+virRotatingFileReaderEntryNew(const char *path,
+                              bool compressed)
 {
     virRotatingFileReaderEntryPtr entry;
     struct stat sb;
@@ -157,6 +475,21 @@ virRotatingFileReaderEntryNew(const char *path)
                                  _("Unable to open file: %s"), path);
             goto error;
         }
+
+        if (compressed) {
+            g_autofree char *gzpath = g_strdup_printf("%s%s", path,
+                                                      VIR_ROTATING_FILE_COMPRESSED_SUFFIX);
+
+            if ((entry->fd = open(gzpath, O_RDONLY|O_CLOEXEC)) < 0) {
+                if (errno != ENOENT) {
+                    virReportSystemError(errno,
+                                         _("Unable to open file: %s"), gzpath);
+                    goto error;
+                }
+            } else {
+                entry->compressed = true;
+            }
+        }
     }
 
     if (entry->fd != -1) {
@@ -180,8 +513,43 @@ virRotatingFileReaderEntryNew(const char *path)
 }
 
 
+/* Loads the decompressed content of a compressed @entry */
 static int
-virRotatingFileWriterDelete(virRotatingFileWriterPtr file)
+virRotatingFileReaderEntryLoad(virRotatingFileReaderEntryPtr entry)
+{
+    g_autoptr(GZlibDecompressor) conv = NULL;
+    g_autofree char *raw = NULL;
+    int rawlen;
+
+    if (!entry->compressed || entry->data)
+        return 0;
+
+    if ((rawlen = virFileReadLimFD(entry->fd, VIR_ROTATING_FILE_MAX_COMPRESSED,
+                                   &raw)) < 0) {
+        virReportSystemError(errno, _("Unable to read from file %s"),
+                             entry->path);
+        return -1;
+    }
+
+    conv = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+
+    /* make sure empty files still count as loaded */
+    entry->data = g_new0(char, 1);
+    entry->datalen = 0;
+
+    if (virRotatingFileConvert(G_CONVERTER(conv), raw, rawlen, true,
+                               -1, &entry->data, &entry->datalen) < 0) {
+        VIR_FREE(entry->data);
+        entry->datalen = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virRotatingFileWriterDeleteLocked(virRotatingFileWriterPtr file)
 {
     size_t i;
 
@@ -194,24 +562,54 @@ virRotatingFileWriterDelete(virRotatingFileWriterPtr file)
     }
 
     for (i = 0; i < file->maxbackup; i++) {
-        char *oldpath;
+        g_autofree char *oldpath = NULL;
+        g_autofree char *gzpath = NULL;
+
         oldpath = g_strdup_printf("%s.%zu", file->basepath, i);
+        gzpath = g_strdup_printf("%s%s", oldpath,
+                                 VIR_ROTATING_FILE_COMPRESSED_SUFFIX);
 
         if (unlink(oldpath) < 0 &&
             errno != ENOENT) {
             virReportSystemError(errno,
                                  _("Unable to delete file %s"),
                                  oldpath);
-            VIR_FREE(oldpath);
             return -1;
         }
-        VIR_FREE(oldpath);
+
+        if (unlink(gzpath) < 0 &&
+            errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to delete file %s"),
+                                 gzpath);
+            return -1;
+        }
     }
 
     return 0;
 }
 
 
+static int
+virRotatingFileWriterDelete(virRotatingFileWriterPtr file)
+{
+    virRotatingFileCompressJobPtr job;
+    int ret;
+
+    virMutexLock(&virRotatingFileCompressLock);
+
+    /* don't let a compressed copy of a deleted backup reappear */
+    if (virRotatingFileCompressJobs &&
+        (job = virHashLookup(virRotatingFileCompressJobs, file->basepath)))
+        job->stale = true;
+
+    ret = virRotatingFileWriterDeleteLocked(file);
+
+    virMutexUnlock(&virRotatingFileCompressLock);
+    return ret;
+}
+
+
 /**
  * virRotatingFileWriterNew
  * @path: the base path for files
@@ -302,14 +700,14 @@ virRotatingFileReaderNew(const char *path,
     if (VIR_ALLOC_N(file->entries, file->nentries) < 0)
         goto error;
 
-    if (!(file->entries[file->nentries - 1] = virRotatingFileReaderEntryNew(path)))
+    if (!(file->entries[file->nentries - 1] = virRotatingFileReaderEntryNew(path, false)))
         goto error;
 
     for (i = 0; i < maxbackup; i++) {
         char *tmppath;
         tmppath = g_strdup_printf("%s.%zu", path, i);
 
-        file->entries[file->nentries - (i + 2)] = virRotatingFileReaderEntryNew(tmppath);
+        file->entries[file->nentries - (i + 2)] = virRotatingFileReaderEntryNew(tmppath, true);
         VIR_FREE(tmppath);
         if (!file->entries[file->nentries - (i + 2)])
             goto error;
@@ -362,15 +760,245 @@ virRotatingFileWriterGetOffset(virRotatingFileWriterPtr file)
 }
 
 
+/**
+ * virRotatingFileWriterSetBufferSize:
+ * @file: the file context
+ * @size: the size of the write buffer in bytes
+ *
+ * Make virRotatingFileWriterAppend collect up to @size bytes in
+ * memory before writing them out, together with the data that did not
+ * fit, in a single system call. The caller is responsible for calling
+ * virRotatingFileWriterFlush periodically. Data is flushed on
+ * rollover and when @file is freed. A @size of zero disables
+ * buffering, which is the default.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int
+virRotatingFileWriterSetBufferSize(virRotatingFileWriterPtr file,
+                                   size_t size)
+{
+    if (virRotatingFileWriterFlush(file) < 0)
+        return -1;
+
+    VIR_FREE(file->buf);
+    file->bufsize = size;
+    if (size > 0)
+        file->buf = g_new0(char, size);
+
+    return 0;
+}
+
+
+/**
+ * virRotatingFileWriterSetCompress:
+ * @file: the file context
+ * @compress: whether to compress backups
+ *
+ * Control whether backup files are gzip compressed after rollover.
+ * Compression happens in a detached background thread, the backup is
+ * renamed to have a ".gz" suffix once done. Backups created while the
+ * thread is busy are compressed after the current one.
+ * virRotatingFileReader reads compressed backups transparently.
+ *
+ * Partial compressed copies left behind by a previous instance of the
+ * daemon are removed. If @compress is true, backups it didn't get to
+ * compress are compressed now.
+ */
+void
+virRotatingFileWriterSetCompress(virRotatingFileWriterPtr file,
+                                 bool compress)
+{
+    file->compress = compress;
+
+    virMutexLock(&virRotatingFileCompressLock);
+
+    if (!virRotatingFileCompressJobs ||
+        !virHashLookup(virRotatingFileCompressJobs, file->basepath)) {
+        virRotatingFileWriterCompressCleanup(file);
+
+        if (compress)
+            virRotatingFileWriterCompressStart(file);
+    }
+
+    virMutexUnlock(&virRotatingFileCompressLock);
+}
+
+
+/**
+ * virRotatingFileWriterGetPending:
+ * @file: the file context
+ *
+ * Return the number of bytes which were appended but are still
+ * waiting in the write buffer
+ */
+size_t
+virRotatingFileWriterGetPending(virRotatingFileWriterPtr file)
+{
+    return file->buflen;
+}
+
+
+/* Like safewrite, but for a vector of buffers */
+static int
+virRotatingFileWritev(int fd,
+                      struct iovec *iov,
+                      int niov)
+{
+    while (niov > 0) {
+        ssize_t n = writev(fd, iov, niov);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        while (niov > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+
+        if (niov > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Queues @len bytes from @buf in the write buffer. If they do not fit,
+ * the buffer and @buf are written out together.
+ */
+static int
+virRotatingFileWriterWrite(virRotatingFileWriterPtr file,
+                           const char *buf,
+                           size_t len)
+{
+    struct iovec iov[2];
+
+    if (file->buflen + len <= file->bufsize) {
+        memcpy(file->buf + file->buflen, buf, len);
+        file->buflen += len;
+        return 0;
+    }
+
+    iov[0].iov_base = file->buf;
+    iov[0].iov_len = file->buflen;
+    iov[1].iov_base = (char *)buf;
+    iov[1].iov_len = len;
+
+    if (virRotatingFileWritev(file->entry->fd, iov, 2) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to write to file %s"),
+                             file->basepath);
+        return -1;
+    }
+
+    file->buflen = 0;
+    return 0;
+}
+
+
+/**
+ * virRotatingFileWriterFlush:
+ * @file: the file context
+ *
+ * Write out any data held in the write buffer
+ *
+ * Returns 0 on success, -1 on error
+ */
+int
+virRotatingFileWriterFlush(virRotatingFileWriterPtr file)
+{
+    if (file->buflen == 0)
+        return 0;
+
+    if (safewrite(file->entry->fd, file->buf, file->buflen) != file->buflen) {
+        virReportSystemError(errno,
+                             _("Unable to write to file %s"),
+                             file->basepath);
+        return -1;
+    }
+
+    file->buflen = 0;
+    return 0;
+}
+
+
+/*
+ * Renames backup @from to @to, whichever of the plain and the compressed
+ * variant exists, and removes the other variant of @to so that it does
+ * not shadow the renamed file.
+ */
+static int
+virRotatingFileWriterRename(const char *from,
+                            const char *to)
+{
+    g_autofree char *gzfrom = g_strdup_printf("%s%s", from,
+                                              VIR_ROTATING_FILE_COMPRESSED_SUFFIX);
+    g_autofree char *gzto = g_strdup_printf("%s%s", to,
+                                            VIR_ROTATING_FILE_COMPRESSED_SUFFIX);
+    struct {
+        const char *from;
+        const char *to;
+        const char *other;
+    } names[] = {
+        { from, to, gzto },
+        { gzfrom, gzto, to },
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(names); i++) {
+        if (rename(names[i].from, names[i].to) < 0) {
+            if (errno == ENOENT)
+                continue;
+
+            virReportSystemError(errno,
+                                 _("Unable to rename %s to %s"),
+                                 names[i].from, names[i].to);
+            return -1;
+        }
+
+        if (unlink(names[i].other) < 0 &&
+            errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to delete file %s"),
+                                 names[i].other);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 static int
 virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
 {
+    virRotatingFileCompressJobPtr job = NULL;
     size_t i;
     char *nextpath = NULL;
     char *thispath = NULL;
     int ret = -1;
 
     VIR_DEBUG("Rollover %s", file->basepath);
+
+    /* The backup being compressed is about to be renamed, its compressed
+     * copy must follow it or be dropped if the backup is deleted */
+    virMutexLock(&virRotatingFileCompressLock);
+    if (virRotatingFileCompressJobs &&
+        (job = virHashLookup(virRotatingFileCompressJobs, file->basepath)) &&
+        !job->stale) {
+        job->maxbackup = file->maxbackup;
+        if (++job->backup >= file->maxbackup)
+            job->stale = true;
+    }
+
     if (file->maxbackup == 0) {
         if (unlink(file->basepath) < 0 &&
             errno != ENOENT) {
@@ -390,23 +1018,23 @@ virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
             }
             VIR_DEBUG("Rollover %s -> %s", thispath, nextpath);
 
-            if (rename(thispath, nextpath) < 0 &&
-                errno != ENOENT) {
-                virReportSystemError(errno,
-                                     _("Unable to rename %s to %s"),
-                                     thispath, nextpath);
+            if (virRotatingFileWriterRename(thispath, nextpath) < 0)
                 goto cleanup;
-            }
 
             VIR_FREE(nextpath);
             nextpath = g_steal_pointer(&thispath);
         }
+
+        /* a running job picks up the new backup by itself */
+        if (file->compress)
+            virRotatingFileWriterCompressStart(file);
     }
 
     VIR_DEBUG("Rollover done %s", file->basepath);
 
     ret = 0;
  cleanup:
+    virMutexUnlock(&virRotatingFileCompressLock);
     VIR_FREE(nextpath);
     VIR_FREE(thispath);
     return ret;
@@ -459,12 +1087,8 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
         }
 
         if (towrite) {
-            if (safewrite(file->entry->fd, buf, towrite) != towrite) {
-                virReportSystemError(errno,
-                                     _("Unable to write to file %s"),
-                                     file->basepath);
+            if (virRotatingFileWriterWrite(file, buf, towrite) < 0)
                 return -1;
-            }
 
             len -= towrite;
             buf += towrite;
@@ -479,6 +1103,9 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
             VIR_DEBUG("Hit max size %zu on %s (force=%d)",
                       file->maxlen, file->basepath, forceRollover);
 
+            if (virRotatingFileWriterFlush(file) < 0)
+                return -1;
+
             if (virRotatingFileWriterRollover(file) < 0)
                 return -1;
 
@@ -505,36 +1132,38 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
  * If no file with a inode matching @inode currently
  * exists, then seeks to the start of the oldest
  * file, on the basis that the requested file has
- * probably been rotated out of existence
+ * probably been rotated out of existence. Note that
+ * compressing a backup gives it a new inode.
  */
 int
 virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
                           ino_t inode,
                           off_t offset)
 {
+    virRotatingFileReaderEntryPtr entry;
     size_t i;
     off_t ret;
 
     for (i = 0; i < file->nentries; i++) {
-        virRotatingFileReaderEntryPtr entry = file->entries[i];
-        if (entry->inode != inode ||
-            entry->fd == -1)
-            continue;
+        if (file->entries[i]->inode == inode &&
+            file->entries[i]->fd != -1)
+            break;
+    }
 
-        ret = lseek(entry->fd, offset, SEEK_SET);
-        if (ret == (off_t)-1) {
-            virReportSystemError(errno,
-                                 _("Unable to seek to inode %llu offset %llu"),
-                                 (unsigned long long)inode, (unsigned long long)offset);
-            return -1;
-        }
+    if (i == file->nentries)
+        i = 0;
 
-        file->current = i;
+    file->current = i;
+    entry = file->entries[i];
+
+    if (entry->compressed) {
+        if (virRotatingFileReaderEntryLoad(entry) < 0)
+            return -1;
+        entry->datapos = MIN(offset, entry->datalen);
         return 0;
     }
 
-    file->current = 0;
-    ret = lseek(file->entries[0]->fd, offset, SEEK_SET);
+    ret = lseek(entry->fd, offset, SEEK_SET);
     if (ret == (off_t)-1) {
         virReportSystemError(errno,
                              _("Unable to seek to inode %llu offset %llu"),
@@ -577,7 +1206,16 @@ virRotatingFileReaderConsume(virRotatingFileReaderPtr file,
             continue;
         }
 
-        got = saferead(entry->fd, buf + ret, len);
+        if (entry->compressed) {
+            if (virRotatingFileReaderEntryLoad(entry) < 0)
+                return -1;
+
+            got = MIN(len, entry->datalen - entry->datapos);
+            memcpy(buf + ret, entry->data + entry->datapos, got);
+            entry->datapos += got;
+        } else {
+            got = saferead(entry->fd, buf + ret, len);
+        }
         if (got < 0) {
             virReportSystemError(errno,
                                  _("Unable to read from file %s"),
@@ -610,7 +1248,13 @@ virRotatingFileWriterFree(virRotatingFileWriterPtr file)
     if (!file)
         return;
 
+    if (file->entry &&
+        virRotatingFileWriterFlush(file) < 0)
+        VIR_WARN("Unable to flush %s: %s",
+                 file->basepath, virGetLastErrorMessage());
+
     virRotatingFileWriterEntryFree(file->entry);
+    VIR_FREE(file->buf);
     VIR_FREE(file->basepath);
     VIR_FREE(file);
 }
@@ -43,10 +43,18 @@ const char *virRotatingFileWriterGetPath(virRotatingFileWriterPtr file);
 ino_t virRotatingFileWriterGetINode(virRotatingFileWriterPtr file);
 off_t virRotatingFileWriterGetOffset(virRotatingFileWriterPtr file);
 
+int virRotatingFileWriterSetBufferSize(virRotatingFileWriterPtr file,
+                                       size_t size);
+void virRotatingFileWriterSetCompress(virRotatingFileWriterPtr file,
+                                      bool compress);
+size_t virRotatingFileWriterGetPending(virRotatingFileWriterPtr file);
+
 ssize_t virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
                                     const char *buf,
                                     size_t len);
 
+int virRotatingFileWriterFlush(virRotatingFileWriterPtr file);
+
 int virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
                               ino_t inode,
                               off_t offset);
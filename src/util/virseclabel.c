@@ -86,6 +86,27 @@ virSecurityDeviceLabelDefNew(const char *model)
 }
 
 
+virSecurityLabelDefPtr
+virSecurityLabelDefCopy(const virSecurityLabelDef *src)
+{
+    virSecurityLabelDefPtr ret;
+
+    if (VIR_ALLOC(ret) < 0)
+        return NULL;
+
+    ret->type = src->type;
+    ret->relabel = src->relabel;
+    ret->implicit = src->implicit;
+
+    ret->model = g_strdup(src->model);
+    ret->label = g_strdup(src->label);
+    ret->imagelabel = g_strdup(src->imagelabel);
+    ret->baselabel = g_strdup(src->baselabel);
+
+    return ret;
+}
+
+
 virSecurityDeviceLabelDefPtr
 virSecurityDeviceLabelDefCopy(const virSecurityDeviceLabelDef *src)
 {
@@ -60,6 +60,10 @@ virSecurityLabelDefNew(const char *model);
 virSecurityDeviceLabelDefPtr
 virSecurityDeviceLabelDefNew(const char *model);
 
+virSecurityLabelDefPtr
+virSecurityLabelDefCopy(const virSecurityLabelDef *src)
+    ATTRIBUTE_NONNULL(1);
+
 virSecurityDeviceLabelDefPtr
 virSecurityDeviceLabelDefCopy(const virSecurityDeviceLabelDef *src)
     ATTRIBUTE_NONNULL(1);
@@ -2177,6 +2177,7 @@ virStorageSourceNetCookiesCopy(virStorageSourcePtr to,
     to->ncookies = from->ncookies;
 
     for (i = 0; i < from->ncookies; i++) {
+        to->cookies[i] = g_new0(virStorageNetCookieDef, 1);
         to->cookies[i]->name = g_strdup(from->cookies[i]->name);
         to->cookies[i]->value = g_strdup(from->cookies[i]->value);
     }
@@ -2341,23 +2342,22 @@ virStorageSourceSliceFree(virStorageSourceSlicePtr slice)
 
 
 /**
- * virStorageSourcePtr:
+ * virStorageSourceCopyInto:
+ * @def: cleared storage source to fill in
+ * @src: storage source to copy
+ * @backingChain: copy the backing chain too
  *
- * Deep-copies a virStorageSource structure. If @backing chain is true
- * then also copies the backing chain recursively, otherwise just
- * the top element is copied. This function doesn't copy the
- * storage driver access structure and thus the struct needs to be initialized
- * separately.
+ * Deep-copies @src into @def, which may be embedded in another structure.
+ * See virStorageSourceCopy. On failure @def may be partially filled and
+ * has to be cleared by the caller with virStorageSourceClear.
+ *
+ * Returns 0 on success, -1 on error.
  */
-virStorageSourcePtr
-virStorageSourceCopy(const virStorageSource *src,
-                     bool backingChain)
+int
+virStorageSourceCopyInto(virStorageSourcePtr def,
+                         const virStorageSource *src,
+                         bool backingChain)
 {
-    g_autoptr(virStorageSource) def = NULL;
-
-    if (!(def = virStorageSourceNew()))
-        return NULL;
-
     def->id = src->id;
     def->type = src->type;
     def->protocol = src->protocol;
@@ -2380,6 +2380,12 @@ virStorageSourceCopy(const virStorageSource *src,
     def->sslverify = src->sslverify;
     def->readahead = src->readahead;
     def->timeout = src->timeout;
+    def->authInherited = src->authInherited;
+    def->encryptionInherited = src->encryptionInherited;
+    def->nocow = src->nocow;
+    def->sparse = src->sparse;
+    def->floppyimg = src->floppyimg;
+    def->hostcdrom = src->hostcdrom;
 
     /* storage driver metadata are not copied */
     def->drv = NULL;
@@ -2403,7 +2409,7 @@ virStorageSourceCopy(const virStorageSource *src,
 
     if (src->nhosts) {
         if (!(def->hosts = virStorageNetHostDefCopy(src->nhosts, src->hosts)))
-            return NULL;
+            return -1;
 
         def->nhosts = src->nhosts;
     }
@@ -2412,51 +2418,76 @@ virStorageSourceCopy(const virStorageSource *src,
 
     if (src->srcpool &&
         !(def->srcpool = virStorageSourcePoolDefCopy(src->srcpool)))
-        return NULL;
+        return -1;
 
     if (src->features &&
         !(def->features = virBitmapNewCopy(src->features)))
-        return NULL;
+        return -1;
 
     if (src->encryption &&
         !(def->encryption = virStorageEncryptionCopy(src->encryption)))
-        return NULL;
+        return -1;
 
     if (src->perms &&
         !(def->perms = virStoragePermsCopy(src->perms)))
-        return NULL;
+        return -1;
 
     if (src->timestamps &&
         !(def->timestamps = virStorageTimestampsCopy(src->timestamps)))
-        return NULL;
+        return -1;
 
     if (virStorageSourceSeclabelsCopy(def, src) < 0)
-        return NULL;
+        return -1;
 
     if (src->auth &&
         !(def->auth = virStorageAuthDefCopy(src->auth)))
-        return NULL;
+        return -1;
 
     if (src->pr &&
         !(def->pr = virStoragePRDefCopy(src->pr)))
-        return NULL;
+        return -1;
 
     if (src->nvme)
         def->nvme = virStorageSourceNVMeDefCopy(src->nvme);
 
     if (virStorageSourceInitiatorCopy(&def->initiator, &src->initiator) < 0)
-        return NULL;
+        return -1;
 
     if (backingChain && src->backingStore) {
         if (!(def->backingStore = virStorageSourceCopy(src->backingStore,
                                                        true)))
-            return NULL;
+            return -1;
     }
 
     /* ssh config passthrough for libguestfs */
     def->ssh_host_key_check_disabled = src->ssh_host_key_check_disabled;
     def->ssh_user = g_strdup(src->ssh_user);
 
+    return 0;
+}
+
+
+/**
+ * virStorageSourcePtr:
+ *
+ * Deep-copies a virStorageSource structure. If @backing chain is true
+ * then also copies the backing chain recursively, otherwise just
+ * the top element is copied. This function doesn't copy the
+ * storage driver access structure and thus the struct needs to be initialized
+ * separately.
+ */
+virStorageSourcePtr
+virStorageSourceCopy(const virStorageSource *src,
+                     bool backingChain)
+{
+    g_autoptr(virStorageSource) def = NULL;
+
+    if (!(def = virStorageSourceNew()))
+        return NULL;
+
+    if (virStorageSourceCopyInto(def, src, backingChain) < 0)
+        return NULL;
+
     return g_steal_pointer(&def);
 }
 
@@ -498,6 +498,10 @@ int virStorageSourceNetCookiesValidate(virStorageSourcePtr src);
 virStorageSourcePtr virStorageSourceCopy(const virStorageSource *src,
                                          bool backingChain)
     ATTRIBUTE_NONNULL(1);
+int virStorageSourceCopyInto(virStorageSourcePtr def,
+                             const virStorageSource *src,
+                             bool backingChain)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 bool virStorageSourceIsSameLocation(virStorageSourcePtr a,
                                     virStorageSourcePtr b)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -191,6 +191,117 @@ void virSysinfoDefFree(virSysinfoDefPtr def)
 }
 
 
+/**
+ * virSysinfoDefCopy:
+ * @src: a sysinfo structure
+ *
+ * Returns a deep copy of @src.
+ */
+virSysinfoDefPtr
+virSysinfoDefCopy(const virSysinfoDef *src)
+{
+    virSysinfoDefPtr def = g_new0(virSysinfoDef, 1);
+    size_t i;
+
+    def->type = src->type;
+
+    if (src->bios) {
+        def->bios = g_new0(virSysinfoBIOSDef, 1);
+        def->bios->vendor = g_strdup(src->bios->vendor);
+        def->bios->version = g_strdup(src->bios->version);
+        def->bios->date = g_strdup(src->bios->date);
+        def->bios->release = g_strdup(src->bios->release);
+    }
+
+    if (src->system) {
+        def->system = g_new0(virSysinfoSystemDef, 1);
+        def->system->manufacturer = g_strdup(src->system->manufacturer);
+        def->system->product = g_strdup(src->system->product);
+        def->system->version = g_strdup(src->system->version);
+        def->system->serial = g_strdup(src->system->serial);
+        def->system->uuid = g_strdup(src->system->uuid);
+        def->system->sku = g_strdup(src->system->sku);
+        def->system->family = g_strdup(src->system->family);
+    }
+
+    if (src->nbaseBoard) {
+        def->baseBoard = g_new0(virSysinfoBaseBoardDef, src->nbaseBoard);
+        def->nbaseBoard = src->nbaseBoard;
+        for (i = 0; i < src->nbaseBoard; i++) {
+            virSysinfoBaseBoardDefPtr dst = def->baseBoard + i;
+            const virSysinfoBaseBoardDef *board = src->baseBoard + i;
+
+            dst->manufacturer = g_strdup(board->manufacturer);
+            dst->product = g_strdup(board->product);
+            dst->version = g_strdup(board->version);
+            dst->serial = g_strdup(board->serial);
+            dst->asset = g_strdup(board->asset);
+            dst->location = g_strdup(board->location);
+        }
+    }
+
+    if (src->chassis) {
+        def->chassis = g_new0(virSysinfoChassisDef, 1);
+        def->chassis->manufacturer = g_strdup(src->chassis->manufacturer);
+        def->chassis->version = g_strdup(src->chassis->version);
+        def->chassis->serial = g_strdup(src->chassis->serial);
+        def->chassis->asset = g_strdup(src->chassis->asset);
+        def->chassis->sku = g_strdup(src->chassis->sku);
+    }
+
+    if (src->nprocessor) {
+        def->processor = g_new0(virSysinfoProcessorDef, src->nprocessor);
+        def->nprocessor = src->nprocessor;
+        for (i = 0; i < src->nprocessor; i++) {
+            virSysinfoProcessorDefPtr dst = def->processor + i;
+            const virSysinfoProcessorDef *proc = src->processor + i;
+
+            dst->processor_socket_destination = g_strdup(proc->processor_socket_destination);
+            dst->processor_type = g_strdup(proc->processor_type);
+            dst->processor_family = g_strdup(proc->processor_family);
+            dst->processor_manufacturer = g_strdup(proc->processor_manufacturer);
+            dst->processor_signature = g_strdup(proc->processor_signature);
+            dst->processor_version = g_strdup(proc->processor_version);
+            dst->processor_external_clock = g_strdup(proc->processor_external_clock);
+            dst->processor_max_speed = g_strdup(proc->processor_max_speed);
+            dst->processor_status = g_strdup(proc->processor_status);
+            dst->processor_serial_number = g_strdup(proc->processor_serial_number);
+            dst->processor_part_number = g_strdup(proc->processor_part_number);
+        }
+    }
+
+    if (src->nmemory) {
+        def->memory = g_new0(virSysinfoMemoryDef, src->nmemory);
+        def->nmemory = src->nmemory;
+        for (i = 0; i < src->nmemory; i++) {
+            virSysinfoMemoryDefPtr dst = def->memory + i;
+            const virSysinfoMemoryDef *mem = src->memory + i;
+
+            dst->memory_size = g_strdup(mem->memory_size);
+            dst->memory_form_factor = g_strdup(mem->memory_form_factor);
+            dst->memory_locator = g_strdup(mem->memory_locator);
+            dst->memory_bank_locator = g_strdup(mem->memory_bank_locator);
+            dst->memory_type = g_strdup(mem->memory_type);
+            dst->memory_type_detail = g_strdup(mem->memory_type_detail);
+            dst->memory_speed = g_strdup(mem->memory_speed);
+            dst->memory_manufacturer = g_strdup(mem->memory_manufacturer);
+            dst->memory_serial_number = g_strdup(mem->memory_serial_number);
+            dst->memory_part_number = g_strdup(mem->memory_part_number);
+        }
+    }
+
+    if (src->oemStrings) {
+        def->oemStrings = g_new0(virSysinfoOEMStringsDef, 1);
+        def->oemStrings->values = g_new0(char *, src->oemStrings->nvalues);
+        def->oemStrings->nvalues = src->oemStrings->nvalues;
+        for (i = 0; i < src->oemStrings->nvalues; i++)
+            def->oemStrings->values[i] = g_strdup(src->oemStrings->values[i]);
+    }
+
+    return def;
+}
+
+
 static bool
 virSysinfoDefIsEmpty(const virSysinfoDef *def)
 {
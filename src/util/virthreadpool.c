@@ -26,9 +26,12 @@
 #include "viralloc.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virlog.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("util.threadpool");
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
@@ -389,7 +392,7 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
     if (pool->quit)
         goto error;
 
-    if (pool->freeWorkers - pool->jobQueueDepth <= 0 &&
+    if (pool->freeWorkers <= pool->jobQueueDepth &&
         pool->nWorkers < pool->maxWorkers &&
         virThreadPoolExpand(pool, 1, false) < 0)
         goto error;
@@ -483,3 +486,67 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
     virMutexUnlock(&pool->mutex);
     return -1;
 }
+
+
+struct virThreadPoolRunData {
+    virThreadFunc func;
+    void *opaque;
+};
+
+
+static void
+virThreadPoolRunJob(void *jobdata G_GNUC_UNUSED,
+                    void *opaque)
+{
+    struct virThreadPoolRunData *data = opaque;
+
+    data->func(data->opaque);
+}
+
+
+/**
+ * virThreadPoolRunParallel:
+ * @nthreads: maximum number of threads, including the calling one
+ * @func: function run by each of the threads
+ * @name: name of the additional threads
+ * @opaque: data passed to @func
+ *
+ * Runs @func in up to @nthreads threads at once and returns when all of
+ * them are done. Each run of @func is expected to take work items from
+ * a queue in @opaque until it's empty. Since the calling thread takes
+ * part in the work, everything gets done even if no additional thread
+ * can be started.
+ */
+void
+virThreadPoolRunParallel(size_t nthreads,
+                         virThreadFunc func,
+                         const char *name,
+                         void *opaque)
+{
+    struct virThreadPoolRunData data = { .func = func, .opaque = opaque };
+    virThreadPoolPtr pool = NULL;
+    size_t nstarted = 0;
+
+    if (nthreads > 1) {
+        if ((pool = virThreadPoolNewFull(0, nthreads - 1, 0,
+                                         virThreadPoolRunJob, name, &data))) {
+            while (nstarted < nthreads - 1 &&
+                   virThreadPoolSendJob(pool, 0, &data) == 0)
+                nstarted++;
+        }
+
+        if (nstarted < nthreads - 1) {
+            /* carry on with the threads we've got */
+            VIR_WARN("Unable to start all %s threads: %s",
+                     name, virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
+    func(opaque);
+
+    /* The queue in @opaque is empty by now, so the jobs which didn't
+     * get a worker yet wouldn't find anything to do and can be
+     * dropped. Freeing the pool waits for the running ones. */
+    virThreadPoolFree(pool);
+}
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virthread.h"
 
 typedef struct _virThreadPool virThreadPool;
 typedef virThreadPool *virThreadPoolPtr;
@@ -56,3 +57,8 @@ int virThreadPoolSetParameters(virThreadPoolPtr pool,
                                long long int minWorkers,
                                long long int maxWorkers,
                                long long int prioWorkers);
+
+void virThreadPoolRunParallel(size_t nthreads,
+                              virThreadFunc func,
+                              const char *name,
+                              void *opaque) ATTRIBUTE_NONNULL(2);
@@ -378,6 +378,122 @@ virTypedParamsCopy(virTypedParameterPtr *dst,
 }
 
 
+static bool
+virTypedParameterValueEqual(virTypedParameterPtr a,
+                            virTypedParameterPtr b)
+{
+    if (a->type != b->type)
+        return false;
+
+    switch ((virTypedParameterType) a->type) {
+    case VIR_TYPED_PARAM_INT:
+        return a->value.i == b->value.i;
+    case VIR_TYPED_PARAM_UINT:
+        return a->value.ui == b->value.ui;
+    case VIR_TYPED_PARAM_LLONG:
+        return a->value.l == b->value.l;
+    case VIR_TYPED_PARAM_ULLONG:
+        return a->value.ul == b->value.ul;
+    case VIR_TYPED_PARAM_DOUBLE:
+        return a->value.d == b->value.d;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        return !a->value.b == !b->value.b;
+    case VIR_TYPED_PARAM_STRING:
+        return STREQ_NULLABLE(a->value.s, b->value.s);
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        break;
+    }
+
+    return false;
+}
+
+
+/**
+ * virTypedParamsGetChanged:
+ * @oldparams: array of previously seen typed parameters
+ * @noldparams: number of parameters in the @oldparams array
+ * @params: array of current typed parameters
+ * @nparams: number of parameters in the @params array
+ * @changed: pointer to the returned array
+ * @removed: set to true if some parameters of @oldparams are missing
+ *           in @params
+ *
+ * Copies those parameters from @params into @changed which either
+ * don't exist in @oldparams or have a different type or value
+ * there. Lookup is cheapest when both arrays list the parameters in
+ * the same order, which is the case for repeated queries of the same
+ * data. Since @changed can't express that a parameter disappeared,
+ * @removed tells the caller to report the whole @params instead.
+ * Parameter names must be unique in both arrays. Caller should free
+ * @changed using virTypedParamsFree.
+ *
+ * Returns amount of elements in @changed on success, -1 on error.
+ */
+int
+virTypedParamsGetChanged(virTypedParameterPtr oldparams,
+                         int noldparams,
+                         virTypedParameterPtr params,
+                         int nparams,
+                         virTypedParameterPtr *changed,
+                         bool *removed)
+{
+    virTypedParameterPtr ret = NULL;
+    size_t nret = 0;
+    size_t nfound = 0;
+    size_t i;
+    size_t j;
+
+    *changed = NULL;
+    *removed = noldparams > 0;
+
+    if (nparams <= 0)
+        return 0;
+
+    if (VIR_ALLOC_N(ret, nparams) < 0)
+        return -1;
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr old = NULL;
+
+        if (i < noldparams && STREQ(oldparams[i].field, params[i].field)) {
+            old = &oldparams[i];
+        } else {
+            for (j = 0; j < noldparams; j++) {
+                if (STREQ(oldparams[j].field, params[i].field)) {
+                    old = &oldparams[j];
+                    break;
+                }
+            }
+        }
+
+        if (old) {
+            nfound++;
+            if (virTypedParameterValueEqual(old, &params[i]))
+                continue;
+        }
+
+        ignore_value(virStrcpyStatic(ret[nret].field, params[i].field));
+        ret[nret].type = params[i].type;
+        if (params[i].type == VIR_TYPED_PARAM_STRING)
+            ret[nret].value.s = g_strdup(params[i].value.s);
+        else
+            ret[nret].value = params[i].value;
+        nret++;
+    }
+
+    *removed = nfound < noldparams;
+
+    if (nret == 0) {
+        VIR_FREE(ret);
+        return 0;
+    }
+
+    *changed = ret;
+    return nret;
+}
+
+
 /**
  * virTypedParamsFilter:
  * @params: array of typed parameters
@@ -98,6 +98,14 @@ char *virTypedParameterToString(virTypedParameterPtr param);
 void virTypedParamsRemoteFree(virTypedParameterRemotePtr remote_params_val,
                               unsigned int remote_params_len);
 
+int virTypedParamsGetChanged(virTypedParameterPtr oldparams,
+                             int noldparams,
+                             virTypedParameterPtr params,
+                             int nparams,
+                             virTypedParameterPtr *changed,
+                             bool *removed)
+    G_GNUC_WARN_UNUSED_RESULT;
+
 int virTypedParamsDeserialize(virTypedParameterRemotePtr remote_params,
                               unsigned int remote_params_len,
                               int limit,
@@ -18,12 +18,19 @@
 
 #include <config.h>
 
+#include <unistd.h>
+
 #include "testutils.h"
 #include "virerror.h"
 #include "viralloc.h"
 #include "virlog.h"
 
 #include "domain_conf.h"
+#include "virdomainobjlist.h"
+#include "virdomainstatuswriter.h"
+#include "virthread.h"
+#include "virfile.h"
+#include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -76,6 +83,1117 @@ static int testGetFilesystem(const void *opaque)
     return ret;
 }
 
+
+static void
+testDomainObjListUUID(unsigned char *uuid,
+                      size_t idx)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_UUID_BUFLEN; i++)
+        uuid[i] = (idx >> ((i % sizeof(idx)) * 8)) & 0xff;
+    uuid[0] = 0xc0;
+}
+
+
+static int
+testDomainObjListAddDef(virDomainObjListPtr doms,
+                        size_t idx,
+                        const char *name)
+{
+    virDomainDefPtr def;
+    virDomainObjPtr vm;
+
+    if (!(def = virDomainDefNew()))
+        return -1;
+
+    def->name = g_strdup(name);
+    testDomainObjListUUID(def->uuid, idx);
+
+    if (!(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL))) {
+        virDomainDefFree(def);
+        return -1;
+    }
+
+    virDomainObjEndAPI(&vm);
+    return 0;
+}
+
+
+static int
+testDomainObjListAddOne(virDomainObjListPtr doms,
+                        size_t idx)
+{
+    g_autofree char *name = g_strdup_printf("dom%zu", idx);
+
+    return testDomainObjListAddDef(doms, idx, name);
+}
+
+
+static virDomainObjListPtr
+testDomainObjListPopulate(size_t count)
+{
+    virDomainObjListPtr doms;
+    size_t i;
+
+    if (!(doms = virDomainObjListNew()))
+        return NULL;
+
+    for (i = 0; i < count; i++) {
+        if (testDomainObjListAddOne(doms, i) < 0) {
+            virObjectUnref(doms);
+            return NULL;
+        }
+    }
+
+    return doms;
+}
+
+
+static int
+testDomainObjListCheck(virDomainObjListPtr doms,
+                       size_t idx,
+                       const char *name,
+                       bool expect)
+{
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    virDomainObjPtr vm;
+    bool found;
+
+    testDomainObjListUUID(uuid, idx);
+    vm = virDomainObjListFindByUUID(doms, uuid);
+    found = vm && STREQ(vm->def->name, name);
+    virDomainObjEndAPI(&vm);
+
+    if (found != expect) {
+        fprintf(stderr, "domain %zu %sexpected by uuid\n", idx,
+                expect ? "" : "not ");
+        return -1;
+    }
+
+    vm = virDomainObjListFindByName(doms, name);
+    found = vm && memcmp(vm->def->uuid, uuid, VIR_UUID_BUFLEN) == 0;
+    virDomainObjEndAPI(&vm);
+
+    if (found != expect) {
+        fprintf(stderr, "domain '%s' %sexpected by name\n", name,
+                expect ? "" : "not ");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testDomainObjListRenameCallback(virDomainObjPtr dom,
+                                const char *new_name,
+                                unsigned int flags G_GNUC_UNUSED,
+                                void *opaque G_GNUC_UNUSED)
+{
+    g_free(dom->def->name);
+    dom->def->name = g_strdup(new_name);
+    return 0;
+}
+
+
+static int
+testDomainObjListLookup(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virDomainObjList) doms = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    virDomainObjPtr vm;
+    size_t i;
+
+    if (!(doms = testDomainObjListPopulate(100)))
+        return -1;
+
+    for (i = 0; i < 100; i++) {
+        g_autofree char *name = g_strdup_printf("dom%zu", i);
+
+        if (testDomainObjListCheck(doms, i, name, true) < 0)
+            return -1;
+    }
+
+    if (testDomainObjListCheck(doms, 100, "dom100", false) < 0)
+        return -1;
+
+    testDomainObjListUUID(uuid, 0);
+    if (!(vm = virDomainObjListFindByUUID(doms, uuid)))
+        return -1;
+    if (virDomainObjListRename(doms, vm, "renamed", 0,
+                               testDomainObjListRenameCallback, NULL) < 0) {
+        virDomainObjEndAPI(&vm);
+        return -1;
+    }
+    virDomainObjEndAPI(&vm);
+
+    if (testDomainObjListCheck(doms, 0, "renamed", true) < 0 ||
+        testDomainObjListCheck(doms, 0, "dom0", false) < 0)
+        return -1;
+
+    testDomainObjListUUID(uuid, 1);
+    if (!(vm = virDomainObjListFindByUUID(doms, uuid)))
+        return -1;
+    virDomainObjListRemove(doms, vm);
+    virDomainObjEndAPI(&vm);
+
+    if (testDomainObjListCheck(doms, 1, "dom1", false) < 0 ||
+        testDomainObjListCheck(doms, 2, "dom2", true) < 0)
+        return -1;
+
+    if (testDomainObjListAddOne(doms, 100) < 0 ||
+        testDomainObjListCheck(doms, 100, "dom100", true) < 0)
+        return -1;
+
+    /* each change switches the copy of the tables used by lookups, so
+     * make sure the earlier changes were repeated on both of them */
+    if (testDomainObjListCheck(doms, 0, "renamed", true) < 0 ||
+        testDomainObjListCheck(doms, 0, "dom0", false) < 0 ||
+        testDomainObjListCheck(doms, 1, "dom1", false) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+struct testDomainObjListReaderData {
+    virDomainObjListPtr doms;
+    size_t count;
+    size_t lookups;
+    int *quit;
+    bool failed;
+};
+
+
+static void
+testDomainObjListReader(void *opaque)
+{
+    struct testDomainObjListReaderData *data = opaque;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    size_t i;
+
+    for (i = 0; i < data->lookups || (data->quit && !g_atomic_int_get(data->quit)); i++) {
+        virDomainObjPtr vm;
+
+        testDomainObjListUUID(uuid, (i * 7919) % data->count);
+        vm = virDomainObjListFindByUUID(data->doms, uuid);
+
+        if (vm && memcmp(vm->def->uuid, uuid, VIR_UUID_BUFLEN) != 0)
+            data->failed = true;
+
+        virDomainObjEndAPI(&vm);
+    }
+}
+
+
+#define TEST_READERS 4
+
+static int
+testDomainObjListConcurrent(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virDomainObjList) doms = NULL;
+    struct testDomainObjListReaderData data[TEST_READERS];
+    virThread threads[TEST_READERS];
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int quit = 0;
+    int ret = 0;
+    size_t nthreads;
+    size_t i;
+
+    if (!(doms = testDomainObjListPopulate(64)))
+        return -1;
+
+    for (nthreads = 0; nthreads < TEST_READERS; nthreads++) {
+        data[nthreads] = (struct testDomainObjListReaderData) {
+            .doms = doms, .count = 65, .lookups = 1000, .quit = &quit,
+        };
+
+        if (virThreadCreate(&threads[nthreads], true,
+                            testDomainObjListReader, &data[nthreads]) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    /* Keep retiring snapshots while the readers use them */
+    for (i = 0; ret == 0 && i < 200; i++) {
+        virDomainObjPtr vm;
+
+        if (testDomainObjListAddOne(doms, 64) < 0) {
+            ret = -1;
+            break;
+        }
+
+        testDomainObjListUUID(uuid, 64);
+        if (!(vm = virDomainObjListFindByUUID(doms, uuid))) {
+            ret = -1;
+            break;
+        }
+        virDomainObjListRemove(doms, vm);
+        virDomainObjEndAPI(&vm);
+    }
+
+    g_atomic_int_set(&quit, 1);
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (data[i].failed)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+
+static int
+testDomainObjListRenameFail(virDomainObjPtr dom G_GNUC_UNUSED,
+                            const char *new_name G_GNUC_UNUSED,
+                            unsigned int flags G_GNUC_UNUSED,
+                            void *opaque G_GNUC_UNUSED)
+{
+    return -1;
+}
+
+
+/* Changes of the list which have to be refused must leave the tables
+ * used by lookups untouched */
+static int
+testDomainObjListLookupFail(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virDomainObjList) doms = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    if (!(doms = testDomainObjListPopulate(4)))
+        return -1;
+
+    virTestQuiesceLibvirtErrors(true);
+
+    /* known UUID with a different name, known name with a new UUID */
+    if (testDomainObjListAddDef(doms, 0, "other") == 0 ||
+        testDomainObjListAddDef(doms, 4, "dom1") == 0) {
+        fprintf(stderr, "conflicting domain was added\n");
+        goto cleanup;
+    }
+
+    testDomainObjListUUID(uuid, 2);
+    if (!(vm = virDomainObjListFindByUUID(doms, uuid)))
+        goto cleanup;
+
+    /* the name is taken, or the driver refuses the rename */
+    if (virDomainObjListRename(doms, vm, "dom3", 0,
+                               testDomainObjListRenameCallback, NULL) == 0 ||
+        virDomainObjListRename(doms, vm, "renamed", 0,
+                               testDomainObjListRenameFail, NULL) == 0) {
+        fprintf(stderr, "refused rename succeeded\n");
+        virDomainObjEndAPI(&vm);
+        goto cleanup;
+    }
+    virDomainObjEndAPI(&vm);
+
+    if (virDomainObjListNumOfDomains(doms, false, NULL, NULL) != 4 ||
+        testDomainObjListCheck(doms, 0, "dom0", true) < 0 ||
+        testDomainObjListCheck(doms, 0, "other", false) < 0 ||
+        testDomainObjListCheck(doms, 1, "dom1", true) < 0 ||
+        testDomainObjListCheck(doms, 4, "dom1", false) < 0 ||
+        testDomainObjListCheck(doms, 2, "dom2", true) < 0 ||
+        testDomainObjListCheck(doms, 2, "renamed", false) < 0 ||
+        testDomainObjListCheck(doms, 3, "dom3", true) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virSetErrorFunc(NULL, NULL);
+    virResetLastError();
+    return ret;
+}
+
+
+struct testDomainObjListBenchData {
+    virDomainObjListPtr doms;
+    size_t count;
+    size_t lookups;
+};
+
+
+/* Runs @nworkers threads doing lookups at the same time */
+static int
+testDomainObjListBenchRun(size_t nworkers,
+                          void *opaque)
+{
+    struct testDomainObjListBenchData *bench = opaque;
+    g_autofree struct testDomainObjListReaderData *data = NULL;
+    g_autofree virThread *threads = NULL;
+    size_t nthreads;
+    size_t i;
+    int ret = 0;
+
+    data = g_new0(struct testDomainObjListReaderData, nworkers);
+    threads = g_new0(virThread, nworkers);
+
+    for (nthreads = 0; nthreads < nworkers; nthreads++) {
+        data[nthreads].doms = bench->doms;
+        data[nthreads].count = bench->count;
+        data[nthreads].lookups = bench->lookups;
+
+        if (virThreadCreate(&threads[nthreads], true,
+                            testDomainObjListReader, &data[nthreads]) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (data[i].failed)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+
+static int
+testDomainObjListBench(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virDomainObjList) doms = NULL;
+    struct testDomainObjListBenchData bench = { .count = 5000,
+                                                .lookups = 200000 };
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    if (!(doms = testDomainObjListPopulate(bench.count)))
+        return -1;
+    bench.doms = doms;
+
+    return virTestBenchWorkers("200000 lookups by UUID per thread in "
+                               "5000 domains",
+                               testDomainObjListBenchRun, &bench);
+}
+
+
+#define TEST_LOAD_DIR_TEMPLATE abs_builddir "/domainconfdir-XXXXXX"
+
+static const char testDomainObjListLoadXML[] =
+    "<domain type='qemu'>\n"
+    "  <name>%s</name>\n"
+    "  <uuid>%s</uuid>\n"
+    "  <memory unit='KiB'>219136</memory>\n"
+    "  <currentMemory unit='KiB'>219136</currentMemory>\n"
+    "  <vcpu placement='static'>2</vcpu>\n"
+    "  <os>\n"
+    "    <type arch='x86_64' machine='pc'>hvm</type>\n"
+    "    <boot dev='hd'/>\n"
+    "  </os>\n"
+    "  <clock offset='utc'/>\n"
+    "  <on_poweroff>destroy</on_poweroff>\n"
+    "  <on_reboot>restart</on_reboot>\n"
+    "  <on_crash>destroy</on_crash>\n"
+    "  <devices>\n"
+    "    <emulator>/usr/bin/qemu-system-x86_64</emulator>\n"
+    "    <disk type='file' device='disk'>\n"
+    "      <driver name='qemu' type='qcow2'/>\n"
+    "      <source file='/var/lib/libvirt/images/%s.qcow2'/>\n"
+    "      <target dev='vda' bus='virtio'/>\n"
+    "      <address type='pci' domain='0x0000' bus='0x00' slot='0x04' function='0x0'/>\n"
+    "    </disk>\n"
+    "    <disk type='file' device='cdrom'>\n"
+    "      <driver name='qemu' type='raw'/>\n"
+    "      <target dev='hdc' bus='ide'/>\n"
+    "      <readonly/>\n"
+    "      <address type='drive' controller='0' bus='1' target='0' unit='0'/>\n"
+    "    </disk>\n"
+    "    <controller type='usb' index='0'/>\n"
+    "    <controller type='ide' index='0'/>\n"
+    "    <controller type='pci' index='0' model='pci-root'/>\n"
+    "    <interface type='network'>\n"
+    "      <mac address='52:54:00:%02x:%02x:%02x'/>\n"
+    "      <source network='default'/>\n"
+    "      <model type='virtio'/>\n"
+    "      <address type='pci' domain='0x0000' bus='0x00' slot='0x03' function='0x0'/>\n"
+    "    </interface>\n"
+    "    <serial type='pty'>\n"
+    "      <target port='0'/>\n"
+    "    </serial>\n"
+    "    <console type='pty'>\n"
+    "      <target type='serial' port='0'/>\n"
+    "    </console>\n"
+    "    <input type='tablet' bus='usb'/>\n"
+    "    <graphics type='vnc' port='-1' autoport='yes'/>\n"
+    "    <video>\n"
+    "      <model type='cirrus' vram='16384' heads='1'/>\n"
+    "      <address type='pci' domain='0x0000' bus='0x00' slot='0x02' function='0x0'/>\n"
+    "    </video>\n"
+    "    <memballoon model='virtio'>\n"
+    "      <address type='pci' domain='0x0000' bus='0x00' slot='0x05' function='0x0'/>\n"
+    "    </memballoon>\n"
+    "  </devices>\n"
+    "</domain>\n";
+
+
+/* Fills a new scratch directory with @count domain configs, every third
+ * of them marked autostart, plus one which fails to parse. */
+static char *
+testDomainObjListLoadPrepare(size_t count)
+{
+    g_autofree char *dir = g_strdup(TEST_LOAD_DIR_TEMPLATE);
+    g_autofree char *autostartDir = NULL;
+    g_autofree char *broken = NULL;
+    size_t i;
+
+    if (!g_mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create %s\n", dir);
+        return NULL;
+    }
+
+    autostartDir = g_strdup_printf("%s/autostart", dir);
+    if (g_mkdir(autostartDir, 0700) < 0)
+        goto error;
+
+    for (i = 0; i < count; i++) {
+        unsigned char uuid[VIR_UUID_BUFLEN];
+        char uuidstr[VIR_UUID_STRING_BUFLEN];
+        g_autofree char *name = g_strdup_printf("dom%zu", i);
+        g_autofree char *path = g_strdup_printf("%s/%s.xml", dir, name);
+        g_autofree char *xml = NULL;
+
+        testDomainObjListUUID(uuid, i);
+        virUUIDFormat(uuid, uuidstr);
+        xml = g_strdup_printf(testDomainObjListLoadXML, name, uuidstr, name,
+                              (unsigned int) (i >> 16) & 0xff,
+                              (unsigned int) (i >> 8) & 0xff,
+                              (unsigned int) i & 0xff);
+
+        if (virFileWriteStr(path, xml, 0600) < 0)
+            goto error;
+
+        if (i % 3 == 0) {
+            g_autofree char *link = g_strdup_printf("%s/%s.xml",
+                                                    autostartDir, name);
+
+            if (symlink(path, link) < 0)
+                goto error;
+        }
+    }
+
+    broken = g_strdup_printf("%s/broken.xml", dir);
+    if (virFileWriteStr(broken, "<domain type='qemu'><name>broken", 0600) < 0)
+        goto error;
+
+    return g_steal_pointer(&dir);
+
+ error:
+    fprintf(stderr, "Cannot populate %s\n", dir);
+    virFileDeleteTree(dir);
+    return NULL;
+}
+
+
+static void
+testDomainObjListLoadNotify(virDomainObjPtr dom G_GNUC_UNUSED,
+                            int newDomain,
+                            void *opaque)
+{
+    size_t *added = opaque;
+
+    if (newDomain)
+        (*added)++;
+}
+
+
+static int
+testDomainObjListLoad(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virDomainObjList) doms = NULL;
+    g_autofree char *dir = NULL;
+    g_autofree char *autostartDir = NULL;
+    const size_t count = 64;
+    size_t added = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(dir = testDomainObjListLoadPrepare(count)))
+        return -1;
+    autostartDir = g_strdup_printf("%s/autostart", dir);
+
+    if (!(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    virTestQuiesceLibvirtErrors(true);
+    if (virDomainObjListLoadAllConfigs(doms, dir, autostartDir, false, xmlopt,
+                                       testDomainObjListLoadNotify, &added) < 0)
+        goto cleanup;
+    virResetLastError();
+
+    if (added != count) {
+        fprintf(stderr, "expected %zu new domains, got %zu\n", count, added);
+        goto cleanup;
+    }
+
+    if (virDomainObjListNumOfDomains(doms, false, NULL, NULL) != count) {
+        fprintf(stderr, "unexpected number of domains in the list\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < count; i++) {
+        g_autofree char *name = g_strdup_printf("dom%zu", i);
+        virDomainObjPtr vm;
+        bool ok;
+
+        if (testDomainObjListCheck(doms, i, name, true) < 0)
+            goto cleanup;
+
+        vm = virDomainObjListFindByName(doms, name);
+        ok = vm->persistent && vm->autostart == (i % 3 == 0);
+        virDomainObjEndAPI(&vm);
+
+        if (!ok) {
+            fprintf(stderr, "domain '%s' has wrong persistent/autostart flags\n",
+                    name);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virFileDeleteTree(dir);
+    return ret;
+}
+
+
+static int
+testDomainObjListLoadBench(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virDomainObjList) doms = NULL;
+    g_autofree char *dir = NULL;
+    g_autofree char *autostartDir = NULL;
+    const size_t count = 1500;
+    gint64 start;
+    gint64 serial;
+    gint64 parallel;
+    size_t i;
+    int ret = -1;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    if (!(dir = testDomainObjListLoadPrepare(count)))
+        return -1;
+    autostartDir = g_strdup_printf("%s/autostart", dir);
+
+    /* Parsing the files one after another, which is what loading the
+     * directory used to cost */
+    start = g_get_monotonic_time();
+    for (i = 0; i < count; i++) {
+        g_autofree char *path = g_strdup_printf("%s/dom%zu.xml", dir, i);
+        virDomainDefPtr def;
+
+        if (!(def = virDomainDefParseFile(path, xmlopt, NULL,
+                                          VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                          VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
+            goto cleanup;
+        virDomainDefFree(def);
+    }
+    serial = g_get_monotonic_time() - start;
+
+    if (!(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    virTestQuiesceLibvirtErrors(true);
+    start = g_get_monotonic_time();
+    if (virDomainObjListLoadAllConfigs(doms, dir, autostartDir, false, xmlopt,
+                                       NULL, NULL) < 0)
+        goto cleanup;
+    parallel = g_get_monotonic_time() - start;
+    virResetLastError();
+
+    if (virDomainObjListNumOfDomains(doms, false, NULL, NULL) != count)
+        goto cleanup;
+
+    VIR_TEST_VERBOSE("%zu domains: serial parse %.1f ms, "
+                     "virDomainObjListLoadAllConfigs %.1f ms (%.1fx)",
+                     count, serial / 1000.0, parallel / 1000.0,
+                     parallel ? serial / (double) parallel : 0);
+
+    ret = 0;
+
+ cleanup:
+    virFileDeleteTree(dir);
+    return ret;
+}
+
+
+/* Returns a new locked domain object which looks running */
+static virDomainObjPtr
+testDomainStatusWriterNewVM(size_t idx)
+{
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    g_autofree char *name = g_strdup_printf("dom%zu", idx);
+    g_autofree char *xml = NULL;
+    virDomainObjPtr vm;
+
+    testDomainObjListUUID(uuid, idx);
+    virUUIDFormat(uuid, uuidstr);
+    xml = g_strdup_printf(testDomainObjListLoadXML, name, uuidstr, name,
+                          0, 0, (unsigned int) idx & 0xff);
+
+    if (!(vm = virDomainObjNew(xmlopt)))
+        return NULL;
+
+    if (!(vm->def = virDomainDefParseString(xml, xmlopt, NULL,
+                                            VIR_DOMAIN_DEF_PARSE_INACTIVE))) {
+        virDomainObjEndAPI(&vm);
+        return NULL;
+    }
+
+    vm->def->id = idx + 1;
+    virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
+
+    return vm;
+}
+
+
+static bool
+testDomainStatusWriterExists(const char *dir,
+                             virDomainObjPtr vm)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s.xml", dir, vm->def->name);
+
+    return virFileExists(path);
+}
+
+
+static int
+testDomainStatusWriter(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *dir = g_strdup(TEST_LOAD_DIR_TEMPLATE);
+    virDomainStatusWriterPtr writer = NULL;
+    virDomainObjPtr vms[4] = { NULL };
+    size_t i;
+    int ret = -1;
+
+    if (!g_mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create %s\n", dir);
+        return -1;
+    }
+
+    if (!(writer = virDomainStatusWriterNew(xmlopt, dir, 10000)))
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(vms); i++) {
+        if (!(vms[i] = testDomainStatusWriterNewVM(i)))
+            goto cleanup;
+    }
+
+    /* vms[0]: repeated updates end up as one queued write */
+    virDomainStatusWriterSchedule(writer, vms[0]);
+    virDomainStatusWriterSchedule(writer, vms[0]);
+    virDomainStatusWriterSchedule(writer, vms[0]);
+    if (!vms[0]->statusPending ||
+        testDomainStatusWriterExists(dir, vms[0])) {
+        fprintf(stderr, "status write was not deferred\n");
+        goto cleanup;
+    }
+
+    /* vms[1]: cancelled, e.g. because the domain was stopped */
+    virDomainStatusWriterSchedule(writer, vms[1]);
+    virDomainStatusWriterCancel(writer, vms[1]);
+
+    /* vms[2]: stopped while the write was queued */
+    virDomainStatusWriterSchedule(writer, vms[2]);
+    vms[2]->def->id = -1;
+
+    /* vms[3]: saved synchronously, superseding the queued write */
+    virDomainStatusWriterSchedule(writer, vms[3]);
+    if (virDomainStatusWriterSave(writer, vms[3]) < 0)
+        goto cleanup;
+    if (vms[3]->statusPending ||
+        !testDomainStatusWriterExists(dir, vms[3])) {
+        fprintf(stderr, "save did not write the status\n");
+        goto cleanup;
+    }
+
+    /* the worker must be able to lock the domains */
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virObjectUnlock(vms[i]);
+
+    /* writes whatever is still queued without waiting for the delay */
+    virDomainStatusWriterFree(g_steal_pointer(&writer));
+
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virObjectLock(vms[i]);
+
+    if (vms[0]->statusPending ||
+        !testDomainStatusWriterExists(dir, vms[0])) {
+        fprintf(stderr, "queued status was not written\n");
+        goto cleanup;
+    }
+
+    if (testDomainStatusWriterExists(dir, vms[1]) ||
+        testDomainStatusWriterExists(dir, vms[2])) {
+        fprintf(stderr, "status written for cancelled or inactive domain\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainStatusWriterFree(writer);
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virDomainObjEndAPI(&vms[i]);
+    virFileDeleteTree(dir);
+    return ret;
+}
+
+
+static int
+testDomainStatusWriterFlush(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *dir = g_strdup(TEST_LOAD_DIR_TEMPLATE);
+    g_autofree char *file = NULL;
+    g_autofree char *baddir = NULL;
+    virDomainStatusWriterPtr writer = NULL;
+    virDomainStatusWriterPtr broken = NULL;
+    virDomainObjPtr vms[2] = { NULL };
+    size_t i;
+    int ret = -1;
+
+    if (!g_mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create %s\n", dir);
+        return -1;
+    }
+
+    /* a status directory below a regular file can't be created */
+    file = g_strdup_printf("%s/file", dir);
+    baddir = g_strdup_printf("%s/status", file);
+    if (virFileWriteStr(file, "", 0600) < 0)
+        goto cleanup;
+
+    /* with this delay the workers don't get to write anything before
+     * the flush does */
+    if (!(writer = virDomainStatusWriterNew(xmlopt, dir, 60000)) ||
+        !(broken = virDomainStatusWriterNew(xmlopt, baddir, 60000)))
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(vms); i++) {
+        if (!(vms[i] = testDomainStatusWriterNewVM(i)))
+            goto cleanup;
+    }
+
+    virTestQuiesceLibvirtErrors(true);
+
+    /* vms[1]: saving into a directory which can't be created fails */
+    if (virDomainStatusWriterSave(broken, vms[1]) == 0) {
+        fprintf(stderr, "status saved to an invalid directory\n");
+        goto cleanup;
+    }
+
+    virDomainStatusWriterSchedule(writer, vms[0]);
+    virDomainStatusWriterSchedule(broken, vms[1]);
+
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virObjectUnlock(vms[i]);
+
+    virDomainStatusWriterFlush(writer);
+    virDomainStatusWriterFlush(broken);
+
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virObjectLock(vms[i]);
+
+    if (vms[0]->statusPending ||
+        !testDomainStatusWriterExists(dir, vms[0])) {
+        fprintf(stderr, "flush did not write the status\n");
+        goto cleanup;
+    }
+
+    /* a failed write is not retried forever */
+    if (vms[1]->statusPending ||
+        virFileExists(baddir)) {
+        fprintf(stderr, "failed write is still pending\n");
+        goto cleanup;
+    }
+
+    /* flushing an empty queue is fine */
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virObjectUnlock(vms[i]);
+    virDomainStatusWriterFlush(writer);
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virObjectLock(vms[i]);
+
+    ret = 0;
+
+ cleanup:
+    virSetErrorFunc(NULL, NULL);
+    virResetLastError();
+    virDomainStatusWriterFree(writer);
+    virDomainStatusWriterFree(broken);
+    for (i = 0; i < G_N_ELEMENTS(vms); i++)
+        virDomainObjEndAPI(&vms[i]);
+    virFileDeleteTree(dir);
+    return ret;
+}
+
+
+static virDomainDefPtr
+testDomainDefCopyParse(const char *filename)
+{
+    virDomainDefPtr def;
+
+    /* Some of the files are meant to fail parsing or to carry data
+     * the generic parser rejects; those are not interesting here, but
+     * are logged so that a parser regression doesn't go unnoticed. */
+    virTestQuiesceLibvirtErrors(true);
+    def = virDomainDefParseFile(filename, xmlopt, NULL,
+                                VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE);
+    virSetErrorFunc(NULL, NULL);
+
+    if (!def)
+        VIR_TEST_VERBOSE("cannot parse %s: %s",
+                         filename, virGetLastErrorMessage());
+    virResetLastError();
+
+    return def;
+}
+
+
+struct testDomainDefCopyData {
+    const char *filename;
+    size_t *nskipped;
+};
+
+
+static int
+testDomainDefCopy(const void *opaque)
+{
+    const struct testDomainDefCopyData *data = opaque;
+    unsigned int flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
+    g_autoptr(virDomainDef) def = NULL;
+    g_autoptr(virDomainDef) copy = NULL;
+    g_autofree char *expect = NULL;
+    g_autofree char *actual = NULL;
+
+    if (!(def = testDomainDefCopyParse(data->filename))) {
+        (*data->nskipped)++;
+        return EXIT_AM_SKIP;
+    }
+
+    if (!(copy = virDomainDefCopy(def, xmlopt, NULL, false)))
+        return -1;
+
+    if (!(expect = virDomainDefFormat(def, xmlopt, flags)) ||
+        !(actual = virDomainDefFormat(copy, xmlopt, flags)))
+        return -1;
+
+    return virTestCompareToString(expect, actual);
+}
+
+
+static int
+testDomainDefCopyDir(const char *dirname)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s", abs_srcdir, dirname);
+    DIR *dir = NULL;
+    struct dirent *ent;
+    size_t nfiles = 0;
+    size_t nskipped = 0;
+    int ret = 0;
+    int rc;
+
+    if (virDirOpen(&dir, path) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, path)) > 0) {
+        g_autofree char *filename = NULL;
+        g_autofree char *name = NULL;
+        struct testDomainDefCopyData data = { .nskipped = &nskipped };
+
+        if (!virStringHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        filename = g_strdup_printf("%s/%s", path, ent->d_name);
+        name = g_strdup_printf("Domain def copy %s", ent->d_name);
+        data.filename = filename;
+        nfiles++;
+
+        if (virTestRun(name, testDomainDefCopy, &data) < 0)
+            ret = -1;
+    }
+
+    if (rc < 0)
+        ret = -1;
+
+    VIR_TEST_VERBOSE("%zu of %zu files in %s could not be parsed",
+                     nskipped, nfiles, dirname);
+
+    /* most of the files are expected to parse, anything else means
+     * the test doesn't test much anymore */
+    if (nskipped * 5 > nfiles) {
+        fprintf(stderr, "only %zu of %zu files in %s could be parsed\n",
+                nfiles - nskipped, nfiles, dirname);
+        ret = -1;
+    }
+
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+
+/* Changes of a copy must not show up in the original definition. The
+ * native copy keeps live-only data such as the domain id, while the
+ * migratable copy, which is still done via XML, drops it. */
+static int
+testDomainDefCopyDeep(const void *opaque G_GNUC_UNUSED)
+{
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    unsigned int flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
+    g_autofree char *xml = NULL;
+    g_autofree char *expect = NULL;
+    g_autofree char *actual = NULL;
+    g_autoptr(virDomainDef) def = NULL;
+    g_autoptr(virDomainDef) copy = NULL;
+    g_autoptr(virDomainDef) migratable = NULL;
+
+    testDomainObjListUUID(uuid, 0);
+    virUUIDFormat(uuid, uuidstr);
+    xml = g_strdup_printf(testDomainObjListLoadXML, "copy", uuidstr, "copy",
+                          0, 0, 0);
+
+    if (!(def = virDomainDefParseString(xml, xmlopt, NULL,
+                                        VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+        return -1;
+    def->id = 42;
+
+    if (!(expect = virDomainDefFormat(def, xmlopt, flags)) ||
+        !(copy = virDomainDefCopy(def, xmlopt, NULL, false)) ||
+        !(migratable = virDomainDefCopy(def, xmlopt, NULL, true)))
+        return -1;
+
+    if (copy->id != 42 || migratable->id != -1) {
+        fprintf(stderr, "copies have id %d and %d instead of 42 and -1\n",
+                copy->id, migratable->id);
+        return -1;
+    }
+
+    if (copy->ndisks != def->ndisks || copy->nnets != def->nnets ||
+        copy->disks[0] == def->disks[0] ||
+        copy->disks[0]->src == def->disks[0]->src ||
+        copy->nets[0] == def->nets[0]) {
+        fprintf(stderr, "devices are shared with the copy\n");
+        return -1;
+    }
+
+    g_free(copy->name);
+    copy->name = g_strdup("changed");
+    g_free(copy->disks[0]->src->path);
+    copy->disks[0]->src->path = g_strdup("/changed.qcow2");
+    copy->nets[0]->mac.addr[5] = 0xff;
+    copy->mem.cur_balloon = 1;
+
+    if (!(actual = virDomainDefFormat(def, xmlopt, flags)))
+        return -1;
+
+    return virTestCompareToString(expect, actual);
+}
+
+
+struct testDomainDefCopyBenchData {
+    virDomainDefPtr *defs;
+    size_t ndefs;
+};
+
+
+static int
+testDomainDefCopyBenchNative(size_t i,
+                             void *opaque)
+{
+    struct testDomainDefCopyBenchData *data = opaque;
+    virDomainDefPtr copy;
+
+    if (!(copy = virDomainDefCopy(data->defs[i % data->ndefs],
+                                  xmlopt, NULL, false)))
+        return -1;
+
+    virDomainDefFree(copy);
+    return 0;
+}
+
+
+/* This is what virDomainDefCopy used to do */
+static int
+testDomainDefCopyBenchXML(size_t i,
+                          void *opaque)
+{
+    struct testDomainDefCopyBenchData *data = opaque;
+    g_autofree char *str = NULL;
+    virDomainDefPtr copy;
+
+    if (!(str = virDomainDefFormat(data->defs[i % data->ndefs], xmlopt,
+                                   VIR_DOMAIN_DEF_FORMAT_SECURE)) ||
+        !(copy = virDomainDefParseString(str, xmlopt, NULL,
+                                         VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                         VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
+        return -1;
+
+    virDomainDefFree(copy);
+    return 0;
+}
+
+
+static int
+testDomainDefCopyBench(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *path = g_strdup_printf("%s/qemuxml2argvdata", abs_srcdir);
+    struct testDomainDefCopyBenchData data = { 0 };
+    DIR *dir = NULL;
+    struct dirent *ent;
+    size_t i;
+    int ret = -1;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    if (virDirOpen(&dir, path) < 0)
+        return -1;
+
+    while (virDirRead(dir, &ent, path) > 0) {
+        g_autofree char *filename = NULL;
+        virDomainDefPtr def;
+
+        if (!virStringHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        filename = g_strdup_printf("%s/%s", path, ent->d_name);
+        if (!(def = testDomainDefCopyParse(filename)))
+            continue;
+
+        if (VIR_APPEND_ELEMENT(data.defs, data.ndefs, def) < 0)
+            goto cleanup;
+    }
+
+    if (data.ndefs == 0 ||
+        virTestBenchLoop("native copy", data.ndefs * 20,
+                         testDomainDefCopyBenchNative, &data) < 0 ||
+        virTestBenchLoop("XML round-trip", data.ndefs * 20,
+                         testDomainDefCopyBenchXML, &data) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < data.ndefs; i++)
+        virDomainDefFree(data.defs[i]);
+    VIR_FREE(data.defs);
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -103,6 +1221,41 @@ mymain(void)
     DO_TEST_GET_FS("/dev/pts", false);
     DO_TEST_GET_FS("/doesnotexist", false);
 
+    if (virTestRun("Domain list lookup", testDomainObjListLookup, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Domain list lookup failures",
+                   testDomainObjListLookupFail, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Domain list concurrent lookup",
+                   testDomainObjListConcurrent, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Domain list lookup benchmark",
+                   testDomainObjListBench, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Domain list load configs",
+                   testDomainObjListLoad, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Domain list load configs benchmark",
+                   testDomainObjListLoadBench, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Domain status writer",
+                   testDomainStatusWriter, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Domain status writer flush",
+                   testDomainStatusWriterFlush, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Domain def copy is deep",
+                   testDomainDefCopyDeep, NULL) < 0)
+        ret = -1;
+    if (testDomainDefCopyDir("qemuxml2argvdata") < 0)
+        ret = -1;
+    if (virTestRun("Domain def copy benchmark",
+                   testDomainDefCopyBench, NULL) < 0)
+        ret = -1;
+
     virObjectUnref(caps);
     virObjectUnref(xmlopt);
 
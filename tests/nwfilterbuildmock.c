@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "virnetdev.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Pretend every "vnetN" interface exists and has index N */
+
+int
+virNetDevExists(const char *ifname)
+{
+    return STRPREFIX(ifname, "vnet");
+}
+
+
+int
+virNetDevGetIndex(const char *ifname,
+                  int *ifindex)
+{
+    if (!STRPREFIX(ifname, "vnet") ||
+        virStrToLong_i(ifname + strlen("vnet"), NULL, 10, ifindex) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+int
+virNetDevValidateConfig(const char *ifname,
+                        const virMacAddr *macaddr G_GNUC_UNUSED,
+                        int ifindex)
+{
+    int actual;
+
+    if (virNetDevGetIndex(ifname, &actual) < 0)
+        return 0;
+
+    return ifindex <= 0 || actual == ifindex;
+}
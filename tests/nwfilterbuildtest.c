@@ -0,0 +1,381 @@
+/*
+ * nwfilterbuildtest.c: Test rebuilding the filters of all bindings
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#if defined (__linux__)
+
+# include "testutils.h"
+# include "nwfilter/nwfilter_gentech_driver.h"
+# include "nwfilter/nwfilter_learnipaddr.h"
+# include "nwfilter_ipaddrmap.h"
+# include "virbuffer.h"
+# include "virstring.h"
+
+# define LIBVIRT_VIRFIREWALLPRIV_H_ALLOW
+# include "virfirewallpriv.h"
+
+# define LIBVIRT_VIRCOMMANDPRIV_H_ALLOW
+# include "vircommandpriv.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+static virNWFilterDriverState driver;
+
+/* The commands run, if requested */
+static virBufferPtr commands;
+
+
+static void
+testNWFilterBuildHook(const char *const*args,
+                      const char *const*env G_GNUC_UNUSED,
+                      const char *input,
+                      char **output,
+                      char **error G_GNUC_UNUSED,
+                      int *status G_GNUC_UNUSED,
+                      void *opaque G_GNUC_UNUSED)
+{
+    /* the state match probe of the ebiptables driver */
+    if (args[1] && STREQ(args[1], "--version")) {
+        *output = g_strdup("iptables v1.8.4\n");
+        return;
+    }
+
+    if (commands) {
+        g_autoptr(virCommand) cmd = virCommandNewArgs(args);
+        g_autofree char *str = virCommandToString(cmd, false);
+
+        virBufferAsprintf(commands, "%s\n", str);
+        if (input)
+            virBufferAdd(commands, input, -1);
+    }
+}
+
+
+static int
+testNWFilterBuildRebuild(void *opaque)
+{
+    virNWFilterDriverStatePtr nwdriver = opaque;
+
+    return virNWFilterBuildAll(nwdriver, true);
+}
+
+
+static int
+testNWFilterBuildDefine(const char *name,
+                        const char *uuid,
+                        const char *body)
+{
+    g_autofree char *xml = NULL;
+    virNWFilterDefPtr def;
+    virNWFilterObjPtr obj;
+
+    xml = g_strdup_printf("<filter name='%s' chain='root'>\n"
+                          "  <uuid>%s</uuid>\n"
+                          "%s"
+                          "</filter>\n",
+                          name, uuid, body);
+
+    if (!(def = virNWFilterDefParseString(xml)))
+        return -1;
+
+    if (!(obj = virNWFilterObjListAssignDef(driver.nwfilters, def))) {
+        virNWFilterDefFree(def);
+        return -1;
+    }
+
+    virNWFilterObjUnlock(obj);
+    return 0;
+}
+
+
+static const char *testRuleBase =
+    "  <rule action='drop' direction='out' priority='500'>\n"
+    "    <mac match='no' srcmacaddr='$MAC'/>\n"
+    "  </rule>\n";
+
+static const char *testRuleBaseNew =
+    "  <rule action='drop' direction='out' priority='500'>\n"
+    "    <mac match='no' srcmacaddr='$MAC'/>\n"
+    "  </rule>\n"
+    "  <rule action='accept' direction='inout' priority='600'>\n"
+    "    <mac protocolid='arp'/>\n"
+    "  </rule>\n";
+
+static const char *testRuleA =
+    "  <filterref filter='test-base'/>\n"
+    "  <rule action='accept' direction='in' priority='700'>\n"
+    "    <mac protocolid='ipv4'/>\n"
+    "  </rule>\n";
+
+static const char *testRuleB =
+    "  <rule action='accept' direction='in' priority='700'>\n"
+    "    <mac protocolid='ipv6'/>\n"
+    "  </rule>\n";
+
+# define TEST_UUID_BASE "5c6d49af-b071-6127-b4ec-6f8ed4b55300"
+# define TEST_UUID_A "5c6d49af-b071-6127-b4ec-6f8ed4b55301"
+# define TEST_UUID_B "5c6d49af-b071-6127-b4ec-6f8ed4b55302"
+
+
+/*
+ * Set up @nbindings bindings on the interfaces vnet1 to vnetN,
+ * those with an odd index use filter 'test-a', which includes
+ * 'test-base', those with an even index use 'test-b'.
+ */
+static int
+testNWFilterBuildSetup(size_t nbindings)
+{
+    size_t i;
+
+    if (!(driver.nwfilters = virNWFilterObjListNew()) ||
+        !(driver.bindings = virNWFilterBindingObjListNew()))
+        return -1;
+
+    if (testNWFilterBuildDefine("test-base", TEST_UUID_BASE, testRuleBase) < 0 ||
+        testNWFilterBuildDefine("test-a", TEST_UUID_A, testRuleA) < 0 ||
+        testNWFilterBuildDefine("test-b", TEST_UUID_B, testRuleB) < 0)
+        return -1;
+
+    for (i = 1; i <= nbindings; i++) {
+        g_autofree char *xml = NULL;
+        virNWFilterBindingDefPtr def;
+        virNWFilterBindingObjPtr obj;
+
+        xml = g_strdup_printf("<filterbinding>\n"
+                              "  <owner>\n"
+                              "    <name>vm%zu</name>\n"
+                              "    <uuid>d54df46f-1ab5-4a22-8618-%012zx</uuid>\n"
+                              "  </owner>\n"
+                              "  <portdev name='vnet%zu'/>\n"
+                              "  <mac address='52:54:00:%02zx:%02zx:%02zx'/>\n"
+                              "  <filterref filter='%s'/>\n"
+                              "</filterbinding>\n",
+                              i, i, i,
+                              (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff,
+                              i % 2 ? "test-a" : "test-b");
+
+        if (!(def = virNWFilterBindingDefParseString(xml)))
+            return -1;
+
+        if (!(obj = virNWFilterBindingObjListAdd(driver.bindings, def))) {
+            virNWFilterBindingDefFree(def);
+            return -1;
+        }
+
+        virNWFilterBindingObjEndAPI(&obj);
+    }
+
+    return virNWFilterBuildAll(&driver, false);
+}
+
+
+static void
+testNWFilterBuildTeardown(void)
+{
+    virObjectUnref(driver.bindings);
+    driver.bindings = NULL;
+    if (driver.nwfilters)
+        virNWFilterObjListFree(driver.nwfilters);
+    driver.nwfilters = NULL;
+}
+
+
+static int
+testNWFilterBuildIncremental(const void *opaque)
+{
+    const size_t *nworkers = opaque;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    const char *actual;
+    size_t i;
+    int ret = -1;
+
+    driver.buildWorkers = *nworkers;
+
+    if (testNWFilterBuildSetup(4) < 0)
+        goto cleanup;
+
+    /* changing 'test-base' must only rebuild the interfaces whose
+     * filter includes it */
+    commands = &buf;
+    if (testNWFilterBuildDefine("test-base", TEST_UUID_BASE,
+                                testRuleBaseNew) < 0)
+        goto cleanup;
+    commands = NULL;
+
+    actual = virBufferCurrentContent(&buf);
+    for (i = 1; i <= 4; i++) {
+        g_autofree char *chain = g_strdup_printf("-vnet%zu", i);
+        bool used = actual && strstr(actual, chain);
+
+        if (used != (i % 2 == 1)) {
+            fprintf(stderr, "interface vnet%zu %s unexpectedly\n",
+                    i, used ? "rebuilt" : "not rebuilt");
+            goto cleanup;
+        }
+    }
+
+    /* a filter nobody references changing must not touch anything */
+    commands = &buf;
+    virBufferFreeAndReset(&buf);
+    if (testNWFilterBuildDefine("test-unused",
+                                "5c6d49af-b071-6127-b4ec-6f8ed4b55303",
+                                testRuleB) < 0 ||
+        testNWFilterBuildDefine("test-unused",
+                                "5c6d49af-b071-6127-b4ec-6f8ed4b55303",
+                                testRuleA) < 0)
+        goto cleanup;
+    commands = NULL;
+
+    if (virBufferUse(&buf) != 0) {
+        fprintf(stderr, "Unexpected commands run:\n%s",
+                virBufferCurrentContent(&buf));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    commands = NULL;
+    virBufferFreeAndReset(&buf);
+    testNWFilterBuildTeardown();
+    return ret;
+}
+
+
+static int
+testNWFilterBuildBenchRun(size_t nworkers,
+                          void *opaque)
+{
+    size_t *runs = opaque;
+    const char *rule = (*runs)++ % 2 ? testRuleBase : testRuleBaseNew;
+
+    driver.buildWorkers = nworkers;
+
+    /* alternate between two versions so that every run changes it */
+    return testNWFilterBuildDefine("test-base", TEST_UUID_BASE, rule);
+}
+
+
+/*
+ * Measure how long updating a filter used by all of @nbindings
+ * bindings takes, both with the rules applied by a single thread and
+ * by a pool of workers, and how long updating a filter not used by
+ * any of them takes.
+ */
+static int
+testNWFilterBuildBench(const void *opaque G_GNUC_UNUSED)
+{
+    const size_t nbindings = 2000;
+    g_autofree char *what = NULL;
+    size_t runs = 0;
+    gint64 start;
+    int ret = -1;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    driver.buildWorkers = 1;
+
+    if (testNWFilterBuildSetup(nbindings) < 0)
+        goto cleanup;
+
+    what = g_strdup_printf("%zu bindings: rebuilt %zu",
+                           nbindings, nbindings / 2);
+    if (virTestBenchWorkers(what, testNWFilterBuildBenchRun, &runs) < 0)
+        goto cleanup;
+
+    start = g_get_monotonic_time();
+    if (testNWFilterBuildDefine("test-b", TEST_UUID_B, testRuleA) < 0)
+        goto cleanup;
+    VIR_TEST_VERBOSE("%zu bindings: rebuilt %zu after changing another filter in %lld ms",
+                     nbindings, nbindings / 2,
+                     (long long)(g_get_monotonic_time() - start) / 1000);
+
+    ret = 0;
+ cleanup:
+    testNWFilterBuildTeardown();
+    return ret;
+}
+
+
+static bool
+hasNetfilterTools(void)
+{
+    return virFileIsExecutable(IPTABLES_PATH) &&
+        virFileIsExecutable(IP6TABLES_PATH) &&
+        virFileIsExecutable(EBTABLES_PATH);
+}
+
+
+static int
+mymain(void)
+{
+    size_t serial = 1;
+    size_t parallel = 4;
+    int ret = 0;
+
+    virFirewallSetLockOverride(true);
+
+    if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0) {
+        if (!hasNetfilterTools()) {
+            fprintf(stderr, "iptables/ip6tables/ebtables tools not present");
+            return EXIT_AM_SKIP;
+        }
+
+        return EXIT_FAILURE;
+    }
+
+    virCommandSetDryRun(NULL, testNWFilterBuildHook, NULL);
+
+    if (virNWFilterIPAddrMapInit() < 0 ||
+        virNWFilterLearnInit() < 0 ||
+        virNWFilterTechDriversInit(true) < 0 ||
+        virNWFilterConfLayerInit(testNWFilterBuildRebuild, &driver) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Incremental rebuild", testNWFilterBuildIncremental,
+                   &serial) < 0)
+        ret = -1;
+    if (virTestRun("Incremental rebuild parallel", testNWFilterBuildIncremental,
+                   &parallel) < 0)
+        ret = -1;
+    if (virTestRun("Rebuild benchmark", testNWFilterBuildBench, NULL) < 0)
+        ret = -1;
+
+    virNWFilterConfLayerShutdown();
+    virNWFilterTechDriversShutdown();
+    virNWFilterLearnShutdown();
+    virNWFilterIPAddrMapShutdown();
+    virCommandSetDryRun(NULL, NULL, NULL);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("nwfilterbuild"))
+
+#else /* ! defined (__linux__) */
+
+int main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* ! defined (__linux__) */
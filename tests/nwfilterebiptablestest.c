@@ -25,6 +25,7 @@
 #include "nwfilter/nwfilter_ebiptables_driver.h"
 #include "virbuffer.h"
 #include "virfirewall.h"
+#include "virstring.h"
 
 #define LIBVIRT_VIRFIREWALLPRIV_H_ALLOW
 #include "virfirewallpriv.h"
@@ -35,6 +36,82 @@
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 
+/*
+ * Record the commands run in the same format as the dry run buffer
+ * does, except that a *-restore payload is expanded into the
+ * commands for the individual rules it contains. With batching
+ * enabled the result must be the same as without.
+ */
+static void
+testNWFilterEBIPTablesExpandRestore(const char *const*args,
+                                    const char *const*env G_GNUC_UNUSED,
+                                    const char *input,
+                                    char **output G_GNUC_UNUSED,
+                                    char **error G_GNUC_UNUSED,
+                                    int *status G_GNUC_UNUSED,
+                                    void *opaque)
+{
+    virBufferPtr buf = opaque;
+    g_autofree char *bin = NULL;
+    g_autofree char *table = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    size_t i;
+
+    if (!virStringHasSuffix(args[0], "-restore")) {
+        g_autoptr(virCommand) cmd = virCommandNewArgs(args);
+        g_autofree char *str = virCommandToString(cmd, false);
+
+        virBufferAsprintf(buf, "%s\n", str);
+        return;
+    }
+
+    bin = g_strndup(args[0], strlen(args[0]) - strlen("-restore"));
+    lines = virStringSplit(input, "\n", 0);
+
+    for (i = 0; lines && lines[i]; i++) {
+        g_autoptr(virCommand) cmd = NULL;
+        g_autofree char *str = NULL;
+        VIR_AUTOSTRINGLIST words = NULL;
+        size_t j;
+
+        if (lines[i][0] == '\0' || STREQ(lines[i], "COMMIT"))
+            continue;
+
+        if (lines[i][0] == '*') {
+            g_free(table);
+            table = g_strdup(lines[i] + 1);
+            continue;
+        }
+
+        cmd = virCommandNew(bin);
+        if (STRNEQ_NULLABLE(table, "filter"))
+            virCommandAddArgList(cmd, "-t", table, NULL);
+
+        /* The rules used here need no quoting */
+        words = virStringSplit(lines[i], " ", 0);
+        for (j = 0; words[j]; j++)
+            virCommandAddArg(cmd, words[j]);
+
+        str = virCommandToString(cmd, false);
+        virBufferAsprintf(buf, "%s\n", str);
+    }
+}
+
+
+static void
+testNWFilterEBIPTablesSetDryRun(virBufferPtr buf,
+                                const void *opaque)
+{
+    bool batch = *(const bool *)opaque;
+
+    virFirewallSetRestoreOverride(batch);
+    if (batch)
+        virCommandSetDryRun(NULL, testNWFilterEBIPTablesExpandRestore, buf);
+    else
+        virCommandSetDryRun(buf, NULL, NULL);
+}
+
+
 #define VIR_NWFILTER_NEW_RULES_TEARDOWN \
     "iptables -D libvirt-out -m physdev --physdev-is-bridged --physdev-out vnet0 -g FP-vnet0\n" \
     "iptables -D libvirt-out -m physdev --physdev-out vnet0 -g FP-vnet0\n" \
@@ -66,7 +143,7 @@
     "ebtables -t nat -X libvirt-P-vnet0\n"
 
 static int
-testNWFilterEBIPTablesAllTeardown(const void *opaque G_GNUC_UNUSED)
+testNWFilterEBIPTablesAllTeardown(const void *opaque)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     const char *expected =
@@ -104,7 +181,7 @@ testNWFilterEBIPTablesAllTeardown(const void *opaque G_GNUC_UNUSED)
     char *actual = NULL;
     int ret = -1;
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    testNWFilterEBIPTablesSetDryRun(&buf, opaque);
 
     if (ebiptables_driver.allTeardown("vnet0") < 0)
         goto cleanup;
@@ -127,7 +204,7 @@ testNWFilterEBIPTablesAllTeardown(const void *opaque G_GNUC_UNUSED)
 
 
 static int
-testNWFilterEBIPTablesTearOldRules(const void *opaque G_GNUC_UNUSED)
+testNWFilterEBIPTablesTearOldRules(const void *opaque)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     const char *expected =
@@ -172,7 +249,7 @@ testNWFilterEBIPTablesTearOldRules(const void *opaque G_GNUC_UNUSED)
     char *actual = NULL;
     int ret = -1;
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    testNWFilterEBIPTablesSetDryRun(&buf, opaque);
 
     if (ebiptables_driver.tearOldRules("vnet0") < 0)
         goto cleanup;
@@ -195,7 +272,7 @@ testNWFilterEBIPTablesTearOldRules(const void *opaque G_GNUC_UNUSED)
 
 
 static int
-testNWFilterEBIPTablesRemoveBasicRules(const void *opaque G_GNUC_UNUSED)
+testNWFilterEBIPTablesRemoveBasicRules(const void *opaque)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     const char *expected =
@@ -218,7 +295,7 @@ testNWFilterEBIPTablesRemoveBasicRules(const void *opaque G_GNUC_UNUSED)
     char *actual = NULL;
     int ret = -1;
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    testNWFilterEBIPTablesSetDryRun(&buf, opaque);
 
     if (ebiptables_driver.removeBasicRules("vnet0") < 0)
         goto cleanup;
@@ -241,7 +318,7 @@ testNWFilterEBIPTablesRemoveBasicRules(const void *opaque G_GNUC_UNUSED)
 
 
 static int
-testNWFilterEBIPTablesTearNewRules(const void *opaque G_GNUC_UNUSED)
+testNWFilterEBIPTablesTearNewRules(const void *opaque)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     const char *expected =
@@ -249,7 +326,7 @@ testNWFilterEBIPTablesTearNewRules(const void *opaque G_GNUC_UNUSED)
     char *actual = NULL;
     int ret = -1;
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    testNWFilterEBIPTablesSetDryRun(&buf, opaque);
 
     if (ebiptables_driver.tearNewRules("vnet0") < 0)
         goto cleanup;
@@ -272,7 +349,7 @@ testNWFilterEBIPTablesTearNewRules(const void *opaque G_GNUC_UNUSED)
 
 
 static int
-testNWFilterEBIPTablesApplyBasicRules(const void *opaque G_GNUC_UNUSED)
+testNWFilterEBIPTablesApplyBasicRules(const void *opaque)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     const char *expected =
@@ -318,7 +395,7 @@ testNWFilterEBIPTablesApplyBasicRules(const void *opaque G_GNUC_UNUSED)
     int ret = -1;
     virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    testNWFilterEBIPTablesSetDryRun(&buf, opaque);
 
     if (ebiptables_driver.applyBasicRules("vnet0", &mac) < 0)
         goto cleanup;
@@ -341,7 +418,7 @@ testNWFilterEBIPTablesApplyBasicRules(const void *opaque G_GNUC_UNUSED)
 
 
 static int
-testNWFilterEBIPTablesApplyDHCPOnlyRules(const void *opaque G_GNUC_UNUSED)
+testNWFilterEBIPTablesApplyDHCPOnlyRules(const void *opaque)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     const char *expected =
@@ -405,7 +482,7 @@ testNWFilterEBIPTablesApplyDHCPOnlyRules(const void *opaque G_GNUC_UNUSED)
         }
     };
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    testNWFilterEBIPTablesSetDryRun(&buf, opaque);
 
     if (ebiptables_driver.applyDHCPOnlyRules("vnet0", &mac, &val, false) < 0)
         goto cleanup;
@@ -429,7 +506,7 @@ testNWFilterEBIPTablesApplyDHCPOnlyRules(const void *opaque G_GNUC_UNUSED)
 
 
 static int
-testNWFilterEBIPTablesApplyDropAllRules(const void *opaque G_GNUC_UNUSED)
+testNWFilterEBIPTablesApplyDropAllRules(const void *opaque)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     const char *expected =
@@ -475,7 +552,7 @@ testNWFilterEBIPTablesApplyDropAllRules(const void *opaque G_GNUC_UNUSED)
     char *actual = NULL;
     int ret = -1;
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    testNWFilterEBIPTablesSetDryRun(&buf, opaque);
 
     if (ebiptables_driver.applyDropAllRules("vnet0") < 0)
         goto cleanup;
@@ -521,40 +598,23 @@ mymain(void)
         return EXIT_FAILURE;
     }
 
-    if (virTestRun("ebiptablesAllTeardown",
-                   testNWFilterEBIPTablesAllTeardown,
-                   NULL) < 0)
-        ret = -1;
-
-    if (virTestRun("ebiptablesTearOldRules",
-                   testNWFilterEBIPTablesTearOldRules,
-                   NULL) < 0)
-        ret = -1;
-
-    if (virTestRun("ebiptablesRemoveBasicRules",
-                   testNWFilterEBIPTablesRemoveBasicRules,
-                   NULL) < 0)
-        ret = -1;
-
-    if (virTestRun("ebiptablesTearNewRules",
-                   testNWFilterEBIPTablesTearNewRules,
-                   NULL) < 0)
-        ret = -1;
-
-    if (virTestRun("ebiptablesApplyBasicRules",
-                   testNWFilterEBIPTablesApplyBasicRules,
-                   NULL) < 0)
-        ret = -1;
-
-    if (virTestRun("ebiptablesApplyDHCPOnlyRules",
-                   testNWFilterEBIPTablesApplyDHCPOnlyRules,
-                   NULL) < 0)
-        ret = -1;
-
-    if (virTestRun("ebiptablesApplyDropAllRules",
-                   testNWFilterEBIPTablesApplyDropAllRules,
-                   NULL) < 0)
-        ret = -1;
+#define DO_TEST(name, func) \
+    do { \
+        bool batch = false; \
+        if (virTestRun(name, func, &batch) < 0) \
+            ret = -1; \
+        batch = true; \
+        if (virTestRun(name " batched", func, &batch) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST("ebiptablesAllTeardown", testNWFilterEBIPTablesAllTeardown);
+    DO_TEST("ebiptablesTearOldRules", testNWFilterEBIPTablesTearOldRules);
+    DO_TEST("ebiptablesRemoveBasicRules", testNWFilterEBIPTablesRemoveBasicRules);
+    DO_TEST("ebiptablesTearNewRules", testNWFilterEBIPTablesTearNewRules);
+    DO_TEST("ebiptablesApplyBasicRules", testNWFilterEBIPTablesApplyBasicRules);
+    DO_TEST("ebiptablesApplyDHCPOnlyRules", testNWFilterEBIPTablesApplyDHCPOnlyRules);
+    DO_TEST("ebiptablesApplyDropAllRules", testNWFilterEBIPTablesApplyDropAllRules);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -79,32 +79,33 @@ qemuMonitorSend(qemuMonitorPtr mon,
 }
 
 
-static int (*realQemuMonitorJSONIOProcessLine)(qemuMonitorPtr mon,
-                                               const char *line,
-                                               qemuMonitorMessagePtr msg);
+static int (*realQemuMonitorJSONIOProcessMessage)(qemuMonitorPtr mon,
+                                                  virJSONValuePtr obj,
+                                                  const char *line);
 
 int
-qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
-                             const char *line,
-                             qemuMonitorMessagePtr msg)
+qemuMonitorJSONIOProcessMessage(qemuMonitorPtr mon,
+                                virJSONValuePtr obj,
+                                const char *line)
 {
-    virJSONValuePtr value = NULL;
     char *json = NULL;
+    bool greeting;
     int ret;
 
-    REAL_SYM(realQemuMonitorJSONIOProcessLine);
+    REAL_SYM(realQemuMonitorJSONIOProcessMessage);
 
-    ret = realQemuMonitorJSONIOProcessLine(mon, line, msg);
+    /* @obj is consumed by the real function */
+    if (!(json = virJSONValueToString(obj, true))) {
+        fprintf(stderr, "Failed to reformat reply string '%s'\n", line);
+        abort();
+    }
+    greeting = virJSONValueObjectHasKey(obj, "QMP") == 1;
 
-    if (ret == 0) {
-        if (!(value = virJSONValueFromString(line)) ||
-            !(json = virJSONValueToString(value, true))) {
-            fprintf(stderr, "Failed to reformat reply string '%s'\n", line);
-            abort();
-        }
+    ret = realQemuMonitorJSONIOProcessMessage(mon, obj, line);
 
+    if (ret == 0) {
         /* Ignore QMP greeting */
-        if (virJSONValueObjectHasKey(value, "QMP"))
+        if (greeting)
             goto cleanup;
 
         if (first)
@@ -117,6 +118,5 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
  cleanup:
     VIR_FREE(json);
-    virJSONValueFree(value);
     return ret;
 }
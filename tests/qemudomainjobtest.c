@@ -0,0 +1,557 @@
+/*
+ * qemudomainjobtest.c: Test the order in which domain jobs are granted
+ *                      and sharing of query jobs
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "virthread.h"
+# include "qemu/qemu_domain.h"
+# include "virtypedparam.h"
+
+# include "testutilsqemu.h"
+
+# define VIR_FROM_THIS VIR_FROM_QEMU
+
+# define TEST_MAX_THREADS 8
+
+static virQEMUDriver driver;
+
+struct testJobRun {
+    virDomainObjPtr vm;
+
+    /* names of the threads in the order they got their job,
+     * protected by the domain lock */
+    const char *order[TEST_MAX_THREADS];
+    size_t norder;
+
+    /* signalled when threads holding their job may end it */
+    virCond cond;
+    bool release;
+};
+
+struct testJobThread {
+    struct testJobRun *run;
+    const char *name;
+    qemuDomainJob job;
+    bool async;
+    bool shared;
+    bool hold; /* keep the job until @run->release is set */
+    virThread thread;
+    unsigned long long id;
+    int ret;
+};
+
+
+static void
+testJobThreadRun(void *opaque)
+{
+    struct testJobThread *thr = opaque;
+    virDomainObjPtr vm = thr->run->vm;
+
+    virObjectLock(vm);
+
+    thr->id = virThreadSelfID();
+
+    if (thr->async) {
+        thr->ret = qemuDomainObjBeginAsyncJob(&driver, vm,
+                                              QEMU_ASYNC_JOB_DUMP,
+                                              VIR_DOMAIN_JOB_OPERATION_DUMP,
+                                              0);
+    } else if (thr->shared) {
+        thr->ret = qemuDomainObjBeginSharedQueryJob(&driver, vm, false, 0);
+    } else {
+        thr->ret = qemuDomainObjBeginJob(&driver, vm, thr->job);
+    }
+
+    if (thr->ret == 0) {
+        thr->run->order[thr->run->norder++] = thr->name;
+        while (thr->hold && !thr->run->release)
+            ignore_value(virCondWait(&thr->run->cond, &vm->parent.lock));
+        /* the async job is ended by the test */
+        if (!thr->async)
+            qemuDomainObjEndJob(&driver, vm);
+    }
+
+    virObjectUnlock(vm);
+}
+
+
+/* Waits until @depth threads are queued for a job. @run->vm must be
+ * locked. */
+static int
+testJobWaitQueued(struct testJobRun *run,
+                  size_t depth)
+{
+    qemuDomainObjPrivatePtr priv = run->vm->privateData;
+    size_t i;
+
+    for (i = 0; i < 1000; i++) {
+        if (priv->job.queueDepth == depth)
+            return 0;
+
+        virObjectUnlock(run->vm);
+        g_usleep(10 * 1000);
+        virObjectLock(run->vm);
+    }
+
+    fprintf(stderr, "expected %zu queued threads, got %zu\n",
+            depth, priv->job.queueDepth);
+    return -1;
+}
+
+
+/* Waits until @holders threads share the job. @run->vm must be
+ * locked. */
+static int
+testJobWaitHolders(struct testJobRun *run,
+                   size_t holders)
+{
+    qemuDomainObjPrivatePtr priv = run->vm->privateData;
+    size_t i;
+
+    for (i = 0; i < 1000; i++) {
+        if (priv->job.sharedQueries == holders)
+            return 0;
+
+        virObjectUnlock(run->vm);
+        g_usleep(10 * 1000);
+        virObjectLock(run->vm);
+    }
+
+    fprintf(stderr, "expected %zu job holders, got %zu\n",
+            holders, priv->job.sharedQueries);
+    return -1;
+}
+
+
+/* Starts @thr and waits until @depth threads are queued, including @thr
+ * unless it gets its job right away. @run->vm must be locked. */
+static int
+testJobThreadStart(struct testJobRun *run,
+                   struct testJobThread *thr,
+                   size_t depth)
+{
+    thr->run = run;
+    thr->ret = -1;
+
+    if (virThreadCreate(&thr->thread, true, testJobThreadRun, thr) < 0)
+        return -1;
+
+    return testJobWaitQueued(run, depth);
+}
+
+
+static int
+testJobCheckOrder(struct testJobRun *run,
+                  const char **expected,
+                  size_t nexpected)
+{
+    size_t i;
+
+    if (run->norder != nexpected) {
+        fprintf(stderr, "expected %zu jobs, got %zu\n",
+                nexpected, run->norder);
+        return -1;
+    }
+
+    for (i = 0; i < nexpected; i++) {
+        if (STRNEQ(run->order[i], expected[i])) {
+            fprintf(stderr, "job %zu went to '%s', expected '%s'\n",
+                    i, run->order[i], expected[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+testJobRunRelease(struct testJobRun *run)
+{
+    run->release = true;
+    virCondBroadcast(&run->cond);
+}
+
+
+static virDomainObjPtr
+testJobDomainNew(void)
+{
+    virDomainObjPtr vm;
+
+    if (!(vm = virDomainObjNew(driver.xmlopt)))
+        return NULL;
+
+    vm->def = virDomainDefNew();
+    vm->def->name = g_strdup("jobs");
+
+    return vm;
+}
+
+
+/* Queries wait for modify jobs, each class is served in order of
+ * arrival */
+static int
+testJobQueueOrder(const void *opaque G_GNUC_UNUSED)
+{
+    struct testJobRun run = { 0 };
+    struct testJobThread thr[] = {
+        { .name = "query1", .job = QEMU_JOB_QUERY },
+        { .name = "modify1", .job = QEMU_JOB_MODIFY },
+        { .name = "query2", .job = QEMU_JOB_QUERY },
+        { .name = "modify2", .job = QEMU_JOB_MODIFY },
+    };
+    const char *expected[] = { "modify1", "modify2", "query1", "query2" };
+    size_t nstarted = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(run.vm = testJobDomainNew()))
+        return -1;
+
+    if (qemuDomainObjBeginJob(&driver, run.vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(thr); i++) {
+        if (testJobThreadStart(&run, &thr[i], i + 1) < 0) {
+            qemuDomainObjEndJob(&driver, run.vm);
+            goto cleanup;
+        }
+        nstarted++;
+    }
+
+    qemuDomainObjEndJob(&driver, run.vm);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(run.vm);
+    for (i = 0; i < nstarted; i++) {
+        virThreadJoin(&thr[i].thread);
+        if (thr[i].ret < 0)
+            ret = -1;
+    }
+
+    if (ret == 0)
+        ret = testJobCheckOrder(&run, expected, G_N_ELEMENTS(expected));
+
+    virObjectUnref(run.vm);
+    return ret;
+}
+
+
+/* Threads which had to wait for an async job started meanwhile keep
+ * their place in the queue */
+static int
+testJobQueueRequeue(const void *opaque G_GNUC_UNUSED)
+{
+    struct testJobRun run = { 0 };
+    struct testJobThread thr[] = {
+        { .name = "async", .async = true },
+        { .name = "modify1", .job = QEMU_JOB_MODIFY },
+        { .name = "modify2", .job = QEMU_JOB_MODIFY },
+    };
+    const char *expected[] = { "async", "modify1", "modify2" };
+    qemuDomainObjPrivatePtr priv;
+    size_t nstarted = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(run.vm = testJobDomainNew()))
+        return -1;
+    priv = run.vm->privateData;
+
+    if (qemuDomainObjBeginJob(&driver, run.vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(thr); i++) {
+        if (testJobThreadStart(&run, &thr[i], i + 1) < 0) {
+            qemuDomainObjEndJob(&driver, run.vm);
+            goto cleanup;
+        }
+        nstarted++;
+    }
+
+    /* the async job goes first, the others leave the queue to wait
+     * for it to finish */
+    qemuDomainObjEndJob(&driver, run.vm);
+
+    if (testJobWaitQueued(&run, 0) < 0)
+        goto cleanup;
+
+    if (priv->job.asyncJob != QEMU_ASYNC_JOB_DUMP) {
+        fprintf(stderr, "expected the async job to be running\n");
+        goto cleanup;
+    }
+
+    /* nobody is queued now, so the test gets the job right away */
+    qemuDomainObjEndAsyncJob(&driver, run.vm);
+    if (qemuDomainObjBeginJob(&driver, run.vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    /* whichever of the waiting threads wakes up first, they're queued
+     * in their original order */
+    if (testJobWaitQueued(&run, 2) < 0) {
+        qemuDomainObjEndJob(&driver, run.vm);
+        goto cleanup;
+    }
+
+    qemuDomainObjEndJob(&driver, run.vm);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(run.vm);
+    for (i = 0; i < nstarted; i++) {
+        virThreadJoin(&thr[i].thread);
+        if (thr[i].ret < 0)
+            ret = -1;
+    }
+
+    if (ret == 0)
+        ret = testJobCheckOrder(&run, expected, G_N_ELEMENTS(expected));
+
+    virObjectUnref(run.vm);
+    return ret;
+}
+
+
+/* Shared query jobs can be held by several threads, the job is handed
+ * over to the remaining holder and queued jobs are not overtaken */
+static int
+testJobShared(const void *opaque G_GNUC_UNUSED)
+{
+    struct testJobRun run = { 0 };
+    struct testJobThread holder = { .name = "shared1", .shared = true,
+                                    .hold = true };
+    struct testJobThread modify = { .name = "modify",
+                                    .job = QEMU_JOB_MODIFY };
+    struct testJobThread shared = { .name = "shared2", .shared = true };
+    struct testJobThread *thr[] = { &holder, &modify, &shared };
+    const char *expected[] = { "shared1", "modify", "shared2" };
+    qemuDomainObjPrivatePtr priv;
+    size_t nstarted = 0;
+    size_t i;
+    int ret = -1;
+
+    if (virCondInit(&run.cond) < 0)
+        return -1;
+
+    if (!(run.vm = testJobDomainNew()))
+        goto cleanup;
+    priv = run.vm->privateData;
+
+    if (qemuDomainObjBeginSharedQueryJob(&driver, run.vm, false, 0) < 0)
+        goto cleanup;
+
+    /* the holder joins the job right away */
+    if (testJobThreadStart(&run, &holder, 0) < 0 ||
+        testJobWaitHolders(&run, 2) < 0) {
+        qemuDomainObjEndJob(&driver, run.vm);
+        goto cleanup;
+    }
+    nstarted++;
+
+    if (priv->job.owner != virThreadSelfID()) {
+        fprintf(stderr, "expected the first holder to own the job\n");
+        qemuDomainObjEndJob(&driver, run.vm);
+        goto cleanup;
+    }
+
+    qemuDomainObjEndJob(&driver, run.vm);
+
+    if (priv->job.active != QEMU_JOB_QUERY ||
+        priv->job.sharedQueries != 1) {
+        fprintf(stderr, "expected the job to stay with the other holder\n");
+        goto cleanup;
+    }
+
+    if (priv->job.owner != holder.id) {
+        fprintf(stderr, "expected the job owner to be %llu, not %llu\n",
+                holder.id, priv->job.owner);
+        goto cleanup;
+    }
+
+    /* a shared query must not overtake the queued modify job */
+    if (testJobThreadStart(&run, &modify, 1) < 0)
+        goto cleanup;
+    nstarted++;
+
+    if (testJobThreadStart(&run, &shared, 2) < 0)
+        goto cleanup;
+    nstarted++;
+
+    ret = 0;
+
+ cleanup:
+    if (run.vm) {
+        testJobRunRelease(&run);
+        virObjectUnlock(run.vm);
+    }
+    for (i = 0; i < nstarted; i++) {
+        virThreadJoin(&thr[i]->thread);
+        if (thr[i]->ret < 0)
+            ret = -1;
+    }
+
+    if (ret == 0)
+        ret = testJobCheckOrder(&run, expected, G_N_ELEMENTS(expected));
+
+    virObjectUnref(run.vm);
+    virCondDestroy(&run.cond);
+    return ret;
+}
+
+
+static int
+testJobQueueCheckParams(virDomainObjPtr vm,
+                        unsigned long long depth)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned long long val;
+    int ret = -1;
+
+    if (qemuDomainObjJobQueueInfoToParams(vm, &params, &nparams) < 0)
+        goto cleanup;
+
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_JOB_QUEUE_DEPTH, &val) != 1 ||
+        val != depth) {
+        fprintf(stderr, "expected queue depth %llu\n", depth);
+        goto cleanup;
+    }
+
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_JOB_QUEUE_WAIT, &val) != 1 ||
+        virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_JOB_QUEUE_WAIT_LAST, &val) != 1) {
+        fprintf(stderr, "expected queue wait times to be reported\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+
+/* The queue behind a synchronous job is reported even though there's no
+ * async job whose statistics the queue could be attached to */
+static int
+testJobQueueSyncOnly(const void *opaque G_GNUC_UNUSED)
+{
+    struct testJobRun run = { 0 };
+    struct testJobThread thr[] = {
+        { .name = "modify", .job = QEMU_JOB_MODIFY },
+        { .name = "query", .job = QEMU_JOB_QUERY },
+    };
+    const char *expected[] = { "modify", "query" };
+    qemuDomainObjPrivatePtr priv;
+    size_t nstarted = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(run.vm = testJobDomainNew()))
+        return -1;
+    priv = run.vm->privateData;
+
+    if (qemuDomainObjBeginJob(&driver, run.vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(thr); i++) {
+        if (testJobThreadStart(&run, &thr[i], i + 1) < 0) {
+            qemuDomainObjEndJob(&driver, run.vm);
+            goto cleanup;
+        }
+        nstarted++;
+    }
+
+    if (priv->job.current || priv->job.asyncJob != QEMU_ASYNC_JOB_NONE) {
+        fprintf(stderr, "expected no job statistics to be available\n");
+        qemuDomainObjEndJob(&driver, run.vm);
+        goto cleanup;
+    }
+
+    if (testJobQueueCheckParams(run.vm, G_N_ELEMENTS(thr)) < 0) {
+        qemuDomainObjEndJob(&driver, run.vm);
+        goto cleanup;
+    }
+
+    qemuDomainObjEndJob(&driver, run.vm);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(run.vm);
+    for (i = 0; i < nstarted; i++) {
+        virThreadJoin(&thr[i].thread);
+        if (thr[i].ret < 0)
+            ret = -1;
+    }
+
+    if (ret == 0)
+        ret = testJobCheckOrder(&run, expected, G_N_ELEMENTS(expected));
+
+    /* the queue drained, but it's still reported */
+    if (ret == 0) {
+        virObjectLock(run.vm);
+        ret = testJobQueueCheckParams(run.vm, 0);
+        virObjectUnlock(run.vm);
+    }
+
+    virObjectUnref(run.vm);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Job queue order", testJobQueueOrder, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Job queue requeue", testJobQueueRequeue, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Shared query job", testJobShared, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Job queue without async job", testJobQueueSyncOnly, NULL) < 0)
+        ret = -1;
+
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
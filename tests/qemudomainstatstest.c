@@ -0,0 +1,282 @@
+/*
+ * qemudomainstatstest.c: Test gathering statistics of several domains
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "virthreadpool.h"
+# include "virtime.h"
+# include "qemu/qemu_domain.h"
+
+# include "testutilsqemu.h"
+
+# define VIR_FROM_THIS VIR_FROM_QEMU
+
+# define TEST_NDOMAINS 4
+
+static virQEMUDriver driver;
+
+struct testStatsData {
+    virMutex lock;
+    virCond cond;
+    const char *stuck; /* name of the domain whose monitor hangs */
+    size_t nstuck; /* tasks gathering stats of @stuck */
+    bool released;
+    size_t nfreed; /* batches done with the data */
+};
+
+struct testStatsParams {
+    const char *stuck;
+    size_t nbatches;
+};
+
+
+static int
+testStatsCollect(virDomainObjPtr vm,
+                 bool partial,
+                 unsigned long long timeout G_GNUC_UNUSED,
+                 virDomainStatsRecordPtr *record,
+                 void *opaque)
+{
+    struct testStatsData *data = opaque;
+    virDomainStatsRecordPtr tmp;
+    int maxparams = 0;
+
+    if (!partial && STREQ_NULLABLE(vm->def->name, data->stuck)) {
+        /* the domain is unlocked while waiting for the monitor */
+        virObjectUnlock(vm);
+        virMutexLock(&data->lock);
+        data->nstuck++;
+        while (!data->released)
+            ignore_value(virCondWait(&data->cond, &data->lock));
+        virMutexUnlock(&data->lock);
+        virObjectLock(vm);
+    }
+
+    tmp = g_new0(virDomainStatsRecord, 1);
+    if (virTypedParamsAddString(&tmp->params, &tmp->nparams, &maxparams,
+                                "name", vm->def->name) < 0 ||
+        virTypedParamsAddBoolean(&tmp->params, &tmp->nparams, &maxparams,
+                                 "partial", partial) < 0) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        g_free(tmp);
+        return -1;
+    }
+
+    *record = tmp;
+    return 0;
+}
+
+
+static void
+testStatsDataFree(void *opaque)
+{
+    struct testStatsData *data = opaque;
+
+    virMutexLock(&data->lock);
+    data->nfreed++;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static int
+testStatsCheckRecords(virDomainStatsRecordPtr *records,
+                      int nrecords,
+                      virDomainObjPtr *vms,
+                      const char *stuck)
+{
+    size_t i;
+
+    if (nrecords != TEST_NDOMAINS) {
+        fprintf(stderr, "expected %d records, got %d\n",
+                TEST_NDOMAINS, nrecords);
+        return -1;
+    }
+
+    for (i = 0; i < nrecords; i++) {
+        const char *name = NULL;
+        int partial = -1;
+
+        ignore_value(virTypedParamsGetString(records[i]->params,
+                                             records[i]->nparams,
+                                             "name", &name));
+        ignore_value(virTypedParamsGetBoolean(records[i]->params,
+                                              records[i]->nparams,
+                                              "partial", &partial));
+
+        if (STRNEQ_NULLABLE(name, vms[i]->def->name)) {
+            fprintf(stderr, "record %zu belongs to '%s', expected '%s'\n",
+                    i, NULLSTR(name), vms[i]->def->name);
+            return -1;
+        }
+
+        if (partial != STREQ_NULLABLE(name, stuck)) {
+            fprintf(stderr, "record of '%s' is %s, expected otherwise\n",
+                    name, partial ? "partial" : "complete");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+testStatsRecordsFree(virDomainStatsRecordPtr *records,
+                     int nrecords)
+{
+    size_t i;
+
+    for (i = 0; i < nrecords; i++) {
+        virTypedParamsFree(records[i]->params, records[i]->nparams);
+        g_free(records[i]);
+    }
+}
+
+
+/* Runs the batches one after another, the stuck domain must not get
+ * another task while its first one hangs */
+static int
+testStatsBatch(const void *opaque)
+{
+    const struct testStatsParams *params = opaque;
+    const char *stuck = params->stuck;
+    virDomainObjPtr vms[TEST_NDOMAINS] = { NULL };
+    virDomainStatsRecordPtr records[TEST_NDOMAINS] = { NULL };
+    struct testStatsData data = { .stuck = stuck };
+    virThreadPoolPtr pool = NULL;
+    unsigned long long timeout = stuck ? 200 : 10000;
+    unsigned long long start;
+    unsigned long long end;
+    size_t nbatches = 0;
+    int nrecords = 0;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&data.lock) < 0 ||
+        virCondInit(&data.cond) < 0)
+        return -1;
+
+    for (i = 0; i < TEST_NDOMAINS; i++) {
+        if (!(vms[i] = virDomainObjNew(driver.xmlopt)))
+            goto cleanup;
+        vms[i]->def = virDomainDefNew();
+        vms[i]->def->name = g_strdup_printf("dom%zu", i);
+        virObjectUnlock(vms[i]);
+    }
+
+    if (!(pool = virThreadPoolNewFull(0, TEST_NDOMAINS, 0,
+                                      qemuDomainStatsBatchWorker,
+                                      "test-stats", NULL)))
+        goto cleanup;
+
+    while (nbatches < params->nbatches) {
+        if (virTimeMillisNow(&start) < 0)
+            goto cleanup;
+
+        nrecords = qemuDomainStatsBatchRun(pool, vms, TEST_NDOMAINS, timeout,
+                                           testStatsCollect, &data,
+                                           testStatsDataFree, records);
+        if (nrecords < 0)
+            goto cleanup;
+        nbatches++;
+
+        if (virTimeMillisNow(&end) < 0)
+            goto cleanup;
+
+        /* be generous, the point is not to wait for the stuck domain */
+        if (end - start > timeout + 5000) {
+            fprintf(stderr, "gathering took %llu ms, timeout is %llu ms\n",
+                    end - start, timeout);
+            goto cleanup;
+        }
+
+        if (testStatsCheckRecords(records, nrecords, vms, stuck) < 0)
+            goto cleanup;
+
+        testStatsRecordsFree(records, nrecords);
+        nrecords = 0;
+    }
+
+    if (stuck && data.nstuck != 1) {
+        fprintf(stderr, "expected a single task for '%s', got %zu\n",
+                stuck, data.nstuck);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    /* let the detached task finish, it must drop its batch */
+    virMutexLock(&data.lock);
+    data.released = true;
+    virCondBroadcast(&data.cond);
+    while (data.nfreed < nbatches)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    virThreadPoolFree(pool);
+    testStatsRecordsFree(records, MAX(nrecords, 0));
+    for (i = 0; i < TEST_NDOMAINS; i++)
+        virObjectUnref(vms[i]);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+# define DO_TEST(name, stuck, nbatches) \
+    do { \
+        struct testStatsParams params = { stuck, nbatches }; \
+        if (virTestRun(name, testStatsBatch, &params) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST("Parallel stats", NULL, 1);
+    DO_TEST("Parallel stats with a stuck domain", "dom1", 1);
+    DO_TEST("Parallel stats with a domain stuck for several batches",
+            "dom1", 3);
+
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
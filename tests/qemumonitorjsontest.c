@@ -1541,6 +1541,230 @@ testQemuMonitorJSONqemuMonitorJSONGetBalloonInfo(const void *opaque)
     return 0;
 }
 
+static int
+testQemuMonitorJSONQueryCache(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    virDomainXMLOptionPtr xmlopt = data->xmlopt;
+    unsigned long long currmem;
+    qemuMonitorPtr mon;
+    g_autoptr(qemuMonitorTest) test = NULL;
+
+    if (!(test = qemuMonitorTestNewSchema(xmlopt, data->schema)))
+        return -1;
+
+    if (qemuMonitorTestAddItem(test, "query-balloon",
+                               "{\"return\": {\"actual\": 1048576}}") < 0 ||
+        qemuMonitorTestAddItem(test, "stop", "{\"return\": {}}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-balloon",
+                               "{\"return\": {\"actual\": 2097152}}") < 0)
+        return -1;
+
+    mon = qemuMonitorTestGetMonitor(test);
+
+    /* the test suite holds the monitor lock already */
+    virObjectUnlock(mon);
+    qemuMonitorSetQueryCacheTTL(mon, 60 * 1000);
+    virObjectLock(mon);
+
+    /* the second call must not issue the command again */
+    if (qemuMonitorGetBalloonInfo(mon, &currmem) < 0 ||
+        currmem != 1024 ||
+        qemuMonitorGetBalloonInfo(mon, &currmem) < 0 ||
+        currmem != 1024) {
+        VIR_TEST_VERBOSE("Unexpected cached balloon size %llu", currmem);
+        return -1;
+    }
+
+    /* commands changing the VM state invalidate the cache */
+    if (qemuMonitorStopCPUs(mon) < 0)
+        return -1;
+
+    if (qemuMonitorGetBalloonInfo(mon, &currmem) < 0 ||
+        currmem != 2048) {
+        VIR_TEST_VERBOSE("Unexpected balloon size %llu", currmem);
+        return -1;
+    }
+
+    return 0;
+}
+
+struct testQemuMonitorJSONHeldReplies {
+    char *replies[3];
+    size_t nreplies;
+};
+
+struct testQemuMonitorJSONHeldReply {
+    struct testQemuMonitorJSONHeldReplies *held;
+    const char *reply;
+};
+
+
+/* Replies tagged by the 'id' of the command, as QEMU does. With @held
+ * the replies are held back until all commands arrived and then sent in
+ * the reverse order. */
+static int
+testQemuMonitorJSONHoldReply(qemuMonitorTestPtr test,
+                             qemuMonitorTestItemPtr item,
+                             const char *cmdstr)
+{
+    struct testQemuMonitorJSONHeldReply *data = qemuMonitorTestItemGetPrivateData(item);
+    struct testQemuMonitorJSONHeldReplies *held = data->held;
+    g_autoptr(virJSONValue) cmd = NULL;
+    const char *id;
+    size_t i;
+
+    if (!(cmd = virJSONValueFromString(cmdstr)) ||
+        !(id = virJSONValueObjectGetString(cmd, "id")))
+        return -1;
+
+    if (!held) {
+        g_autofree char *reply = NULL;
+
+        reply = g_strdup_printf("{\"return\": %s, \"id\": \"%s\"}",
+                                data->reply, id);
+        return qemuMonitorTestAddResponse(test, reply);
+    }
+
+    held->replies[held->nreplies++] = g_strdup_printf("{\"return\": %s, \"id\": \"%s\"}",
+                                                      data->reply, id);
+
+    if (held->nreplies < G_N_ELEMENTS(held->replies))
+        return 0;
+
+    for (i = held->nreplies; i > 0; i--) {
+        if (qemuMonitorTestAddResponse(test, held->replies[i - 1]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testQemuMonitorJSONPrefetchQueries(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    virDomainXMLOptionPtr xmlopt = data->xmlopt;
+    const char *commands[] = { "query-kvm", "query-balloon" };
+    struct testQemuMonitorJSONHeldReply replies[] = {
+        { NULL, "{\"enabled\": true, \"present\": true}" },
+        { NULL, "{\"actual\": 1048576}" },
+    };
+    virDomainVirtType virtType;
+    unsigned long long currmem;
+    g_autoptr(qemuMonitorTest) test = NULL;
+
+    if (!(test = qemuMonitorTestNewSchema(xmlopt, data->schema)))
+        return -1;
+
+    /* both commands are in flight, so the replies need their 'id' */
+    if (qemuMonitorTestAddHandler(test, commands[0],
+                                  testQemuMonitorJSONHoldReply,
+                                  &replies[0], NULL) < 0 ||
+        qemuMonitorTestAddHandler(test, commands[1],
+                                  testQemuMonitorJSONHoldReply,
+                                  &replies[1], NULL) < 0 ||
+        qemuMonitorTestAddItem(test, "stop", "{\"return\": {}}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-balloon",
+                               "{\"return\": {\"actual\": 2097152}}") < 0)
+        return -1;
+
+    if (qemuMonitorPrefetchQueries(qemuMonitorTestGetMonitor(test),
+                                   commands, G_N_ELEMENTS(commands)) < 0)
+        return -1;
+
+    /* uses the prefetched reply */
+    if (qemuMonitorGetVirtType(qemuMonitorTestGetMonitor(test), &virtType) < 0)
+        return -1;
+
+    if (virtType != VIR_DOMAIN_VIRT_KVM) {
+        VIR_TEST_VERBOSE("Unexpected virt type %d", virtType);
+        return -1;
+    }
+
+    /* commands changing the VM state drop the prefetched replies */
+    if (qemuMonitorStopCPUs(qemuMonitorTestGetMonitor(test)) < 0)
+        return -1;
+
+    if (qemuMonitorGetBalloonInfo(qemuMonitorTestGetMonitor(test), &currmem) < 0 ||
+        currmem != 2048) {
+        VIR_TEST_VERBOSE("Unexpected balloon size %llu", currmem);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+testQemuMonitorJSONPipelineReorder(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    virDomainXMLOptionPtr xmlopt = data->xmlopt;
+    const char *commands[] = { "query-kvm", "query-balloon", "query-status" };
+    struct testQemuMonitorJSONHeldReplies held = { 0 };
+    struct testQemuMonitorJSONHeldReply replies[] = {
+        { &held, "{\"enabled\": true, \"present\": true}" },
+        { &held, "{\"actual\": 1048576}" },
+        { &held, "{\"running\": false, \"singlestep\": false, "
+                 "\"status\": \"paused\"}" },
+    };
+    virDomainVirtType virtType;
+    unsigned long long currmem;
+    bool running = true;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    size_t i;
+    int ret = -1;
+
+    G_STATIC_ASSERT(G_N_ELEMENTS(replies) == G_N_ELEMENTS(held.replies));
+
+    if (!(test = qemuMonitorTestNewSchema(xmlopt, data->schema)))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(commands); i++) {
+        if (qemuMonitorTestAddHandler(test, commands[i],
+                                      testQemuMonitorJSONHoldReply,
+                                      &replies[i], NULL) < 0)
+            goto cleanup;
+    }
+
+    /* all three commands are in flight before the first reply arrives */
+    if (qemuMonitorPrefetchQueries(qemuMonitorTestGetMonitor(test),
+                                   commands, G_N_ELEMENTS(commands)) < 0)
+        goto cleanup;
+
+    if (qemuMonitorGetVirtType(qemuMonitorTestGetMonitor(test), &virtType) < 0)
+        goto cleanup;
+
+    if (virtType != VIR_DOMAIN_VIRT_KVM) {
+        VIR_TEST_VERBOSE("Unexpected virt type %d", virtType);
+        goto cleanup;
+    }
+
+    if (qemuMonitorGetBalloonInfo(qemuMonitorTestGetMonitor(test), &currmem) < 0)
+        goto cleanup;
+
+    if (currmem != 1024) {
+        VIR_TEST_VERBOSE("Unexpected balloon size %llu", currmem);
+        goto cleanup;
+    }
+
+    if (qemuMonitorGetStatus(qemuMonitorTestGetMonitor(test), &running, NULL) < 0)
+        goto cleanup;
+
+    if (running) {
+        VIR_TEST_VERBOSE("Expected the domain to be paused");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < held.nreplies; i++)
+        g_free(held.replies[i]);
+    return ret;
+}
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetVirtType(const void *opaque)
 {
@@ -2797,6 +3021,156 @@ testBlockNodeNameDetect(const void *opaque)
 }
 
 
+static int
+testBlockStatsDecodeCheck(virJSONValuePtr entry,
+                          virHashTablePtr stats)
+{
+    virJSONValuePtr entrystats = virJSONValueObjectGetObject(entry, "stats");
+    virJSONValuePtr backing = virJSONValueObjectGetObject(entry, "backing");
+    const char *nodename = virJSONValueObjectGetString(entry, "node-name");
+    unsigned long long rd_bytes;
+    unsigned long long wr_operations;
+    qemuBlockStatsPtr decoded;
+
+    if (nodename) {
+        if (!(decoded = virHashLookup(stats, nodename))) {
+            VIR_TEST_VERBOSE("missing stats of node '%s'", nodename);
+            return -1;
+        }
+
+        if (virJSONValueObjectGetNumberUlong(entrystats, "rd_bytes", &rd_bytes) < 0 ||
+            virJSONValueObjectGetNumberUlong(entrystats, "wr_operations", &wr_operations) < 0)
+            return -1;
+
+        if (decoded->rd_bytes != rd_bytes || decoded->wr_req != wr_operations) {
+            VIR_TEST_VERBOSE("wrong stats of node '%s'", nodename);
+            return -1;
+        }
+    }
+
+    if (backing)
+        return testBlockStatsDecodeCheck(backing, stats);
+
+    return 0;
+}
+
+
+struct testBlockStatsBenchData {
+    const char *reply;
+    virHashTablePtr stats;
+};
+
+
+static int
+testBlockStatsBenchTree(size_t i G_GNUC_UNUSED,
+                        void *opaque)
+{
+    struct testBlockStatsBenchData *data = opaque;
+    virJSONValuePtr tree;
+
+    if (!(tree = virJSONValueFromString(data->reply)))
+        return -1;
+
+    virJSONValueFree(tree);
+    return 0;
+}
+
+
+static int
+testBlockStatsBenchDecode(size_t i G_GNUC_UNUSED,
+                          void *opaque)
+{
+    struct testBlockStatsBenchData *data = opaque;
+
+    virHashRemoveAll(data->stats);
+    return qemuMonitorJSONParseBlockStatsReply(data->reply, data->stats, true);
+}
+
+
+/* Decodes the recorded query-blockstats reply and compares the result
+ * with values found in the same reply parsed into virJSONValue */
+static int
+testBlockStatsDecode(const void *opaque)
+{
+    const char *testname = opaque;
+    g_autofree char *file = NULL;
+    g_autofree char *data = NULL;
+    g_autofree char *reply = NULL;
+    g_autoptr(virJSONValue) devices = NULL;
+    virHashTablePtr stats = NULL;
+    size_t i;
+    int ret = -1;
+
+    file = g_strdup_printf("%s/qemumonitorjsondata/qemumonitorjson-nodename-%s-blockstats.json",
+                           abs_srcdir, testname);
+
+    if (virTestLoadFile(file, &data) < 0)
+        goto cleanup;
+
+    reply = g_strdup_printf("{\"return\": %s, \"id\": \"libvirt-1\"}", data);
+
+    if (!(devices = virJSONValueFromString(data)))
+        goto cleanup;
+
+    stats = virHashCreate(10, virHashValueFree);
+
+    if (qemuMonitorJSONParseBlockStatsReply(reply, stats, true) < 0)
+        goto cleanup;
+
+    for (i = 0; i < virJSONValueArraySize(devices); i++) {
+        if (testBlockStatsDecodeCheck(virJSONValueArrayGet(devices, i), stats) < 0)
+            goto cleanup;
+    }
+
+    if (virTestGetExpensive()) {
+        struct testBlockStatsBenchData bench = { reply, stats };
+        g_autofree char *tree = g_strdup_printf("%s: tree", testname);
+        g_autofree char *decode = g_strdup_printf("%s: decode", testname);
+
+        if (virTestBenchLoop(tree, 10000, testBlockStatsBenchTree, &bench) < 0 ||
+            virTestBenchLoop(decode, 10000, testBlockStatsBenchDecode, &bench) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(stats);
+    return ret;
+}
+
+
+/* Replies which the block stats decoder has to reject */
+static int
+testBlockStatsDecodeFail(const void *opaque G_GNUC_UNUSED)
+{
+    const char *replies[] = {
+        "{\"error\": {\"class\": \"GenericError\", \"desc\": \"fail\"}, "
+        "\"id\": \"libvirt-1\"}",
+        "{\"return\": {}, \"id\": \"libvirt-1\"}",
+        "{\"return\": [[]], \"id\": \"libvirt-1\"}",
+        "{\"return\": [{\"device\": \"drive-virtio-disk0\", "
+        "\"stats\": {\"rd_bytes\": 1",
+        "",
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(replies); i++) {
+        g_autoptr(virHashTable) stats = virHashCreate(10, virHashValueFree);
+
+        if (qemuMonitorJSONParseBlockStatsReply(replies[i], stats, true) >= 0) {
+            VIR_TEST_VERBOSE("decoding reply '%s' should have failed",
+                             replies[i]);
+            return -1;
+        }
+
+        virResetLastError();
+    }
+
+    return 0;
+}
+
+
 struct testQAPISchemaData {
     virHashTablePtr schema;
     const char *name;
@@ -3215,6 +3589,9 @@ mymain(void)
     DO_TEST_GEN(qemuMonitorJSONJobCancel);
     DO_TEST_GEN(qemuMonitorJSONJobComplete);
     DO_TEST(qemuMonitorJSONGetBalloonInfo);
+    DO_TEST(QueryCache);
+    DO_TEST(PrefetchQueries);
+    DO_TEST(PipelineReorder);
     DO_TEST(qemuMonitorJSONGetBlockInfo);
     DO_TEST(qemuMonitorJSONGetAllBlockStatsInfo);
     DO_TEST(qemuMonitorJSONGetMigrationCacheSize);
@@ -3268,6 +3645,29 @@ mymain(void)
 
 #undef DO_TEST_BLOCK_NODE_DETECT
 
+#define DO_TEST_BLOCK_STATS_DECODE(testname) \
+    do { \
+        if (virTestRun("block stats decode (" testname ")", \
+                       testBlockStatsDecode, testname) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_BLOCK_STATS_DECODE("basic");
+    DO_TEST_BLOCK_STATS_DECODE("same-backing");
+    DO_TEST_BLOCK_STATS_DECODE("relative");
+    DO_TEST_BLOCK_STATS_DECODE("gluster");
+    DO_TEST_BLOCK_STATS_DECODE("blockjob");
+    DO_TEST_BLOCK_STATS_DECODE("luks");
+    DO_TEST_BLOCK_STATS_DECODE("iscsi");
+    DO_TEST_BLOCK_STATS_DECODE("old");
+    DO_TEST_BLOCK_STATS_DECODE("empty");
+
+    if (virTestRun("block stats decode failures",
+                   testBlockStatsDecodeFail, NULL) < 0)
+        ret = -1;
+
+#undef DO_TEST_BLOCK_STATS_DECODE
+
 #define DO_TEST_QAPI_QUERY(nme, qry, scc, rplobj) \
     do { \
         qapiData.name = nme; \
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virmock.h"
+#include "virfile.h"
+#include "virstring.h"
+
+/* Refuse to open the volume named by STORAGE_POOL_REFRESH_DENY, which
+ * lets the test tell volumes taken from the cache from probed ones */
+
+static int (*real_virFileOpenAs)(const char *path, int openflags,
+                                 mode_t mode, uid_t uid, gid_t gid,
+                                 unsigned int flags);
+
+
+int
+virFileOpenAs(const char *path,
+              int openflags,
+              mode_t mode,
+              uid_t uid,
+              gid_t gid,
+              unsigned int flags)
+{
+    const char *deny = getenv("STORAGE_POOL_REFRESH_DENY");
+    const char *name = strrchr(path, '/');
+
+    VIR_MOCK_REAL_INIT(virFileOpenAs);
+
+    if (deny && STREQ(name ? name + 1 : path, deny)) {
+        errno = EACCES;
+        return -EACCES;
+    }
+
+    return real_virFileOpenAs(path, openflags, mode, uid, gid, flags);
+}
@@ -0,0 +1,338 @@
+/*
+ * storagepoolrefreshtest.c: Test refreshing directory based pools
+ *
+ * Copyright (C) 2020 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virstorageobj.h"
+#include "storage/storage_util.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+/*
+ * Write a qcow2 header describing an image of @capacity bytes to
+ * @path, dating its modification back by @age seconds.
+ */
+static int
+testWriteImage(const char *path,
+               unsigned long long capacity,
+               time_t age)
+{
+    unsigned char header[512] = { 'Q', 'F', 'I', 0xfb };
+    struct timespec times[2];
+    VIR_AUTOCLOSE fd = -1;
+    size_t i;
+
+    header[7] = 2; /* version */
+    header[23] = 16; /* cluster bits */
+    for (i = 0; i < 8; i++)
+        header[24 + i] = (capacity >> (56 - i * 8)) & 0xff;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, header, sizeof(header)) < 0) {
+        fprintf(stderr, "cannot write '%s'\n", path);
+        return -1;
+    }
+
+    times[0].tv_sec = times[1].tv_sec = time(NULL) - age;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    if (utimensat(AT_FDCWD, path, times, 0) < 0) {
+        fprintf(stderr, "cannot set times of '%s'\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static virStoragePoolObjPtr
+testPoolNew(const char *dir)
+{
+    g_autofree char *xml = NULL;
+    virStoragePoolDefPtr def;
+    virStoragePoolObjPtr pool;
+
+    xml = g_strdup_printf("<pool type='dir'>\n"
+                          "  <name>test</name>\n"
+                          "  <target><path>%s</path></target>\n"
+                          "</pool>\n", dir);
+
+    if (!(def = virStoragePoolDefParseString(xml)))
+        return NULL;
+
+    if (!(pool = virStoragePoolObjNew())) {
+        virStoragePoolDefFree(def);
+        return NULL;
+    }
+
+    virStoragePoolObjSetDef(pool, def);
+    return pool;
+}
+
+
+static int
+testPoolRefresh(virStoragePoolObjPtr pool)
+{
+    virStoragePoolObjClearVols(pool);
+    return virStorageBackendRefreshLocal(pool);
+}
+
+
+static int
+testCheckVolume(virStoragePoolObjPtr pool,
+                const char *name,
+                unsigned long long capacity)
+{
+    virStorageVolDefPtr vol = virStorageVolDefFindByName(pool, name);
+
+    if (!vol) {
+        if (capacity == 0)
+            return 0;
+        fprintf(stderr, "volume '%s' not found\n", name);
+        return -1;
+    }
+
+    if (capacity == 0) {
+        fprintf(stderr, "volume '%s' unexpectedly found\n", name);
+        return -1;
+    }
+
+    if (vol->target.format != VIR_STORAGE_FILE_QCOW2 ||
+        vol->target.capacity != capacity) {
+        fprintf(stderr, "volume '%s' has format %d capacity %llu, "
+                "expected qcow2 of %llu\n", name, vol->target.format,
+                vol->target.capacity, capacity);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testRemoveDir(const char *dir)
+{
+    DIR *dh = NULL;
+    struct dirent *ent;
+
+    if (virDirOpenQuiet(&dh, dir) <= 0)
+        return;
+
+    while (virDirRead(dh, &ent, NULL) > 0) {
+        g_autofree char *path = g_strdup_printf("%s/%s", dir, ent->d_name);
+
+        unlink(path);
+    }
+
+    VIR_DIR_CLOSE(dh);
+    rmdir(dir);
+}
+
+
+static int
+testRefreshIncremental(const void *opaque)
+{
+    const size_t *nworkers = opaque;
+    g_autofree char *dir = g_strdup(abs_builddir "/storagepoolrefresh-XXXXXX");
+    g_autofree char *outside = NULL;
+    g_autofree char *link = NULL;
+    g_autofree char *vol1 = NULL;
+    g_autofree char *vol3 = NULL;
+    g_autofree char *vol5 = NULL;
+    g_autofree char *vol11 = NULL;
+    virStoragePoolObjPtr pool = NULL;
+    size_t i;
+    int ret = -1;
+
+    virStorageBackendRefreshSetWorkers(*nworkers);
+
+    if (!g_mkdtemp(dir))
+        return -1;
+
+    outside = g_strdup_printf("%s.img", dir);
+    link = g_strdup_printf("%s/link.qcow2", dir);
+    vol1 = g_strdup_printf("%s/vol1.qcow2", dir);
+    vol3 = g_strdup_printf("%s/vol3.qcow2", dir);
+    vol5 = g_strdup_printf("%s/vol5.qcow2", dir);
+    vol11 = g_strdup_printf("%s/vol11.qcow2", dir);
+
+    for (i = 1; i <= 10; i++) {
+        g_autofree char *path = g_strdup_printf("%s/vol%zu.qcow2", dir, i);
+
+        if (testWriteImage(path, i * 1024 * 1024, 100) < 0)
+            goto cleanup;
+    }
+
+    if (testWriteImage(outside, 1024, 100) < 0 ||
+        symlink(outside, link) < 0)
+        goto cleanup;
+
+    if (!(pool = testPoolNew(dir)))
+        goto cleanup;
+
+    /* first refresh probes everything, the second one uses the cache */
+    for (i = 0; i < 2; i++) {
+        if (testPoolRefresh(pool) < 0 ||
+            testCheckVolume(pool, "vol1.qcow2", 1024 * 1024) < 0 ||
+            testCheckVolume(pool, "vol3.qcow2", 3 * 1024 * 1024) < 0 ||
+            testCheckVolume(pool, "link.qcow2", 1024) < 0)
+            goto cleanup;
+
+        if (virStoragePoolObjGetVolumesCount(pool) != 11) {
+            fprintf(stderr, "expected 11 volumes, got %zu\n",
+                    virStoragePoolObjGetVolumesCount(pool));
+            goto cleanup;
+        }
+
+        /* volumes which can't be opened are skipped when probed, so
+         * vol1 is only found from now on if it is taken from the cache */
+        g_setenv("STORAGE_POOL_REFRESH_DENY", "vol1.qcow2", TRUE);
+    }
+
+    /* modify, remove and add volumes, as well as the file a volume
+     * links to from outside of the pool */
+    if (testWriteImage(vol3, 100 * 1024 * 1024, 50) < 0 ||
+        unlink(vol5) < 0 ||
+        testWriteImage(vol11, 11 * 1024 * 1024, 100) < 0 ||
+        testWriteImage(outside, 2048, 50) < 0)
+        goto cleanup;
+
+    if (testPoolRefresh(pool) < 0 ||
+        testCheckVolume(pool, "vol1.qcow2", 1024 * 1024) < 0 ||
+        testCheckVolume(pool, "vol3.qcow2", 100 * 1024 * 1024) < 0 ||
+        testCheckVolume(pool, "vol5.qcow2", 0) < 0 ||
+        testCheckVolume(pool, "vol11.qcow2", 11 * 1024 * 1024) < 0 ||
+        testCheckVolume(pool, "link.qcow2", 2048) < 0)
+        goto cleanup;
+
+    /* once modified, vol1 is probed and thus skipped */
+    if (testWriteImage(vol1, 1024 * 1024, 50) < 0 ||
+        testPoolRefresh(pool) < 0 ||
+        testCheckVolume(pool, "vol1.qcow2", 0) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    g_unsetenv("STORAGE_POOL_REFRESH_DENY");
+    virStoragePoolObjEndAPI(&pool);
+    unlink(outside);
+    testRemoveDir(dir);
+    return ret;
+}
+
+
+static int
+testRefreshBenchRun(size_t nworkers,
+                    void *opaque)
+{
+    virStoragePoolObjPtr pool = opaque;
+
+    virStorageBackendRefreshSetWorkers(nworkers);
+
+    /* drop the cache so that all volumes are probed */
+    virStoragePoolObjSetVolCache(pool, NULL, NULL);
+
+    return testPoolRefresh(pool);
+}
+
+
+/*
+ * Measure how long refreshing a pool of @nvols images takes when all
+ * of them need to be probed, using a varying number of workers, and
+ * when they are taken from the cache.
+ */
+static int
+testRefreshBench(const void *opaque G_GNUC_UNUSED)
+{
+    const size_t nvols = 20000;
+    g_autofree char *dir = g_strdup(abs_builddir "/storagepoolrefresh-XXXXXX");
+    g_autofree char *what = g_strdup_printf("%zu volumes: full refresh", nvols);
+    virStoragePoolObjPtr pool = NULL;
+    gint64 start;
+    size_t i;
+    int ret = -1;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    if (!g_mkdtemp(dir))
+        return -1;
+
+    for (i = 0; i < nvols; i++) {
+        g_autofree char *path = g_strdup_printf("%s/vol%zu.qcow2", dir, i);
+
+        if (testWriteImage(path, 1024 * 1024 * 1024, 100) < 0)
+            goto cleanup;
+    }
+
+    if (!(pool = testPoolNew(dir)))
+        goto cleanup;
+
+    if (virTestBenchWorkers(what, testRefreshBenchRun, pool) < 0)
+        goto cleanup;
+
+    start = g_get_monotonic_time();
+    if (testPoolRefresh(pool) < 0)
+        goto cleanup;
+    VIR_TEST_VERBOSE("%zu volumes: cached refresh in %lld ms", nvols,
+                     (long long)(g_get_monotonic_time() - start) / 1000);
+
+    if (virStoragePoolObjGetVolumesCount(pool) != nvols) {
+        fprintf(stderr, "expected %zu volumes, got %zu\n",
+                nvols, virStoragePoolObjGetVolumesCount(pool));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virStoragePoolObjEndAPI(&pool);
+    testRemoveDir(dir);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    size_t serial = 1;
+    size_t parallel = 4;
+    int ret = 0;
+
+    if (virTestRun("Incremental refresh", testRefreshIncremental,
+                   &serial) < 0)
+        ret = -1;
+    if (virTestRun("Incremental refresh parallel", testRefreshIncremental,
+                   &parallel) < 0)
+        ret = -1;
+    if (virTestRun("Refresh benchmark", testRefreshBench, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("storagepoolrefresh"))
@@ -180,6 +180,73 @@ virTestRun(const char *title,
 }
 
 
+/**
+ * virTestBenchWorkers:
+ * @what: description of the measured operation
+ * @body: operation to measure
+ * @data: opaque data passed to @body
+ *
+ * Runs @body with 1, 2, 4 and 8 workers one after another and
+ * prints how long each run took in verbose mode.
+ *
+ * Returns -1 as soon as @body fails, 0 otherwise.
+ */
+int
+virTestBenchWorkers(const char *what,
+                    int (*body)(size_t nworkers, void *data),
+                    void *data)
+{
+    size_t nworkers[] = { 1, 2, 4, 8 };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(nworkers); i++) {
+        gint64 start = g_get_monotonic_time();
+
+        if (body(nworkers[i], data) < 0)
+            return -1;
+
+        VIR_TEST_VERBOSE("%s, %zu workers: %lld ms", what, nworkers[i],
+                         (long long)(g_get_monotonic_time() - start) / 1000);
+    }
+
+    return 0;
+}
+
+
+/**
+ * virTestBenchLoop:
+ * @what: description of the measured operation
+ * @iterations: how many times to run @body
+ * @body: operation to measure, called with the number of the iteration
+ * @data: opaque data passed to @body
+ *
+ * Runs @body @iterations times and prints the average time a single
+ * run took in verbose mode.
+ *
+ * Returns -1 as soon as @body fails, 0 otherwise.
+ */
+int
+virTestBenchLoop(const char *what,
+                 size_t iterations,
+                 int (*body)(size_t i, void *data),
+                 void *data)
+{
+    gint64 start = g_get_monotonic_time();
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (body(i, data) < 0)
+            return -1;
+    }
+
+    VIR_TEST_VERBOSE("%s: %.1f ns per iteration", what,
+                     (g_get_monotonic_time() - start) * 1000.0 /
+                     MAX(iterations, 1));
+
+    return 0;
+}
+
+
 /**
  * virTestLoadFile:
  * @file: name of the file to load
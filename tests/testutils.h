@@ -40,6 +40,13 @@ extern virArch virTestHostArch;
 int virTestRun(const char *title,
                int (*body)(const void *data),
                const void *data);
+int virTestBenchWorkers(const char *what,
+                        int (*body)(size_t nworkers, void *data),
+                        void *data);
+int virTestBenchLoop(const char *what,
+                     size_t iterations,
+                     int (*body)(size_t i, void *data),
+                     void *data);
 int virTestLoadFile(const char *file, char **buf);
 char *virTestLoadFilePath(const char *p, ...)
     G_GNUC_NULL_TERMINATED;
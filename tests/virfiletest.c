@@ -350,6 +350,190 @@ testFileIsSharedFSType(const void *opaque G_GNUC_UNUSED)
 }
 
 
+#ifndef WIN32
+/* Deliberately not a multiple of any buffer size */
+# define TEST_WRAPPER_CHUNK (1024 * 1024 + 4099)
+
+struct testFileWrapperFdData {
+    size_t bufferSize;
+    size_t nbuffers;
+    size_t length;
+    bool direct;
+};
+
+
+/*
+ * Write @data->length bytes to a new file through a file wrapper and
+ * read them back the same way, checking they didn't change.
+ */
+static int
+testFileWrapperFdRoundTrip(const struct testFileWrapperFdData *data,
+                           gint64 *writeTime,
+                           gint64 *readTime)
+{
+    char path[] = abs_builddir "/fileWrapperFd.XXXXXX";
+    g_autofree char *chunk = NULL;
+    g_autofree char *buf = NULL;
+    virFileWrapperFdPtr wfd = NULL;
+    unsigned int flags = VIR_FILE_WRAPPER_NON_BLOCKING;
+    int oflags = 0;
+    int fd = -1;
+    bool created = false;
+    size_t done;
+    ssize_t got;
+    gint64 start;
+    size_t i;
+    int ret = -1;
+
+    chunk = g_new0(char, TEST_WRAPPER_CHUNK);
+    buf = g_new0(char, TEST_WRAPPER_CHUNK);
+    for (i = 0; i < TEST_WRAPPER_CHUNK; i++)
+        chunk[i] = i * 7 + i / 251;
+
+    if (data->direct) {
+        oflags = virFileDirectFdFlag();
+        flags |= VIR_FILE_WRAPPER_BYPASS_CACHE;
+    }
+
+    if ((fd = g_mkstemp_full(path, O_WRONLY | O_CLOEXEC | oflags,
+                             S_IRUSR | S_IWUSR)) < 0) {
+        fprintf(stderr, "unable to create %s (errno=%d)\n", path, errno);
+        goto cleanup;
+    }
+    created = true;
+
+    start = g_get_monotonic_time();
+    if (!(wfd = virFileWrapperFdNewFull(&fd, path, flags,
+                                        data->bufferSize, data->nbuffers)))
+        goto cleanup;
+
+    for (done = 0; done < data->length; done += got) {
+        got = MIN(TEST_WRAPPER_CHUNK, data->length - done);
+        if (safewrite(fd, chunk, got) < 0) {
+            fprintf(stderr, "unable to write to %s (errno=%d)\n", path, errno);
+            goto cleanup;
+        }
+    }
+
+    if (VIR_CLOSE(fd) < 0 || virFileWrapperFdClose(wfd) < 0)
+        goto cleanup;
+    *writeTime = g_get_monotonic_time() - start;
+    virFileWrapperFdFree(wfd);
+    wfd = NULL;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC | oflags)) < 0) {
+        fprintf(stderr, "unable to open %s (errno=%d)\n", path, errno);
+        goto cleanup;
+    }
+
+    start = g_get_monotonic_time();
+    if (!(wfd = virFileWrapperFdNewFull(&fd, path, flags,
+                                        data->bufferSize, data->nbuffers)))
+        goto cleanup;
+
+    /* saferead fills the whole buffer unless it reaches EOF */
+    for (done = 0; (got = saferead(fd, buf, TEST_WRAPPER_CHUNK)) > 0; done += got) {
+        if (done + got > data->length || memcmp(buf, chunk, got) != 0) {
+            fprintf(stderr, "data mismatch after %zu bytes\n", done);
+            goto cleanup;
+        }
+    }
+
+    if (got < 0) {
+        fprintf(stderr, "unable to read %s (errno=%d)\n", path, errno);
+        goto cleanup;
+    }
+
+    if (done != data->length) {
+        fprintf(stderr, "expected %zu bytes, got %zu\n", data->length, done);
+        goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0 || virFileWrapperFdClose(wfd) < 0)
+        goto cleanup;
+    *readTime = g_get_monotonic_time() - start;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    virFileWrapperFdFree(wfd);
+    if (created)
+        unlink(path);
+    return ret;
+}
+
+
+static int
+testFileWrapperFd(const void *opaque)
+{
+    gint64 writeTime;
+    gint64 readTime;
+
+    return testFileWrapperFdRoundTrip(opaque, &writeTime, &readTime);
+}
+
+
+/* Whether O_DIRECT files can be created in the build directory */
+static bool
+testFileWrapperFdDirectSupported(void)
+{
+    char path[] = abs_builddir "/fileWrapperFd.XXXXXX";
+    int fd;
+
+    if (virFileDirectFdFlag() < 0)
+        return false;
+
+    if ((fd = g_mkstemp_full(path, O_WRONLY | O_CLOEXEC | virFileDirectFdFlag(),
+                             S_IRUSR | S_IWUSR)) < 0)
+        return false;
+
+    VIR_FORCE_CLOSE(fd);
+    unlink(path);
+    return true;
+}
+
+
+static int
+testFileWrapperFdBench(const void *opaque G_GNUC_UNUSED)
+{
+    const struct testFileWrapperFdData configs[] = {
+        { 1024 * 1024, 1, 0, false },
+        { 1024 * 1024, 4, 0, false },
+        { 4 * 1024 * 1024, 8, 0, false },
+    };
+    bool direct;
+    size_t i;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    direct = testFileWrapperFdDirectSupported();
+
+    for (i = 0; i < G_N_ELEMENTS(configs); i++) {
+        struct testFileWrapperFdData data = configs[i];
+        gint64 writeTime;
+        gint64 readTime;
+
+        data.length = 1024 * 1024 * 1024;
+        data.direct = direct;
+
+        if (testFileWrapperFdRoundTrip(&data, &writeTime, &readTime) < 0)
+            return -1;
+
+        VIR_TEST_VERBOSE("%zu x %zu KiB buffers%s: write %.2f GB/s, "
+                         "read %.2f GB/s",
+                         data.nbuffers, data.bufferSize / 1024,
+                         direct ? ", O_DIRECT" : "",
+                         data.length / 1000.0 / writeTime,
+                         data.length / 1000.0 / readTime);
+    }
+
+    return 0;
+}
+#endif /* !WIN32 */
+
+
 static int
 mymain(void)
 {
@@ -460,6 +644,27 @@ mymain(void)
     DO_TEST_FILE_IS_SHARED_FS_TYPE("mounts3.txt", "/gpfs/data", true);
     DO_TEST_FILE_IS_SHARED_FS_TYPE("mounts3.txt", "/quobyte", true);
 
+#ifndef WIN32
+# define DO_TEST_WRAPPER_FD(size, count) \
+    do { \
+        struct testFileWrapperFdData data = { \
+            .bufferSize = size, .nbuffers = count, \
+            .length = 3 * TEST_WRAPPER_CHUNK + 17, \
+        }; \
+        if (virTestRun("file wrapper " #size " x " #count, \
+                       testFileWrapperFd, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_WRAPPER_FD(0, 0);
+    DO_TEST_WRAPPER_FD(64 * 1024, 1);
+    DO_TEST_WRAPPER_FD(64 * 1024, 4);
+    DO_TEST_WRAPPER_FD(128 * 1024, 3);
+
+    if (virTestRun("file wrapper benchmark", testFileWrapperFdBench, NULL) < 0)
+        ret = -1;
+#endif /* !WIN32 */
+
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
@@ -14,13 +14,25 @@
 
 VIR_LOG_INIT("tests.hashtest");
 
+/* whether tests use open addressing tables */
+static bool testHashFlat;
+
+static virHashTablePtr
+testHashNew(ssize_t size)
+{
+    if (testHashFlat)
+        return virHashNewFlat(NULL);
+
+    return virHashCreate(size, NULL);
+}
+
 static virHashTablePtr
 testHashInit(int size)
 {
     virHashTablePtr hash;
     ssize_t i;
 
-    if (!(hash = virHashCreate(size, NULL)))
+    if (!(hash = testHashNew(size)))
         return NULL;
 
     /* entries are added in reverse order so that they will be linked in
@@ -395,7 +407,7 @@ testHashGetItems(const void *data G_GNUC_UNUSED)
     char value2[] = "2";
     char value3[] = "3";
 
-    if (!(hash = virHashCreate(0, NULL)) ||
+    if (!(hash = testHashNew(0)) ||
         virHashAddEntry(hash, keya, value3) < 0 ||
         virHashAddEntry(hash, keyc, value1) < 0 ||
         virHashAddEntry(hash, keyb, value2) < 0) {
@@ -465,8 +477,8 @@ testHashEqual(const void *data G_GNUC_UNUSED)
     char value3_u[] = "O";
     char value4_u[] = "P";
 
-    if (!(hash1 = virHashCreate(0, NULL)) ||
-        !(hash2 = virHashCreate(0, NULL)) ||
+    if (!(hash1 = testHashNew(0)) ||
+        !(hash2 = testHashNew(0)) ||
         virHashAddEntry(hash1, keya, value1_l) < 0 ||
         virHashAddEntry(hash1, keyb, value2_l) < 0 ||
         virHashAddEntry(hash1, keyc, value3_l) < 0 ||
@@ -515,7 +527,7 @@ testHashDuplicate(const void *data G_GNUC_UNUSED)
 {
     g_autoptr(virHashTable) hash = NULL;
 
-    if (!(hash = virHashCreate(0, NULL)))
+    if (!(hash = testHashNew(0)))
         return -1;
 
     if (virHashAddEntry(hash, "a", NULL) < 0) {
@@ -532,15 +544,182 @@ testHashDuplicate(const void *data G_GNUC_UNUSED)
 }
 
 
+static int
+testHashBenchIter(void *payload,
+                  const void *name G_GNUC_UNUSED,
+                  void *data)
+{
+    size_t *sum = data;
+
+    *sum += (size_t) payload;
+    return 0;
+}
+
+
+/* Removes every other entry and checks that lookups, removals and
+ * steals of missing keys fail while the remaining entries and re-added
+ * keys are still found. */
+static int
+testHashMissing(const void *data G_GNUC_UNUSED)
+{
+    g_autoptr(virHashTable) hash = NULL;
+    size_t count = G_N_ELEMENTS(uuids);
+    size_t i;
+
+    if (!(hash = testHashNew(0)))
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        if (virHashAddEntry(hash, uuids[i], (void *) uuids[i]) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < count; i += 2) {
+        if (virHashRemoveEntry(hash, uuids[i]) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        bool present = i % 2 == 1;
+
+        if (!!virHashLookup(hash, uuids[i]) != present ||
+            virHashHasEntry(hash, uuids[i]) != present) {
+            VIR_TEST_VERBOSE("entry \"%s\" should%s be present",
+                             uuids[i], present ? "" : " not");
+            return -1;
+        }
+
+        if (!present &&
+            (virHashRemoveEntry(hash, uuids[i]) == 0 ||
+             virHashSteal(hash, uuids[i]) != NULL)) {
+            VIR_TEST_VERBOSE("removed missing entry \"%s\"", uuids[i]);
+            return -1;
+        }
+    }
+
+    if (virHashLookup(hash, "no-such-uuid") ||
+        virHashRemoveEntry(hash, "no-such-uuid") == 0) {
+        VIR_TEST_VERBOSE("found an entry that was never added");
+        return -1;
+    }
+
+    if (testHashCheckCount(hash, count / 2) < 0)
+        return -1;
+
+    for (i = 0; i < count; i += 2) {
+        if (virHashAddEntry(hash, uuids[i], (void *) uuids[i]) < 0 ||
+            virHashLookup(hash, uuids[i]) != uuids[i]) {
+            VIR_TEST_VERBOSE("entry \"%s\" could not be re-added", uuids[i]);
+            return -1;
+        }
+    }
+
+    return testHashCheckCount(hash, count);
+}
+
+
+struct testHashBenchData {
+    virHashTablePtr hash;
+    char **keys;
+    size_t count;
+};
+
+
+static int
+testHashBenchInsert(size_t i,
+                    void *opaque)
+{
+    struct testHashBenchData *data = opaque;
+
+    return virHashAddEntry(data->hash, data->keys[i], (void *) (i + 1));
+}
+
+
+static int
+testHashBenchLookup(size_t i,
+                    void *opaque)
+{
+    struct testHashBenchData *data = opaque;
+
+    if (!virHashLookup(data->hash, data->keys[(i * 31) % data->count]))
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testHashBenchIterate(size_t i G_GNUC_UNUSED,
+                     void *opaque)
+{
+    struct testHashBenchData *data = opaque;
+    size_t sum = 0;
+
+    virHashForEach(data->hash, testHashBenchIter, &sum);
+
+    if (sum != data->count * (data->count + 1) / 2)
+        return -1;
+
+    return 0;
+}
+
+
+/* Measures insert, lookup and iteration with both kinds of tables.
+ * Run with VIR_TEST_EXPENSIVE=1 VIR_TEST_VERBOSE=1 to see the results. */
+static int
+testHashBench(const void *data)
+{
+    const struct testInfo *info = data;
+    g_auto(GStrv) keys = NULL;
+    size_t flat;
+    size_t i;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    keys = g_new0(char *, info->count + 1);
+    for (i = 0; i < info->count; i++)
+        keys[i] = g_strdup_printf("%08zx-6e6f-7465-7374-%012zx", i, i * 7919);
+
+    for (flat = 0; flat < 2; flat++) {
+        g_autoptr(virHashTable) hash = NULL;
+        struct testHashBenchData bench = { NULL, keys, info->count };
+        const char *kind = flat ? "open addressing" : "chained";
+        g_autofree char *insert = NULL;
+        g_autofree char *lookup = NULL;
+        g_autofree char *iterate = NULL;
+
+        hash = flat ? virHashNewFlat(NULL) : virHashNew(NULL);
+        bench.hash = hash;
+
+        insert = g_strdup_printf("%s, %zu entries: insert", kind, info->count);
+        lookup = g_strdup_printf("%s, %zu entries: lookup", kind, info->count);
+        iterate = g_strdup_printf("%s, %zu entries: iterate all", kind,
+                                  info->count);
+
+        if (virTestBenchLoop(insert, info->count,
+                             testHashBenchInsert, &bench) < 0 ||
+            virTestBenchLoop(lookup, info->count,
+                             testHashBenchLookup, &bench) < 0 ||
+            virTestBenchLoop(iterate, 1, testHashBenchIterate, &bench) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
     int ret = 0;
+    size_t flat;
 
 #define DO_TEST_FULL(name, cmd, data, count) \
     do { \
         struct testInfo info = { data, count }; \
-        if (virTestRun(name, testHash ## cmd, &info) < 0) \
+        if (virTestRun(testHashFlat ? name " (flat)" : name, \
+                       testHash ## cmd, &info) < 0) \
             ret = -1; \
     } while (0)
 
@@ -556,19 +735,31 @@ mymain(void)
 #define DO_TEST(name, cmd) \
     DO_TEST_FULL(name, cmd, NULL, -1)
 
-    DO_TEST_COUNT("Grow", Grow, 1);
-    DO_TEST_COUNT("Grow", Grow, 10);
-    DO_TEST_COUNT("Grow", Grow, 42);
-    DO_TEST("Update", Update);
-    DO_TEST("Remove", Remove);
-    DO_TEST_DATA("Remove in ForEach", RemoveForEach, Some);
-    DO_TEST_DATA("Remove in ForEach", RemoveForEach, All);
-    DO_TEST("Steal", Steal);
-    DO_TEST("RemoveSet", RemoveSet);
-    DO_TEST("Search", Search);
-    DO_TEST("GetItems", GetItems);
-    DO_TEST("Equal", Equal);
-    DO_TEST("Duplicate entry", Duplicate);
+    for (flat = 0; flat < 2; flat++) {
+        testHashFlat = flat;
+
+        DO_TEST_COUNT("Grow", Grow, 1);
+        DO_TEST_COUNT("Grow", Grow, 10);
+        DO_TEST_COUNT("Grow", Grow, 42);
+        DO_TEST("Update", Update);
+        DO_TEST("Remove", Remove);
+        DO_TEST_DATA("Remove in ForEach", RemoveForEach, Some);
+        DO_TEST_DATA("Remove in ForEach", RemoveForEach, All);
+        DO_TEST("Steal", Steal);
+        DO_TEST("RemoveSet", RemoveSet);
+        DO_TEST("Search", Search);
+        DO_TEST("GetItems", GetItems);
+        DO_TEST("Equal", Equal);
+        DO_TEST("Duplicate entry", Duplicate);
+        DO_TEST("Missing entries", Missing);
+    }
+
+    testHashFlat = false;
+
+    DO_TEST_COUNT("Benchmark", Bench, 1000);
+    DO_TEST_COUNT("Benchmark", Bench, 10000);
+    DO_TEST_COUNT("Benchmark", Bench, 100000);
+    DO_TEST_COUNT("Benchmark", Bench, 1000000);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -4,6 +4,7 @@
 
 #include "internal.h"
 #include "virjson.h"
+#include "virthread.h"
 #include "testutils.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -470,6 +471,553 @@ testJSONObjectFormatSteal(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static int
+testJSONStreamParser(const void *data G_GNUC_UNUSED)
+{
+    const char *stream =
+        "{\"QMP\": {\"version\": {}, \"capabilities\": []}}\r\n"
+        "{\"return\": {}, \"id\": \"libvirt-1\"}\r\n"
+        "{\"timestamp\": {\"seconds\": 1, \"microseconds\": 2}, "
+        "\"event\": \"STOP\"}\r\n"
+        "{\"return\": [{\"name\": \"a\\\"b\"}, 1.5e3, null, true], "
+        "\"id\": \"libvirt-2\"}\r\n";
+    const char *expect[] = {
+        "{\"QMP\":{\"version\":{},\"capabilities\":[]}}",
+        "{\"return\":{},\"id\":\"libvirt-1\"}",
+        "{\"timestamp\":{\"seconds\":1,\"microseconds\":2},\"event\":\"STOP\"}",
+        "{\"return\":[{\"name\":\"a\\\"b\"},1.5e3,null,true],\"id\":\"libvirt-2\"}",
+    };
+    size_t chunks[] = { 1, 2, 7, 64, strlen(stream) };
+    size_t len = strlen(stream);
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(chunks); i++) {
+        g_autoptr(virJSONStreamParser) parser = NULL;
+        virJSONValuePtr value;
+        size_t offset;
+        size_t vlen;
+        size_t end = 0;
+        size_t nvalues = 0;
+
+        if (!(parser = virJSONStreamParserNew()))
+            return -1;
+
+        for (offset = 0; offset < len; offset += chunks[i]) {
+            size_t chunk = MIN(chunks[i], len - offset);
+
+            if (virJSONStreamParserFeed(parser, stream + offset, chunk) < 0)
+                return -1;
+
+            while ((value = virJSONStreamParserNext(parser, &vlen))) {
+                g_autofree char *actual = virJSONValueToString(value, false);
+
+                virJSONValueFree(value);
+                end += vlen;
+
+                if (nvalues >= G_N_ELEMENTS(expect) ||
+                    STRNEQ_NULLABLE(actual, expect[nvalues])) {
+                    VIR_TEST_VERBOSE("unexpected value '%s' in chunks of %zu",
+                                     NULLSTR(actual), chunks[i]);
+                    return -1;
+                }
+
+                /* the value must end exactly where its text ends */
+                if (stream[end - 1] != '}' || stream[end] != '\r') {
+                    VIR_TEST_VERBOSE("wrong end offset %zu of value %zu in "
+                                     "chunks of %zu", end, nvalues, chunks[i]);
+                    return -1;
+                }
+
+                nvalues++;
+            }
+        }
+
+        if (nvalues != G_N_ELEMENTS(expect)) {
+            VIR_TEST_VERBOSE("got %zu values instead of %zu in chunks of %zu",
+                             nvalues, G_N_ELEMENTS(expect), chunks[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Records what a sink receives in a compact textual form. */
+static void
+testJSONSinkStartObject(void *opaque)
+{
+    virBufferAddLit(opaque, "{");
+}
+
+static void
+testJSONSinkKey(void *opaque, const char *key, size_t len)
+{
+    virBufferAsprintf(opaque, "%.*s:", (int) len, key);
+}
+
+static void
+testJSONSinkEndObject(void *opaque)
+{
+    virBufferAddLit(opaque, "}");
+}
+
+static void
+testJSONSinkStartArray(void *opaque)
+{
+    virBufferAddLit(opaque, "[");
+}
+
+static void
+testJSONSinkEndArray(void *opaque)
+{
+    virBufferAddLit(opaque, "]");
+}
+
+static void
+testJSONSinkScalar(void *opaque,
+                   virJSONType type G_GNUC_UNUSED,
+                   const char *value,
+                   size_t len)
+{
+    if (value)
+        virBufferAsprintf(opaque, "%.*s,", (int) len, value);
+    else
+        virBufferAddLit(opaque, "null,");
+}
+
+static const virJSONSAXCallbacks testJSONSinkCallbacks = {
+    .startObject = testJSONSinkStartObject,
+    .key = testJSONSinkKey,
+    .endObject = testJSONSinkEndObject,
+    .startArray = testJSONSinkStartArray,
+    .endArray = testJSONSinkEndArray,
+    .scalar = testJSONSinkScalar,
+};
+
+
+static int
+testJSONStreamParserCheckNext(virJSONStreamParserPtr parser,
+                              const char *expect)
+{
+    g_autoptr(virJSONValue) value = NULL;
+    g_autofree char *actual = NULL;
+    size_t len;
+
+    if (!(value = virJSONStreamParserNext(parser, &len)) ||
+        !(actual = virJSONValueToString(value, false)) ||
+        STRNEQ(actual, expect)) {
+        VIR_TEST_VERBOSE("expected value '%s', got '%s'",
+                         expect, NULLSTR(actual));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONStreamParserSink(const void *data G_GNUC_UNUSED)
+{
+    const char *stream =
+        "{\"return\": [{\"a\": {\"b\": [1, \"x\"]}, \"c\": null}, {}], "
+        "\"id\": \"libvirt-1\"}\r\n"
+        "{\"return\": {\"a\": 1}, \"id\": \"libvirt-2\"}\r\n";
+    const char *expect = "[{a:{b:[1,x,]}c:null,}{}]";
+    g_autoptr(virJSONStreamParser) parser = NULL;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    if (!(parser = virJSONStreamParserNew()))
+        return -1;
+
+    virJSONStreamParserSetSink(parser, "return", &testJSONSinkCallbacks, &buf);
+
+    if (virJSONStreamParserFeed(parser, stream, strlen(stream)) < 0)
+        return -1;
+
+    /* only the member of the first object is sunk */
+    if (testJSONStreamParserCheckNext(parser,
+                                      "{\"return\":[],\"id\":\"libvirt-1\"}") < 0 ||
+        testJSONStreamParserCheckNext(parser,
+                                      "{\"return\":{\"a\":1},\"id\":\"libvirt-2\"}") < 0)
+        return -1;
+
+    if (STRNEQ(virBufferCurrentContent(&buf), expect)) {
+        VIR_TEST_VERBOSE("sink got '%s' instead of '%s'",
+                         virBufferCurrentContent(&buf), expect);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONStreamParserSinkRemove(const void *data G_GNUC_UNUSED)
+{
+    const char *stream =
+        "{\"return\": {\"a\": {\"b\": [1, 2]}, \"c\": 3}, \"id\": \"libvirt-1\"}\r\n"
+        "{\"return\": [4], \"id\": \"libvirt-2\"}\r\n";
+    /* splits the first reply in the middle of the nested object */
+    size_t split = strstr(stream, "1, 2") - stream;
+    const char *expectFirst = "{a:{b:[";
+    const char *expectSecond = "[4,]";
+    g_autoptr(virJSONStreamParser) parser = NULL;
+    g_auto(virBuffer) first = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) second = VIR_BUFFER_INITIALIZER;
+
+    if (!(parser = virJSONStreamParserNew()))
+        return -1;
+
+    virJSONStreamParserSetSink(parser, "return", &testJSONSinkCallbacks, &first);
+
+    if (virJSONStreamParserFeed(parser, stream, split) < 0)
+        return -1;
+
+    /* the rest of the interrupted member must not reach the new sink */
+    virJSONStreamParserSetSink(parser, NULL, NULL, NULL);
+    virJSONStreamParserSetSink(parser, "return", &testJSONSinkCallbacks, &second);
+
+    if (virJSONStreamParserFeed(parser, stream + split, strlen(stream) - split) < 0)
+        return -1;
+
+    if (testJSONStreamParserCheckNext(parser,
+                                      "{\"return\":{},\"id\":\"libvirt-1\"}") < 0 ||
+        testJSONStreamParserCheckNext(parser,
+                                      "{\"return\":[],\"id\":\"libvirt-2\"}") < 0)
+        return -1;
+
+    if (STRNEQ(virBufferCurrentContent(&first), expectFirst) ||
+        STRNEQ(virBufferCurrentContent(&second), expectSecond)) {
+        VIR_TEST_VERBOSE("sinks got '%s' and '%s' instead of '%s' and '%s'",
+                         virBufferCurrentContent(&first),
+                         virBufferCurrentContent(&second),
+                         expectFirst, expectSecond);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONLargeObject(const void *data G_GNUC_UNUSED)
+{
+    g_autoptr(virJSONValue) json = virJSONValueNewObject();
+    g_autoptr(virJSONValue) stolen = NULL;
+    g_autoptr(virJSONValue) copy = NULL;
+    size_t nkeys = 100;
+    size_t i;
+
+    for (i = 0; i < nkeys; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i);
+
+        /* the key index is built while the object grows */
+        if (i == nkeys / 2 &&
+            virJSONValueObjectHasKey(json, "key0") != 1) {
+            VIR_TEST_VERBOSE("missing key 'key0'");
+            return -1;
+        }
+
+        if (virJSONValueObjectAppendNumberUlong(json, key, i) < 0)
+            return -1;
+    }
+
+    if (virJSONValueObjectAppend(json, "nested", virJSONValueNewObject()) < 0)
+        return -1;
+
+    if (virJSONValueObjectAppendNumberUlong(json, "key1", 1) == 0) {
+        VIR_TEST_VERBOSE("duplicate key was added");
+        return -1;
+    }
+
+    for (i = 0; i < nkeys; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i);
+        unsigned long long val;
+
+        if (virJSONValueObjectGetNumberUlong(json, key, &val) < 0 ||
+            val != i) {
+            VIR_TEST_VERBOSE("wrong value of key '%s'", key);
+            return -1;
+        }
+    }
+
+    if (virJSONValueObjectRemoveKey(json, "key10", NULL) != 1 ||
+        virJSONValueObjectHasKey(json, "key10") != 0) {
+        VIR_TEST_VERBOSE("failed to remove key 'key10'");
+        return -1;
+    }
+
+    if (!(stolen = virJSONValueObjectStealObject(json, "nested")) ||
+        virJSONValueObjectHasKey(json, "nested") != 0) {
+        VIR_TEST_VERBOSE("failed to steal key 'nested'");
+        return -1;
+    }
+
+    if (virJSONValueObjectAppendNumberUlong(json, "key10", 10) < 0 ||
+        virJSONValueObjectHasKey(json, "key10") != 1) {
+        VIR_TEST_VERBOSE("failed to re-add key 'key10'");
+        return -1;
+    }
+
+    if (virJSONValueObjectGet(json, "key100") ||
+        virJSONValueObjectGet(json, "key") ||
+        virJSONValueObjectHasKey(json, "nested") != 0) {
+        VIR_TEST_VERBOSE("lookup of a missing key succeeded");
+        return -1;
+    }
+
+    if (virJSONValueObjectRemoveKey(json, "nested", NULL) != 0 ||
+        virJSONValueObjectStealObject(json, "nested")) {
+        VIR_TEST_VERBOSE("removal of a missing key succeeded");
+        return -1;
+    }
+
+    if (virJSONValueObjectGetString(json, "key1") ||
+        virJSONValueObjectHasKey(json, "key1") != 1) {
+        VIR_TEST_VERBOSE("wrongly typed lookup of key 'key1' succeeded");
+        return -1;
+    }
+
+    if (!(copy = virJSONValueCopy(json)) ||
+        virJSONValueObjectKeysNumber(copy) != nkeys ||
+        virJSONValueObjectHasKey(copy, "key99") != 1 ||
+        virJSONValueObjectHasKey(copy, "nested") != 0) {
+        VIR_TEST_VERBOSE("copy of large object differs");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+struct testJSONConcurrentData {
+    virJSONValuePtr json;
+    size_t nkeys;
+    bool failed;
+};
+
+
+static void
+testJSONConcurrentLookups(void *opaque)
+{
+    struct testJSONConcurrentData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < data->nkeys * 100; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i % data->nkeys);
+        unsigned long long val;
+
+        if (virJSONValueObjectGetNumberUlong(data->json, key, &val) < 0 ||
+            val != i % data->nkeys) {
+            data->failed = true;
+            return;
+        }
+    }
+}
+
+
+/* Lookups don't modify objects and thus may run in parallel, even in
+ * objects large enough to be indexed. */
+static int
+testJSONLargeObjectConcurrent(const void *data G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virJSONValue) json = NULL;
+    struct testJSONConcurrentData threaddata[4];
+    virThread threads[G_N_ELEMENTS(threaddata)];
+    size_t nkeys = 100;
+    size_t nthreads = 0;
+    size_t i;
+    int ret = 0;
+
+    virBufferAddLit(&buf, "{");
+    for (i = 0; i < nkeys; i++)
+        virBufferAsprintf(&buf, "%s\"key%zu\": %zu", i ? ", " : "", i, i);
+    virBufferAddLit(&buf, "}");
+
+    if (!(json = virJSONValueFromString(virBufferCurrentContent(&buf))))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(threads); i++) {
+        threaddata[i].json = json;
+        threaddata[i].nkeys = nkeys;
+        threaddata[i].failed = false;
+
+        if (virThreadCreate(&threads[i], true,
+                            testJSONConcurrentLookups, &threaddata[i]) < 0) {
+            ret = -1;
+            break;
+        }
+        nthreads++;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (threaddata[i].failed) {
+            VIR_TEST_VERBOSE("lookup in thread %zu failed", i);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+
+struct testJSONLookup {
+    virJSONValuePtr object;
+    const char *key;
+};
+
+struct testJSONLookupData {
+    virJSONValuePtr object;
+    struct testJSONLookup *lookups;
+    size_t nlookups;
+};
+
+
+static int testJSONLookupCollect(virJSONValuePtr value,
+                                 struct testJSONLookupData *data);
+
+static int
+testJSONLookupCollectMember(const char *key,
+                            virJSONValuePtr value,
+                            void *opaque)
+{
+    struct testJSONLookupData *data = opaque;
+    struct testJSONLookup lookup = { data->object, key };
+
+    if (VIR_APPEND_ELEMENT(data->lookups, data->nlookups, lookup) < 0)
+        return -1;
+
+    return testJSONLookupCollect(value, data);
+}
+
+
+/* Collects the keys of all members of all objects within @value. */
+static int
+testJSONLookupCollect(virJSONValuePtr value,
+                      struct testJSONLookupData *data)
+{
+    virJSONValuePtr parent = data->object;
+    size_t i;
+    int ret;
+
+    if (virJSONValueIsArray(value)) {
+        for (i = 0; i < virJSONValueArraySize(value); i++) {
+            if (testJSONLookupCollect(virJSONValueArrayGet(value, i), data) < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    if (!virJSONValueIsObject(value))
+        return 0;
+
+    data->object = value;
+    ret = virJSONValueObjectForeachKeyValue(value,
+                                            testJSONLookupCollectMember,
+                                            data);
+    data->object = parent;
+    return ret;
+}
+
+
+static int
+testJSONLookupBenchOne(size_t i,
+                       void *opaque)
+{
+    struct testJSONLookupData *data = opaque;
+    struct testJSONLookup *lookup = &data->lookups[i % data->nlookups];
+
+    if (!virJSONValueObjectGet(lookup->object, lookup->key))
+        return -1;
+
+    return 0;
+}
+
+
+/* Measures lookup throughput in the QMP replies gathered for the
+ * capabilities test, grouped by the size of the objects the lookups
+ * are done in. Run with VIR_TEST_EXPENSIVE=1 VIR_TEST_VERBOSE=1 to
+ * see the results. */
+static int
+testJSONLookupBench(const void *data G_GNUC_UNUSED)
+{
+    size_t sizes[] = { 4, 15, 63, SIZE_MAX };
+    g_autofree char *infile = NULL;
+    g_autofree char *indata = NULL;
+    g_auto(GStrv) msgs = NULL;
+    g_autoptr(virJSONValue) replies = virJSONValueNewArray();
+    struct testJSONLookupData all = { 0 };
+    size_t minkeys = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    infile = g_strdup_printf("%s/qemucapabilitiesdata/caps_5.0.0.x86_64.replies",
+                             abs_srcdir);
+
+    if (virTestLoadFile(infile, &indata) < 0)
+        return -1;
+
+    /* messages in the replies file are separated by empty lines */
+    msgs = g_strsplit(indata, "\n\n", 0);
+
+    for (i = 0; msgs[i]; i++) {
+        virJSONValuePtr msg;
+
+        if (!*msgs[i])
+            continue;
+
+        if (!(msg = virJSONValueFromString(msgs[i])) ||
+            virJSONValueArrayAppend(replies, msg) < 0) {
+            virJSONValueFree(msg);
+            return -1;
+        }
+    }
+
+    if (testJSONLookupCollect(replies, &all) < 0)
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        g_autofree struct testJSONLookup *lookups = g_new0(struct testJSONLookup,
+                                                           all.nlookups);
+        struct testJSONLookupData bench = { .lookups = lookups };
+        g_autofree char *what = NULL;
+
+        for (j = 0; j < all.nlookups; j++) {
+            size_t nkeys = virJSONValueObjectKeysNumber(all.lookups[j].object);
+
+            if (nkeys > minkeys && nkeys <= sizes[i])
+                lookups[bench.nlookups++] = all.lookups[j];
+        }
+
+        if (sizes[i] == SIZE_MAX)
+            what = g_strdup_printf("lookup over %zu keys (%zu members)",
+                                   minkeys, bench.nlookups);
+        else
+            what = g_strdup_printf("lookup in %zu to %zu keys (%zu members)",
+                                   minkeys + 1, sizes[i], bench.nlookups);
+
+        if (bench.nlookups > 0 &&
+            virTestBenchLoop(what, 1000000, testJSONLookupBenchOne, &bench) < 0)
+            goto cleanup;
+
+        minkeys = sizes[i];
+    }
+
+    ret = 0;
+
+ cleanup:
+    g_free(all.lookups);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -611,6 +1159,15 @@ mymain(void)
     DO_TEST_DEFLATTEN("qemu-sheepdog", true);
     DO_TEST_DEFLATTEN("dotted-array", true);
 
+    DO_TEST_FULL("stream parser", StreamParser, NULL, NULL, true);
+    DO_TEST_FULL("stream parser sink", StreamParserSink, NULL, NULL, true);
+    DO_TEST_FULL("stream parser sink removal", StreamParserSinkRemove,
+                 NULL, NULL, true);
+    DO_TEST_FULL("large object", LargeObject, NULL, NULL, true);
+    DO_TEST_FULL("large object concurrent lookups", LargeObjectConcurrent,
+                 NULL, NULL, true);
+    DO_TEST_FULL("lookup benchmark", LookupBench, NULL, NULL, true);
+
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,132 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virlatency.h"
+
+G_STATIC_ASSERT(VIR_LATENCY_BUCKETS == 28);
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+struct testBucketData {
+    unsigned long long usecs;
+    size_t bucket;
+};
+
+static int
+testBucket(const void *opaque)
+{
+    const struct testBucketData *data = opaque;
+    size_t bucket = virLatencyBucket(data->usecs);
+
+    if (bucket != data->bucket) {
+        VIR_TEST_VERBOSE("%llu us fell into bucket %zu, expected %zu",
+                         data->usecs, bucket, data->bucket);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+struct testPercentileData {
+    const char *name;
+    unsigned long long buckets[VIR_LATENCY_BUCKETS];
+    unsigned long long count;
+    unsigned int percent;
+    unsigned long long expect;
+};
+
+static int
+testPercentile(const void *opaque)
+{
+    const struct testPercentileData *data = opaque;
+    unsigned long long actual;
+
+    actual = virLatencyPercentile(data->buckets, VIR_LATENCY_BUCKETS,
+                                  data->count, data->percent);
+
+    if (actual != data->expect) {
+        VIR_TEST_VERBOSE("percentile %u of '%s' is %llu, expected %llu",
+                         data->percent, data->name, actual, data->expect);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST_BUCKET(usecs, bucket) \
+    do { \
+        struct testBucketData data = { usecs, bucket }; \
+        if (virTestRun("bucket of " #usecs " us", testBucket, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_BUCKET(0, 0);
+    DO_TEST_BUCKET(1, 1);
+    DO_TEST_BUCKET(2, 2);
+    DO_TEST_BUCKET(3, 2);
+    DO_TEST_BUCKET(4, 3);
+    DO_TEST_BUCKET(1023, 10);
+    DO_TEST_BUCKET(1024, 11);
+    /* everything from 2^26 us on ends up in the last bucket */
+    DO_TEST_BUCKET(67108863, 26);
+    DO_TEST_BUCKET(67108864, 27);
+    DO_TEST_BUCKET(1099511627776, 27);
+    DO_TEST_BUCKET(18446744073709551615ULL, 27);
+
+#define DO_TEST_PERCENTILE(name, count, percent, expect, ...) \
+    do { \
+        struct testPercentileData data = { \
+            name, { __VA_ARGS__ }, count, percent, expect \
+        }; \
+        if (virTestRun("percentile " name, testPercentile, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_PERCENTILE("empty", 0, 99, 0, 0);
+    DO_TEST_PERCENTILE("instant", 10, 99, 0, 10);
+    DO_TEST_PERCENTILE("single call", 1, 99, 8, [3] = 1);
+    /* 99 fast calls and 1 slow one, the 99th is still fast */
+    DO_TEST_PERCENTILE("one outlier", 100, 99, 8,
+                       [2] = 90, [3] = 9, [20] = 1);
+    /* with 2 slow calls of 100 the 99th is slow */
+    DO_TEST_PERCENTILE("two outliers", 100, 99, 1ULL << 20,
+                       [2] = 90, [3] = 8, [20] = 2);
+    DO_TEST_PERCENTILE("median", 100, 50, 4, [1] = 10, [2] = 40, [3] = 50);
+    DO_TEST_PERCENTILE("last bucket", 1000, 99,
+                       1ULL << (VIR_LATENCY_BUCKETS - 1),
+                       [VIR_LATENCY_BUCKETS - 1] = 1000);
+    /* counts which would overflow when multiplied by the percentage */
+    DO_TEST_PERCENTILE("huge counts", ULLONG_MAX / 2, 99, 1ULL << 5,
+                       [4] = ULLONG_MAX / 2 / 100 * 98,
+                       [5] = ULLONG_MAX / 2 / 100 * 2 + 100);
+    /* events beyond the count are ignored */
+    DO_TEST_PERCENTILE("short count", 100, 99, 1ULL << 6,
+                       [1] = 50, [6] = 60);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,427 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library;  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virevent.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "viruuid.h"
+#include "logging/log_handler.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.loghandlertest");
+
+#define TEST_DIR_TEMPLATE abs_builddir "/virloghandlerdata-XXXXXX"
+
+static int inhibited;
+static int eventQuit;
+
+static void
+testLogHandlerInhibitor(bool inhibit,
+                        void *opaque G_GNUC_UNUSED)
+{
+    if (inhibit)
+        g_atomic_int_inc(&inhibited);
+    else
+        g_atomic_int_add(&inhibited, -1);
+}
+
+
+static void
+testLogHandlerTimer(int timer G_GNUC_UNUSED,
+                    void *opaque G_GNUC_UNUSED)
+{
+}
+
+
+static void
+testLogHandlerEventLoop(void *opaque G_GNUC_UNUSED)
+{
+    while (!g_atomic_int_get(&eventQuit))
+        virEventRunDefaultImpl();
+}
+
+
+/* Waits for the handler to notice all pipes were closed */
+static int
+testLogHandlerWaitClosed(void)
+{
+    size_t i;
+
+    for (i = 0; i < 10000; i++) {
+        if (g_atomic_int_get(&inhibited) == 0)
+            return 0;
+        g_usleep(1000);
+    }
+
+    fprintf(stderr, "%d log files still open\n", g_atomic_int_get(&inhibited));
+    return -1;
+}
+
+
+typedef struct _testLogHandlerPipe testLogHandlerPipe;
+struct _testLogHandlerPipe {
+    char *path;
+    int fd;
+    size_t chunks; /* how many times to write 'chunk' */
+    off_t written;
+};
+
+typedef struct _testLogHandlerPump testLogHandlerPump;
+struct _testLogHandlerPump {
+    testLogHandlerPipe *pipes;
+    size_t npipes;
+    size_t first;
+    size_t stride;
+    bool failed;
+};
+
+static const char testLogHandlerChunk[] =
+    "[    0.000000] Linux version 5.6.0 (gcc version 9.3.1) #1 SMP\n";
+
+
+/* Writes to every stride'th pipe in a round robin fashion so that all of
+ * them have data pending at the same time */
+static void
+testLogHandlerPumpThread(void *opaque)
+{
+    testLogHandlerPump *pump = opaque;
+    size_t len = strlen(testLogHandlerChunk);
+    bool more = true;
+
+    while (more) {
+        size_t i;
+
+        more = false;
+        for (i = pump->first; i < pump->npipes; i += pump->stride) {
+            testLogHandlerPipe *p = &pump->pipes[i];
+
+            if (p->chunks == 0)
+                continue;
+
+            if (safewrite(p->fd, testLogHandlerChunk, len) != len) {
+                pump->failed = true;
+                return;
+            }
+            p->written += len;
+            p->chunks--;
+            more = true;
+        }
+    }
+}
+
+
+static int
+testLogHandlerCheckSize(testLogHandlerPipe *p)
+{
+    struct stat sb;
+
+    if (stat(p->path, &sb) < 0) {
+        fprintf(stderr, "Cannot stat %s\n", p->path);
+        return -1;
+    }
+
+    if (sb.st_size != p->written) {
+        fprintf(stderr, "%s has %lld bytes, expected %lld\n", p->path,
+                (long long) sb.st_size, (long long) p->written);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Opens @npipes guest logs, one of them chatty, fills them from
+ * @nthreads threads concurrently and checks that every byte made it to
+ * the files.
+ */
+static int
+testLogHandlerPumpPipes(size_t npipes,
+                        size_t chunks,
+                        size_t nthreads,
+                        gint64 *elapsed,
+                        off_t *total)
+{
+    g_autofree char *dir = g_strdup(TEST_DIR_TEMPLATE);
+    g_autofree testLogHandlerPipe *pipes = NULL;
+    g_autofree testLogHandlerPump *pumps = NULL;
+    g_autofree virThread *threads = NULL;
+    virLogHandlerPtr handler = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN] = { 0 };
+    gint64 start;
+    size_t i;
+    int ret = -1;
+
+    if (!g_mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create %s\n", dir);
+        return -1;
+    }
+
+    pipes = g_new0(testLogHandlerPipe, npipes);
+    for (i = 0; i < npipes; i++)
+        pipes[i].fd = -1;
+
+    if (!(handler = virLogHandlerNew(false, 1024 * 1024 * 1024, 3,
+                                     64 * 1024, false,
+                                     testLogHandlerInhibitor, NULL)))
+        goto cleanup;
+
+    for (i = 0; i < npipes; i++) {
+        g_autofree char *name = g_strdup_printf("guest%zu", i);
+        ino_t inode;
+        off_t offset;
+
+        pipes[i].path = g_strdup_printf("%s/%s.log", dir, name);
+        /* the first guest is chatty */
+        pipes[i].chunks = i == 0 ? chunks * 50 : chunks;
+
+        if ((pipes[i].fd = virLogHandlerDomainOpenLogFile(handler, "qemu",
+                                                          uuid, name,
+                                                          pipes[i].path,
+                                                          true,
+                                                          &inode,
+                                                          &offset)) < 0)
+            goto cleanup;
+    }
+
+    pumps = g_new0(testLogHandlerPump, nthreads);
+    threads = g_new0(virThread, nthreads);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < nthreads; i++) {
+        pumps[i].pipes = pipes;
+        pumps[i].npipes = npipes;
+        pumps[i].first = i;
+        pumps[i].stride = nthreads;
+
+        if (virThreadCreate(&threads[i], true,
+                            testLogHandlerPumpThread, &pumps[i]) < 0) {
+            while (i-- > 0)
+                virThreadJoin(&threads[i]);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    for (i = 0; i < nthreads; i++) {
+        if (pumps[i].failed) {
+            fprintf(stderr, "Cannot write to log pipe\n");
+            goto cleanup;
+        }
+    }
+
+    /* Everything written so far must be accounted for */
+    for (i = 0; i < npipes; i++) {
+        ino_t inode;
+        off_t offset;
+
+        if (virLogHandlerDomainGetLogFilePosition(handler, pipes[i].path, 0,
+                                                  &inode, &offset) < 0)
+            goto cleanup;
+
+        if (offset != pipes[i].written) {
+            fprintf(stderr, "%s is at offset %lld, expected %lld\n",
+                    pipes[i].path, (long long) offset,
+                    (long long) pipes[i].written);
+            goto cleanup;
+        }
+    }
+
+    /* Guests going away make the handler close their logs */
+    for (i = 0; i < npipes; i++)
+        VIR_FORCE_CLOSE(pipes[i].fd);
+
+    if (testLogHandlerWaitClosed() < 0)
+        goto cleanup;
+    *elapsed = g_get_monotonic_time() - start;
+
+    *total = 0;
+    for (i = 0; i < npipes; i++) {
+        if (testLogHandlerCheckSize(&pipes[i]) < 0)
+            goto cleanup;
+        *total += pipes[i].written;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < npipes; i++) {
+        VIR_FORCE_CLOSE(pipes[i].fd);
+        g_free(pipes[i].path);
+    }
+    virObjectUnref(handler);
+    virFileDeleteTree(dir);
+    return ret;
+}
+
+
+static int
+testLogHandlerPumpMany(const void *opaque G_GNUC_UNUSED)
+{
+    gint64 elapsed;
+    off_t total;
+
+    return testLogHandlerPumpPipes(64, 100, 4, &elapsed, &total);
+}
+
+
+static int
+testLogHandlerAppend(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *dir = g_strdup(TEST_DIR_TEMPLATE);
+    g_autofree char *path = NULL;
+    g_autofree char *data = NULL;
+    virLogHandlerPtr handler = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN] = { 0 };
+    ino_t inode;
+    off_t offset;
+    int fd = -1;
+    int ret = -1;
+
+    if (!g_mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create %s\n", dir);
+        return -1;
+    }
+    path = g_strdup_printf("%s/guest.log", dir);
+
+    if (!(handler = virLogHandlerNew(false, 1024 * 1024, 3,
+                                     64 * 1024, false,
+                                     testLogHandlerInhibitor, NULL)))
+        goto cleanup;
+
+    /* without a guest attached */
+    if (virLogHandlerDomainAppendLogFile(handler, "qemu", uuid, "guest", path,
+                                         "starting up\n", 0) < 0)
+        goto cleanup;
+
+    if ((fd = virLogHandlerDomainOpenLogFile(handler, "qemu", uuid, "guest",
+                                             path, false,
+                                             &inode, &offset)) < 0)
+        goto cleanup;
+
+    if (safewrite(fd, "console\n", 8) != 8)
+        goto cleanup;
+
+    if (virLogHandlerDomainGetLogFilePosition(handler, path, 0,
+                                              &inode, &offset) < 0)
+        goto cleanup;
+
+    /* with the guest attached the message goes through the open file */
+    if (virLogHandlerDomainAppendLogFile(handler, "qemu", uuid, "guest", path,
+                                         "shutting down\n", 0) < 0)
+        goto cleanup;
+
+    if (!(data = virLogHandlerDomainReadLogFile(handler, path, inode, 0,
+                                                1024, 0)))
+        goto cleanup;
+
+    if (STRNEQ(data, "starting up\nconsole\nshutting down\n")) {
+        fprintf(stderr, "unexpected log content '%s'\n", data);
+        goto cleanup;
+    }
+
+    VIR_FORCE_CLOSE(fd);
+    if (testLogHandlerWaitClosed() < 0)
+        goto cleanup;
+
+    if (virLogHandlerDomainGetLogFilePosition(handler, path, 0,
+                                              &inode, &offset) == 0) {
+        fprintf(stderr, "log file still open after guest went away\n");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    virObjectUnref(handler);
+    virFileDeleteTree(dir);
+    return ret;
+}
+
+
+static int
+testLogHandlerPumpBench(const void *opaque G_GNUC_UNUSED)
+{
+    struct rlimit rlim;
+    size_t npipes = 2000;
+    gint64 elapsed;
+    off_t total;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    /* every guest costs two pipe ends and the log file */
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0) {
+        rlim.rlim_cur = rlim.rlim_max;
+        ignore_value(setrlimit(RLIMIT_NOFILE, &rlim));
+        if (rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur / 4 < npipes)
+            npipes = rlim.rlim_cur / 4;
+    }
+
+    if (testLogHandlerPumpPipes(npipes, 500, 8, &elapsed, &total) < 0)
+        return -1;
+
+    VIR_TEST_VERBOSE("%zu guests: %.1f MiB in %.1f ms (%.1f MiB/s)",
+                     npipes, total / (1024.0 * 1024.0), elapsed / 1000.0,
+                     elapsed ? total * 1000000.0 / (1024.0 * 1024.0) / elapsed : 0);
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    virThread eventThread;
+    int timer;
+    int ret = 0;
+
+    virEventRegisterDefaultImpl();
+
+    /* keeps the event loop iterating so that it notices eventQuit */
+    if ((timer = virEventAddTimeout(100, testLogHandlerTimer, NULL, NULL)) < 0)
+        return EXIT_FAILURE;
+
+    if (virThreadCreate(&eventThread, true, testLogHandlerEventLoop, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Append", testLogHandlerAppend, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Pump many pipes", testLogHandlerPumpMany, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Pump many pipes benchmark", testLogHandlerPumpBench, NULL) < 0)
+        ret = -1;
+
+    g_atomic_int_set(&eventQuit, true);
+    virThreadJoin(&eventThread);
+    virEventRemoveTimeout(timer);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -22,7 +22,11 @@
 
 #include "testutils.h"
 #include "virerror.h"
+#include "virthread.h"
 #include "rpc/virnetdaemon.h"
+#include "rpc/virnetclient.h"
+#include "rpc/virnetclientprogram.h"
+#include "admin/admin_server.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -362,6 +366,341 @@ static int testExecRestart(const void *opaque)
 }
 
 
+# define TEST_RPC_PROGRAM 0x20008086
+# define TEST_RPC_VERSION 1
+# define TEST_RPC_PROC_PING 1
+
+static int
+testRPCPing(virNetServerPtr server G_GNUC_UNUSED,
+            virNetServerClientPtr client G_GNUC_UNUSED,
+            virNetMessagePtr msg G_GNUC_UNUSED,
+            virNetMessageErrorPtr rerr G_GNUC_UNUSED,
+            void *args G_GNUC_UNUSED,
+            void *ret G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+static virNetServerProgramProc testRPCProcs[] = {
+    { NULL, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void, false, 0 },
+    { testRPCPing, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void, false, 0 },
+};
+
+struct testRPCClientData {
+    const char *path;
+    size_t ncalls;
+    size_t done;
+};
+
+static void
+testRPCClientThread(void *opaque)
+{
+    struct testRPCClientData *data = opaque;
+    virNetClientPtr client = NULL;
+    virNetClientProgramPtr prog = NULL;
+    size_t i;
+
+    if (!(client = virNetClientNewUNIX(data->path, false, NULL)))
+        goto cleanup;
+
+    if (!(prog = virNetClientProgramNew(TEST_RPC_PROGRAM, TEST_RPC_VERSION,
+                                        NULL, 0, NULL)) ||
+        virNetClientAddProgram(client, prog) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data->ncalls; i++) {
+        if (virNetClientProgramCall(prog, client, i, TEST_RPC_PROC_PING,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t)xdr_void, NULL,
+                                    (xdrproc_t)xdr_void, NULL) < 0)
+            goto cleanup;
+        data->done++;
+    }
+
+ cleanup:
+    if (client)
+        virNetClientClose(client);
+    virObjectUnref(prog);
+    virObjectUnref(client);
+}
+
+static int testRPCQuit;
+
+static void
+testRPCWakeup(int timer, void *opaque G_GNUC_UNUSED)
+{
+    virEventRemoveTimeout(timer);
+}
+
+static void
+testRPCEventLoop(void *opaque G_GNUC_UNUSED)
+{
+    while (!g_atomic_int_get(&testRPCQuit))
+        virEventRunDefaultImpl();
+}
+
+/* Number of calls the workers of @srv finished executing */
+static unsigned long long
+testRPCExecuted(virNetServerPtr srv)
+{
+    g_autofree virNetServerProgramProcStats *stats = NULL;
+    size_t nstats = 0;
+    unsigned long long count = 0;
+    size_t i;
+
+    if (virNetServerGetProcedureStats(srv, &stats, &nstats) < 0)
+        return 0;
+
+    for (i = 0; i < nstats; i++)
+        count += stats[i].exec.count;
+
+    return count;
+}
+
+
+/*
+ * Run @nclients clients, each making @ncalls calls in a row, against
+ * a server spreading its clients across @nthreads event loops. The
+ * rate all the calls were completed at is stored in @rate. If @params
+ * is not NULL, the procedure statistics of the server as reported by
+ * the admin API are stored in it.
+ */
+static int
+testRPCRun(size_t nthreads,
+           size_t nclients,
+           size_t ncalls,
+           double *rate,
+           virTypedParameterPtr *params,
+           int *nparams)
+{
+    virNetServerPtr srv = NULL;
+    virNetServerProgramPtr prog = NULL;
+    char template[] = "/tmp/libvirt_XXXXXX";
+    char *dir = NULL;
+    g_autofree char *path = NULL;
+    g_autofree struct testRPCClientData *data = NULL;
+    g_autofree virThread *threads = NULL;
+    virThread loop;
+    bool loopRunning = false;
+    gint64 start;
+    size_t i;
+    int ret = -1;
+
+    if (!(dir = g_mkdtemp(template))) {
+        fprintf(stderr, "Cannot create %s\n", template);
+        return -1;
+    }
+    path = g_strdup_printf("%s/sock", dir);
+
+    if (!(srv = virNetServerNew("rpcbench", 1,
+                                4, 4, 0, nclients, nclients,
+                                -1, 0,
+                                testClientNew,
+                                testClientPreExec,
+                                testClientFree,
+                                NULL)))
+        goto cleanup;
+
+    if (virNetServerSetEventThreads(srv, nthreads) < 0)
+        goto cleanup;
+
+    if (!(prog = virNetServerProgramNew(TEST_RPC_PROGRAM, TEST_RPC_VERSION,
+                                        testRPCProcs,
+                                        G_N_ELEMENTS(testRPCProcs))) ||
+        virNetServerAddProgram(srv, prog) < 0)
+        goto cleanup;
+
+    if (virNetServerAddServiceUNIX(srv, NULL, NULL, path, 0077, 0,
+                                   VIR_NET_SERVER_SERVICE_AUTH_NONE,
+                                   NULL, false, nclients, ncalls) < 0)
+        goto cleanup;
+
+    virNetServerUpdateServices(srv, true);
+
+    g_atomic_int_set(&testRPCQuit, 0);
+    if (virThreadCreate(&loop, true, testRPCEventLoop, NULL) < 0)
+        goto cleanup;
+    loopRunning = true;
+
+    data = g_new0(struct testRPCClientData, nclients);
+    threads = g_new0(virThread, nclients);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < nclients; i++) {
+        data[i].path = path;
+        data[i].ncalls = ncalls;
+        if (virThreadCreate(&threads[i], true, testRPCClientThread,
+                            &data[i]) < 0) {
+            while (i-- > 0)
+                virThreadJoin(&threads[i]);
+            goto cleanup;
+        }
+    }
+    for (i = 0; i < nclients; i++)
+        virThreadJoin(&threads[i]);
+    *rate = (double)nclients * ncalls * G_USEC_PER_SEC /
+        MAX(g_get_monotonic_time() - start, 1);
+
+    for (i = 0; i < nclients; i++) {
+        if (data[i].done != ncalls) {
+            fprintf(stderr, "client %zu completed %zu of %zu calls\n",
+                    i, data[i].done, ncalls);
+            goto cleanup;
+        }
+    }
+
+    if (params) {
+        /* Workers record the execution time only after sending the
+         * reply, give them a moment to catch up */
+        for (i = 0; i < 100; i++) {
+            if (testRPCExecuted(srv) == nclients * ncalls)
+                break;
+            g_usleep(10 * 1000);
+        }
+
+        if (adminServerGetProcedureStats(srv, params, nparams, 0) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (ret < 0)
+        virDispatchError(NULL);
+    virNetServerClose(srv);
+    if (loopRunning) {
+        g_atomic_int_set(&testRPCQuit, 1);
+        virEventAddTimeout(0, testRPCWakeup, NULL, NULL);
+        virThreadJoin(&loop);
+    }
+    virObjectUnref(prog);
+    virObjectUnref(srv);
+    if (path)
+        unlink(path);
+    rmdir(dir);
+    return ret;
+}
+
+
+static int
+testEventThreads(const void *opaque G_GNUC_UNUSED)
+{
+    double rate;
+
+    return testRPCRun(2, 8, 50, &rate, NULL, NULL);
+}
+
+
+static int
+testProcedureStatsCheckLatency(virTypedParameterPtr params,
+                               int nparams,
+                               const char *kind,
+                               unsigned long long expect)
+{
+    g_autofree char *name = NULL;
+    unsigned long long count = 0;
+    unsigned long long total = 0;
+    unsigned long long bucket;
+    size_t i;
+
+    name = g_strdup_printf("procedure.0.%s.count", kind);
+    if (virTypedParamsGetULLong(params, nparams, name, &count) != 1 ||
+        count != expect) {
+        VIR_TEST_VERBOSE("%s is %llu, expected %llu", name, count, expect);
+        return -1;
+    }
+
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; i++) {
+        g_free(name);
+        name = g_strdup_printf("procedure.0.%s.bucket.%zu", kind, i);
+        bucket = 0;
+        if (virTypedParamsGetULLong(params, nparams, name, &bucket) < 0)
+            return -1;
+        total += bucket;
+    }
+
+    if (total != count) {
+        VIR_TEST_VERBOSE("%s buckets add up to %llu, expected %llu",
+                         kind, total, count);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Calls dispatched by the workers of a server have their queue wait and
+ * execution time recorded exactly once, no matter which worker thread
+ * recorded them, and are reported by the admin API.
+ */
+static int
+testProcedureStats(const void *opaque G_GNUC_UNUSED)
+{
+    const size_t nclients = 4;
+    const size_t ncalls = 25;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int val;
+    double rate;
+    int ret = -1;
+
+    if (testRPCRun(1, nclients, ncalls, &rate, &params, &nparams) < 0)
+        return -1;
+
+    if (virTypedParamsGetUInt(params, nparams, "procedure.count", &val) != 1 ||
+        val != 1) {
+        VIR_TEST_VERBOSE("expected stats of exactly one procedure");
+        goto cleanup;
+    }
+
+    if (virTypedParamsGetUInt(params, nparams,
+                              "procedure.0.program", &val) != 1 ||
+        val != TEST_RPC_PROGRAM ||
+        virTypedParamsGetUInt(params, nparams,
+                              "procedure.0.procedure", &val) != 1 ||
+        val != TEST_RPC_PROC_PING) {
+        VIR_TEST_VERBOSE("stats reported for the wrong procedure");
+        goto cleanup;
+    }
+
+    if (testProcedureStatsCheckLatency(params, nparams, "wait",
+                                       nclients * ncalls) < 0 ||
+        testProcedureStatsCheckLatency(params, nparams, "exec",
+                                       nclients * ncalls) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+
+static int
+testEventThreadsBench(const void *opaque G_GNUC_UNUSED)
+{
+    const size_t nclients = 64;
+    const size_t ncalls = 1000;
+    size_t nthreads[] = { 0, 2, 4, 8 };
+    size_t i;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    for (i = 0; i < G_N_ELEMENTS(nthreads); i++) {
+        double rate;
+
+        if (testRPCRun(nthreads[i], nclients, ncalls, &rate, NULL, NULL) < 0)
+            return -1;
+
+        VIR_TEST_VERBOSE("%zu clients, %zu event threads: %.0f calls/s",
+                         nclients, nthreads[i], rate);
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -414,6 +753,13 @@ mymain(void)
     EXEC_RESTART_TEST("client-auth-pending", 1);
     EXEC_RESTART_TEST_FAIL("client-auth-pending-failure", 1);
 
+    if (virTestRun("Event threads", testEventThreads, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Event threads benchmark", testEventThreadsBench, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Procedure stats", testProcedureStats, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virnetdaemon"))
@@ -520,6 +520,98 @@ static int testMessagePayloadStreamEncode(const void *args G_GNUC_UNUSED)
 }
 
 
+static int testMessagePayloadStreamSegments(const void *args G_GNUC_UNUSED)
+{
+    static const char stream[] = "The quick brown fox jumps over the lazy dog";
+    virNetMessagePtr msg = virNetMessageNew(true);
+    static const char expect[] = {
+        0x00, 0x00, 0x00, 0x47,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x03,  /* Type */
+        0x00, 0x00, 0x00, 0x99,  /* Serial */
+        0x00, 0x00, 0x00, 0x02,  /* Status */
+    };
+    GOutputVector vectors[VIR_NET_MESSAGE_WRITE_VECTORS];
+    char *data = g_strdup(stream);
+    char *payload = data;
+    size_t nvectors;
+    int ret = -1;
+
+    if (!msg)
+        goto cleanup;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayloadRawSteal(msg, &data, strlen(stream)) < 0)
+        goto cleanup;
+
+    if (data) {
+        VIR_DEBUG("Expected payload to be stolen");
+        goto cleanup;
+    }
+
+    if (msg->bufferLength != G_N_ELEMENTS(expect) ||
+        memcmp(expect, msg->buffer, sizeof(expect)) != 0) {
+        virTestDifferenceBin(stderr, expect, msg->buffer,
+                             MIN(sizeof(expect), msg->bufferLength));
+        goto cleanup;
+    }
+
+    nvectors = virNetMessageGetWriteVectors(msg, vectors);
+    if (nvectors != 2 ||
+        vectors[0].buffer != msg->buffer ||
+        vectors[0].size != sizeof(expect) ||
+        vectors[1].buffer != payload ||
+        vectors[1].size != strlen(stream)) {
+        VIR_DEBUG("Unexpected write vectors");
+        goto cleanup;
+    }
+
+    /* A partial write ending in the payload */
+    virNetMessageWriteAdvance(msg, sizeof(expect) + 4);
+    nvectors = virNetMessageGetWriteVectors(msg, vectors);
+    if (nvectors != 1 ||
+        vectors[0].buffer != payload + 4 ||
+        vectors[0].size != strlen(stream) - 4 ||
+        virNetMessageWriteDone(msg)) {
+        VIR_DEBUG("Unexpected write vectors after partial write");
+        goto cleanup;
+    }
+
+    virNetMessageWriteAdvance(msg, strlen(stream) - 4);
+    if (virNetMessageGetWriteVectors(msg, vectors) != 0 ||
+        !virNetMessageWriteDone(msg)) {
+        VIR_DEBUG("Expected message to be written");
+        goto cleanup;
+    }
+
+    /* Borrowed payload must survive the message */
+    virNetMessageClear(msg);
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayloadRawBorrow(msg, stream, strlen(stream)) < 0)
+        goto cleanup;
+
+    if (msg->payload != stream)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(data);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -544,6 +636,9 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Payload Stream Segments", testMessagePayloadStreamSegments, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
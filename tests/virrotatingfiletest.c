@@ -22,6 +22,7 @@
 #include <fcntl.h>
 
 #include "virrotatingfile.h"
+#include "virfile.h"
 #include "virlog.h"
 #include "testutils.h"
 
@@ -32,6 +33,8 @@ VIR_LOG_INIT("tests.rotatingfiletest");
 #define FILENAME "virrotatingfiledata.txt"
 #define FILENAME0 "virrotatingfiledata.txt.0"
 #define FILENAME1 "virrotatingfiledata.txt.1"
+#define FILENAME0GZ "virrotatingfiledata.txt.0.gz"
+#define FILENAME1GZ "virrotatingfiledata.txt.1.gz"
 
 #define FILEBYTE 0xde
 #define FILEBYTE0 0xad
@@ -554,6 +557,237 @@ static int testRotatingFileWriterLargeFile(const void *data G_GNUC_UNUSED)
 }
 
 
+static int testRotatingFileWriterBuffered(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileWriterPtr file;
+    int ret = -1;
+    char buf[512];
+
+    if (testRotatingFileInitFiles((off_t)-1,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    1024,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    if (virRotatingFileWriterSetBufferSize(file, 4096) < 0)
+        goto cleanup;
+
+    memset(buf, 0x5e, sizeof(buf));
+
+    virRotatingFileWriterAppend(file, buf, sizeof(buf));
+    virRotatingFileWriterAppend(file, buf, sizeof(buf));
+
+    if (virRotatingFileWriterGetPending(file) != 1024) {
+        fprintf(stderr, "Expected 1024 bytes pending not %zu\n",
+                virRotatingFileWriterGetPending(file));
+        goto cleanup;
+    }
+
+    if (testRotatingFileWriterAssertFileSizes(0,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    /* rollover writes out the buffer first */
+    virRotatingFileWriterAppend(file, buf, sizeof(buf));
+
+    if (testRotatingFileWriterAssertFileSizes(0,
+                                              1024,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    if (virRotatingFileWriterFlush(file) < 0)
+        goto cleanup;
+
+    if (virRotatingFileWriterGetPending(file) != 0) {
+        fprintf(stderr, "Expected no data pending after flush\n");
+        goto cleanup;
+    }
+
+    if (testRotatingFileWriterAssertFileSizes(512,
+                                              1024,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    return ret;
+}
+
+/* Waits for the background compression of backup @path to @gzpath */
+static int
+testRotatingFileWaitCompressed(const char *path,
+                               const char *gzpath)
+{
+    size_t i;
+
+    for (i = 0; i < 1000; i++) {
+        if (!virFileExists(path) && virFileExists(gzpath))
+            return 0;
+        g_usleep(10 * 1000);
+    }
+
+    fprintf(stderr, "Timed out waiting for %s to be compressed\n", path);
+    return -1;
+}
+
+static int testRotatingFileWriterCompress(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileWriterPtr writer;
+    virRotatingFileReaderPtr reader = NULL;
+    int ret = -1;
+    char buf[1024];
+    char got[4096];
+    ssize_t len;
+    size_t i;
+
+    if (testRotatingFileInitFiles((off_t)-1,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    writer = virRotatingFileWriterNew(FILENAME,
+                                      1024,
+                                      2,
+                                      false,
+                                      0700);
+    if (!writer)
+        goto cleanup;
+
+    virRotatingFileWriterSetCompress(writer, true);
+
+    /* rollovers while the previous backup is still being compressed
+     * must not leave the new one uncompressed */
+    for (i = 0; i < 3; i++) {
+        memset(buf, 'a' + i, sizeof(buf));
+        virRotatingFileWriterAppend(writer, buf, sizeof(buf));
+    }
+    memset(buf, 'd', 100);
+    virRotatingFileWriterAppend(writer, buf, 100);
+
+    if (testRotatingFileWaitCompressed(FILENAME0, FILENAME0GZ) < 0 ||
+        testRotatingFileWaitCompressed(FILENAME1, FILENAME1GZ) < 0)
+        goto cleanup;
+
+    virRotatingFileWriterFree(writer);
+    writer = NULL;
+
+    if (testRotatingFileWriterAssertFileSizes(100,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    if (!virFileExists(FILENAME0GZ) || !virFileExists(FILENAME1GZ)) {
+        fprintf(stderr, "Expected compressed backups to exist\n");
+        goto cleanup;
+    }
+
+    if (!(reader = virRotatingFileReaderNew(FILENAME, 2)))
+        goto cleanup;
+
+    if ((len = virRotatingFileReaderConsume(reader, got, sizeof(got))) < 0)
+        goto cleanup;
+
+    if (len != 1024 * 2 + 100) {
+        fprintf(stderr, "Expected %d bytes not %zd\n", 1024 * 2 + 100, len);
+        goto cleanup;
+    }
+
+    for (i = 0; i < len; i++) {
+        char want = 'b' + i / 1024;
+        if (got[i] != want) {
+            fprintf(stderr, "Expected '%c' but got '%c' at byte %zu\n",
+                    want, got[i], i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virRotatingFileWriterFree(writer);
+    virRotatingFileReaderFree(reader);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    unlink(FILENAME0GZ);
+    unlink(FILENAME1GZ);
+    return ret;
+}
+
+/* Backups left uncompressed by a previous instance of the daemon are
+ * compressed and its partial compressed copies removed */
+static int testRotatingFileWriterCompressBacklog(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileWriterPtr writer = NULL;
+    virRotatingFileReaderPtr reader = NULL;
+    const char *tmp = FILENAME0GZ ".tmp";
+    char got[1024];
+    ssize_t len;
+    ssize_t i;
+    int ret = -1;
+
+    if (testRotatingFileInitFiles((off_t)-1, 100, 200) < 0 ||
+        testRotatingFileInitOne(tmp, 50, 'x') < 0)
+        goto cleanup;
+
+    if (!(writer = virRotatingFileWriterNew(FILENAME, 1024, 2, false, 0700)))
+        goto cleanup;
+
+    virRotatingFileWriterSetCompress(writer, true);
+
+    if (testRotatingFileWaitCompressed(FILENAME0, FILENAME0GZ) < 0 ||
+        testRotatingFileWaitCompressed(FILENAME1, FILENAME1GZ) < 0)
+        goto cleanup;
+
+    if (virFileExists(tmp)) {
+        fprintf(stderr, "Expected %s to be removed\n", tmp);
+        goto cleanup;
+    }
+
+    if (!(reader = virRotatingFileReaderNew(FILENAME, 2)))
+        goto cleanup;
+
+    if ((len = virRotatingFileReaderConsume(reader, got, sizeof(got))) < 0)
+        goto cleanup;
+
+    if (len != 300) {
+        fprintf(stderr, "Expected 300 bytes not %zd\n", len);
+        goto cleanup;
+    }
+
+    for (i = 0; i < len; i++) {
+        char want = i < 200 ? FILEBYTE1 : FILEBYTE0;
+        if (got[i] != want) {
+            fprintf(stderr, "Unexpected byte 0x%02x at %zd\n",
+                    (unsigned char)got[i], i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virRotatingFileWriterFree(writer);
+    virRotatingFileReaderFree(reader);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    unlink(FILENAME0GZ);
+    unlink(FILENAME1GZ);
+    unlink(tmp);
+    return ret;
+}
+
 static int testRotatingFileReaderOne(const void *data G_GNUC_UNUSED)
 {
     virRotatingFileReaderPtr file;
@@ -723,6 +957,15 @@ mymain(void)
     if (virTestRun("Rotating file write to file larger then maxlen", testRotatingFileWriterLargeFile, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Rotating file write buffered", testRotatingFileWriterBuffered, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Rotating file write compressed", testRotatingFileWriterCompress, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Rotating file compress backlog", testRotatingFileWriterCompressBacklog, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("Rotating file read one", testRotatingFileReaderOne, NULL) < 0)
         ret = -1;
 
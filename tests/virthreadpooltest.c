@@ -0,0 +1,209 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library;  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virthreadpool.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "testutils.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define TEST_WORKERS 4
+#define TEST_TIMEOUT 10000
+
+struct testBusyData {
+    virMutex lock;
+    virCond cond;
+    size_t running;
+    bool release;
+};
+
+
+static void
+testBusyJob(void *jobdata G_GNUC_UNUSED,
+            void *opaque)
+{
+    struct testBusyData *data = opaque;
+
+    virMutexLock(&data->lock);
+    data->running++;
+    virCondBroadcast(&data->cond);
+    while (!data->release) {
+        if (virCondWait(&data->cond, &data->lock) < 0)
+            break;
+    }
+    virMutexUnlock(&data->lock);
+}
+
+
+static int
+testBusyWait(struct testBusyData *data,
+             size_t running)
+{
+    unsigned long long deadline;
+    int ret = 0;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return -1;
+    deadline += TEST_TIMEOUT;
+
+    virMutexLock(&data->lock);
+    while (data->running < running) {
+        if (virCondWaitUntil(&data->cond, &data->lock, deadline) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+    virMutexUnlock(&data->lock);
+    return ret;
+}
+
+
+/*
+ * Send jobs which block until released to a pool whose only worker is
+ * already busy. Every job has to get a worker of its own: the pool must
+ * grow up to its maximum even while jobs are waiting in the queue.
+ */
+static int
+testThreadPoolExpandBusy(const void *opaque G_GNUC_UNUSED)
+{
+    struct testBusyData data = { .running = 0 };
+    virThreadPoolPtr pool = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&data.lock) < 0 ||
+        virCondInit(&data.cond) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNew(1, TEST_WORKERS, 0, testBusyJob, &data)))
+        goto cleanup;
+
+    if (virThreadPoolSendJob(pool, 0, &data) < 0 ||
+        testBusyWait(&data, 1) < 0)
+        goto cleanup;
+
+    for (i = 1; i < TEST_WORKERS; i++) {
+        if (virThreadPoolSendJob(pool, 0, &data) < 0)
+            goto cleanup;
+    }
+
+    if (testBusyWait(&data, TEST_WORKERS) < 0) {
+        VIR_TEST_VERBOSE("only %zu of %d jobs running with %zu workers",
+                         data.running, TEST_WORKERS,
+                         virThreadPoolGetCurrentWorkers(pool));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexLock(&data.lock);
+    data.release = true;
+    virCondBroadcast(&data.cond);
+    virMutexUnlock(&data.lock);
+    virThreadPoolFree(pool);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+#define TEST_ITEMS 100
+
+struct testRunData {
+    struct testBusyData busy;
+    int next;
+    int done[TEST_ITEMS];
+};
+
+
+/* Waits for all threads to start and then takes items from the queue */
+static void
+testRunFunc(void *opaque)
+{
+    struct testRunData *data = opaque;
+    int i;
+
+    virMutexLock(&data->busy.lock);
+    data->busy.running++;
+    virCondBroadcast(&data->busy.cond);
+    virMutexUnlock(&data->busy.lock);
+
+    if (testBusyWait(&data->busy, TEST_WORKERS) < 0)
+        return;
+
+    while ((i = g_atomic_int_add(&data->next, 1)) < TEST_ITEMS)
+        g_atomic_int_inc(&data->done[i]);
+}
+
+
+/*
+ * Every thread has to be running at the same time and each item has to
+ * be processed exactly once by the time virThreadPoolRunParallel
+ * returns.
+ */
+static int
+testThreadPoolRunParallel(const void *opaque G_GNUC_UNUSED)
+{
+    struct testRunData data = { .next = 0 };
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&data.busy.lock) < 0 ||
+        virCondInit(&data.busy.cond) < 0)
+        return -1;
+
+    virThreadPoolRunParallel(TEST_WORKERS, testRunFunc, "test-run", &data);
+
+    if (data.busy.running != TEST_WORKERS) {
+        VIR_TEST_VERBOSE("%zu of %d threads ran",
+                         data.busy.running, TEST_WORKERS);
+        goto cleanup;
+    }
+
+    for (i = 0; i < TEST_ITEMS; i++) {
+        if (data.done[i] != 1) {
+            VIR_TEST_VERBOSE("item %zu processed %d times", i, data.done[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCondDestroy(&data.busy.cond);
+    virMutexDestroy(&data.busy.lock);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Expand busy pool", testThreadPoolExpandBusy, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Run in parallel", testThreadPoolRunParallel, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -125,6 +125,73 @@ testTypedParamsFilter(const void *opaque G_GNUC_UNUSED)
     return rv;
 }
 
+static int
+testTypedParamsGetChanged(const void *opaque G_GNUC_UNUSED)
+{
+    int nchanged;
+    int rv = -1;
+    virTypedParameter oldparams[] = {
+        { .field = "state", .type = VIR_TYPED_PARAM_INT, .value.i = 1 },
+        { .field = "name", .type = VIR_TYPED_PARAM_STRING, .value.s = (char *) "vda" },
+        { .field = "rd.reqs", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 10 },
+        { .field = "wr.reqs", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 20 },
+    };
+    virTypedParameter params[] = {
+        { .field = "state", .type = VIR_TYPED_PARAM_INT, .value.i = 1 },
+        { .field = "name", .type = VIR_TYPED_PARAM_STRING, .value.s = (char *) "vda" },
+        { .field = "wr.reqs", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 20 },
+        { .field = "rd.reqs", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 11 },
+        { .field = "fl.reqs", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 0 },
+    };
+    virTypedParameterPtr changed = NULL;
+    bool removed;
+
+    nchanged = virTypedParamsGetChanged(oldparams, G_N_ELEMENTS(oldparams),
+                                        params, G_N_ELEMENTS(params),
+                                        &changed, &removed);
+    if (nchanged != 2 || removed)
+        goto cleanup;
+
+    if (STRNEQ(changed[0].field, "rd.reqs") ||
+        changed[0].value.ul != 11 ||
+        STRNEQ(changed[1].field, "fl.reqs"))
+        goto cleanup;
+
+    virTypedParamsFree(changed, nchanged);
+    changed = NULL;
+
+    nchanged = virTypedParamsGetChanged(params, G_N_ELEMENTS(params),
+                                        params, G_N_ELEMENTS(params),
+                                        &changed, &removed);
+    if (nchanged != 0 || changed || removed)
+        goto cleanup;
+
+    /* "fl.reqs" disappeared, nothing else changed */
+    nchanged = virTypedParamsGetChanged(params, G_N_ELEMENTS(params),
+                                        params, G_N_ELEMENTS(params) - 1,
+                                        &changed, &removed);
+    if (nchanged != 0 || !removed)
+        goto cleanup;
+
+    /* all of them disappeared */
+    nchanged = virTypedParamsGetChanged(params, G_N_ELEMENTS(params),
+                                        NULL, 0, &changed, &removed);
+    if (nchanged != 0 || !removed)
+        goto cleanup;
+
+    nchanged = virTypedParamsGetChanged(NULL, 0,
+                                        params, G_N_ELEMENTS(params),
+                                        &changed, &removed);
+    if (nchanged != G_N_ELEMENTS(params) || removed)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (nchanged > 0)
+        virTypedParamsFree(changed, nchanged);
+    return rv;
+}
+
 static int
 testTypedParamsAddStringList(const void *opaque G_GNUC_UNUSED)
 {
@@ -298,6 +365,9 @@ mymain(void)
     if (virTestRun("Get All Strings", testTypedParamsGetStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("Get Changed", testTypedParamsGetChanged, NULL) < 0)
+        rv = -1;
+
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
@@ -36,6 +36,7 @@
 #include "virthread.h"
 #include "virgettext.h"
 #include "virtime.h"
+#include "virlatency.h"
 #include "virt-admin-completer.h"
 #include "vsh-table.h"
 #include "virenum.h"
@@ -441,6 +442,188 @@ cmdSrvThreadpoolInfo(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/* ----------------------------
+ * Command srv-procedure-stats
+ * ----------------------------
+ */
+
+static const vshCmdInfo info_srv_procedure_stats[] = {
+    {.name = "help",
+     .data = N_("get server RPC procedure latency statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve queue wait and execution time statistics of the "
+                "RPC procedures handled by a server, sorted by the total "
+                "time spent executing them.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_procedure_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve procedure statistics from."),
+    },
+    {.name = NULL}
+};
+
+typedef struct _vshAdmProcedureStats vshAdmProcedureStats;
+struct _vshAdmProcedureStats {
+    unsigned int program;
+    unsigned int procedure;
+    unsigned long long waitCount;
+    unsigned long long waitSum;
+    unsigned long long waitP99;
+    unsigned long long execCount;
+    unsigned long long execSum;
+    unsigned long long execP99;
+};
+
+static int
+vshAdmProcedureStatsCompare(const void *a, const void *b)
+{
+    const vshAdmProcedureStats *sa = a;
+    const vshAdmProcedureStats *sb = b;
+
+    if (sa->execSum > sb->execSum)
+        return -1;
+    if (sa->execSum < sb->execSum)
+        return 1;
+    return 0;
+}
+
+/* Returns the upper bound in microseconds of the histogram bucket
+ * which contains the 99th percentile of @count calls. */
+static unsigned long long
+vshAdmProcedureStatsP99(virTypedParameterPtr params,
+                        int nparams,
+                        size_t idx,
+                        const char *kind,
+                        unsigned long long count)
+{
+    unsigned long long buckets[VIR_LATENCY_BUCKETS] = { 0 };
+    size_t i;
+
+    for (i = 0; i < VIR_LATENCY_BUCKETS; i++) {
+        g_autofree char *field = NULL;
+
+        /* empty buckets are omitted */
+        field = g_strdup_printf("procedure.%zu.%s.bucket.%zu", idx, kind, i);
+        ignore_value(virTypedParamsGetULLong(params, nparams, field,
+                                             &buckets[i]));
+    }
+
+    return virLatencyPercentile(buckets, VIR_LATENCY_BUCKETS, count, 99);
+}
+
+static int
+vshAdmProcedureStatsGet(virTypedParameterPtr params,
+                        int nparams,
+                        size_t idx,
+                        vshAdmProcedureStats *stats)
+{
+    g_autofree char *program = g_strdup_printf("procedure.%zu.program", idx);
+    g_autofree char *procedure = g_strdup_printf("procedure.%zu.procedure", idx);
+    g_autofree char *waitCount = g_strdup_printf("procedure.%zu.wait.count", idx);
+    g_autofree char *waitSum = g_strdup_printf("procedure.%zu.wait.sum", idx);
+    g_autofree char *execCount = g_strdup_printf("procedure.%zu.exec.count", idx);
+    g_autofree char *execSum = g_strdup_printf("procedure.%zu.exec.sum", idx);
+
+    if (virTypedParamsGetUInt(params, nparams, program, &stats->program) <= 0 ||
+        virTypedParamsGetUInt(params, nparams, procedure, &stats->procedure) <= 0 ||
+        virTypedParamsGetULLong(params, nparams, waitCount, &stats->waitCount) <= 0 ||
+        virTypedParamsGetULLong(params, nparams, waitSum, &stats->waitSum) <= 0 ||
+        virTypedParamsGetULLong(params, nparams, execCount, &stats->execCount) <= 0 ||
+        virTypedParamsGetULLong(params, nparams, execSum, &stats->execSum) <= 0)
+        return -1;
+
+    stats->waitP99 = vshAdmProcedureStatsP99(params, nparams, idx, "wait",
+                                             stats->waitCount);
+    stats->execP99 = vshAdmProcedureStatsP99(params, nparams, idx, "exec",
+                                             stats->execCount);
+    return 0;
+}
+
+static bool
+cmdSrvProcedureStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int nstats = 0;
+    g_autofree vshAdmProcedureStats *stats = NULL;
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr table = NULL;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetProcedureStats(srv, &params, &nparams, 0) < 0 ||
+        virTypedParamsGetUInt(params, nparams, "procedure.count", &nstats) <= 0) {
+        vshError(ctl, "%s",
+                 _("Unable to get server procedure statistics"));
+        goto cleanup;
+    }
+
+    stats = g_new0(vshAdmProcedureStats, nstats);
+    for (i = 0; i < nstats; i++) {
+        if (vshAdmProcedureStatsGet(params, nparams, i, &stats[i]) < 0) {
+            vshError(ctl, _("Malformed statistics of procedure %zu"), i);
+            goto cleanup;
+        }
+    }
+
+    qsort(stats, nstats, sizeof(*stats), vshAdmProcedureStatsCompare);
+
+    table = vshTableNew(_("Program"), _("Procedure"), _("Calls"),
+                        _("Wait avg (us)"), _("Wait p99 (us)"),
+                        _("Exec avg (us)"), _("Exec p99 (us)"),
+                        _("Exec total (ms)"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < nstats; i++) {
+        g_autofree char *program = g_strdup_printf("0x%x", stats[i].program);
+        g_autofree char *procedure = g_strdup_printf("%u", stats[i].procedure);
+        g_autofree char *calls = g_strdup_printf("%llu", stats[i].execCount);
+        g_autofree char *waitAvg = NULL;
+        g_autofree char *waitP99 = g_strdup_printf("%llu", stats[i].waitP99);
+        g_autofree char *execAvg = NULL;
+        g_autofree char *execP99 = g_strdup_printf("%llu", stats[i].execP99);
+        g_autofree char *execTotal = g_strdup_printf("%llu",
+                                                     stats[i].execSum / 1000);
+
+        waitAvg = g_strdup_printf("%llu", stats[i].waitCount ?
+                                  stats[i].waitSum / stats[i].waitCount : 0);
+        execAvg = g_strdup_printf("%llu", stats[i].execCount ?
+                                  stats[i].execSum / stats[i].execCount : 0);
+
+        if (vshTableRowAppend(table, program, procedure, calls,
+                              waitAvg, waitP99, execAvg, execP99,
+                              execTotal, NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    if (srv)
+        virAdmServerFree(srv);
+    return ret;
+}
+
 /* --------------------------
  * Command srv-threadpool-set
  * --------------------------
@@ -1434,6 +1617,16 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_threadpool_info,
      .flags = 0
     },
+    {.name = "srv-procedure-stats",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-procedure-stats"
+    },
+    {.name = "server-procedure-stats",
+     .handler = cmdSrvProcedureStats,
+     .opts = opts_srv_procedure_stats,
+     .info = info_srv_procedure_stats,
+     .flags = 0
+    },
     {.name = "srv-clients-list",
      .flags = VSH_CMD_FLAG_ALIAS,
      .alias = "client-list"